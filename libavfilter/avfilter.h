@@ -1135,7 +1135,9 @@ int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const
  * Dump a graph into a human-readable string representation.
  *
  * @param graph    the graph to dump
- * @param options  formatting options; currently ignored
+ * @param options  formatting options, a list of ','-separated flags or NULL;
+ *                 "pools" appends the configuration and recycling
+ *                 statistics of the frame pools shared by the graph links
  * @return  a string, or NULL in case of memory allocation failure;
  *          the string must be freed using av_free
  */
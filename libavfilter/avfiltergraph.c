@@ -92,6 +92,13 @@ AVFilterGraph *avfilter_graph_alloc(void)
         return NULL;
     }
 
+    ret->internal->frame_pools = ff_frame_pool_cache_alloc();
+    if (!ret->internal->frame_pools) {
+        av_freep(&ret->internal);
+        av_freep(&ret);
+        return NULL;
+    }
+
     ret->av_class = &filtergraph_class;
     av_opt_set_defaults(ret);
     ff_framequeue_global_init(&ret->internal->frame_queues);
@@ -117,15 +124,37 @@ void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter
     }
 }
 
+static void log_frame_pools(AVFilterGraph *graph)
+{
+    FFFramePoolStats stats;
+    enum AVPixelFormat format;
+    int i, width, height, align;
+
+    if (av_log_get_level() < AV_LOG_DEBUG)
+        return;
+
+    for (i = 0; ff_frame_pool_cache_get_stats(graph->internal->frame_pools, i,
+                                              &width, &height, &format,
+                                              &align, &stats) >= 0; i++)
+        av_log(graph, AV_LOG_DEBUG, "Frame pool %dx%d %s: %u of %u buffers "
+               "reused, %"SIZE_SPECIFIER" bytes allocated\n", width, height,
+               (const char *)av_x_if_null(av_get_pix_fmt_name(format), "?"),
+               stats.nb_requested - stats.nb_allocated, stats.nb_requested,
+               stats.allocated_size);
+}
+
 void avfilter_graph_free(AVFilterGraph **graph)
 {
     if (!*graph)
         return;
 
+    log_frame_pools(*graph);
+
     while ((*graph)->nb_filters)
         avfilter_free((*graph)->filters[0]);
 
     ff_graph_thread_free(*graph);
+    ff_frame_pool_cache_free(&(*graph)->internal->frame_pools);
 
     av_freep(&(*graph)->sink_links);
 
@@ -21,6 +21,7 @@
 
 #include <string.h>
 
+#include "config.h"
 #include "libavutil/avassert.h"
 #include "libavutil/avutil.h"
 #include "libavutil/colorspace.h"
@@ -175,6 +176,17 @@ void ff_copy_rectangle(uint8_t *dst[4], int dst_linesize[4],
     }
 }
 
+static void blend_row8_c(uint8_t *dst, const uint8_t *mask,
+                         unsigned src, unsigned alpha, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++) {
+        unsigned a = alpha * mask[x];
+        dst[x] = ((0x1010101 - a) * dst[x] + a * src) >> 24;
+    }
+}
+
 int ff_draw_init(FFDrawContext *draw, enum AVPixelFormat format, unsigned flags)
 {
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
@@ -225,6 +237,9 @@ int ff_draw_init(FFDrawContext *draw, enum AVPixelFormat format, unsigned flags)
     for (i = 0; i < (desc->nb_components - !!(desc->flags & AV_PIX_FMT_FLAG_ALPHA && !(flags & FF_DRAW_PROCESS_ALPHA))); i++)
         draw->comp_mask[desc->comp[i].plane] |=
             1 << desc->comp[i].offset;
+    draw->blend_row8 = blend_row8_c;
+    if (ARCH_X86)
+        ff_draw_init_x86(draw);
     return 0;
 }
 
@@ -676,7 +691,16 @@ void ff_blend_mask(FFDrawContext *draw, FFDrawColor *color,
                 p += dst_linesize[plane];
                 m += top * mask_linesize;
             }
-            if (depth <= 8) {
+            if (depth <= 8 && l2depth == 3 && draw->pixelstep[plane] == 1 &&
+                !draw->hsub[plane] && !draw->vsub[plane]) {
+                /* one 8-bit mask sample per destination sample */
+                for (y = 0; y < h_sub; y++) {
+                    draw->blend_row8(p, m + xm0, color->comp[plane].u8[comp],
+                                     alpha, w_sub);
+                    p += dst_linesize[plane];
+                    m += mask_linesize;
+                }
+            } else if (depth <= 8) {
                 for (y = 0; y < h_sub; y++) {
                     blend_line_hv(p, draw->pixelstep[plane],
                                   color->comp[plane].u8[comp], alpha,
@@ -57,6 +57,13 @@ typedef struct FFDrawContext {
     uint8_t vsub_max;
     int full_range;
     unsigned flags;
+
+    /**
+     * Blend w 8-bit samples of dst towards src, weighting them by the 8-bit
+     * mask multiplied by alpha, which is in the [ 0 ; 0x10203 ] range.
+     */
+    void (*blend_row8)(uint8_t *dst, const uint8_t *mask,
+                       unsigned src, unsigned alpha, int w);
 } FFDrawContext;
 
 typedef struct FFDrawColor {
@@ -83,6 +90,8 @@ typedef struct FFDrawColor {
  */
 int ff_draw_init(FFDrawContext *draw, enum AVPixelFormat format, unsigned flags);
 
+void ff_draw_init_x86(FFDrawContext *draw);
+
 /**
  * Prepare a color.
  */
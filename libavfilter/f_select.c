@@ -27,6 +27,7 @@
 #include "libavutil/eval.h"
 #include "libavutil/fifo.h"
 #include "libavutil/internal.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixelutils.h"
 #include "avfilter.h"
@@ -148,20 +149,29 @@ typedef struct SelectContext {
     av_pixelutils_sad_fn sad;       ///< Sum of the absolute difference function (scene detect only)
     double prev_mafd;               ///< previous MAFD                           (scene detect only)
     AVFrame *prev_picref;           ///< previous frame                          (scene detect only)
+    int scene_scale;                ///< downscale factor of the scene detection (scene detect only)
+    uint8_t *proxy[2];              ///< downscaled current and previous frames  (scene detect only)
+    int proxy_linesize, proxy_w, proxy_h;
+    int proxy_valid;                ///< 1 if proxy[1] holds the previous frame
+    int64_t *slice_sad;             ///< sum of absolute differences per slice    (scene detect only)
+    int nb_threads;
     double select;
     int select_out;                 ///< mark the selected output pad index
     int nb_outputs;
 } SelectContext;
 
+typedef struct ThreadData {
+    const uint8_t *p1, *p2;
+    int p1_linesize, p2_linesize;
+    int width, height;              ///< size of the compared area, in bytes and lines
+} ThreadData;
+
 #define OFFSET(x) offsetof(SelectContext, x)
-#define DEFINE_OPTIONS(filt_name, FLAGS)                            \
-static const AVOption filt_name##_options[] = {                     \
+#define COMMON_OPTIONS(FLAGS)                                           \
     { "expr", "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "e",    "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "outputs", "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
-    { "n",       "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
-    { NULL }                                                            \
-}
+    { "n",       "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS },
 
 static int request_frame(AVFilterLink *outlink);
 
@@ -242,40 +252,150 @@ static int config_input(AVFilterLink *inlink)
         inlink->type == AVMEDIA_TYPE_AUDIO ? inlink->sample_rate : NAN;
 
     if (select->do_scene_detect) {
+        AVFilterContext *ctx = inlink->dst;
+
         select->sad = av_pixelutils_get_sad_fn(3, 3, 2, select); // 8x8 both sources aligned
         if (!select->sad)
             return AVERROR(EINVAL);
+
+        select->nb_threads = ff_filter_get_nb_threads(ctx);
+        av_freep(&select->slice_sad);
+        select->slice_sad = av_calloc(select->nb_threads, sizeof(*select->slice_sad));
+        if (!select->slice_sad)
+            return AVERROR(ENOMEM);
+
+        if (select->scene_scale > 1) {
+            select->proxy_w = inlink->w / select->scene_scale;
+            select->proxy_h = inlink->h / select->scene_scale;
+            select->proxy_linesize = FFALIGN(select->proxy_w * 3, 32);
+            select->proxy_valid = 0;
+            av_freep(&select->proxy[0]);
+            av_freep(&select->proxy[1]);
+            select->proxy[0] = av_malloc_array(select->proxy_h, select->proxy_linesize);
+            select->proxy[1] = av_malloc_array(select->proxy_h, select->proxy_linesize);
+            if (!select->proxy[0] || !select->proxy[1])
+                return AVERROR(ENOMEM);
+        }
+    }
+    return 0;
+}
+
+static int sad_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SelectContext *select = ctx->priv;
+    ThreadData *td = arg;
+    const int nb_rows   = td->height / 8;
+    const int row_start = (nb_rows *  jobnr   ) / nb_jobs;
+    const int row_end   = (nb_rows * (jobnr+1)) / nb_jobs;
+    const uint8_t *p1 = td->p1 + 8 * row_start * td->p1_linesize;
+    const uint8_t *p2 = td->p2 + 8 * row_start * td->p2_linesize;
+    int64_t sad = 0;
+    int x, y;
+
+    for (y = row_start; y < row_end; y++) {
+        for (x = 0; x < td->width - 7; x += 8)
+            sad += select->sad(p1 + x, td->p1_linesize, p2 + x, td->p2_linesize);
+        p1 += 8 * td->p1_linesize;
+        p2 += 8 * td->p2_linesize;
+    }
+    emms_c();
+
+    select->slice_sad[jobnr] = sad;
+    return 0;
+}
+
+/* Box filter the packed RGB frame into proxy[0]. */
+static int downscale_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SelectContext *select = ctx->priv;
+    const AVFrame *frame = arg;
+    const int scale = select->scene_scale;
+    const int area  = scale * scale;
+    const int linesize = frame->linesize[0];
+    const int slice_start = (select->proxy_h *  jobnr   ) / nb_jobs;
+    const int slice_end   = (select->proxy_h * (jobnr+1)) / nb_jobs;
+    int x, y, c, i, j;
+
+    for (y = slice_start; y < slice_end; y++) {
+        const uint8_t *src = frame->data[0] + y * scale * linesize;
+        uint8_t *dst = select->proxy[0] + y * select->proxy_linesize;
+
+        for (x = 0; x < select->proxy_w; x++) {
+            for (c = 0; c < 3; c++) {
+                const uint8_t *p = src + x * scale * 3 + c;
+                int sum = 0;
+
+                for (i = 0; i < scale; i++)
+                    for (j = 0; j < scale; j++)
+                        sum += p[i * linesize + j * 3];
+                dst[x * 3 + c] = (sum + area / 2) / area;
+            }
+        }
     }
+
     return 0;
 }
 
+static double get_mafd(AVFilterContext *ctx, ThreadData *td)
+{
+    SelectContext *select = ctx->priv;
+    const int nb_jobs = FFMAX(1, FFMIN(td->height / 8, select->nb_threads));
+    const int64_t nb_sad = (int64_t)(td->height / 8) * (FFMAX(td->width, 0) / 8) * 8 * 8;
+    int64_t sad = 0;
+    int i;
+
+    ctx->internal->execute(ctx, sad_slice, td, NULL, nb_jobs);
+
+    for (i = 0; i < nb_jobs; i++)
+        sad += select->slice_sad[i];
+
+    return nb_sad ? (double)sad / nb_sad : 0;
+}
+
 static double get_scene_score(AVFilterContext *ctx, AVFrame *frame)
 {
     double ret = 0;
     SelectContext *select = ctx->priv;
     AVFrame *prev_picref = select->prev_picref;
+    ThreadData td;
+    double mafd, diff;
+
+    if (select->scene_scale > 1) {
+        /* the proxies are sized for the link, so only frames of that size
+         * are downscaled and compared with each other */
+        if (frame->width  != ctx->inputs[0]->w ||
+            frame->height != ctx->inputs[0]->h) {
+            select->proxy_valid = 0;
+            return 0;
+        }
+        FFSWAP(uint8_t *, select->proxy[0], select->proxy[1]);
+        ctx->internal->execute(ctx, downscale_slice, frame, NULL,
+                               FFMAX(1, FFMIN(select->proxy_h, select->nb_threads)));
+        if (select->proxy_valid) {
+            td.p1 = select->proxy[0];
+            td.p2 = select->proxy[1];
+            td.p1_linesize = td.p2_linesize = select->proxy_linesize;
+            td.width  = select->proxy_w * 3;
+            td.height = select->proxy_h;
+            mafd = get_mafd(ctx, &td);
+            diff = fabs(mafd - select->prev_mafd);
+            ret  = av_clipf(FFMIN(mafd, diff) / 100., 0, 1);
+            select->prev_mafd = mafd;
+        }
+        select->proxy_valid = 1;
+        return ret;
+    }
 
     if (prev_picref &&
         frame->height == prev_picref->height &&
         frame->width  == prev_picref->width) {
-        int x, y, nb_sad = 0;
-        int64_t sad = 0;
-        double mafd, diff;
-        uint8_t *p1 =      frame->data[0];
-        uint8_t *p2 = prev_picref->data[0];
-        const int p1_linesize =       frame->linesize[0];
-        const int p2_linesize = prev_picref->linesize[0];
-
-        for (y = 0; y < frame->height - 7; y += 8) {
-            for (x = 0; x < frame->width*3 - 7; x += 8) {
-                sad += select->sad(p1 + x, p1_linesize, p2 + x, p2_linesize);
-                nb_sad += 8 * 8;
-            }
-            p1 += 8 * p1_linesize;
-            p2 += 8 * p2_linesize;
-        }
-        emms_c();
-        mafd = nb_sad ? (double)sad / nb_sad : 0;
+        td.p1 =       frame->data[0];
+        td.p2 = prev_picref->data[0];
+        td.p1_linesize =       frame->linesize[0];
+        td.p2_linesize = prev_picref->linesize[0];
+        td.width  = frame->width * 3;
+        td.height = frame->height;
+        mafd = get_mafd(ctx, &td);
         diff = fabs(mafd - select->prev_mafd);
         ret  = av_clipf(FFMIN(mafd, diff) / 100., 0, 1);
         select->prev_mafd = mafd;
@@ -310,7 +430,7 @@ static double get_concatdec_select(AVFrame *frame, int64_t pts)
 #define D2TS(d)  (isnan(d) ? AV_NOPTS_VALUE : (int64_t)(d))
 #define TS2D(ts) ((ts) == AV_NOPTS_VALUE ? NAN : (double)(ts))
 
-static void select_frame(AVFilterContext *ctx, AVFrame *frame)
+static int select_frame(AVFilterContext *ctx, AVFrame *frame)
 {
     SelectContext *select = ctx->priv;
     AVFilterLink *inlink = ctx->inputs[0];
@@ -339,11 +459,18 @@ static void select_frame(AVFilterContext *ctx, AVFrame *frame)
         frame->top_field_first ? INTERLACE_TYPE_T : INTERLACE_TYPE_B;
         select->var_values[VAR_PICT_TYPE] = frame->pict_type;
         if (select->do_scene_detect) {
+            AVFrameSideData *sd;
             char buf[32];
             select->var_values[VAR_SCENE] = get_scene_score(ctx, frame);
             // TODO: document metadata
             snprintf(buf, sizeof(buf), "%f", select->var_values[VAR_SCENE]);
             av_dict_set(&frame->metadata, "lavfi.scene_score", buf, 0);
+
+            av_frame_remove_side_data(frame, AV_FRAME_DATA_SCENE_SCORE);
+            sd = av_frame_new_side_data(frame, AV_FRAME_DATA_SCENE_SCORE, sizeof(double));
+            if (!sd)
+                return AVERROR(ENOMEM);
+            memcpy(sd->data, &select->var_values[VAR_SCENE], sizeof(double));
         }
         break;
     }
@@ -392,14 +519,20 @@ static void select_frame(AVFilterContext *ctx, AVFrame *frame)
 
     select->var_values[VAR_PREV_PTS] = select->var_values[VAR_PTS];
     select->var_values[VAR_PREV_T]   = select->var_values[VAR_T];
+
+    return 0;
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
 {
     AVFilterContext *ctx = inlink->dst;
     SelectContext *select = ctx->priv;
+    int ret;
 
-    select_frame(ctx, frame);
+    if ((ret = select_frame(ctx, frame)) < 0) {
+        av_frame_free(&frame);
+        return ret;
+    }
     if (select->select)
         return ff_filter_frame(ctx->outputs[select->select_out], frame);
 
@@ -427,6 +560,9 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     if (select->do_scene_detect) {
         av_frame_free(&select->prev_picref);
+        av_freep(&select->proxy[0]);
+        av_freep(&select->proxy[1]);
+        av_freep(&select->slice_sad);
     }
 }
 
@@ -455,7 +591,10 @@ static int query_formats(AVFilterContext *ctx)
 
 #if CONFIG_ASELECT_FILTER
 
-DEFINE_OPTIONS(aselect, AV_OPT_FLAG_AUDIO_PARAM|AV_OPT_FLAG_FILTERING_PARAM);
+static const AVOption aselect_options[] = {
+    COMMON_OPTIONS(AV_OPT_FLAG_AUDIO_PARAM|AV_OPT_FLAG_FILTERING_PARAM)
+    { NULL }
+};
 AVFILTER_DEFINE_CLASS(aselect);
 
 static av_cold int aselect_init(AVFilterContext *ctx)
@@ -498,7 +637,11 @@ AVFilter ff_af_aselect = {
 
 #if CONFIG_SELECT_FILTER
 
-DEFINE_OPTIONS(select, AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM);
+static const AVOption select_options[] = {
+    COMMON_OPTIONS(AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM)
+    { "scene_scale", "set the downscale factor of the frames compared by the scene detection", OFFSET(scene_scale), AV_OPT_TYPE_INT, {.i64 = 1}, 1, 16, .flags=AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM },
+    { NULL }
+};
 AVFILTER_DEFINE_CLASS(select);
 
 static av_cold int select_init(AVFilterContext *ctx)
@@ -530,6 +673,6 @@ AVFilter ff_vf_select = {
     .priv_size     = sizeof(SelectContext),
     .priv_class    = &select_class,
     .inputs        = avfilter_vf_select_inputs,
-    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
 #endif /* CONFIG_SELECT_FILTER */
@@ -18,6 +18,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
+
 #include "framepool.h"
 #include "libavutil/avassert.h"
 #include "libavutil/avutil.h"
@@ -26,6 +28,7 @@
 #include "libavutil/imgutils.h"
 #include "libavutil/mem.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/thread.h"
 
 struct FFFramePool {
 
@@ -46,8 +49,39 @@ struct FFFramePool {
     int linesize[4];
     AVBufferPool *pools[4];
 
+    AVBufferRef* (*alloc)(int size);
+    atomic_uint refcount;
+
+    /* statistics */
+    atomic_uint nb_requested;
+    atomic_uint nb_allocated;
+    atomic_size_t allocated_size;
 };
 
+struct FFFramePoolCache {
+    AVMutex mutex;
+    FFFramePool **pools;
+    int nb_pools;
+};
+
+static AVBufferRef *pool_alloc(void *opaque, int size)
+{
+    FFFramePool *pool = opaque;
+    AVBufferRef *buf = pool->alloc ? pool->alloc(size) : av_buffer_alloc(size);
+
+    if (buf) {
+        atomic_fetch_add_explicit(&pool->nb_allocated, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pool->allocated_size, size, memory_order_relaxed);
+    }
+    return buf;
+}
+
+static AVBufferRef *pool_get_buffer(FFFramePool *pool, AVBufferPool *buffer_pool)
+{
+    atomic_fetch_add_explicit(&pool->nb_requested, 1, memory_order_relaxed);
+    return av_buffer_pool_get(buffer_pool);
+}
+
 FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
                                       int width,
                                       int height,
@@ -66,6 +100,8 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
         return NULL;
 
     pool->type = AVMEDIA_TYPE_VIDEO;
+    pool->alloc = alloc;
+    atomic_init(&pool->refcount, 1);
     pool->width = width;
     pool->height = height;
     pool->format = format;
@@ -96,15 +132,16 @@ FFFramePool *ff_frame_pool_video_init(AVBufferRef* (*alloc)(int size),
         if (i == 1 || i == 2)
             h = AV_CEIL_RSHIFT(h, desc->log2_chroma_h);
 
-        pool->pools[i] = av_buffer_pool_init(pool->linesize[i] * h + 16 + 16 - 1,
-                                             alloc);
+        pool->pools[i] = av_buffer_pool_init2(pool->linesize[i] * h + 16 + 16 - 1,
+                                              pool, pool_alloc, NULL);
         if (!pool->pools[i])
             goto fail;
     }
 
     if (desc->flags & AV_PIX_FMT_FLAG_PAL ||
         desc->flags & FF_PSEUDOPAL) {
-        pool->pools[1] = av_buffer_pool_init(AVPALETTE_SIZE, alloc);
+        pool->pools[1] = av_buffer_pool_init2(AVPALETTE_SIZE, pool,
+                                              pool_alloc, NULL);
         if (!pool->pools[1])
             goto fail;
     }
@@ -132,6 +169,8 @@ FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(int size),
     planar = av_sample_fmt_is_planar(format);
 
     pool->type = AVMEDIA_TYPE_AUDIO;
+    pool->alloc = alloc;
+    atomic_init(&pool->refcount, 1);
     pool->planes = planar ? channels : 1;
     pool->channels = channels;
     pool->nb_samples = nb_samples;
@@ -143,7 +182,8 @@ FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(int size),
     if (ret < 0)
         goto fail;
 
-    pool->pools[0] = av_buffer_pool_init(pool->linesize[0], NULL);
+    pool->pools[0] = av_buffer_pool_init2(pool->linesize[0], pool,
+                                          pool_alloc, NULL);
     if (!pool->pools[0])
         goto fail;
 
@@ -219,7 +259,7 @@ AVFrame *ff_frame_pool_get(FFFramePool *pool)
             if (!pool->pools[i])
                 break;
 
-            frame->buf[i] = av_buffer_pool_get(pool->pools[i]);
+            frame->buf[i] = pool_get_buffer(pool, pool->pools[i]);
             if (!frame->buf[i])
                 goto fail;
 
@@ -258,13 +298,13 @@ AVFrame *ff_frame_pool_get(FFFramePool *pool)
         }
 
         for (i = 0; i < FFMIN(pool->planes, AV_NUM_DATA_POINTERS); i++) {
-            frame->buf[i] = av_buffer_pool_get(pool->pools[0]);
+            frame->buf[i] = pool_get_buffer(pool, pool->pools[0]);
             if (!frame->buf[i])
                 goto fail;
             frame->extended_data[i] = frame->data[i] = frame->buf[i]->data;
         }
         for (i = 0; i < frame->nb_extended_buf; i++) {
-            frame->extended_buf[i] = av_buffer_pool_get(pool->pools[0]);
+            frame->extended_buf[i] = pool_get_buffer(pool, pool->pools[0]);
             if (!frame->extended_buf[i])
                 goto fail;
             frame->extended_data[i + AV_NUM_DATA_POINTERS] = frame->extended_buf[i]->data;
@@ -281,6 +321,25 @@ fail:
     return NULL;
 }
 
+int ff_frame_pool_get_stats(FFFramePool *pool, FFFramePoolStats *stats)
+{
+    if (!pool)
+        return AVERROR(EINVAL);
+
+    stats->nb_requested   = atomic_load_explicit(&pool->nb_requested, memory_order_relaxed);
+    stats->nb_allocated   = atomic_load_explicit(&pool->nb_allocated, memory_order_relaxed);
+    stats->allocated_size = atomic_load_explicit(&pool->allocated_size, memory_order_relaxed);
+    stats->nb_users       = atomic_load_explicit(&pool->refcount, memory_order_relaxed);
+
+    return 0;
+}
+
+FFFramePool *ff_frame_pool_ref(FFFramePool *pool)
+{
+    atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+    return pool;
+}
+
 void ff_frame_pool_uninit(FFFramePool **pool)
 {
     int i;
@@ -288,9 +347,123 @@ void ff_frame_pool_uninit(FFFramePool **pool)
     if (!pool || !*pool)
         return;
 
+    if (atomic_fetch_add_explicit(&(*pool)->refcount, -1, memory_order_acq_rel) > 1) {
+        *pool = NULL;
+        return;
+    }
+
     for (i = 0; i < 4; i++) {
         av_buffer_pool_uninit(&(*pool)->pools[i]);
     }
 
     av_freep(pool);
 }
+
+FFFramePoolCache *ff_frame_pool_cache_alloc(void)
+{
+    FFFramePoolCache *cache = av_mallocz(sizeof(*cache));
+
+    if (!cache)
+        return NULL;
+
+    if (ff_mutex_init(&cache->mutex, NULL)) {
+        av_freep(&cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void ff_frame_pool_cache_free(FFFramePoolCache **cache)
+{
+    int i;
+
+    if (!cache || !*cache)
+        return;
+
+    for (i = 0; i < (*cache)->nb_pools; i++)
+        ff_frame_pool_uninit(&(*cache)->pools[i]);
+    av_freep(&(*cache)->pools);
+    ff_mutex_destroy(&(*cache)->mutex);
+    av_freep(cache);
+}
+
+/* Drop the pools no user references anymore; must be called with the cache
+ * mutex held. */
+static void cache_prune(FFFramePoolCache *cache)
+{
+    int i;
+
+    for (i = 0; i < cache->nb_pools; i++) {
+        FFFramePool *pool = cache->pools[i];
+
+        if (atomic_load_explicit(&pool->refcount, memory_order_acquire) > 1)
+            continue;
+
+        ff_frame_pool_uninit(&cache->pools[i]);
+        cache->pools[i--] = cache->pools[--cache->nb_pools];
+    }
+}
+
+FFFramePool *ff_frame_pool_cache_get_video(FFFramePoolCache *cache,
+                                           AVBufferRef* (*alloc)(int size),
+                                           int width,
+                                           int height,
+                                           enum AVPixelFormat format,
+                                           int align)
+{
+    FFFramePool *pool = NULL, **pools;
+    int i;
+
+    ff_mutex_lock(&cache->mutex);
+
+    for (i = 0; i < cache->nb_pools; i++) {
+        FFFramePool *p = cache->pools[i];
+
+        if (p->type == AVMEDIA_TYPE_VIDEO && p->alloc == alloc &&
+            p->width == width && p->height == height &&
+            p->format == format && p->align == align) {
+            pool = ff_frame_pool_ref(p);
+            goto end;
+        }
+    }
+
+    cache_prune(cache);
+
+    pool = ff_frame_pool_video_init(alloc, width, height, format, align);
+    if (!pool)
+        goto end;
+
+    /* on failure the pool is simply not shared */
+    pools = av_realloc_array(cache->pools, cache->nb_pools + 1, sizeof(*pools));
+    if (!pools)
+        goto end;
+    cache->pools = pools;
+    cache->pools[cache->nb_pools++] = ff_frame_pool_ref(pool);
+
+end:
+    ff_mutex_unlock(&cache->mutex);
+    return pool;
+}
+
+int ff_frame_pool_cache_get_stats(FFFramePoolCache *cache, int idx,
+                                  int *width, int *height,
+                                  enum AVPixelFormat *format, int *align,
+                                  FFFramePoolStats *stats)
+{
+    int ret = AVERROR(ENOENT);
+
+    ff_mutex_lock(&cache->mutex);
+    if (idx >= 0 && idx < cache->nb_pools) {
+        FFFramePool *pool = cache->pools[idx];
+
+        ff_frame_pool_get_video_config(pool, width, height, format, align);
+        ff_frame_pool_get_stats(pool, stats);
+        /* do not count the reference held by the cache itself */
+        stats->nb_users--;
+        ret = 0;
+    }
+    ff_mutex_unlock(&cache->mutex);
+
+    return ret;
+}
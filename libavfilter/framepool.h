@@ -68,8 +68,16 @@ FFFramePool *ff_frame_pool_audio_init(AVBufferRef* (*alloc)(int size),
                                       int align);
 
 /**
- * Deallocate the frame pool. It is safe to call this function while
- * some of the allocated frame are still in use.
+ * Create a new reference to a frame pool.
+ *
+ * @return pool
+ */
+FFFramePool *ff_frame_pool_ref(FFFramePool *pool);
+
+/**
+ * Release a reference to the frame pool and deallocate it when it was the
+ * last one. It is safe to call this function while some of the allocated
+ * frame are still in use.
  *
  * @param pool pointer to the frame pool to be freed. It will be set to NULL.
  */
@@ -114,5 +122,61 @@ int ff_frame_pool_get_audio_config(FFFramePool *pool,
  */
 AVFrame *ff_frame_pool_get(FFFramePool *pool);
 
+typedef struct FFFramePoolStats {
+    unsigned nb_requested;  ///< number of buffers requested from the pool
+    unsigned nb_allocated;  ///< number of buffers the pool had to allocate
+    size_t allocated_size;  ///< total size in bytes of the allocated buffers
+    int nb_users;           ///< number of references to the pool
+} FFFramePoolStats;
+
+/**
+ * Get the frame pool recycling statistics. Buffers requested but not
+ * allocated were reused from previously released frames.
+ *
+ * @return 0 on success, a negative AVERROR otherwise.
+ */
+int ff_frame_pool_get_stats(FFFramePool *pool, FFFramePoolStats *stats);
+
+/**
+ * Cache of video frame pools, shared by all the links of a filter graph
+ * that need frames of the same configuration.
+ */
+typedef struct FFFramePoolCache FFFramePoolCache;
+
+FFFramePoolCache *ff_frame_pool_cache_alloc(void);
+
+/**
+ * Release the references the cache holds on its pools and free it. Pools
+ * still referenced elsewhere stay valid.
+ */
+void ff_frame_pool_cache_free(FFFramePoolCache **cache);
+
+/**
+ * Get a reference to a video frame pool with the given configuration from
+ * the cache, creating it when no such pool exists. Pools not referenced
+ * outside of the cache anymore are released when a new pool is created.
+ * This function may be called simultaneously from multiple threads.
+ *
+ * The parameters are the same as for ff_frame_pool_video_init().
+ * @return a new reference to the pool, to be released with
+ *         ff_frame_pool_uninit(), NULL on error.
+ */
+FFFramePool *ff_frame_pool_cache_get_video(FFFramePoolCache *cache,
+                                           AVBufferRef* (*alloc)(int size),
+                                           int width,
+                                           int height,
+                                           enum AVPixelFormat format,
+                                           int align);
+
+/**
+ * Get the configuration and statistics of the idx-th pool of the cache.
+ * nb_users does not account for the reference held by the cache.
+ *
+ * @return 0 on success, AVERROR(ENOENT) if idx is out of range.
+ */
+int ff_frame_pool_cache_get_stats(FFFramePoolCache *cache, int idx,
+                                  int *width, int *height,
+                                  enum AVPixelFormat *format, int *align,
+                                  FFFramePoolStats *stats);
 
 #endif /* AVFILTER_FRAMEPOOL_H */
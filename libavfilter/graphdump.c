@@ -21,6 +21,7 @@
 
 #include <string.h>
 
+#include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/bprint.h"
 #include "libavutil/pixdesc.h"
@@ -151,15 +152,38 @@ static void avfilter_graph_dump_to_buf(AVBPrint *buf, AVFilterGraph *graph)
     }
 }
 
+static void dump_frame_pools(AVBPrint *buf, AVFilterGraph *graph)
+{
+    FFFramePoolStats stats;
+    enum AVPixelFormat format;
+    int i, width, height, align;
+
+    av_bprintf(buf, "Frame pools:\n");
+    for (i = 0; ff_frame_pool_cache_get_stats(graph->internal->frame_pools, i,
+                                              &width, &height, &format,
+                                              &align, &stats) >= 0; i++) {
+        av_bprintf(buf, "  [%dx%d %s align:%d] links:%d buffers:%u/%u "
+                   "reused:%u size:%"SIZE_SPECIFIER"\n", width, height,
+                   (const char *)av_x_if_null(av_get_pix_fmt_name(format), "?"), align,
+                   stats.nb_users, stats.nb_allocated, stats.nb_requested,
+                   stats.nb_requested - stats.nb_allocated,
+                   stats.allocated_size);
+    }
+}
+
 char *avfilter_graph_dump(AVFilterGraph *graph, const char *options)
 {
     AVBPrint buf;
     char *dump;
+    int pools = options && av_match_name("pools", options);
 
     av_bprint_init(&buf, 0, AV_BPRINT_SIZE_COUNT_ONLY);
     avfilter_graph_dump_to_buf(&buf, graph);
-    av_bprint_init(&buf, buf.len + 1, buf.len + 1);
+    av_bprint_init(&buf, buf.len + 1,
+                   pools ? AV_BPRINT_SIZE_UNLIMITED : buf.len + 1);
     avfilter_graph_dump_to_buf(&buf, graph);
+    if (pools)
+        dump_frame_pools(&buf, graph);
     av_bprint_finalize(&buf, &dump);
     return dump;
 }
@@ -0,0 +1,76 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "libavutil/bswap.h"
+#include "lutdsp.h"
+
+static void lut_row8_c(uint8_t *dst, const uint8_t *src,
+                       const uint16_t *lut, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++)
+        dst[x] = lut[src[x]];
+}
+
+static void lut_row16_c(uint16_t *dst, const uint16_t *src,
+                        const uint16_t *lut, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++) {
+#if HAVE_BIGENDIAN
+        dst[x] = av_bswap16(lut[av_bswap16(src[x])]);
+#else
+        dst[x] = lut[src[x]];
+#endif
+    }
+}
+
+static void lut2_row8_c(uint8_t *dst, const uint8_t *srcx, const uint8_t *srcy,
+                        const uint16_t *lut, int depthx, int w)
+{
+    const int mask = (1 << depthx) - 1;
+    int x;
+
+    for (x = 0; x < w; x++)
+        dst[x] = lut[((srcy[x] & mask) << depthx) | (srcx[x] & mask)];
+}
+
+static void lut2_row16_c(uint16_t *dst, const uint16_t *srcx, const uint16_t *srcy,
+                         const uint16_t *lut, int depthx, int w)
+{
+    const int mask = (1 << depthx) - 1;
+    int x;
+
+    for (x = 0; x < w; x++)
+        dst[x] = lut[((srcy[x] & mask) << depthx) | (srcx[x] & mask)];
+}
+
+av_cold void ff_lutdsp_init(LutDSPContext *dsp)
+{
+    dsp->lut_row8   = lut_row8_c;
+    dsp->lut_row16  = lut_row16_c;
+    dsp->lut2_row8  = lut2_row8_c;
+    dsp->lut2_row16 = lut2_row16_c;
+
+    if (ARCH_X86)
+        ff_lutdsp_init_x86(dsp);
+}
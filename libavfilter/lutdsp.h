@@ -0,0 +1,47 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_LUTDSP_H
+#define AVFILTER_LUTDSP_H
+
+#include <stdint.h>
+
+typedef struct LutDSPContext {
+    /* Look up every sample of a row in a table of 16-bit entries, the 8-bit
+     * version stores the low byte of each entry. 16-bit samples are little
+     * endian, as used by the lut filters. */
+    void (*lut_row8)(uint8_t *dst, const uint8_t *src,
+                     const uint16_t *lut, int w);
+    void (*lut_row16)(uint16_t *dst, const uint16_t *src,
+                      const uint16_t *lut, int w);
+
+    /* Same for two native endian inputs, indexing the table of
+     * 1 << (2 * depthx) entries with (srcy << depthx) | srcx, both samples
+     * being masked to depthx bits. */
+    void (*lut2_row8)(uint8_t *dst, const uint8_t *srcx, const uint8_t *srcy,
+                      const uint16_t *lut, int depthx, int w);
+    void (*lut2_row16)(uint16_t *dst, const uint16_t *srcx, const uint16_t *srcy,
+                       const uint16_t *lut, int depthx, int w);
+} LutDSPContext;
+
+void ff_lutdsp_init(LutDSPContext *dsp);
+
+/* internal */
+void ff_lutdsp_init_x86(LutDSPContext *dsp);
+
+#endif /* AVFILTER_LUTDSP_H */
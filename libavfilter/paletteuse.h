@@ -0,0 +1,38 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_PALETTEUSE_H
+#define AVFILTER_PALETTEUSE_H
+
+#include <stdint.h>
+
+typedef struct PaletteUseDSPContext {
+    /**
+     * Find the nearest of nb_entries (> 0) colors for the 256 values x of the
+     * last component, the distance to entry i being
+     * base[i] + (x - comp[i])^2; dst[x] is set to idx[i] of the first entry
+     * with the smallest distance.
+     */
+    void (*nearest_row)(uint8_t *dst, const int *base, const int *comp,
+                        const int *idx, int nb_entries);
+} PaletteUseDSPContext;
+
+void ff_paletteuse_init(PaletteUseDSPContext *dsp);
+void ff_paletteuse_init_x86(PaletteUseDSPContext *dsp);
+
+#endif /* AVFILTER_PALETTEUSE_H */
@@ -0,0 +1,53 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_REMAP_H
+#define AVFILTER_REMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*remap_line_fn)(uint8_t *dst, const uint8_t *src, ptrdiff_t slinesize,
+                              const uint16_t *xmap, const uint16_t *ymap,
+                              int w, int sw, int sh);
+
+typedef struct RemapDSPContext {
+    /* Set each of the w samples of dst to the source sample at
+     * (xmap[x], ymap[x]), or to 0 if that lies outside of the sw x sh
+     * source. line8 and line16 work on 8-bit and 16-bit samples, line32 on
+     * packed pixels of 4 bytes. */
+    remap_line_fn remap_line8;
+    remap_line_fn remap_line16;
+    remap_line_fn remap_line32;
+} RemapDSPContext;
+
+void ff_remap_init(RemapDSPContext *dsp);
+void ff_remap_init_x86(RemapDSPContext *dsp);
+
+/* C versions, used for the left-over samples of the SIMD versions */
+void ff_remap_line8_c(uint8_t *dst, const uint8_t *src, ptrdiff_t slinesize,
+                      const uint16_t *xmap, const uint16_t *ymap,
+                      int w, int sw, int sh);
+void ff_remap_line16_c(uint8_t *dst, const uint8_t *src, ptrdiff_t slinesize,
+                       const uint16_t *xmap, const uint16_t *ymap,
+                       int w, int sw, int sh);
+void ff_remap_line32_c(uint8_t *dst, const uint8_t *src, ptrdiff_t slinesize,
+                       const uint16_t *xmap, const uint16_t *ymap,
+                       int w, int sw, int sh);
+
+#endif /* AVFILTER_REMAP_H */
@@ -0,0 +1,59 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "libavutil/attributes.h"
+#include "statsdsp.h"
+
+static int count_le_c(const uint8_t *src, int w, int threshold)
+{
+    int x, count = 0;
+
+    for (x = 0; x < w; x++)
+        count += src[x] <= threshold;
+
+    return count;
+}
+
+static int row_sum_c(const uint8_t *src, int w)
+{
+    int x, sum = 0;
+
+    for (x = 0; x < w; x++)
+        sum += src[x];
+
+    return sum;
+}
+
+static void col_sum_c(uint32_t *sum, const uint8_t *src, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++)
+        sum[x] += src[x];
+}
+
+av_cold void ff_statsdsp_init(StatsDSPContext *dsp)
+{
+    dsp->count_le = count_le_c;
+    dsp->row_sum  = row_sum_c;
+    dsp->col_sum  = col_sum_c;
+
+    if (ARCH_X86)
+        ff_statsdsp_init_x86(dsp);
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_STATSDSP_H
+#define AVFILTER_STATSDSP_H
+
+#include <stdint.h>
+
+typedef struct StatsDSPContext {
+    /* Return the number of the w 8-bit samples of src which are lower than
+     * or equal to threshold, 0 <= threshold <= 255. */
+    int (*count_le)(const uint8_t *src, int w, int threshold);
+
+    /* Return the sum of the w 8-bit samples of src. */
+    int (*row_sum)(const uint8_t *src, int w);
+
+    /* Add the w 8-bit samples of src to the column sums in sum. */
+    void (*col_sum)(uint32_t *sum, const uint8_t *src, int w);
+} StatsDSPContext;
+
+void ff_statsdsp_init(StatsDSPContext *dsp);
+
+/* internal */
+void ff_statsdsp_init_x86(StatsDSPContext *dsp);
+
+#endif /* AVFILTER_STATSDSP_H */
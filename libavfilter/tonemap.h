@@ -0,0 +1,56 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_TONEMAP_H
+#define AVFILTER_TONEMAP_H
+
+/* number of curve intervals in the lut, which holds TONEMAP_LUT_SIZE + 2
+ * entries: the gain curve(sig) / sig sampled at
+ * sig = peak * (i / TONEMAP_LUT_SIZE)^2, dense near black, plus one guard
+ * entry */
+#define TONEMAP_LUT_SIZE 1024
+
+enum TonemapParam {
+    TONEMAP_PARAM_CR,
+    TONEMAP_PARAM_CG,
+    TONEMAP_PARAM_CB,
+    TONEMAP_PARAM_DESAT,
+    TONEMAP_PARAM_LUT_SCALE,   ///< TONEMAP_LUT_SIZE^2 / peak
+    TONEMAP_PARAM_PEAK,
+    TONEMAP_PARAM_NB,
+};
+
+typedef void (*tonemap_row_fn)(float *dst_r, float *dst_g, float *dst_b,
+                               const float *src_r, const float *src_g,
+                               const float *src_b, const float *lut,
+                               const float *params, int width);
+
+typedef struct TonemapDSPContext {
+    /* Tone map one row of linear light float pixels, evaluating the gain
+     * by linear interpolation in lut at sqrt(sig * lut_scale); signal values
+     * above the peak are mapped to the curve value at the peak.
+     * map_row_desat additionally desaturates the pixels towards their luma
+     * first. */
+    tonemap_row_fn map_row;
+    tonemap_row_fn map_row_desat;
+} TonemapDSPContext;
+
+void ff_tonemap_dsp_init(TonemapDSPContext *dsp);
+void ff_tonemap_dsp_init_x86(TonemapDSPContext *dsp);
+
+#endif /* AVFILTER_TONEMAP_H */
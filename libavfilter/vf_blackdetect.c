@@ -25,10 +25,12 @@
  */
 
 #include <float.h>
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/timestamp.h"
 #include "avfilter.h"
 #include "internal.h"
+#include "statsdsp.h"
 
 typedef struct BlackDetectContext {
     const AVClass *class;
@@ -44,6 +46,10 @@ typedef struct BlackDetectContext {
     unsigned int pixel_black_th_i;
 
     unsigned int nb_black_pixels;   ///< number of black pixels counted so far
+    unsigned int *counter;          ///< number of black pixels of each slice
+    int nb_threads;
+
+    StatsDSPContext dsp;
 } BlackDetectContext;
 
 #define OFFSET(x) offsetof(BlackDetectContext, x)
@@ -94,6 +100,14 @@ static int config_input(AVFilterLink *inlink)
     blackdetect->black_min_duration =
         blackdetect->black_min_duration_time / av_q2d(inlink->time_base);
 
+    blackdetect->nb_threads = ff_filter_get_nb_threads(ctx);
+    av_freep(&blackdetect->counter);
+    blackdetect->counter = av_calloc(blackdetect->nb_threads, sizeof(*blackdetect->counter));
+    if (!blackdetect->counter)
+        return AVERROR(ENOMEM);
+
+    ff_statsdsp_init(&blackdetect->dsp);
+
     blackdetect->pixel_black_th_i = ff_fmt_is_in(inlink->format, yuvj_formats) ?
         // luminance_minimum_value + pixel_black_th * luminance_range_size
              blackdetect->pixel_black_th *  255 :
@@ -136,20 +150,39 @@ static int request_frame(AVFilterLink *outlink)
     return ret;
 }
 
+static int black_counter(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    BlackDetectContext *blackdetect = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    AVFrame *picref = arg;
+    const int slice_start = (inlink->h *  jobnr   ) / nb_jobs;
+    const int slice_end   = (inlink->h * (jobnr+1)) / nb_jobs;
+    const uint8_t *p = picref->data[0] + slice_start * picref->linesize[0];
+    unsigned int counter = 0;
+    int i;
+
+    for (i = slice_start; i < slice_end; i++) {
+        counter += blackdetect->dsp.count_le(p, inlink->w, blackdetect->pixel_black_th_i);
+        p += picref->linesize[0];
+    }
+
+    blackdetect->counter[jobnr] = counter;
+    return 0;
+}
+
 // TODO: document metadata
 static int filter_frame(AVFilterLink *inlink, AVFrame *picref)
 {
     AVFilterContext *ctx = inlink->dst;
     BlackDetectContext *blackdetect = ctx->priv;
     double picture_black_ratio = 0;
-    const uint8_t *p = picref->data[0];
-    int x, i;
+    const int nb_jobs = FFMAX(1, FFMIN(inlink->h, blackdetect->nb_threads));
+    int i;
 
-    for (i = 0; i < inlink->h; i++) {
-        for (x = 0; x < inlink->w; x++)
-            blackdetect->nb_black_pixels += p[x] <= blackdetect->pixel_black_th_i;
-        p += picref->linesize[0];
-    }
+    ctx->internal->execute(ctx, black_counter, picref, NULL, nb_jobs);
+
+    for (i = 0; i < nb_jobs; i++)
+        blackdetect->nb_black_pixels += blackdetect->counter[i];
 
     picture_black_ratio = (double)blackdetect->nb_black_pixels / (inlink->w * inlink->h);
 
@@ -181,6 +214,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *picref)
     return ff_filter_frame(inlink->dst->outputs[0], picref);
 }
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    BlackDetectContext *blackdetect = ctx->priv;
+
+    av_freep(&blackdetect->counter);
+}
+
 static const AVFilterPad blackdetect_inputs[] = {
     {
         .name          = "default",
@@ -205,7 +245,9 @@ AVFilter ff_vf_blackdetect = {
     .description   = NULL_IF_CONFIG_SMALL("Detect video intervals that are (almost) black."),
     .priv_size     = sizeof(BlackDetectContext),
     .query_formats = query_formats,
+    .uninit        = uninit,
     .inputs        = blackdetect_inputs,
     .outputs       = blackdetect_outputs,
     .priv_class    = &blackdetect_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
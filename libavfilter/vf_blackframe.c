@@ -31,10 +31,12 @@
 #include <inttypes.h>
 
 #include "libavutil/internal.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
+#include "statsdsp.h"
 #include "video.h"
 
 typedef struct BlackFrameContext {
@@ -44,6 +46,10 @@ typedef struct BlackFrameContext {
     unsigned int frame;   ///< frame number
     unsigned int nblack;  ///< number of black pixels counted so far
     unsigned int last_keyframe; ///< frame number of the last received key-frame
+    unsigned int *counter;      ///< number of black pixels of each slice
+    int nb_threads;
+
+    StatsDSPContext dsp;
 } BlackFrameContext;
 
 static int query_formats(AVFilterContext *ctx)
@@ -60,6 +66,45 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_formats(ctx, fmts_list);
 }
 
+static int config_input(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    BlackFrameContext *s = ctx->priv;
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    av_freep(&s->counter);
+    s->counter = av_calloc(s->nb_threads, sizeof(*s->counter));
+    if (!s->counter)
+        return AVERROR(ENOMEM);
+
+    ff_statsdsp_init(&s->dsp);
+
+    return 0;
+}
+
+static int black_counter(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    BlackFrameContext *s = ctx->priv;
+    AVFrame *frame = arg;
+    const int w = ctx->inputs[0]->w;
+    const int slice_start = (frame->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (frame->height * (jobnr+1)) / nb_jobs;
+    const uint8_t *p = frame->data[0] + slice_start * frame->linesize[0];
+    unsigned int counter = 0;
+    int i;
+
+    /* p[x] < bthresh is counted as p[x] <= bthresh - 1 */
+    if (s->bthresh > 0) {
+        for (i = slice_start; i < slice_end; i++) {
+            counter += s->dsp.count_le(p, w, s->bthresh - 1);
+            p += frame->linesize[0];
+        }
+    }
+
+    s->counter[jobnr] = counter;
+    return 0;
+}
+
 #define SET_META(key, format, value) \
     snprintf(buf, sizeof(buf), format, value);  \
     av_dict_set(metadata, key, buf, 0)
@@ -68,17 +113,16 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
 {
     AVFilterContext *ctx = inlink->dst;
     BlackFrameContext *s = ctx->priv;
-    int x, i;
+    const int nb_jobs = FFMAX(1, FFMIN(frame->height, s->nb_threads));
+    int i;
     int pblack = 0;
-    uint8_t *p = frame->data[0];
     AVDictionary **metadata;
     char buf[32];
 
-    for (i = 0; i < frame->height; i++) {
-        for (x = 0; x < inlink->w; x++)
-            s->nblack += p[x] < s->bthresh;
-        p += frame->linesize[0];
-    }
+    ctx->internal->execute(ctx, black_counter, frame, NULL, nb_jobs);
+
+    for (i = 0; i < nb_jobs; i++)
+        s->nblack += s->counter[i];
 
     if (frame->key_frame)
         s->last_keyframe = s->frame;
@@ -115,10 +159,18 @@ static const AVOption blackframe_options[] = {
 
 AVFILTER_DEFINE_CLASS(blackframe);
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    BlackFrameContext *s = ctx->priv;
+
+    av_freep(&s->counter);
+}
+
 static const AVFilterPad avfilter_vf_blackframe_inputs[] = {
     {
         .name         = "default",
         .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_input,
         .filter_frame = filter_frame,
     },
     { NULL }
@@ -138,6 +190,8 @@ AVFilter ff_vf_blackframe = {
     .priv_size     = sizeof(BlackFrameContext),
     .priv_class    = &blackframe_class,
     .query_formats = query_formats,
+    .uninit        = uninit,
     .inputs        = avfilter_vf_blackframe_inputs,
     .outputs       = avfilter_vf_blackframe_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
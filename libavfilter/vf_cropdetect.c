@@ -25,11 +25,13 @@
 
 #include "libavutil/imgutils.h"
 #include "libavutil/internal.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
+#include "statsdsp.h"
 #include "video.h"
 
 typedef struct CropDetectContext {
@@ -41,8 +43,18 @@ typedef struct CropDetectContext {
     int frame_nb;
     int max_pixsteps[4];
     int max_outliers;
+
+    uint32_t *col_sums;   ///< per slice column sums, the first row holds the totals
+    int nb_threads;
+    StatsDSPContext dsp;
 } CropDetectContext;
 
+typedef struct ThreadData {
+    const AVFrame *frame;
+    int start[2], end[2]; ///< column spans to sum
+    int nb_spans;
+} ThreadData;
+
 static int query_formats(AVFilterContext *ctx)
 {
     static const enum AVPixelFormat pix_fmts[] = {
@@ -68,14 +80,19 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_formats(ctx, fmts_list);
 }
 
-static int checkline(void *ctx, const unsigned char *src, int stride, int len, int bpp)
+static int checkline(AVFilterContext *ctx, const unsigned char *src, int stride, int len, int bpp)
 {
+    CropDetectContext *s = ctx->priv;
     int total = 0;
     int div = len;
     const uint16_t *src16 = (const uint16_t *)src;
 
     switch (bpp) {
     case 1:
+        if (stride == 1) {
+            total = s->dsp.row_sum(src, len);
+            break;
+        }
         while (len >= 8) {
             total += src[       0] + src[  stride] + src[2*stride] + src[3*stride]
                   +  src[4*stride] + src[5*stride] + src[6*stride] + src[7*stride];
@@ -123,6 +140,96 @@ static int checkline(void *ctx, const unsigned char *src, int stride, int len, i
     return total;
 }
 
+/* same as checkline() for column x, from the sums of col_sums_slice() */
+static int checkcol(AVFilterContext *ctx, int x, int len, int bpp)
+{
+    CropDetectContext *s = ctx->priv;
+    int total = s->col_sums[x];
+
+    total /= bpp >= 3 ? len * 3 : len;
+
+    av_log(ctx, AV_LOG_DEBUG, "total:%d\n", total);
+    return total;
+}
+
+static int col_sums_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    CropDetectContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *frame = td->frame;
+    const int bpp = s->max_pixsteps[0];
+    const int slice_start = (frame->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (frame->height * (jobnr+1)) / nb_jobs;
+    uint32_t *sums = s->col_sums + jobnr * frame->width;
+    int i, x, y;
+
+    for (i = 0; i < td->nb_spans; i++)
+        memset(sums + td->start[i], 0, (td->end[i] - td->start[i]) * sizeof(*sums));
+
+    for (y = slice_start; y < slice_end; y++) {
+        const uint8_t *src = frame->data[0] + y * frame->linesize[0];
+        const uint16_t *src16 = (const uint16_t *)src;
+
+        for (i = 0; i < td->nb_spans; i++) {
+            const int start = td->start[i], end = td->end[i];
+
+            switch (bpp) {
+            case 1:
+                s->dsp.col_sum(sums + start, src + start, end - start);
+                break;
+            case 2:
+                for (x = start; x < end; x++)
+                    sums[x] += src16[x];
+                break;
+            case 3:
+            case 4:
+                for (x = start; x < end; x++)
+                    sums[x] += src[bpp*x] + src[bpp*x + 1] + src[bpp*x + 2];
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Sum the columns which the search of the left and right edges may check,
+ * the ones left of x1 and right of x2. */
+static void col_sums(AVFilterContext *ctx, const AVFrame *frame)
+{
+    CropDetectContext *s = ctx->priv;
+    ThreadData td = { .frame = frame };
+    int nb_jobs = FFMAX(1, FFMIN(frame->height, s->nb_threads));
+    int i, j, x;
+
+    if (s->x2 + 1 <= s->x1) {
+        td.start[0] = 0;
+        td.end[0]   = frame->width;
+        td.nb_spans = 1;
+    } else {
+        if (s->x1 > 0) {
+            td.start[td.nb_spans] = 0;
+            td.end[td.nb_spans++] = s->x1;
+        }
+        if (s->x2 + 1 < frame->width) {
+            td.start[td.nb_spans] = s->x2 + 1;
+            td.end[td.nb_spans++] = frame->width;
+        }
+    }
+    if (!td.nb_spans)
+        return;
+
+    ctx->internal->execute(ctx, col_sums_slice, &td, NULL, nb_jobs);
+
+    for (j = 1; j < nb_jobs; j++) {
+        const uint32_t *sums = s->col_sums + j * frame->width;
+
+        for (i = 0; i < td.nb_spans; i++)
+            for (x = td.start[i]; x < td.end[i]; x++)
+                s->col_sums[x] += sums[x];
+    }
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     CropDetectContext *s = ctx->priv;
@@ -143,6 +250,14 @@ static int config_input(AVFilterLink *inlink)
 
     av_image_fill_max_pixsteps(s->max_pixsteps, NULL, desc);
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    av_freep(&s->col_sums);
+    s->col_sums = av_malloc_array(inlink->w, s->nb_threads * sizeof(*s->col_sums));
+    if (!s->col_sums)
+        return AVERROR(ENOMEM);
+
+    ff_statsdsp_init(&s->dsp);
+
     if (s->limit < 1.0)
         s->limit *= (1 << desc->comp[0].depth) - 1;
 
@@ -180,10 +295,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
             s->frame_nb = 1;
         }
 
-#define FIND(DST, FROM, NOEND, INC, STEP0, STEP1, LEN) \
+#define FIND(DST, FROM, NOEND, INC, CHECK) \
         outliers = 0;\
         for (last_y = y = FROM; NOEND; y = y INC) {\
-            if (checkline(ctx, frame->data[0] + STEP0 * y, STEP1, LEN, bpp) > limit) {\
+            if (CHECK > limit) {\
                 if (++outliers > s->max_outliers) { \
                     DST = last_y;\
                     break;\
@@ -192,10 +307,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
                 last_y = y INC;\
         }
 
-        FIND(s->y1,                 0,               y < s->y1, +1, frame->linesize[0], bpp, frame->width);
-        FIND(s->y2, frame->height - 1, y > FFMAX(s->y2, s->y1), -1, frame->linesize[0], bpp, frame->width);
-        FIND(s->x1,                 0,               y < s->x1, +1, bpp, frame->linesize[0], frame->height);
-        FIND(s->x2,  frame->width - 1, y > FFMAX(s->x2, s->x1), -1, bpp, frame->linesize[0], frame->height);
+#define CHECK_ROW checkline(ctx, frame->data[0] + frame->linesize[0] * y, bpp, frame->width, bpp)
+#define CHECK_COL checkcol(ctx, y, frame->height, bpp)
+
+        col_sums(ctx, frame);
+
+        FIND(s->y1,                 0,               y < s->y1, +1, CHECK_ROW);
+        FIND(s->y2, frame->height - 1, y > FFMAX(s->y2, s->y1), -1, CHECK_ROW);
+        FIND(s->x1,                 0,               y < s->x1, +1, CHECK_COL);
+        FIND(s->x2,  frame->width - 1, y > FFMAX(s->x2, s->x1), -1, CHECK_COL);
 
 
         // round x and y (up), important for yuv colorspaces
@@ -254,6 +374,13 @@ static const AVOption cropdetect_options[] = {
 
 AVFILTER_DEFINE_CLASS(cropdetect);
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    CropDetectContext *s = ctx->priv;
+
+    av_freep(&s->col_sums);
+}
+
 static const AVFilterPad avfilter_vf_cropdetect_inputs[] = {
     {
         .name         = "default",
@@ -278,8 +405,9 @@ AVFilter ff_vf_cropdetect = {
     .priv_size     = sizeof(CropDetectContext),
     .priv_class    = &cropdetect_class,
     .init          = init,
+    .uninit        = uninit,
     .query_formats = query_formats,
     .inputs        = avfilter_vf_cropdetect_inputs,
     .outputs       = avfilter_vf_cropdetect_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -128,6 +128,28 @@ enum var_name {
     VAR_VARS_NB
 };
 
+/**
+ * Coverage of the text glyphs, kept between frames and rendered again only
+ * when the text changes.
+ */
+typedef struct TextBlock {
+    uint8_t *mask[2];               ///< 8-bit coverage of the glyphs and of their border
+    int linesize;
+    int x, y, w, h;                 ///< area of the masks relative to the text position
+    struct Glyph **glyphs;          ///< glyph drawn for each character, NULL if none
+    FT_Vector *positions;           ///< positions the glyphs were rendered at
+    int nb_glyphs;
+    AVBPrint text;                  ///< text the layout was computed for
+    /* settings the glyphs and the layout were computed with */
+    unsigned int fontsize;
+    FT_Face face;
+    int ft_load_flags;
+    int borderw;
+    int line_spacing;
+    int use_kerning;
+    int tabsize;
+} TextBlock;
+
 enum expansion_mode {
     EXP_NONE,
     EXP_NORMAL,
@@ -197,6 +219,7 @@ typedef struct DrawTextContext {
     int text_shaping;               ///< 1 to shape the text before drawing it
 #endif
     AVDictionary *metadata;
+    TextBlock block;                ///< rendered text
 } DrawTextContext;
 
 #define OFFSET(x) offsetof(DrawTextContext, x)
@@ -774,6 +797,7 @@ static av_cold int init(AVFilterContext *ctx)
 
     av_bprint_init(&s->expanded_text, 0, AV_BPRINT_SIZE_UNLIMITED);
     av_bprint_init(&s->expanded_fontcolor, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprint_init(&s->block.text, 0, AV_BPRINT_SIZE_UNLIMITED);
 
     return 0;
 }
@@ -817,6 +841,12 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_bprint_finalize(&s->expanded_text, NULL);
     av_bprint_finalize(&s->expanded_fontcolor, NULL);
+
+    av_freep(&s->block.mask[0]);
+    av_freep(&s->block.glyphs);
+    av_freep(&s->block.positions);
+    av_bprint_finalize(&s->block.text, NULL);
+    memset(&s->block, 0, sizeof(s->block));
 }
 
 static int config_input(AVFilterLink *inlink)
@@ -1174,50 +1204,271 @@ static int expand_text(AVFilterContext *ctx, char *text, AVBPrint *bp)
     return 0;
 }
 
-static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
-                       int width, int height,
-                       FFDrawColor *color,
-                       int x, int y, int borderw)
+static int glyph_rect(DrawTextContext *s, Glyph *glyph, const FT_Vector *pos,
+                      int rect[4])
+{
+    const FT_Bitmap *bitmap = &glyph->bitmap;
+
+    if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
+        glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
+        return AVERROR(EINVAL);
+
+    rect[0] = pos->x;
+    rect[1] = pos->y;
+    rect[2] = pos->x + bitmap->width;
+    rect[3] = pos->y + bitmap->rows;
+    if (s->borderw) {
+        bitmap = &glyph->border_bitmap;
+        rect[0] = FFMIN(rect[0], pos->x - s->borderw);
+        rect[1] = FFMIN(rect[1], pos->y - s->borderw);
+        rect[2] = FFMAX(rect[2], pos->x - s->borderw + (int)bitmap->width);
+        rect[3] = FFMAX(rect[3], pos->y - s->borderw + (int)bitmap->rows);
+    }
+    return 0;
+}
+
+/* add the coverage of bitmap at (x, y) to the mask, inside of clip only */
+static void render_bitmap(uint8_t *mask, int linesize, const FT_Bitmap *bitmap,
+                          int x, int y, const int clip[4])
+{
+    int x0 = FFMAX(clip[0] - x, 0), x1 = FFMIN(clip[2] - x, (int)bitmap->width);
+    int y0 = FFMAX(clip[1] - y, 0), y1 = FFMIN(clip[3] - y, (int)bitmap->rows);
+    int mono = bitmap->pixel_mode == FT_PIXEL_MODE_MONO;
+    int i, j;
+
+    for (j = y0; j < y1; j++) {
+        const uint8_t *src = bitmap->buffer + j * bitmap->pitch;
+        uint8_t *dst = mask + (y + j) * linesize + x;
+
+        for (i = x0; i < x1; i++) {
+            int v = mono ? -((src[i >> 3] >> (7 - (i & 7))) & 1) & 0xff : src[i];
+            /* same coverage as blending the glyphs one after another */
+            dst[i] += v - (dst[i] * v + 127) / 255;
+        }
+    }
+}
+
+/* clear the part of the block inside of clip, and render the glyphs again */
+static void render_block_rect(DrawTextContext *s, const int clip[4])
 {
+    TextBlock *b = &s->block;
+    int i, j;
+
+    for (i = 0; i < 1 + !!s->borderw; i++)
+        for (j = clip[1]; j < clip[3]; j++)
+            memset(b->mask[i] + j * b->linesize + clip[0], 0, clip[2] - clip[0]);
+
+    for (i = 0; i < b->nb_glyphs; i++) {
+        Glyph *glyph = b->glyphs[i];
+        int x = b->positions[i].x - b->x;
+        int y = b->positions[i].y - b->y;
+
+        if (!glyph)
+            continue;
+        render_bitmap(b->mask[0], b->linesize, &glyph->bitmap, x, y, clip);
+        if (s->borderw)
+            render_bitmap(b->mask[1], b->linesize, &glyph->border_bitmap,
+                          x - s->borderw, y - s->borderw, clip);
+    }
+}
+
+/**
+ * Render the coverage of the laid out text into the block masks. When the
+ * new text covers the same area as the previous one, only the glyphs which
+ * changed are rendered again, which is typically the case of counters and
+ * timecodes.
+ */
+static int render_text_block(DrawTextContext *s)
+{
+    TextBlock *b = &s->block;
     char *text = s->expanded_text.str;
+    int len = s->expanded_text.len;
+    int bounds[4] = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+    Glyph **glyphs;
     uint32_t code = 0;
-    int i, x1, y1;
     uint8_t *p;
-    Glyph *glyph = NULL;
+    int i, n, ret, full;
+
+    glyphs = av_mallocz_array(FFMAX(len, 1), sizeof(*glyphs));
+    if (!glyphs)
+        return AVERROR(ENOMEM);
 
     for (i = 0, p = text; *p; i++) {
-        FT_Bitmap bitmap;
         Glyph dummy = { 0 };
+        int rect[4];
+
         GET_UTF8(code, *p++, continue;);
 
-        /* skip new line chars, just go to new line */
-        if (code == '\n' || code == '\r' || code == '\t')
+        /* skip new line chars and tabs, they are not drawn */
+        if (is_newline(code) || code == '\t')
             continue;
 
         dummy.code = code;
         dummy.fontsize = s->fontsize;
-        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+        glyphs[i] = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
 
-        bitmap = borderw ? glyph->border_bitmap : glyph->bitmap;
+        if ((ret = glyph_rect(s, glyphs[i], &s->positions[i], rect)) < 0) {
+            av_free(glyphs);
+            return ret;
+        }
+        bounds[0] = FFMIN(bounds[0], rect[0]);
+        bounds[1] = FFMIN(bounds[1], rect[1]);
+        bounds[2] = FFMAX(bounds[2], rect[2]);
+        bounds[3] = FFMAX(bounds[3], rect[3]);
+    }
+    n = i;
+    if (bounds[0] >= bounds[2] || bounds[1] >= bounds[3])
+        bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0;
+
+    full = !b->mask[0] || n != b->nb_glyphs ||
+           bounds[0] != b->x || bounds[2] != b->x + b->w ||
+           bounds[1] != b->y || bounds[3] != b->y + b->h;
+
+    if (full) {
+        b->x = bounds[0];
+        b->y = bounds[1];
+        b->w = bounds[2] - bounds[0];
+        b->h = bounds[3] - bounds[1];
+        b->linesize = FFALIGN(b->w, 32);
+        av_freep(&b->mask[0]);
+        b->mask[0] = av_malloc(FFMAX(2 * b->linesize * b->h, 1));
+        if (!b->mask[0]) {
+            av_free(glyphs);
+            return AVERROR(ENOMEM);
+        }
+        b->mask[1] = b->mask[0] + b->linesize * b->h;
+    }
 
-        if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
-            glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
-            return AVERROR(EINVAL);
+    if ((ret = av_reallocp_array(&b->positions, FFMAX(n, 1),
+                                 sizeof(*b->positions))) < 0) {
+        av_free(glyphs);
+        av_freep(&b->mask[0]);
+        b->nb_glyphs = 0;
+        return ret;
+    }
+
+    if (full) {
+        int clip[4] = { 0, 0, b->w, b->h };
+
+        av_free(b->glyphs);
+        b->glyphs = glyphs;
+        b->nb_glyphs = n;
+        memcpy(b->positions, s->positions, n * sizeof(*b->positions));
+        render_block_rect(s, clip);
+    } else {
+        for (i = 0; i < n; i++) {
+            int clip[4] = { INT_MAX, INT_MAX, INT_MIN, INT_MIN }, rect[4];
 
-        x1 = s->positions[i].x+s->x+x - borderw;
-        y1 = s->positions[i].y+s->y+y - borderw;
+            if (glyphs[i] == b->glyphs[i] &&
+                (!glyphs[i] || (s->positions[i].x == b->positions[i].x &&
+                                s->positions[i].y == b->positions[i].y)))
+                continue;
 
-        ff_blend_mask(&s->dc, color,
-                      frame->data, frame->linesize, width, height,
-                      bitmap.buffer, bitmap.pitch,
-                      bitmap.width, bitmap.rows,
-                      bitmap.pixel_mode == FT_PIXEL_MODE_MONO ? 0 : 3,
-                      0, x1, y1);
+            /* the area of the old glyph and the one of the new glyph */
+            if (b->glyphs[i]) {
+                glyph_rect(s, b->glyphs[i], &b->positions[i], clip);
+            }
+            if (glyphs[i]) {
+                glyph_rect(s, glyphs[i], &s->positions[i], rect);
+                clip[0] = FFMIN(clip[0], rect[0]);
+                clip[1] = FFMIN(clip[1], rect[1]);
+                clip[2] = FFMAX(clip[2], rect[2]);
+                clip[3] = FFMAX(clip[3], rect[3]);
+            }
+            clip[0] -= b->x;
+            clip[1] -= b->y;
+            clip[2] -= b->x;
+            clip[3] -= b->y;
+
+            b->glyphs[i]    = glyphs[i];
+            b->positions[i] = s->positions[i];
+            render_block_rect(s, clip);
+        }
+        av_free(glyphs);
     }
 
     return 0;
 }
 
+typedef struct ThreadData {
+    AVFrame *frame;
+    int width, height;
+    int y_start, y_end;             ///< rows of the frame which are drawn
+    int box_w, box_h;
+    FFDrawColor fontcolor;
+    FFDrawColor shadowcolor;
+    FFDrawColor bordercolor;
+    FFDrawColor boxcolor;
+} ThreadData;
+
+/* blend the rows in [ys; ye) of a block mask put at (x, y) */
+static void blend_block(DrawTextContext *s, ThreadData *td, FFDrawColor *color,
+                        const uint8_t *mask, int x, int y, int ys, int ye)
+{
+    TextBlock *b = &s->block;
+    int top    = FFMAX(ys - y, 0);
+    int bottom = FFMIN(ye - y, b->h);
+
+    if (top >= bottom)
+        return;
+
+    ff_blend_mask(&s->dc, color, td->frame->data, td->frame->linesize,
+                  td->width, td->height,
+                  mask + top * b->linesize, b->linesize, b->w, bottom - top,
+                  3, 0, x, y + top);
+}
+
+static int slice_row(ThreadData *td, int vsub, int jobnr, int nb_jobs)
+{
+    int y;
+
+    if (jobnr == 0)
+        return td->y_start;
+    if (jobnr == nb_jobs)
+        return td->y_end;
+
+    /* keep the rows sharing chroma samples in the same slice */
+    y = td->y_start + (td->y_end - td->y_start) * jobnr / nb_jobs;
+    y &= ~((1 << vsub) - 1);
+    return av_clip(y, td->y_start, td->y_end);
+}
+
+static int draw_text_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DrawTextContext *s = ctx->priv;
+    ThreadData *td = arg;
+    TextBlock *b = &s->block;
+    int ys = slice_row(td, s->dc.vsub_max, jobnr,     nb_jobs);
+    int ye = slice_row(td, s->dc.vsub_max, jobnr + 1, nb_jobs);
+    int x = s->x + b->x, y = s->y + b->y;
+
+    if (ys >= ye)
+        return 0;
+
+    if (s->draw_box) {
+        int by = FFMAX(s->y - s->boxborderw, ys);
+        int bh = FFMIN(s->y - s->boxborderw + td->box_h + s->boxborderw * 2, ye) - by;
+
+        if (bh > 0)
+            ff_blend_rectangle(&s->dc, &td->boxcolor,
+                               td->frame->data, td->frame->linesize,
+                               td->width, td->height,
+                               s->x - s->boxborderw, by,
+                               td->box_w + s->boxborderw * 2, bh);
+    }
+
+    if (!b->w || !b->h)
+        return 0;
+
+    if (s->shadowx || s->shadowy)
+        blend_block(s, td, &td->shadowcolor, b->mask[0],
+                    x + s->shadowx, y + s->shadowy, ys, ye);
+    if (s->borderw)
+        blend_block(s, td, &td->bordercolor, b->mask[1], x, y, ys, ye);
+    blend_block(s, td, &td->fontcolor, b->mask[0], x, y, ys, ye);
+
+    return 0;
+}
 
 static void update_color_with_alpha(DrawTextContext *s, FFDrawColor *color, const FFDrawColor incolor)
 {
@@ -1241,17 +1492,14 @@ static void update_alpha(DrawTextContext *s)
         s->alpha = 256 * alpha;
 }
 
-static int draw_text(AVFilterContext *ctx, AVFrame *frame,
-                     int width, int height)
+/* load the glyphs of the text, compute their positions and the text metrics */
+static int layout_text(AVFilterContext *ctx)
 {
     DrawTextContext *s = ctx->priv;
-    AVFilterLink *inlink = ctx->inputs[0];
-
+    char *text = s->expanded_text.str;
     uint32_t code = 0, prev_code = 0;
     int x = 0, y = 0, i = 0, ret;
-    int max_text_line_w = 0, len;
-    int box_w, box_h;
-    char *text;
+    int max_text_line_w = 0;
     uint8_t *p;
     int y_min = 32000, y_max = -32000;
     int x_min = 32000, x_max = -32000;
@@ -1259,71 +1507,6 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
     Glyph *glyph = NULL, *prev_glyph = NULL;
     Glyph dummy = { 0 };
 
-    time_t now = time(0);
-    struct tm ltime;
-    AVBPrint *bp = &s->expanded_text;
-
-    FFDrawColor fontcolor;
-    FFDrawColor shadowcolor;
-    FFDrawColor bordercolor;
-    FFDrawColor boxcolor;
-
-    av_bprint_clear(bp);
-
-    if(s->basetime != AV_NOPTS_VALUE)
-        now= frame->pts*av_q2d(ctx->inputs[0]->time_base) + s->basetime/1000000;
-
-    switch (s->exp_mode) {
-    case EXP_NONE:
-        av_bprintf(bp, "%s", s->text);
-        break;
-    case EXP_NORMAL:
-        if ((ret = expand_text(ctx, s->text, &s->expanded_text)) < 0)
-            return ret;
-        break;
-    case EXP_STRFTIME:
-        localtime_r(&now, &ltime);
-        av_bprint_strftime(bp, s->text, &ltime);
-        break;
-    }
-
-    if (s->tc_opt_string) {
-        char tcbuf[AV_TIMECODE_STR_SIZE];
-        av_timecode_make_string(&s->tc, tcbuf, inlink->frame_count_out);
-        av_bprint_clear(bp);
-        av_bprintf(bp, "%s%s", s->text, tcbuf);
-    }
-
-    if (!av_bprint_is_complete(bp))
-        return AVERROR(ENOMEM);
-    text = s->expanded_text.str;
-    if ((len = s->expanded_text.len) > s->nb_positions) {
-        if (!(s->positions =
-              av_realloc(s->positions, len*sizeof(*s->positions))))
-            return AVERROR(ENOMEM);
-        s->nb_positions = len;
-    }
-
-    if (s->fontcolor_expr[0]) {
-        /* If expression is set, evaluate and replace the static value */
-        av_bprint_clear(&s->expanded_fontcolor);
-        if ((ret = expand_text(ctx, s->fontcolor_expr, &s->expanded_fontcolor)) < 0)
-            return ret;
-        if (!av_bprint_is_complete(&s->expanded_fontcolor))
-            return AVERROR(ENOMEM);
-        av_log(s, AV_LOG_DEBUG, "Evaluated fontcolor is '%s'\n", s->expanded_fontcolor.str);
-        ret = av_parse_color(s->fontcolor.rgba, s->expanded_fontcolor.str, -1, s);
-        if (ret)
-            return ret;
-        ff_draw_color(&s->dc, &s->fontcolor, s->fontcolor.rgba);
-    }
-
-    x = 0;
-    y = 0;
-
-    if ((ret = update_fontsize(ctx)) < 0)
-        return ret;
-
     /* load and cache glyphs */
     for (i = 0, p = text; *p; i++) {
         GET_UTF8(code, *p++, continue;);
@@ -1396,19 +1579,130 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
 
     s->var_values[VAR_LINE_H] = s->var_values[VAR_LH] = s->max_glyph_h;
 
+    return 0;
+}
+
+/* check whether any setting affecting the glyph bitmaps or the layout
+ * changed since the block was rendered */
+static int text_block_settings_changed(DrawTextContext *s)
+{
+    TextBlock *b = &s->block;
+
+    return b->fontsize      != s->fontsize      ||
+           b->face          != s->face          ||
+           b->ft_load_flags != s->ft_load_flags ||
+           b->borderw       != s->borderw       ||
+           b->line_spacing  != s->line_spacing  ||
+           b->use_kerning   != s->use_kerning   ||
+           b->tabsize       != s->tabsize;
+}
+
+static int draw_text(AVFilterContext *ctx, AVFrame *frame,
+                     int width, int height)
+{
+    DrawTextContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    TextBlock *b = &s->block;
+    ThreadData td;
+
+    int ret, len, settings_changed;
+    int box_w, box_h;
+    int y_start = INT_MAX, y_end = INT_MIN;
+    char *text;
+
+    time_t now = time(0);
+    struct tm ltime;
+    AVBPrint *bp = &s->expanded_text;
+
+    av_bprint_clear(bp);
+
+    if(s->basetime != AV_NOPTS_VALUE)
+        now= frame->pts*av_q2d(ctx->inputs[0]->time_base) + s->basetime/1000000;
+
+    switch (s->exp_mode) {
+    case EXP_NONE:
+        av_bprintf(bp, "%s", s->text);
+        break;
+    case EXP_NORMAL:
+        if ((ret = expand_text(ctx, s->text, &s->expanded_text)) < 0)
+            return ret;
+        break;
+    case EXP_STRFTIME:
+        localtime_r(&now, &ltime);
+        av_bprint_strftime(bp, s->text, &ltime);
+        break;
+    }
+
+    if (s->tc_opt_string) {
+        char tcbuf[AV_TIMECODE_STR_SIZE];
+        av_timecode_make_string(&s->tc, tcbuf, inlink->frame_count_out);
+        av_bprint_clear(bp);
+        av_bprintf(bp, "%s%s", s->text, tcbuf);
+    }
+
+    if (!av_bprint_is_complete(bp))
+        return AVERROR(ENOMEM);
+    text = s->expanded_text.str;
+    if ((len = s->expanded_text.len) > s->nb_positions) {
+        if (!(s->positions =
+              av_realloc(s->positions, len*sizeof(*s->positions))))
+            return AVERROR(ENOMEM);
+        s->nb_positions = len;
+    }
+
+    if (s->fontcolor_expr[0]) {
+        /* If expression is set, evaluate and replace the static value */
+        av_bprint_clear(&s->expanded_fontcolor);
+        if ((ret = expand_text(ctx, s->fontcolor_expr, &s->expanded_fontcolor)) < 0)
+            return ret;
+        if (!av_bprint_is_complete(&s->expanded_fontcolor))
+            return AVERROR(ENOMEM);
+        av_log(s, AV_LOG_DEBUG, "Evaluated fontcolor is '%s'\n", s->expanded_fontcolor.str);
+        ret = av_parse_color(s->fontcolor.rgba, s->expanded_fontcolor.str, -1, s);
+        if (ret)
+            return ret;
+        ff_draw_color(&s->dc, &s->fontcolor, s->fontcolor.rgba);
+    }
+
+    if ((ret = update_fontsize(ctx)) < 0)
+        return ret;
+
+    settings_changed = text_block_settings_changed(s);
+    if (settings_changed || strcmp(b->text.str, text)) {
+        /* no glyph of the previous rendering can be kept */
+        if (settings_changed)
+            av_freep(&b->mask[0]);
+        if ((ret = layout_text(ctx)) < 0 ||
+            (ret = render_text_block(s)) < 0) {
+            b->fontsize = 0;
+            return ret;
+        }
+        av_bprint_clear(&b->text);
+        av_bprintf(&b->text, "%s", text);
+        if (!av_bprint_is_complete(&b->text))
+            return AVERROR(ENOMEM);
+        b->fontsize      = s->fontsize;
+        b->face          = s->face;
+        b->ft_load_flags = s->ft_load_flags;
+        b->borderw       = s->borderw;
+        b->line_spacing  = s->line_spacing;
+        b->use_kerning   = s->use_kerning;
+        b->tabsize       = s->tabsize;
+    }
+
     s->x = s->var_values[VAR_X] = av_expr_eval(s->x_pexpr, s->var_values, &s->prng);
     s->y = s->var_values[VAR_Y] = av_expr_eval(s->y_pexpr, s->var_values, &s->prng);
     /* It is necessary if x is expressed from y  */
     s->x = s->var_values[VAR_X] = av_expr_eval(s->x_pexpr, s->var_values, &s->prng);
 
     update_alpha(s);
-    update_color_with_alpha(s, &fontcolor  , s->fontcolor  );
-    update_color_with_alpha(s, &shadowcolor, s->shadowcolor);
-    update_color_with_alpha(s, &bordercolor, s->bordercolor);
-    update_color_with_alpha(s, &boxcolor   , s->boxcolor   );
+    update_color_with_alpha(s, &td.fontcolor  , s->fontcolor  );
+    update_color_with_alpha(s, &td.shadowcolor, s->shadowcolor);
+    update_color_with_alpha(s, &td.bordercolor, s->bordercolor);
+    update_color_with_alpha(s, &td.boxcolor   , s->boxcolor   );
 
-    box_w = max_text_line_w;
-    box_h = y + s->max_glyph_h;
+    box_w = s->var_values[VAR_TEXT_W];
+    box_h = s->var_values[VAR_TEXT_H];
 
     if (s->fix_bounds) {
 
@@ -1436,27 +1730,32 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
             s->y = FFMAX(height - box_h - offsetbottom, 0);
     }
 
-    /* draw box */
-    if (s->draw_box)
-        ff_blend_rectangle(&s->dc, &boxcolor,
-                           frame->data, frame->linesize, width, height,
-                           s->x - s->boxborderw, s->y - s->boxborderw,
-                           box_w + s->boxborderw * 2, box_h + s->boxborderw * 2);
-
-    if (s->shadowx || s->shadowy) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &shadowcolor, s->shadowx, s->shadowy, 0)) < 0)
-            return ret;
+    /* rows covered by the box, the shadow, the border and the text */
+    if (s->draw_box) {
+        y_start = s->y - s->boxborderw;
+        y_end   = s->y + box_h + s->boxborderw;
     }
-
-    if (s->borderw) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &bordercolor, 0, 0, s->borderw)) < 0)
-            return ret;
+    if (b->w && b->h) {
+        y_start = FFMIN(y_start, s->y + b->y);
+        y_end   = FFMAX(y_end,   s->y + b->y + b->h);
+        if (s->shadowx || s->shadowy) {
+            y_start = FFMIN(y_start, s->y + b->y + s->shadowy);
+            y_end   = FFMAX(y_end,   s->y + b->y + s->shadowy + b->h);
+        }
     }
-    if ((ret = draw_glyphs(s, frame, width, height,
-                           &fontcolor, 0, 0, 0)) < 0)
-        return ret;
+
+    td.frame   = frame;
+    td.width   = width;
+    td.height  = height;
+    td.box_w   = box_w;
+    td.box_h   = box_h;
+    td.y_start = av_clip(y_start, 0, height);
+    td.y_end   = av_clip(y_end,   0, height);
+
+    if (td.y_start < td.y_end)
+        ctx->internal->execute(ctx, draw_text_slice, &td, NULL,
+                               av_clip((td.y_end - td.y_start) >> s->dc.vsub_max,
+                                       1, ff_filter_get_nb_threads(ctx)));
 
     return 0;
 }
@@ -1529,5 +1828,5 @@ AVFilter ff_vf_drawtext = {
     .inputs        = avfilter_vf_drawtext_inputs,
     .outputs       = avfilter_vf_drawtext_outputs,
     .process_command = command,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -41,11 +41,9 @@ typedef struct PlaneContext {
     float n;
 
     float *buffer[BSIZE];
-    FFTComplex *hdata, *vdata;
+    FFTComplex *hdata, *vdata;  ///< scratch blocks, one per thread
     int data_linesize;
     int buffer_linesize;
-
-    FFTContext *fft, *ifft;
 } PlaneContext;
 
 typedef struct FFTdnoizContext {
@@ -63,7 +61,9 @@ typedef struct FFTdnoizContext {
 
     int depth;
     int nb_planes;
+    int nb_threads;
     PlaneContext planes[4];
+    FFTContext **fft, **ifft;   ///< one per thread
 
     void (*import_row)(FFTComplex *dst, uint8_t *src, int rw);
     void (*export_row)(FFTComplex *src, uint8_t *dst, int rw, float scale, int depth);
@@ -91,23 +91,6 @@ static const AVOption fftdnoiz_options[] = {
 
 AVFILTER_DEFINE_CLASS(fftdnoiz);
 
-static av_cold int init(AVFilterContext *ctx)
-{
-    FFTdnoizContext *s = ctx->priv;
-    int i;
-
-    for (i = 0; i < 4; i++) {
-        PlaneContext *p = &s->planes[i];
-
-        p->fft  = av_fft_init(s->block_bits, 0);
-        p->ifft = av_fft_init(s->block_bits, 1);
-        if (!p->fft || !p->ifft)
-            return AVERROR(ENOMEM);
-    }
-
-    return 0;
-}
-
 static int query_formats(AVFilterContext *ctx)
 {
     static const enum AVPixelFormat pix_fmts[] = {
@@ -138,7 +121,7 @@ static int query_formats(AVFilterContext *ctx)
 }
 
 typedef struct ThreadData {
-    float *src, *dst;
+    AVFrame *out;
 } ThreadData;
 
 static void import_row8(FFTComplex *dst, uint8_t *src, int rw)
@@ -188,6 +171,19 @@ static int config_input(AVFilterLink *inlink)
 
     desc = av_pix_fmt_desc_get(inlink->format);
     s->depth = desc->comp[0].depth;
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+
+    s->fft  = av_calloc(s->nb_threads, sizeof(*s->fft));
+    s->ifft = av_calloc(s->nb_threads, sizeof(*s->ifft));
+    if (!s->fft || !s->ifft)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_threads; i++) {
+        s->fft[i]  = av_fft_init(s->block_bits, 0);
+        s->ifft[i] = av_fft_init(s->block_bits, 1);
+        if (!s->fft[i] || !s->ifft[i])
+            return AVERROR(ENOMEM);
+    }
 
     if (s->depth <= 8) {
         s->import_row = import_row8;
@@ -233,8 +229,8 @@ static int config_input(AVFilterLink *inlink)
                 return AVERROR(ENOMEM);
         }
         p->data_linesize = 2 * p->b * sizeof(float);
-        p->hdata = av_calloc(p->b, p->data_linesize);
-        p->vdata = av_calloc(p->b, p->data_linesize);
+        p->hdata = av_calloc(p->b * s->nb_threads, p->data_linesize);
+        p->vdata = av_calloc(p->b * s->nb_threads, p->data_linesize);
         if (!p->hdata || !p->vdata)
             return AVERROR(ENOMEM);
     }
@@ -242,9 +238,22 @@ static int config_input(AVFilterLink *inlink)
     return 0;
 }
 
+/**
+ * Return the index of the sample mirrored to position i >= n of a block of
+ * which only the first n samples are set. The block is mirrored around its
+ * center, or around n when that would read an unset sample.
+ */
+static av_always_inline int mirror(int i, int n, int block)
+{
+    const int m = block - i - 1;
+
+    return m < n ? m : FFMAX(2 * n - i - 1, 0);
+}
+
 static void import_plane(FFTdnoizContext *s,
                          uint8_t *srcp, int src_linesize,
-                         float *buffer, int buffer_linesize, int plane)
+                         float *buffer, int buffer_linesize, int plane,
+                         int jobnr, int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int width = p->planewidth;
@@ -253,15 +262,15 @@ static void import_plane(FFTdnoizContext *s,
     const int overlap = p->o;
     const int size = block - overlap;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int bpp = (s->depth + 7) / 8;
     const int data_linesize = p->data_linesize / sizeof(FFTComplex);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
+    FFTComplex *hdata = p->hdata + jobnr * block * data_linesize;
+    FFTComplex *vdata = p->vdata + jobnr * block * data_linesize;
+    FFTContext *fft = s->fft[jobnr];
     int x, y, i, j;
 
     buffer_linesize /= sizeof(float);
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             const int rh = FFMIN(block, height - y * size);
             const int rw = FFMIN(block, width  - x * size);
@@ -272,22 +281,20 @@ static void import_plane(FFTdnoizContext *s,
             for (i = 0; i < rh; i++) {
                 s->import_row(dst, src, rw);
                 for (j = rw; j < block; j++) {
-                    dst[j].re = dst[block - j - 1].re;
+                    dst[j].re = dst[mirror(j, rw, block)].re;
                     dst[j].im = 0;
                 }
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
+                av_fft_permute(fft, dst);
+                av_fft_calc(fft, dst);
 
                 src += src_linesize;
                 dst += data_linesize;
             }
 
-            dst = hdata;
             for (; i < block; i++) {
-                for (j = 0; j < block; j++) {
-                    dst[j].re = dst[(block - i - 1) * data_linesize + j].re;
-                    dst[j].im = dst[(block - i - 1) * data_linesize + j].im;
-                }
+                memcpy(hdata + i * data_linesize,
+                       hdata + mirror(i, rh, block) * data_linesize,
+                       block * sizeof(FFTComplex));
             }
 
             ssrc = hdata;
@@ -295,8 +302,8 @@ static void import_plane(FFTdnoizContext *s,
             for (i = 0; i < block; i++) {
                 for (j = 0; j < block; j++)
                     dst[j] = ssrc[j * data_linesize + i];
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
+                av_fft_permute(fft, dst);
+                av_fft_calc(fft, dst);
                 memcpy(bdst, dst, block * sizeof(FFTComplex));
 
                 dst += data_linesize;
@@ -308,7 +315,8 @@ static void import_plane(FFTdnoizContext *s,
 
 static void export_plane(FFTdnoizContext *s,
                          uint8_t *dstp, int dst_linesize,
-                         float *buffer, int buffer_linesize, int plane)
+                         float *buffer, int buffer_linesize, int plane,
+                         int jobnr, int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int depth = s->depth;
@@ -323,17 +331,21 @@ static void export_plane(FFTdnoizContext *s,
     const int noy = p->noy;
     const int data_linesize = p->data_linesize / sizeof(FFTComplex);
     const float scale = 1.f / (block * block);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
+    FFTComplex *hdata = p->hdata + jobnr * block * data_linesize;
+    FFTComplex *vdata = p->vdata + jobnr * block * data_linesize;
+    FFTContext *ifft = s->ifft[jobnr];
     int x, y, i, j;
 
     buffer_linesize /= sizeof(float);
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             const int woff = x == 0 ? 0 : hoverlap;
             const int hoff = y == 0 ? 0 : hoverlap;
             const int rw = x == 0 ? block : FFMIN(size, width  - x * size - woff);
-            const int rh = y == 0 ? block : FFMIN(size, height - y * size - hoff);
+            /* the rows of the first block row from size + hoverlap on are
+             * overwritten by the second one, so leave them to it */
+            const int rh = y == 0 ? (noy > 1 ? size + hoverlap : block)
+                                  : FFMIN(size, height - y * size - hoff);
             float *bsrc = buffer + buffer_linesize * y * block + x * block * 2;
             uint8_t *dst = dstp + dst_linesize * (y * size + hoff) + (x * size + woff) * bpp;
             FFTComplex *hdst, *ddst = vdata;
@@ -341,8 +353,8 @@ static void export_plane(FFTdnoizContext *s,
             hdst = hdata;
             for (i = 0; i < block; i++) {
                 memcpy(ddst, bsrc, block * sizeof(FFTComplex));
-                av_fft_permute(p->ifft, ddst);
-                av_fft_calc(p->ifft, ddst);
+                av_fft_permute(ifft, ddst);
+                av_fft_calc(ifft, ddst);
                 for (j = 0; j < block; j++) {
                     hdst[j * data_linesize + i] = ddst[j];
                 }
@@ -353,8 +365,8 @@ static void export_plane(FFTdnoizContext *s,
 
             hdst = hdata + hoff * data_linesize;
             for (i = 0; i < rh; i++) {
-                av_fft_permute(p->ifft, hdst);
-                av_fft_calc(p->ifft, hdst);
+                av_fft_permute(ifft, hdst);
+                av_fft_calc(ifft, hdst);
                 s->export_row(hdst + woff, dst, rw, scale, depth);
 
                 hdst += data_linesize;
@@ -364,12 +376,12 @@ static void export_plane(FFTdnoizContext *s,
     }
 }
 
-static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float *nbuffer)
+static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float *nbuffer,
+                            int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / sizeof(float);
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
@@ -378,7 +390,7 @@ static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float
     const float scale = 1.f / 3.f;
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             float *cbuff = cbuffer + buffer_linesize * y * block + x * block * 2;
             float *pbuff = pbuffer + buffer_linesize * y * block + x * block * 2;
@@ -424,19 +436,19 @@ static void filter_plane3d2(FFTdnoizContext *s, int plane, float *pbuffer, float
     }
 }
 
-static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer)
+static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer,
+                            int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / sizeof(float);
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
     float *cbuffer = p->buffer[CURRENT];
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             float *cbuff = cbuffer + buffer_linesize * y * block + x * block * 2;
             float *pbuff = pbuffer + buffer_linesize * y * block + x * block * 2;
@@ -476,19 +488,19 @@ static void filter_plane3d1(FFTdnoizContext *s, int plane, float *pbuffer)
     }
 }
 
-static void filter_plane2d(FFTdnoizContext *s, int plane)
+static void filter_plane2d(FFTdnoizContext *s, int plane,
+                           int slice_start, int slice_end)
 {
     PlaneContext *p = &s->planes[plane];
     const int block = p->b;
     const int nox = p->nox;
-    const int noy = p->noy;
     const int buffer_linesize = p->buffer_linesize / 4;
     const float sigma = s->sigma * s->sigma * block * block;
     const float limit = 1.f - s->amount;
     float *buffer = p->buffer[CURRENT];
     int y, x, i, j;
 
-    for (y = 0; y < noy; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (x = 0; x < nox; x++) {
             float *buff = buffer + buffer_linesize * y * block + x * block * 2;
 
@@ -510,12 +522,80 @@ static void filter_plane2d(FFTdnoizContext *s, int plane)
     }
 }
 
+static int denoise_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FFTdnoizContext *s = ctx->priv;
+    int plane;
+
+    for (plane = 0; plane < s->nb_planes; plane++) {
+        PlaneContext *p = &s->planes[plane];
+        const int slice_start = (p->noy *  jobnr   ) / nb_jobs;
+        const int slice_end   = (p->noy * (jobnr+1)) / nb_jobs;
+
+        if (!((1 << plane) & s->planesf) || ctx->is_disabled)
+            continue;
+
+        if (s->next) {
+            import_plane(s, s->next->data[plane], s->next->linesize[plane],
+                         p->buffer[NEXT], p->buffer_linesize, plane,
+                         jobnr, slice_start, slice_end);
+        }
+
+        if (s->prev) {
+            import_plane(s, s->prev->data[plane], s->prev->linesize[plane],
+                         p->buffer[PREV], p->buffer_linesize, plane,
+                         jobnr, slice_start, slice_end);
+        }
+
+        import_plane(s, s->cur->data[plane], s->cur->linesize[plane],
+                     p->buffer[CURRENT], p->buffer_linesize, plane,
+                     jobnr, slice_start, slice_end);
+
+        if (s->next && s->prev) {
+            filter_plane3d2(s, plane, p->buffer[PREV], p->buffer[NEXT],
+                            slice_start, slice_end);
+        } else if (s->next) {
+            filter_plane3d1(s, plane, p->buffer[NEXT], slice_start, slice_end);
+        } else  if (s->prev) {
+            filter_plane3d1(s, plane, p->buffer[PREV], slice_start, slice_end);
+        } else {
+            filter_plane2d(s, plane, slice_start, slice_end);
+        }
+    }
+
+    return 0;
+}
+
+static int export_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FFTdnoizContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *out = td->out;
+    int plane;
+
+    for (plane = 0; plane < s->nb_planes; plane++) {
+        PlaneContext *p = &s->planes[plane];
+        const int slice_start = (p->noy *  jobnr   ) / nb_jobs;
+        const int slice_end   = (p->noy * (jobnr+1)) / nb_jobs;
+
+        if (!((1 << plane) & s->planesf) || ctx->is_disabled)
+            continue;
+
+        export_plane(s, out->data[plane], out->linesize[plane],
+                     p->buffer[CURRENT], p->buffer_linesize, plane,
+                     jobnr, slice_start, slice_end);
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
     FFTdnoizContext *s = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
-    int direct, plane;
+    int direct, plane, nb_jobs;
+    ThreadData td;
     AVFrame *out;
 
     if (s->nb_next > 0 && s->nb_prev > 0) {
@@ -570,36 +650,16 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
                 av_image_copy_plane(out->data[plane], out->linesize[plane],
                                     s->cur->data[plane], s->cur->linesize[plane],
                                     p->planewidth, p->planeheight);
-            continue;
-        }
-
-        if (s->next) {
-            import_plane(s, s->next->data[plane], s->next->linesize[plane],
-                         p->buffer[NEXT], p->buffer_linesize, plane);
         }
-
-        if (s->prev) {
-            import_plane(s, s->prev->data[plane], s->prev->linesize[plane],
-                         p->buffer[PREV], p->buffer_linesize, plane);
-        }
-
-        import_plane(s, s->cur->data[plane], s->cur->linesize[plane],
-                     p->buffer[CURRENT], p->buffer_linesize, plane);
-
-        if (s->next && s->prev) {
-            filter_plane3d2(s, plane, p->buffer[PREV], p->buffer[NEXT]);
-        } else if (s->next) {
-            filter_plane3d1(s, plane, p->buffer[NEXT]);
-        } else  if (s->prev) {
-            filter_plane3d1(s, plane, p->buffer[PREV]);
-        } else {
-            filter_plane2d(s, plane);
-        }
-
-        export_plane(s, out->data[plane], out->linesize[plane],
-                     p->buffer[CURRENT], p->buffer_linesize, plane);
     }
 
+    /* the blocks overlap, so all of them are imported before any is
+     * exported, which may be in place */
+    td.out = out;
+    nb_jobs = FFMIN(s->planes[0].noy, s->nb_threads);
+    ctx->internal->execute(ctx, denoise_slice, NULL, NULL, nb_jobs);
+    ctx->internal->execute(ctx, export_slice, &td, NULL, nb_jobs);
+
     if (s->nb_next == 0 && s->nb_prev == 0) {
         if (direct) {
             s->cur = NULL;
@@ -652,10 +712,17 @@ static av_cold void uninit(AVFilterContext *ctx)
         av_freep(&p->buffer[PREV]);
         av_freep(&p->buffer[CURRENT]);
         av_freep(&p->buffer[NEXT]);
-        av_fft_end(p->fft);
-        av_fft_end(p->ifft);
     }
 
+    for (i = 0; i < s->nb_threads; i++) {
+        if (s->fft)
+            av_fft_end(s->fft[i]);
+        if (s->ifft)
+            av_fft_end(s->ifft[i]);
+    }
+    av_freep(&s->fft);
+    av_freep(&s->ifft);
+
     av_frame_free(&s->prev);
     av_frame_free(&s->cur);
     av_frame_free(&s->next);
@@ -684,11 +751,11 @@ AVFilter ff_vf_fftdnoiz = {
     .name          = "fftdnoiz",
     .description   = NULL_IF_CONFIG_SMALL("Denoise frames using 3D FFT."),
     .priv_size     = sizeof(FFTdnoizContext),
-    .init          = init,
     .uninit        = uninit,
     .query_formats = query_formats,
     .inputs        = fftdnoiz_inputs,
     .outputs       = fftdnoiz_outputs,
     .priv_class    = &fftdnoiz_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
 };
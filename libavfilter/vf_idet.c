@@ -22,6 +22,7 @@
 
 #include "libavutil/cpu.h"
 #include "libavutil/common.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "internal.h"
 #include "vf_idet.h"
@@ -110,39 +111,67 @@ int ff_idet_filter_line_c_16bit(const uint16_t *a, const uint16_t *b, const uint
     return ret;
 }
 
-static void filter(AVFilterContext *ctx)
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     IDETContext *idet = ctx->priv;
+    IDETSliceStats *stats = &idet->slice_stats[jobnr];
     int y, i;
-    int64_t alpha[2]={0};
-    int64_t delta=0;
-    int64_t gamma[2]={0};
-    Type type, best_type;
-    RepeatedField repeat;
-    int match = 0;
-    AVDictionary **metadata = &idet->cur->metadata;
+
+    memset(stats, 0, sizeof(*stats));
 
     for (i = 0; i < idet->csp->nb_components; i++) {
         int w = idet->cur->width;
         int h = idet->cur->height;
         int refs = idet->cur->linesize[i];
+        int slice_start, slice_end;
 
         if (i && i<3) {
             w = AV_CEIL_RSHIFT(w, idet->csp->log2_chroma_w);
             h = AV_CEIL_RSHIFT(h, idet->csp->log2_chroma_h);
         }
 
-        for (y = 2; y < h - 2; y++) {
+        slice_start = 2 + (FFMAX(h - 4, 0) *  jobnr   ) / nb_jobs;
+        slice_end   = 2 + (FFMAX(h - 4, 0) * (jobnr+1)) / nb_jobs;
+
+        for (y = slice_start; y < slice_end; y++) {
             uint8_t *prev = &idet->prev->data[i][y*refs];
             uint8_t *cur  = &idet->cur ->data[i][y*refs];
             uint8_t *next = &idet->next->data[i][y*refs];
-            alpha[ y   &1] += idet->filter_line(cur-refs, prev, cur+refs, w);
-            alpha[(y^1)&1] += idet->filter_line(cur-refs, next, cur+refs, w);
-            delta          += idet->filter_line(cur-refs,  cur, cur+refs, w);
-            gamma[(y^1)&1] += idet->filter_line(cur     , prev, cur     , w);
+            stats->alpha[ y   &1] += idet->filter_line(cur-refs, prev, cur+refs, w);
+            stats->alpha[(y^1)&1] += idet->filter_line(cur-refs, next, cur+refs, w);
+            stats->delta          += idet->filter_line(cur-refs,  cur, cur+refs, w);
+            stats->gamma[(y^1)&1] += idet->filter_line(cur     , prev, cur     , w);
         }
     }
 
+    return 0;
+}
+
+static void filter(AVFilterContext *ctx)
+{
+    IDETContext *idet = ctx->priv;
+    int i;
+    int64_t alpha[2]={0};
+    int64_t delta=0;
+    int64_t gamma[2]={0};
+    Type type, best_type;
+    RepeatedField repeat;
+    int match = 0;
+    AVDictionary **metadata = &idet->cur->metadata;
+    const int nb_jobs = FFMAX(1, FFMIN(idet->nb_threads, idet->cur->height - 4));
+
+    ctx->internal->execute(ctx, filter_slice, NULL, NULL, nb_jobs);
+
+    for (i = 0; i < nb_jobs; i++) {
+        const IDETSliceStats *stats = &idet->slice_stats[i];
+
+        alpha[0] += stats->alpha[0];
+        alpha[1] += stats->alpha[1];
+        delta    += stats->delta;
+        gamma[0] += stats->gamma[0];
+        gamma[1] += stats->gamma[1];
+    }
+
     if      (alpha[0] > idet->interlace_threshold * alpha[1]){
         type = TFF;
     }else if(alpha[1] > idet->interlace_threshold * alpha[0]){
@@ -359,6 +388,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_frame_free(&idet->prev);
     av_frame_free(&idet->cur );
     av_frame_free(&idet->next);
+    av_freep(&idet->slice_stats);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -402,6 +432,20 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_formats(ctx, fmts_list);
 }
 
+static int config_input(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    IDETContext *idet = ctx->priv;
+
+    idet->nb_threads = ff_filter_get_nb_threads(ctx);
+    av_freep(&idet->slice_stats);
+    idet->slice_stats = av_calloc(idet->nb_threads, sizeof(*idet->slice_stats));
+    if (!idet->slice_stats)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     IDETContext *idet = ctx->priv;
@@ -427,6 +471,7 @@ static const AVFilterPad idet_inputs[] = {
     {
         .name         = "default",
         .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_input,
         .filter_frame = filter_frame,
     },
     { NULL }
@@ -451,4 +496,5 @@ AVFilter ff_vf_idet = {
     .inputs        = idet_inputs,
     .outputs       = idet_outputs,
     .priv_class    = &idet_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
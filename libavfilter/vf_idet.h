@@ -39,6 +39,12 @@ typedef enum {
     REPEAT_BOTTOM,
 } RepeatedField;
 
+typedef struct IDETSliceStats {
+    int64_t alpha[2];
+    int64_t delta;
+    int64_t gamma[2];
+} IDETSliceStats;
+
 typedef struct IDETContext {
     const AVClass *class;
     float interlace_threshold;
@@ -69,6 +75,9 @@ typedef struct IDETContext {
 
     const AVPixFmtDescriptor *csp;
     int eof;
+
+    IDETSliceStats *slice_stats;
+    int nb_threads;
 } IDETContext;
 
 void ff_idet_init_x86(IDETContext *idet, int for_16b);
@@ -48,9 +48,11 @@ typedef struct LIBVMAFContext {
     pthread_mutex_t lock;
     pthread_cond_t cond;
     int eof;
-    AVFrame *gmain;
-    AVFrame *gref;
-    int frame_set;
+    AVFrame **gmain;
+    AVFrame **gref;
+    int queue_size;
+    int queue_start;
+    int queue_count;
     char *model_path;
     char *log_path;
     char *log_fmt;
@@ -78,75 +80,83 @@ static const AVOption libvmaf_options[] = {
     {"ssim",  "Enables computing ssim along with vmaf.",                                OFFSET(ssim), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS},
     {"ms_ssim",  "Enables computing ms-ssim along with vmaf.",                          OFFSET(ms_ssim), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS},
     {"pool",  "Set the pool method to be used for computing vmaf.",                     OFFSET(pool), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 1, FLAGS},
+    {"queue_size",  "Set the number of frame pairs queued for libvmaf.",                OFFSET(queue_size), AV_OPT_TYPE_INT, {.i64=4}, 1, 64, FLAGS},
     { NULL }
 };
 
 FRAMESYNC_DEFINE_CLASS(libvmaf, LIBVMAFContext, fs);
 
-#define read_frame_fn(type, bits)                                               \
-    static int read_frame_##bits##bit(float *ref_data, float *main_data,        \
-                                      float *temp_data, int stride, void *ctx)  \
+#define convert_frame_fn(type, bits)                                            \
+static void convert_frame_##bits##bit(float *dst, int dst_stride,               \
+                                      const AVFrame *frame, int w, int h)       \
 {                                                                               \
-    LIBVMAFContext *s = (LIBVMAFContext *) ctx;                                 \
-    int ret;                                                                    \
-    \
-    pthread_mutex_lock(&s->lock);                                               \
-    \
-    while (!s->frame_set && !s->eof) {                                          \
-        pthread_cond_wait(&s->cond, &s->lock);                                  \
-    }                                                                           \
-    \
-    if (s->frame_set) {                                                         \
-        int ref_stride = s->gref->linesize[0];                                  \
-        int main_stride = s->gmain->linesize[0];                                \
-        \
-        const type *ref_ptr = (const type *) s->gref->data[0];                  \
-        const type *main_ptr = (const type *) s->gmain->data[0];                \
-        \
-        float *ptr = ref_data;                                                  \
-        \
-        int h = s->height;                                                      \
-        int w = s->width;                                                       \
-        \
-        int i,j;                                                                \
-        \
-        for (i = 0; i < h; i++) {                                               \
-            for ( j = 0; j < w; j++) {                                          \
-                ptr[j] = (float)ref_ptr[j];                                     \
-            }                                                                   \
-            ref_ptr += ref_stride / sizeof(*ref_ptr);                           \
-            ptr += stride / sizeof(*ptr);                                       \
-        }                                                                       \
-        \
-        ptr = main_data;                                                        \
-        \
-        for (i = 0; i < h; i++) {                                               \
-            for (j = 0; j < w; j++) {                                           \
-                ptr[j] = (float)main_ptr[j];                                    \
-            }                                                                   \
-            main_ptr += main_stride / sizeof(*main_ptr);                        \
-            ptr += stride / sizeof(*ptr);                                       \
+    const type *src = (const type *) frame->data[0];                            \
+    int i, j;                                                                   \
+                                                                                \
+    for (i = 0; i < h; i++) {                                                   \
+        for (j = 0; j < w; j++) {                                               \
+            dst[j] = (float)src[j];                                             \
         }                                                                       \
+        src += frame->linesize[0] / sizeof(*src);                               \
+        dst += dst_stride / sizeof(*dst);                                       \
     }                                                                           \
-    \
-    ret = !s->frame_set;                                                        \
-    \
-    av_frame_unref(s->gref);                                                    \
-    av_frame_unref(s->gmain);                                                   \
-    s->frame_set = 0;                                                           \
-    \
-    pthread_cond_signal(&s->cond);                                              \
-    pthread_mutex_unlock(&s->lock);                                             \
-    \
-    if (ret) {                                                                  \
-        return 2;                                                               \
-    }                                                                           \
-    \
-    return 0;                                                                   \
 }
 
-read_frame_fn(uint8_t, 8);
-read_frame_fn(uint16_t, 10);
+convert_frame_fn(uint8_t, 8);
+convert_frame_fn(uint16_t, 10);
+
+/**
+ * Take the oldest frame pair from the queue and convert it into the float
+ * buffers of libvmaf. The frames are only referenced by the queue, so the
+ * conversion is the only copy and it is done without holding the lock.
+ */
+static int read_frame(float *ref_data, float *main_data, int stride,
+                      LIBVMAFContext *s,
+                      void (*convert)(float *dst, int dst_stride,
+                                      const AVFrame *frame, int w, int h))
+{
+    AVFrame *ref_frame = NULL, *main_frame = NULL;
+
+    pthread_mutex_lock(&s->lock);
+
+    while (!s->queue_count && !s->eof) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+
+    if (s->queue_count) {
+        ref_frame  = s->gref[s->queue_start];
+        main_frame = s->gmain[s->queue_start];
+        s->gref[s->queue_start]  = NULL;
+        s->gmain[s->queue_start] = NULL;
+        s->queue_start = (s->queue_start + 1) % s->queue_size;
+        s->queue_count--;
+    }
+
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    if (!ref_frame)
+        return 2;
+
+    convert(ref_data,  stride, ref_frame,  s->width, s->height);
+    convert(main_data, stride, main_frame, s->width, s->height);
+
+    av_frame_free(&ref_frame);
+    av_frame_free(&main_frame);
+
+    return 0;
+}
+
+#define read_frame_fn(bits)                                                     \
+static int read_frame_##bits##bit(float *ref_data, float *main_data,            \
+                                  float *temp_data, int stride, void *ctx)      \
+{                                                                               \
+    return read_frame(ref_data, main_data, stride, ctx,                         \
+                      convert_frame_##bits##bit);                               \
+}
+
+read_frame_fn(8);
+read_frame_fn(10);
 
 static void compute_vmaf_score(LIBVMAFContext *s)
 {
@@ -189,7 +199,7 @@ static int do_vmaf(FFFrameSync *fs)
     AVFilterContext *ctx = fs->parent;
     LIBVMAFContext *s = ctx->priv;
     AVFrame *master, *ref;
-    int ret;
+    int idx, ret;
 
     ret = ff_framesync_dualinput_get(fs, &master, &ref);
     if (ret < 0)
@@ -199,7 +209,7 @@ static int do_vmaf(FFFrameSync *fs)
 
     pthread_mutex_lock(&s->lock);
 
-    while (s->frame_set && !s->error) {
+    while (s->queue_count == s->queue_size && !s->error) {
         pthread_cond_wait(&s->cond, &s->lock);
     }
 
@@ -210,10 +220,17 @@ static int do_vmaf(FFFrameSync *fs)
         return AVERROR(EINVAL);
     }
 
-    av_frame_ref(s->gref, ref);
-    av_frame_ref(s->gmain, master);
+    idx = (s->queue_start + s->queue_count) % s->queue_size;
+    s->gref[idx]  = av_frame_clone(ref);
+    s->gmain[idx] = av_frame_clone(master);
+    if (!s->gref[idx] || !s->gmain[idx]) {
+        av_frame_free(&s->gref[idx]);
+        av_frame_free(&s->gmain[idx]);
+        pthread_mutex_unlock(&s->lock);
+        return AVERROR(ENOMEM);
+    }
 
-    s->frame_set = 1;
+    s->queue_count++;
 
     pthread_cond_signal(&s->cond);
     pthread_mutex_unlock(&s->lock);
@@ -225,14 +242,17 @@ static av_cold int init(AVFilterContext *ctx)
 {
     LIBVMAFContext *s = ctx->priv;
 
-    s->gref = av_frame_alloc();
-    s->gmain = av_frame_alloc();
     s->error = 0;
 
     s->vmaf_thread_created = 0;
     pthread_mutex_init(&s->lock, NULL);
     pthread_cond_init (&s->cond, NULL);
 
+    s->gref  = av_calloc(s->queue_size, sizeof(*s->gref));
+    s->gmain = av_calloc(s->queue_size, sizeof(*s->gmain));
+    if (!s->gref || !s->gmain)
+        return AVERROR(ENOMEM);
+
     s->fs.on_event = do_vmaf;
     return 0;
 }
@@ -326,8 +346,16 @@ static av_cold void uninit(AVFilterContext *ctx)
         s->vmaf_thread_created = 0;
     }
 
-    av_frame_free(&s->gref);
-    av_frame_free(&s->gmain);
+    if (s->gref && s->gmain) {
+        int i;
+
+        for (i = 0; i < s->queue_size; i++) {
+            av_frame_free(&s->gref[i]);
+            av_frame_free(&s->gmain[i]);
+        }
+    }
+    av_freep(&s->gref);
+    av_freep(&s->gmain);
 
     pthread_mutex_destroy(&s->lock);
     pthread_cond_destroy(&s->cond);
@@ -27,6 +27,7 @@
 #include "drawutils.h"
 #include "formats.h"
 #include "internal.h"
+#include "lutdsp.h"
 #include "video.h"
 #include "framesync.h"
 
@@ -65,7 +66,8 @@ typedef struct LUT2Context {
     int tlut2;
     AVFrame *prev_frame;        /* only used with tlut2 */
 
-    void (*lut2)(struct LUT2Context *s, AVFrame *dst, AVFrame *srcx, AVFrame *srcy);
+    int (*lut2)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
+    LutDSPContext dsp;
 
 } LUT2Context;
 
@@ -158,54 +160,72 @@ static int config_inputy(AVFilterLink *inlink)
     return 0;
 }
 
-static void lut2_8bit(struct LUT2Context *s, AVFrame *out, AVFrame *srcx, AVFrame *srcy)
+typedef struct ThreadData {
+    AVFrame *out, *srcx, *srcy;
+} ThreadData;
+
+static int lut2_8bit(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int p, y, x;
+    LUT2Context *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *out = td->out;
+    AVFrame *srcx = td->srcx;
+    AVFrame *srcy = td->srcy;
+    int p, y;
 
     for (p = 0; p < s->nb_planes; p++) {
+        const int slice_start = (s->height[p] *  jobnr   ) / nb_jobs;
+        const int slice_end   = (s->height[p] * (jobnr+1)) / nb_jobs;
         const uint16_t *lut = s->lut[p];
         const uint8_t *srcxx, *srcyy;
         uint8_t *dst;
 
-        dst   = out->data[p];
-        srcxx = srcx->data[p];
-        srcyy = srcy->data[p];
+        dst   = out->data[p]  + slice_start * out->linesize[p];
+        srcxx = srcx->data[p] + slice_start * srcx->linesize[p];
+        srcyy = srcy->data[p] + slice_start * srcy->linesize[p];
 
-        for (y = 0; y < s->height[p]; y++) {
-            for (x = 0; x < s->width[p]; x++) {
-                dst[x] = lut[(srcyy[x] << s->depthx) | srcxx[x]];
-            }
+        for (y = slice_start; y < slice_end; y++) {
+            s->dsp.lut2_row8(dst, srcxx, srcyy, lut, s->depthx, s->width[p]);
 
             dst   += out->linesize[p];
             srcxx += srcx->linesize[p];
             srcyy += srcy->linesize[p];
         }
     }
+
+    return 0;
 }
 
-static void lut2_16bit(struct LUT2Context *s, AVFrame *out, AVFrame *srcx, AVFrame *srcy)
+static int lut2_16bit(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int p, y, x;
+    LUT2Context *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *out = td->out;
+    AVFrame *srcx = td->srcx;
+    AVFrame *srcy = td->srcy;
+    int p, y;
 
     for (p = 0; p < s->nb_planes; p++) {
+        const int slice_start = (s->height[p] *  jobnr   ) / nb_jobs;
+        const int slice_end   = (s->height[p] * (jobnr+1)) / nb_jobs;
         const uint16_t *lut = s->lut[p];
         const uint16_t *srcxx, *srcyy;
         uint16_t *dst;
 
-        dst   = (uint16_t *)out->data[p];
-        srcxx = (uint16_t *)srcx->data[p];
-        srcyy = (uint16_t *)srcy->data[p];
+        dst   = (uint16_t *)(out->data[p]  + slice_start * out->linesize[p]);
+        srcxx = (uint16_t *)(srcx->data[p] + slice_start * srcx->linesize[p]);
+        srcyy = (uint16_t *)(srcy->data[p] + slice_start * srcy->linesize[p]);
 
-        for (y = 0; y < s->height[p]; y++) {
-            for (x = 0; x < s->width[p]; x++) {
-                dst[x] = lut[(srcyy[x] << s->depthx) | srcxx[x]];
-            }
+        for (y = slice_start; y < slice_end; y++) {
+            s->dsp.lut2_row16(dst, srcxx, srcyy, lut, s->depthx, s->width[p]);
 
             dst   += out->linesize[p]  / 2;
             srcxx += srcx->linesize[p] / 2;
             srcyy += srcy->linesize[p] / 2;
         }
     }
+
+    return 0;
 }
 
 static int process_frame(FFFrameSync *fs)
@@ -214,6 +234,7 @@ static int process_frame(FFFrameSync *fs)
     LUT2Context *s = fs->opaque;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out, *srcx = NULL, *srcy = NULL;
+    ThreadData td;
     int ret;
 
     if ((ret = ff_framesync_get_frame(&s->fs, 0, &srcx, 0)) < 0 ||
@@ -230,7 +251,11 @@ static int process_frame(FFFrameSync *fs)
             return AVERROR(ENOMEM);
         av_frame_copy_props(out, srcx);
 
-        s->lut2(s, out, srcx, srcy);
+        td.out  = out;
+        td.srcx = srcx;
+        td.srcy = srcy;
+        ctx->internal->execute(ctx, s->lut2, &td, NULL,
+                               FFMIN(s->height[1], ff_filter_get_nb_threads(ctx)));
     }
 
     out->pts = av_rescale_q(s->fs.pts, s->fs.time_base, outlink->time_base);
@@ -247,6 +272,7 @@ static int config_output(AVFilterLink *outlink)
     s->depth = s->depthx + s->depthy;
 
     s->lut2 = s->depth > 16 ? lut2_16bit : lut2_8bit;
+    ff_lutdsp_init(&s->dsp);
 
     for (p = 0; p < s->nb_planes; p++) {
         s->lut[p] = av_malloc_array(1 << s->depth, sizeof(uint16_t));
@@ -385,7 +411,8 @@ AVFilter ff_vf_lut2 = {
     .activate      = activate,
     .inputs        = inputs,
     .outputs       = outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
 };
 
 #if CONFIG_TLUT2_FILTER
@@ -407,6 +434,7 @@ static int tlut2_filter_frame(AVFilterLink *inlink, AVFrame *frame)
 
     if (s->prev_frame) {
         AVFrame *out;
+        ThreadData td;
 
         if (ctx->is_disabled) {
             out = av_frame_clone(frame);
@@ -419,7 +447,12 @@ static int tlut2_filter_frame(AVFilterLink *inlink, AVFrame *frame)
             }
 
             av_frame_copy_props(out, frame);
-            s->lut2(s, out, frame, s->prev_frame);
+
+            td.out  = out;
+            td.srcx = frame;
+            td.srcy = s->prev_frame;
+            ctx->internal->execute(ctx, s->lut2, &td, NULL,
+                                   FFMIN(s->height[1], ff_filter_get_nb_threads(ctx)));
         }
         av_frame_free(&s->prev_frame);
         s->prev_frame = frame;
@@ -462,7 +495,8 @@ AVFilter ff_vf_tlut2 = {
     .uninit        = uninit,
     .inputs        = tlut2_inputs,
     .outputs       = tlut2_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
 };
 
 #endif
@@ -19,14 +19,18 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
+
 #include "motion_estimation.h"
 #include "libavcodec/mathops.h"
 #include "libavutil/avassert.h"
 #include "libavutil/common.h"
+#include "libavutil/internal.h"
 #include "libavutil/motion_vector.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/pixelutils.h"
+#include "libavutil/thread.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
@@ -49,6 +53,7 @@
 #define CLUSTER_THRESHOLD 4
 #define PX_WEIGHT_MAX 255
 #define COST_PRED_SCALE 64
+#define PROGRESS_BLOCKS 8
 
 static const uint8_t obmc_linear32[1024] = {
   0,  0,  0,  0,  4,  4,  4,  4,  4,  4,  4,  4,  8,  8,  8,  8,  8,  8,  8,  8,  4,  4,  4,  4,  4,  4,  4,  4,  0,  0,  0,  0,
@@ -158,6 +163,18 @@ typedef struct PixelRefs {
     int nb;
 } PixelRefs;
 
+typedef struct SearchThreadData {
+    Block *blocks;
+    int dir;
+    atomic_int next_row;
+    int pred_x, pred_y;
+} SearchThreadData;
+
+typedef struct ThreadData {
+    AVFrame *out;
+    int alpha;
+} ThreadData;
+
 typedef struct Frame {
     AVFrame *avf;
     Block *blocks;
@@ -182,6 +199,12 @@ typedef struct MIContext {
     PixelWeights *pixel_weights;
     PixelRefs *pixel_refs;
     int (*mv_table[3])[2][2];
+    atomic_int *row_progress;           ///< number of blocks searched in each row
+#if HAVE_THREADS
+    pthread_mutex_t *progress_mutex;
+    pthread_cond_t *progress_cond;
+    int nb_progress_locks;
+#endif
     int64_t out_pts;
     int b_width, b_height, b_count;
     int log2_mb_size;
@@ -263,6 +286,7 @@ static uint64_t get_sbad(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int
     int mv_x1 = x_mv - x;
     int mv_y1 = y_mv - y;
     int mv_x, mv_y, i, j;
+    av_pixelutils_sad_fn sad_fn = ff_me_get_sad_fn(me_ctx, me_ctx->mb_size);
     uint64_t sbad = 0;
 
     x = av_clip(x, me_ctx->x_min, me_ctx->x_max);
@@ -273,9 +297,12 @@ static uint64_t get_sbad(AVMotionEstContext *me_ctx, int x, int y, int x_mv, int
     data_cur += (y + mv_y) * linesize;
     data_next += (y - mv_y) * linesize;
 
-    for (j = 0; j < me_ctx->mb_size; j++)
-        for (i = 0; i < me_ctx->mb_size; i++)
-            sbad += FFABS(data_cur[x + mv_x + i + j * linesize] - data_next[x - mv_x + i + j * linesize]);
+    if (sad_fn)
+        sbad = sad_fn(data_cur + x + mv_x, linesize, data_next + x - mv_x, linesize);
+    else
+        for (j = 0; j < me_ctx->mb_size; j++)
+            for (i = 0; i < me_ctx->mb_size; i++)
+                sbad += FFABS(data_cur[x + mv_x + i + j * linesize] - data_next[x - mv_x + i + j * linesize]);
 
     return sbad + (FFABS(mv_x1 - me_ctx->pred_x) + FFABS(mv_y1 - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
@@ -291,7 +318,9 @@ static uint64_t get_sbad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv,
     int y_max = me_ctx->y_max - me_ctx->mb_size / 2;
     int mv_x1 = x_mv - x;
     int mv_y1 = y_mv - y;
+    int ob = me_ctx->mb_size / 2;
     int mv_x, mv_y, i, j;
+    av_pixelutils_sad_fn sad_fn = ff_me_get_sad_fn(me_ctx, me_ctx->mb_size * 3 / 2 + ob);
     uint64_t sbad = 0;
 
     x = av_clip(x, x_min, x_max);
@@ -299,9 +328,13 @@ static uint64_t get_sbad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv,
     mv_x = av_clip(x_mv - x, -FFMIN(x - x_min, x_max - x), FFMIN(x - x_min, x_max - x));
     mv_y = av_clip(y_mv - y, -FFMIN(y - y_min, y_max - y), FFMIN(y - y_min, y_max - y));
 
-    for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
-        for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
-            sbad += FFABS(data_cur[x + mv_x + i + (y + mv_y + j) * linesize] - data_next[x - mv_x + i + (y - mv_y + j) * linesize]);
+    if (sad_fn)
+        sbad = sad_fn(data_cur  + x + mv_x - ob + (y + mv_y - ob) * linesize, linesize,
+                      data_next + x - mv_x - ob + (y - mv_y - ob) * linesize, linesize);
+    else
+        for (j = -ob; j < me_ctx->mb_size * 3 / 2; j++)
+            for (i = -ob; i < me_ctx->mb_size * 3 / 2; i++)
+                sbad += FFABS(data_cur[x + mv_x + i + (y + mv_y + j) * linesize] - data_next[x - mv_x + i + (y - mv_y + j) * linesize]);
 
     return sbad + (FFABS(mv_x1 - me_ctx->pred_x) + FFABS(mv_y1 - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
@@ -315,9 +348,11 @@ static uint64_t get_sad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv, i
     int x_max = me_ctx->x_max - me_ctx->mb_size / 2;
     int y_min = me_ctx->y_min + me_ctx->mb_size / 2;
     int y_max = me_ctx->y_max - me_ctx->mb_size / 2;
+    int ob = me_ctx->mb_size / 2;
     int mv_x = x_mv - x;
     int mv_y = y_mv - y;
     int i, j;
+    av_pixelutils_sad_fn sad_fn = ff_me_get_sad_fn(me_ctx, me_ctx->mb_size * 3 / 2 + ob);
     uint64_t sad = 0;
 
     x = av_clip(x, x_min, x_max);
@@ -325,9 +360,13 @@ static uint64_t get_sad_ob(AVMotionEstContext *me_ctx, int x, int y, int x_mv, i
     x_mv = av_clip(x_mv, x_min, x_max);
     y_mv = av_clip(y_mv, y_min, y_max);
 
-    for (j = -me_ctx->mb_size / 2; j < me_ctx->mb_size * 3 / 2; j++)
-        for (i = -me_ctx->mb_size / 2; i < me_ctx->mb_size * 3 / 2; i++)
-            sad += FFABS(data_ref[x_mv + i + (y_mv + j) * linesize] - data_cur[x + i + (y + j) * linesize]);
+    if (sad_fn)
+        sad = sad_fn(data_ref + x_mv - ob + (y_mv - ob) * linesize, linesize,
+                     data_cur + x    - ob + (y    - ob) * linesize, linesize);
+    else
+        for (j = -ob; j < me_ctx->mb_size * 3 / 2; j++)
+            for (i = -ob; i < me_ctx->mb_size * 3 / 2; i++)
+                sad += FFABS(data_ref[x_mv + i + (y_mv + j) * linesize] - data_cur[x + i + (y + j) * linesize]);
 
     return sad + (FFABS(mv_x - me_ctx->pred_x) + FFABS(mv_y - me_ctx->pred_y)) * COST_PRED_SCALE;
 }
@@ -373,6 +412,23 @@ static int config_input(AVFilterLink *inlink)
             if (!(mi_ctx->int_blocks = av_mallocz_array(mi_ctx->b_count, sizeof(Block))))
                 return AVERROR(ENOMEM);
 
+        if (!(mi_ctx->row_progress = av_malloc_array(mi_ctx->b_height, sizeof(*mi_ctx->row_progress))))
+            return AVERROR(ENOMEM);
+#if HAVE_THREADS
+        mi_ctx->progress_mutex = av_malloc_array(mi_ctx->b_height, sizeof(*mi_ctx->progress_mutex));
+        mi_ctx->progress_cond  = av_malloc_array(mi_ctx->b_height, sizeof(*mi_ctx->progress_cond));
+        if (!mi_ctx->progress_mutex || !mi_ctx->progress_cond)
+            return AVERROR(ENOMEM);
+        for (; mi_ctx->nb_progress_locks < mi_ctx->b_height; mi_ctx->nb_progress_locks++) {
+            if (pthread_mutex_init(&mi_ctx->progress_mutex[mi_ctx->nb_progress_locks], NULL))
+                return AVERROR(ENOMEM);
+            if (pthread_cond_init(&mi_ctx->progress_cond[mi_ctx->nb_progress_locks], NULL)) {
+                pthread_mutex_destroy(&mi_ctx->progress_mutex[mi_ctx->nb_progress_locks]);
+                return AVERROR(ENOMEM);
+            }
+        }
+#endif
+
         if (mi_ctx->me_method == AV_ME_METHOD_EPZS) {
             for (i = 0; i < 3; i++) {
                 mi_ctx->mv_table[i] = av_mallocz_array(mi_ctx->b_count, sizeof(*mi_ctx->mv_table[0]));
@@ -422,9 +478,8 @@ static int config_output(AVFilterLink *outlink)
         preds.nb++;\
     } while(0)
 
-static void search_mv(MIContext *mi_ctx, Block *blocks, int mb_x, int mb_y, int dir)
+static void search_mv(MIContext *mi_ctx, AVMotionEstContext *me_ctx, Block *blocks, int mb_x, int mb_y, int dir)
 {
-    AVMotionEstContext *me_ctx = &mi_ctx->me_ctx;
     AVMotionEstPredictor *preds = me_ctx->preds;
     Block *block = &blocks[mb_x + mb_y * mi_ctx->b_width];
 
@@ -564,8 +619,90 @@ static void search_mv(MIContext *mi_ctx, Block *blocks, int mb_x, int mb_y, int
     block->mvs[dir][1] = mv[1] - y_mb;
 }
 
-static void bilateral_me(MIContext *mi_ctx)
+static void await_row(MIContext *mi_ctx, int mb_y, int needed)
+{
+    if (atomic_load_explicit(&mi_ctx->row_progress[mb_y], memory_order_acquire) >= needed)
+        return;
+#if HAVE_THREADS
+    pthread_mutex_lock(&mi_ctx->progress_mutex[mb_y]);
+    while (atomic_load_explicit(&mi_ctx->row_progress[mb_y], memory_order_acquire) < needed)
+        pthread_cond_wait(&mi_ctx->progress_cond[mb_y], &mi_ctx->progress_mutex[mb_y]);
+    pthread_mutex_unlock(&mi_ctx->progress_mutex[mb_y]);
+#endif
+}
+
+static void report_row(MIContext *mi_ctx, int mb_y, int progress)
+{
+#if HAVE_THREADS
+    pthread_mutex_lock(&mi_ctx->progress_mutex[mb_y]);
+    atomic_store_explicit(&mi_ctx->row_progress[mb_y], progress, memory_order_release);
+    pthread_cond_signal(&mi_ctx->progress_cond[mb_y]);
+    pthread_mutex_unlock(&mi_ctx->progress_mutex[mb_y]);
+#else
+    atomic_store_explicit(&mi_ctx->row_progress[mb_y], progress, memory_order_release);
+#endif
+}
+
+static int search_mv_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MIContext *mi_ctx = ctx->priv;
+    SearchThreadData *td = arg;
+    AVMotionEstContext me_ctx = mi_ctx->me_ctx;
+    const int wavefront = mi_ctx->me_method == AV_ME_METHOD_EPZS ||
+                          mi_ctx->me_method == AV_ME_METHOD_UMH;
+    int mb_x, mb_y;
+
+    /* Rows are handed out in order, so the row above the current one is
+     * always being searched already and waiting for it cannot deadlock. */
+    while ((mb_y = atomic_fetch_add_explicit(&td->next_row, 1, memory_order_relaxed)) < mi_ctx->b_height) {
+        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
+            /* the predictors use the left, top and top-right blocks */
+            if (wavefront && mb_y > 0)
+                await_row(mi_ctx, mb_y - 1, FFMIN(mb_x + 2, mi_ctx->b_width));
+
+            search_mv(mi_ctx, &me_ctx, td->blocks, mb_x, mb_y, td->dir);
+
+            /* report in batches of blocks, not to lock for each of them */
+            if (wavefront && ((mb_x + 1) % PROGRESS_BLOCKS == 0 ||
+                              mb_x + 1 == mi_ctx->b_width))
+                report_row(mi_ctx, mb_y, mb_x + 1);
+        }
+
+        if (mb_y == mi_ctx->b_height - 1) {
+            td->pred_x = me_ctx.pred_x;
+            td->pred_y = me_ctx.pred_y;
+        }
+    }
+
+    emms_c();
+    return 0;
+}
+
+static void search_mvs(AVFilterContext *ctx, Block *blocks, int dir)
+{
+    MIContext *mi_ctx = ctx->priv;
+    SearchThreadData td;
+    int i;
+
+    td.blocks = blocks;
+    td.dir    = dir;
+    td.pred_x = mi_ctx->me_ctx.pred_x;
+    td.pred_y = mi_ctx->me_ctx.pred_y;
+    atomic_init(&td.next_row, 0);
+    for (i = 0; i < mi_ctx->b_height; i++)
+        atomic_store_explicit(&mi_ctx->row_progress[i], 0, memory_order_relaxed);
+
+    ctx->internal->execute(ctx, search_mv_slice, &td, NULL,
+                           FFMIN(mi_ctx->b_height, ff_filter_get_nb_threads(ctx)));
+
+    /* the cost functions keep using the predictor of the last block */
+    mi_ctx->me_ctx.pred_x = td.pred_x;
+    mi_ctx->me_ctx.pred_y = td.pred_y;
+}
+
+static void bilateral_me(AVFilterContext *ctx)
 {
+    MIContext *mi_ctx = ctx->priv;
     Block *block;
     int mb_x, mb_y;
 
@@ -580,9 +717,7 @@ static void bilateral_me(MIContext *mi_ctx)
             block->mvs[0][1] = 0;
         }
 
-    for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++)
-            search_mv(mi_ctx, mi_ctx->int_blocks, mb_x, mb_y, 0);
+    search_mvs(ctx, mi_ctx->int_blocks, 0);
 }
 
 static int var_size_bme(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n)
@@ -765,9 +900,7 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
                     mi_ctx->me_ctx.data_cur = mi_ctx->frames[2].avf->data[0];
                     mi_ctx->me_ctx.data_ref = mi_ctx->frames[dir ? 3 : 1].avf->data[0];
 
-                    for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-                        for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++)
-                            search_mv(mi_ctx, mi_ctx->frames[2].blocks, mb_x, mb_y, dir);
+                    search_mvs(ctx, mi_ctx->frames[2].blocks, dir);
                 }
             }
 
@@ -782,7 +915,7 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
             mi_ctx->me_ctx.data_cur = mi_ctx->frames[1].avf->data[0];
             mi_ctx->me_ctx.data_ref = mi_ctx->frames[2].avf->data[0];
 
-            bilateral_me(mi_ctx);
+            bilateral_me(ctx);
 
             if (mi_ctx->mc_mode == MC_MODE_AOBMC) {
 
@@ -817,6 +950,7 @@ static int inject_frame(AVFilterLink *inlink, AVFrame *avf_in)
                 if (ret = cluster_mvs(mi_ctx))
                     return ret;
             }
+            emms_c();
         }
     }
 
@@ -867,17 +1001,13 @@ static int detect_scene_change(MIContext *mi_ctx)
         pixel_refs->nb++;\
     } while(0)
 
-static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
+static void bidirectional_obmc(MIContext *mi_ctx, int alpha, int slice_start, int slice_end)
 {
     int x, y;
     int width = mi_ctx->frames[0].avf->width;
     int height = mi_ctx->frames[0].avf->height;
     int mb_y, mb_x, dir;
 
-    for (y = 0; y < height; y++)
-        for (x = 0; x < width; x++)
-            mi_ctx->pixel_refs[x + y * width].nb = 0;
-
     for (dir = 0; dir < 2; dir++)
         for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
             for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
@@ -895,6 +1025,9 @@ static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
                 endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
                 endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
 
+                startc_y = FFMAX(startc_y, slice_start);
+                endc_y = FFMIN(endc_y, slice_end);
+
                 if (dir) {
                     mv_x = -mv_x;
                     mv_y = -mv_y;
@@ -917,16 +1050,15 @@ static void bidirectional_obmc(MIContext *mi_ctx, int alpha)
             }
 }
 
-static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
+static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out, int slice_start, int slice_end)
 {
     int x, y, plane;
 
     for (plane = 0; plane < mi_ctx->nb_planes; plane++) {
         int width = avf_out->width;
-        int height = avf_out->height;
         int chroma = plane == 1 || plane == 2;
 
-        for (y = 0; y < height; y++)
+        for (y = slice_start; y < slice_end; y++)
             for (x = 0; x < width; x++) {
                 int x_mv, y_mv;
                 int weight_sum = 0;
@@ -975,7 +1107,8 @@ static void set_frame_data(MIContext *mi_ctx, int alpha, AVFrame *avf_out)
     }
 }
 
-static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n, int alpha)
+static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, int n, int alpha,
+                         int slice_start, int slice_end)
 {
     int sb_x, sb_y;
     int width = mi_ctx->frames[0].avf->width;
@@ -986,7 +1119,8 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
             Block *sb = &block->subs[sb_x + sb_y * 2];
 
             if (sb->sb)
-                var_size_bmc(mi_ctx, sb, x_mb + (sb_x << (n - 1)), y_mb + (sb_y << (n - 1)), n - 1, alpha);
+                var_size_bmc(mi_ctx, sb, x_mb + (sb_x << (n - 1)), y_mb + (sb_y << (n - 1)), n - 1, alpha,
+                             slice_start, slice_end);
             else {
                 int x, y;
                 int mv_x = sb->mvs[0][0] * 2;
@@ -997,6 +1131,9 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
                 int end_x = start_x + (1 << (n - 1));
                 int end_y = start_y + (1 << (n - 1));
 
+                start_y = FFMAX(start_y, slice_start);
+                end_y = FFMIN(end_y, slice_end);
+
                 for (y = start_y; y < end_y; y++)  {
                     int y_min = -y;
                     int y_max = height - y - 1;
@@ -1014,7 +1151,8 @@ static void var_size_bmc(MIContext *mi_ctx, Block *block, int x_mb, int y_mb, in
         }
 }
 
-static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y, int alpha)
+static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y, int alpha,
+                           int slice_start, int slice_end)
 {
     int x, y;
     int width = mi_ctx->frames[0].avf->width;
@@ -1029,6 +1167,19 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
     int start_x, start_y;
     int startc_x, startc_y, endc_x, endc_y;
 
+    start_x = (mb_x << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
+    start_y = (mb_y << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
+
+    startc_x = av_clip(start_x, 0, width - 1);
+    startc_y = av_clip(start_y, 0, height - 1);
+    endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
+    endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
+
+    startc_y = FFMAX(startc_y, slice_start);
+    endc_y = FFMIN(endc_y, slice_end);
+    if (startc_y >= endc_y)
+        return;
+
     if (mi_ctx->mc_mode == MC_MODE_AOBMC)
         for (nb_y = FFMAX(0, mb_y - 1); nb_y < FFMIN(mb_y + 2, mi_ctx->b_height); nb_y++)
             for (nb_x = FFMAX(0, mb_x - 1); nb_x < FFMIN(mb_x + 2, mi_ctx->b_width); nb_x++) {
@@ -1039,14 +1190,6 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
                     sbads[nb_x - mb_x + 1 + (nb_y - mb_y + 1) * 3] = get_sbad(&mi_ctx->me_ctx, x_nb, y_nb, x_nb + block->mvs[0][0], y_nb + block->mvs[0][1]);
             }
 
-    start_x = (mb_x << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
-    start_y = (mb_y << mi_ctx->log2_mb_size) - mi_ctx->mb_size / 2;
-
-    startc_x = av_clip(start_x, 0, width - 1);
-    startc_y = av_clip(start_y, 0, height - 1);
-    endc_x = av_clip(start_x + (2 << mi_ctx->log2_mb_size), 0, width - 1);
-    endc_y = av_clip(start_y + (2 << mi_ctx->log2_mb_size), 0, height - 1);
-
     for (y = startc_y; y < endc_y; y++) {
         int y_min = -y;
         int y_max = height - y - 1;
@@ -1078,13 +1221,87 @@ static void bilateral_obmc(MIContext *mi_ctx, Block *block, int mb_x, int mb_y,
     }
 }
 
+static int blend_frames_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MIContext *mi_ctx = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *avf_out = td->out;
+    int alpha = td->alpha;
+    int x, y, plane;
+
+    for (plane = 0; plane < mi_ctx->nb_planes; plane++) {
+        int width = avf_out->width;
+        int height = avf_out->height;
+        int slice_start, slice_end;
+
+        if (plane == 1 || plane == 2) {
+            width = AV_CEIL_RSHIFT(width, mi_ctx->log2_chroma_w);
+            height = AV_CEIL_RSHIFT(height, mi_ctx->log2_chroma_h);
+        }
+
+        slice_start = (height * jobnr) / nb_jobs;
+        slice_end = (height * (jobnr + 1)) / nb_jobs;
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++) {
+                avf_out->data[plane][x + y * avf_out->linesize[plane]] =
+                    (alpha  * mi_ctx->frames[2].avf->data[plane][x + y * mi_ctx->frames[2].avf->linesize[plane]] +
+                     (ALPHA_MAX - alpha) * mi_ctx->frames[1].avf->data[plane][x + y * mi_ctx->frames[1].avf->linesize[plane]] + 512) >> 10;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mci_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MIContext *mi_ctx = ctx->priv;
+    ThreadData *td = arg;
+    const int width = td->out->width;
+    const int height = td->out->height;
+    /* the chroma samples are written from every luma row covering them,
+     * so the slices must not split them */
+    const int slice_start = (height * jobnr / nb_jobs) >> mi_ctx->log2_chroma_h << mi_ctx->log2_chroma_h;
+    const int slice_end = jobnr == nb_jobs - 1 ? height :
+                          (height * (jobnr + 1) / nb_jobs) >> mi_ctx->log2_chroma_h << mi_ctx->log2_chroma_h;
+    int x, y;
+
+    for (y = slice_start; y < slice_end; y++)
+        for (x = 0; x < width; x++)
+            mi_ctx->pixel_refs[x + y * width].nb = 0;
+
+    if (mi_ctx->me_mode == ME_MODE_BIDIR) {
+        bidirectional_obmc(mi_ctx, td->alpha, slice_start, slice_end);
+    } else if (mi_ctx->me_mode == ME_MODE_BILAT) {
+        int mb_x, mb_y;
+        Block *block;
+
+        for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
+            for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
+                block = &mi_ctx->int_blocks[mb_x + mb_y * mi_ctx->b_width];
+
+                if (block->sb)
+                    var_size_bmc(mi_ctx, block, mb_x << mi_ctx->log2_mb_size, mb_y << mi_ctx->log2_mb_size, mi_ctx->log2_mb_size, td->alpha,
+                                 slice_start, slice_end);
+
+                bilateral_obmc(mi_ctx, block, mb_x, mb_y, td->alpha, slice_start, slice_end);
+            }
+    }
+
+    set_frame_data(mi_ctx, td->alpha, td->out, slice_start, slice_end);
+
+    emms_c();
+    return 0;
+}
+
 static void interpolate(AVFilterLink *inlink, AVFrame *avf_out)
 {
     AVFilterContext *ctx = inlink->dst;
     AVFilterLink *outlink = ctx->outputs[0];
     MIContext *mi_ctx = ctx->priv;
-    int x, y;
-    int plane, alpha;
+    ThreadData td;
+    int alpha;
     int64_t pts;
 
     pts = av_rescale(avf_out->pts, (int64_t) ALPHA_MAX * outlink->time_base.num * inlink->time_base.den,
@@ -1104,57 +1321,22 @@ static void interpolate(AVFilterLink *inlink, AVFrame *avf_out)
         return;
     }
 
+    td.out   = avf_out;
+    td.alpha = alpha;
+
     switch(mi_ctx->mi_mode) {
         case MI_MODE_DUP:
             av_frame_copy(avf_out, alpha > ALPHA_MAX / 2 ? mi_ctx->frames[2].avf : mi_ctx->frames[1].avf);
 
             break;
         case MI_MODE_BLEND:
-            for (plane = 0; plane < mi_ctx->nb_planes; plane++) {
-                int width = avf_out->width;
-                int height = avf_out->height;
-
-                if (plane == 1 || plane == 2) {
-                    width = AV_CEIL_RSHIFT(width, mi_ctx->log2_chroma_w);
-                    height = AV_CEIL_RSHIFT(height, mi_ctx->log2_chroma_h);
-                }
-
-                for (y = 0; y < height; y++) {
-                    for (x = 0; x < width; x++) {
-                        avf_out->data[plane][x + y * avf_out->linesize[plane]] =
-                            (alpha  * mi_ctx->frames[2].avf->data[plane][x + y * mi_ctx->frames[2].avf->linesize[plane]] +
-                             (ALPHA_MAX - alpha) * mi_ctx->frames[1].avf->data[plane][x + y * mi_ctx->frames[1].avf->linesize[plane]] + 512) >> 10;
-                    }
-                }
-            }
+            ctx->internal->execute(ctx, blend_frames_slice, &td, NULL,
+                                   FFMIN(avf_out->height, ff_filter_get_nb_threads(ctx)));
 
             break;
         case MI_MODE_MCI:
-            if (mi_ctx->me_mode == ME_MODE_BIDIR) {
-                bidirectional_obmc(mi_ctx, alpha);
-                set_frame_data(mi_ctx, alpha, avf_out);
-
-            } else if (mi_ctx->me_mode == ME_MODE_BILAT) {
-                int mb_x, mb_y;
-                Block *block;
-
-                for (y = 0; y < mi_ctx->frames[0].avf->height; y++)
-                    for (x = 0; x < mi_ctx->frames[0].avf->width; x++)
-                        mi_ctx->pixel_refs[x + y * mi_ctx->frames[0].avf->width].nb = 0;
-
-                for (mb_y = 0; mb_y < mi_ctx->b_height; mb_y++)
-                    for (mb_x = 0; mb_x < mi_ctx->b_width; mb_x++) {
-                        block = &mi_ctx->int_blocks[mb_x + mb_y * mi_ctx->b_width];
-
-                        if (block->sb)
-                            var_size_bmc(mi_ctx, block, mb_x << mi_ctx->log2_mb_size, mb_y << mi_ctx->log2_mb_size, mi_ctx->log2_mb_size, alpha);
-
-                        bilateral_obmc(mi_ctx, block, mb_x, mb_y, alpha);
-
-                    }
-
-                set_frame_data(mi_ctx, alpha, avf_out);
-            }
+            ctx->internal->execute(ctx, mci_slice, &td, NULL,
+                                   FFMIN(avf_out->height, ff_filter_get_nb_threads(ctx)));
 
             break;
     }
@@ -1226,6 +1408,16 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&mi_ctx->pixel_mvs);
     av_freep(&mi_ctx->pixel_weights);
     av_freep(&mi_ctx->pixel_refs);
+    av_freep(&mi_ctx->row_progress);
+#if HAVE_THREADS
+    for (i = 0; i < mi_ctx->nb_progress_locks; i++) {
+        pthread_mutex_destroy(&mi_ctx->progress_mutex[i]);
+        pthread_cond_destroy(&mi_ctx->progress_cond[i]);
+    }
+    mi_ctx->nb_progress_locks = 0;
+    av_freep(&mi_ctx->progress_mutex);
+    av_freep(&mi_ctx->progress_cond);
+#endif
     if (mi_ctx->int_blocks)
         for (m = 0; m < mi_ctx->b_count; m++)
             free_blocks(&mi_ctx->int_blocks[m], 0);
@@ -1269,4 +1461,5 @@ AVFilter ff_vf_minterpolate = {
     .query_formats = query_formats,
     .inputs        = minterpolate_inputs,
     .outputs       = minterpolate_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -30,6 +30,7 @@
 #include "formats.h"
 #include "internal.h"
 #include "video.h"
+#include "vf_nnedi.h"
 
 typedef struct FrameData {
     uint8_t *paddedp[3];
@@ -45,6 +46,7 @@ typedef struct FrameData {
     int32_t *lcount[3];
     float *input;
     float *temp;
+    int temp_size;
 } FrameData;
 
 typedef struct NNEDIContext {
@@ -59,6 +61,8 @@ typedef struct NNEDIContext {
     int64_t cur_pts;
 
     AVFloatDSPContext *fdsp;
+    NNEDIDSPContext dsp;
+    int nb_threads;
     int nb_planes;
     int linesize[4];
     int planeheight[4];
@@ -84,8 +88,8 @@ typedef struct NNEDIContext {
     int max_value;
 
     void (*copy_pad)(const AVFrame *, FrameData *, struct NNEDIContext *, int);
-    void (*evalfunc_0)(struct NNEDIContext *, FrameData *);
-    void (*evalfunc_1)(struct NNEDIContext *, FrameData *);
+    void (*evalfunc_0)(struct NNEDIContext *, FrameData *, int, float *, float *, int, int);
+    void (*evalfunc_1)(struct NNEDIContext *, FrameData *, int, float *, float *, int, int);
 
     // Functions used in evalfunc_0
     void (*readpixels)(const uint8_t *, const int, float *);
@@ -94,7 +98,6 @@ typedef struct NNEDIContext {
 
     // Functions used in evalfunc_1
     void (*extract)(const uint8_t *, const int, const int, const int, float *, float *);
-    void (*dot_prod)(struct NNEDIContext *, const float *, const float *, float *, const int, const int, const float *);
     void (*expfunc)(float *, const int);
     void (*wae5)(const float *, const int, float *);
 
@@ -151,6 +154,7 @@ static int config_input(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
     NNEDIContext *s = ctx->priv;
+    FrameData *frame_data = &s->frame_data;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
     int ret;
 
@@ -161,6 +165,19 @@ static int config_input(AVFilterLink *inlink)
     s->planeheight[1] = s->planeheight[2] = AV_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h);
     s->planeheight[0] = s->planeheight[3] = inlink->h;
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+
+    // Every slice job gets its own input and temp buffers.
+    // evalfunc_0 requires at least padded_width[0] bytes of temp.
+    // evalfunc_1 requires at least 512 floats of both.
+    av_freep(&frame_data->input);
+    av_freep(&frame_data->temp);
+    frame_data->temp_size = FFALIGN(FFMAX(s->linesize[0] + 64, 512 * sizeof(float)), 64);
+    frame_data->input = av_malloc_array(s->nb_threads, 512 * sizeof(float));
+    frame_data->temp = av_malloc_array(s->nb_threads, frame_data->temp_size);
+    if (!frame_data->input || !frame_data->temp)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
@@ -278,11 +295,23 @@ static void dot_prod(NNEDIContext *s, const float *data, const float *weights, f
     }
 }
 
-static void dot_prods(NNEDIContext *s, const float *dataf, const float *weightsf, float *vals, const int n, const int len, const float *scale)
+static void dot_prods_c(const float *data, const float *weights, float *vals, int n, int len, const float *scale)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        float sum = 0.0f;
+
+        for (j = 0; j < len; j++)
+            sum += data[j] * weights[i * len + j];
+
+        vals[i] = sum * scale[0] + weights[n * len + i];
+    }
+}
+
+static void dot_prods_i16_c(const int16_t *data, const int16_t *weights, float *vals, int n, int len, const float *scale)
 {
-    const int16_t *data = (int16_t *)dataf;
-    const int16_t *weights = (int16_t *)weightsf;
-    const float *wf = (float *)&weights[n * len];
+    const float *wf = (const float *)&weights[n * len];
     int i, j;
 
     for (i = 0; i < n; i++) {
@@ -298,7 +327,7 @@ static void compute_network0(NNEDIContext *s, const float *input, const float *w
 {
     float t, temp[12], scale = 1.0f;
 
-    dot_prod(s, input, weights, temp, 4, 48, &scale);
+    s->dsp.dot_prods(input, weights, temp, 4, 48, &scale);
     t = temp[0];
     elliott(temp, 4);
     temp[0] = t;
@@ -316,7 +345,7 @@ static void compute_network0_i16(NNEDIContext *s, const float *inputf, const flo
     const float *wf = weightsf + 2 * 48;
     float t, temp[12], scale = 1.0f;
 
-    dot_prods(s, inputf, weightsf, temp, 4, 48, &scale);
+    s->dsp.dot_prods_i16((const int16_t *)inputf, (const int16_t *)weightsf, temp, 4, 48, &scale);
     t = temp[0];
     elliott(temp, 4);
     temp[0] = t;
@@ -382,21 +411,13 @@ static void byte2word64(const uint8_t *t, const int pitch, float *p)
 
 static void compute_network0new(NNEDIContext *s, const float *datai, const float *weights, uint8_t *d)
 {
-    int16_t *data = (int16_t *)datai;
-    int16_t *ws = (int16_t *)weights;
-    float *wf = (float *)&ws[4 * 64];
-    float vals[8];
+    const int16_t *ws = (const int16_t *)weights;
+    const float *wf = (const float *)&ws[4 * 64];
+    float vals[8], scale = 1.0f;
     int mask, i, j;
 
-    for (i = 0; i < 4; i++) {
-        int sum = 0;
-        float t;
-
-        for (j = 0; j < 64; j++)
-            sum += data[j] * ws[(i << 3) + ((j >> 3) << 5) + (j & 7)];
-        t = sum * wf[i] + wf[4 + i];
-        vals[i] = t / (1.0f + FFABS(t));
-    }
+    s->dsp.dot_prods_i16((const int16_t *)datai, ws, vals, 4, 64, &scale);
+    elliott(vals, 4);
 
     for (i = 0; i < 4; i++) {
         float sum = 0.0f;
@@ -415,71 +436,62 @@ static void compute_network0new(NNEDIContext *s, const float *datai, const float
     ((int *)d)[0] = mask;
 }
 
-static void evalfunc_0(NNEDIContext *s, FrameData *frame_data)
+static void evalfunc_0(NNEDIContext *s, FrameData *frame_data, int plane,
+                       float *input, float *temp, int slice_start, int slice_end)
 {
-    float *input = frame_data->input;
     const float *weights0 = s->weights0;
-    float *temp = frame_data->temp;
     uint8_t *tempu = (uint8_t *)temp;
-    int plane, x, y;
+    int x, y;
 
-    // And now the actual work.
-    for (plane = 0; plane < s->nb_planes; plane++) {
-        const uint8_t *srcp = (const uint8_t *)frame_data->paddedp[plane];
-        const int src_stride = frame_data->padded_stride[plane] / sizeof(uint8_t);
+    const uint8_t *srcp = (const uint8_t *)frame_data->paddedp[plane];
+    const int src_stride = frame_data->padded_stride[plane] / sizeof(uint8_t);
 
-        const int width = frame_data->padded_width[plane];
-        const int height = frame_data->padded_height[plane];
+    const int width = frame_data->padded_width[plane];
 
-        uint8_t *dstp = (uint8_t *)frame_data->dstp[plane];
-        const int dst_stride = frame_data->dst_stride[plane] / sizeof(uint8_t);
-        const uint8_t *src3p;
-        int ystart, ystop;
-        int32_t *lcount;
+    uint8_t *dstp = (uint8_t *)frame_data->dstp[plane];
+    const int dst_stride = frame_data->dst_stride[plane] / sizeof(uint8_t);
+    const uint8_t *src3p;
+    int ystart, ystop;
+    int32_t *lcount;
 
-        if (!(s->process_plane & (1 << plane)))
-            continue;
-
-        for (y = 1 - frame_data->field[plane]; y < height - 12; y += 2) {
-            memcpy(dstp + y * dst_stride,
-                   srcp + 32 + (6 + y) * src_stride,
-                   (width - 64) * sizeof(uint8_t));
+    for (y = slice_start + 1 - frame_data->field[plane]; y < slice_end; y += 2) {
+        memcpy(dstp + y * dst_stride,
+               srcp + 32 + (6 + y) * src_stride,
+               (width - 64) * sizeof(uint8_t));
+    }
 
-        }
+    ystart = 6 + slice_start + frame_data->field[plane];
+    ystop = 6 + slice_end;
+    srcp += ystart * src_stride;
+    dstp += (ystart - 6) * dst_stride - 32;
+    src3p = srcp - src_stride * 3;
+    lcount = frame_data->lcount[plane] - 6;
 
-        ystart = 6 + frame_data->field[plane];
-        ystop = height - 6;
-        srcp += ystart * src_stride;
-        dstp += (ystart - 6) * dst_stride - 32;
-        src3p = srcp - src_stride * 3;
-        lcount = frame_data->lcount[plane] - 6;
-
-        if (s->pscrn == 1) { // original
-            for (y = ystart; y < ystop; y += 2) {
-                for (x = 32; x < width - 32; x++) {
-                    s->readpixels((const uint8_t *)(src3p + x - 5), src_stride, input);
-                    s->compute_network0(s, input, weights0, tempu+x);
-                }
-                lcount[y] += s->process_line0(tempu + 32, width - 64, (uint8_t *)(dstp + 32), (const uint8_t *)(src3p + 32), src_stride, s->max_value, plane);
-                src3p += src_stride * 2;
-                dstp += dst_stride * 2;
-            }
-        } else if (s->pscrn > 1) { // new
-            for (y = ystart; y < ystop; y += 2) {
-                for (x = 32; x < width - 32; x += 4) {
-                    s->readpixels((const uint8_t *)(src3p + x - 6), src_stride, input);
-                    s->compute_network0(s, input, weights0, tempu + x);
-                }
-                lcount[y] += s->process_line0(tempu + 32, width - 64, (uint8_t *)(dstp + 32), (const uint8_t *)(src3p + 32), src_stride, s->max_value, plane);
-                src3p += src_stride * 2;
-                dstp += dst_stride * 2;
+    if (s->pscrn == 1) { // original
+        for (y = ystart; y < ystop; y += 2) {
+            for (x = 32; x < width - 32; x++) {
+                s->readpixels((const uint8_t *)(src3p + x - 5), src_stride, input);
+                s->compute_network0(s, input, weights0, tempu+x);
             }
-        } else { // no prescreening
-            for (y = ystart; y < ystop; y += 2) {
-                memset(dstp + 32, 255, (width - 64) * sizeof(uint8_t));
-                lcount[y] += width - 64;
-                dstp += dst_stride * 2;
+            lcount[y] += s->process_line0(tempu + 32, width - 64, (uint8_t *)(dstp + 32), (const uint8_t *)(src3p + 32), src_stride, s->max_value, plane);
+            src3p += src_stride * 2;
+            dstp += dst_stride * 2;
+        }
+    } else if (s->pscrn > 1) { // new
+        for (y = ystart; y < ystop; y += 2) {
+            for (x = 32; x < width - 32; x += 4) {
+                s->readpixels((const uint8_t *)(src3p + x - 6), src_stride, input);
+                s->compute_network0(s, input, weights0, tempu + x);
             }
+            lcount[y] += s->process_line0(tempu + 32, width - 64, (uint8_t *)(dstp + 32), (const uint8_t *)(src3p + 32), src_stride, s->max_value, plane);
+            src3p += src_stride * 2;
+            dstp += dst_stride * 2;
+        }
+    } else { // no prescreening
+        for (y = ystart; y < ystop; y += 2) {
+            memset(dstp + 32, 255, (width - 64) * sizeof(uint8_t));
+            lcount[y] += width - 64;
+            dstp += dst_stride * 2;
         }
     }
 }
@@ -575,10 +587,9 @@ static void weighted_avg_elliott_mul5_m16(const float *w, const int n, float *ms
 }
 
 
-static void evalfunc_1(NNEDIContext *s, FrameData *frame_data)
+static void evalfunc_1(NNEDIContext *s, FrameData *frame_data, int plane,
+                       float *input, float *temp, int slice_start, int slice_end)
 {
-    float *input = frame_data->input;
-    float *temp = frame_data->temp;
     float **weights1 = s->weights1;
     const int qual = s->qual;
     const int asize = s->asize;
@@ -587,48 +598,45 @@ static void evalfunc_1(NNEDIContext *s, FrameData *frame_data)
     const int xdiad2m1 = (xdia / 2) - 1;
     const int ydia = s->ydia;
     const float scale = 1.0f / (float)qual;
-    int plane, y, x, i;
+    int y, x, i;
 
-    for (plane = 0; plane < s->nb_planes; plane++) {
-        const uint8_t *srcp = (const uint8_t *)frame_data->paddedp[plane];
-        const int src_stride = frame_data->padded_stride[plane] / sizeof(uint8_t);
+    const uint8_t *srcp = (const uint8_t *)frame_data->paddedp[plane];
+    const int src_stride = frame_data->padded_stride[plane] / sizeof(uint8_t);
 
-        const int width = frame_data->padded_width[plane];
-        const int height = frame_data->padded_height[plane];
+    const int width = frame_data->padded_width[plane];
 
-        uint8_t *dstp = (uint8_t *)frame_data->dstp[plane];
-        const int dst_stride = frame_data->dst_stride[plane] / sizeof(uint8_t);
+    uint8_t *dstp = (uint8_t *)frame_data->dstp[plane];
+    const int dst_stride = frame_data->dst_stride[plane] / sizeof(uint8_t);
 
-        const int ystart = frame_data->field[plane];
-        const int ystop = height - 12;
-        const uint8_t *srcpp;
+    const int ystart = slice_start + frame_data->field[plane];
+    const int ystop = slice_end;
+    const uint8_t *srcpp;
 
-        if (!(s->process_plane & (1 << plane)))
-            continue;
+    srcp += (ystart + 6) * src_stride;
+    dstp += ystart * dst_stride - 32;
+    srcpp = srcp - (ydia - 1) * src_stride - xdiad2m1;
 
-        srcp += (ystart + 6) * src_stride;
-        dstp += ystart * dst_stride - 32;
-        srcpp = srcp - (ydia - 1) * src_stride - xdiad2m1;
+    for (y = ystart; y < ystop; y += 2) {
+        for (x = 32; x < width - 32; x++) {
+            float mstd[4];
 
-        for (y = ystart; y < ystop; y += 2) {
-            for (x = 32; x < width - 32; x++) {
-                float mstd[4];
-
-                if (dstp[x] != 255)
-                    continue;
-
-                s->extract((const uint8_t *)(srcpp + x), src_stride, xdia, ydia, mstd, input);
-                for (i = 0; i < qual; i++) {
-                    s->dot_prod(s, input, weights1[i], temp, nns * 2, asize, mstd + 2);
-                    s->expfunc(temp, nns);
-                    s->wae5(temp, nns, mstd);
-                }
+            if (dstp[x] != 255)
+                continue;
 
-                dstp[x] = FFMIN(FFMAX((int)(mstd[3] * scale + 0.5f), 0), s->max_value);
+            s->extract((const uint8_t *)(srcpp + x), src_stride, xdia, ydia, mstd, input);
+            for (i = 0; i < qual; i++) {
+                if (s->fapprox & 2)
+                    s->dsp.dot_prods_i16((const int16_t *)input, (const int16_t *)weights1[i], temp, nns * 2, asize, mstd + 2);
+                else
+                    s->dsp.dot_prods(input, weights1[i], temp, nns * 2, asize, mstd + 2);
+                s->expfunc(temp, nns);
+                s->wae5(temp, nns, mstd);
             }
-            srcpp += src_stride * 2;
-            dstp += dst_stride * 2;
+
+            dstp[x] = FFMIN(FFMAX((int)(mstd[3] * scale + 0.5f), 0), s->max_value);
         }
+        srcpp += src_stride * 2;
+        dstp += dst_stride * 2;
     }
 }
 
@@ -670,15 +678,22 @@ static void select_functions(NNEDIContext *s)
 
     if (s->fapprox & 2) { // use int16 dot products
         s->extract = extract_m8_i16;
-        s->dot_prod = dot_prods;
     } else { // use float dot products
         s->extract = extract_m8;
-        s->dot_prod = dot_prod;
     }
 
     s->expfunc = e2_m16;
 }
 
+void ff_nnedi_init(NNEDIDSPContext *dsp)
+{
+    dsp->dot_prods     = dot_prods_c;
+    dsp->dot_prods_i16 = dot_prods_i16_c;
+
+    if (ARCH_X86)
+        ff_nnedi_init_x86(dsp);
+}
+
 static int modnpf(const int m, const int n)
 {
     if ((m % n) == 0)
@@ -686,6 +701,33 @@ static int modnpf(const int m, const int n)
     return m + n - (m % n);
 }
 
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    NNEDIContext *s = ctx->priv;
+    FrameData *frame_data = &s->frame_data;
+    float *input = frame_data->input + jobnr * 512;
+    float *temp = (float *)((uint8_t *)frame_data->temp + jobnr * frame_data->temp_size);
+    int plane;
+
+    for (plane = 0; plane < s->nb_planes; plane++) {
+        // Slices hold whole pairs of lines, one from each field.
+        const int nb_pairs = (s->planeheight[plane] + 1) / 2;
+        const int slice_start = 2 * ((nb_pairs * jobnr) / nb_jobs);
+        const int slice_end = FFMIN(2 * ((nb_pairs * (jobnr + 1)) / nb_jobs), s->planeheight[plane]);
+
+        if (!(s->process_plane & (1 << plane)))
+            continue;
+
+        // Handles prescreening and the cubic interpolation.
+        s->evalfunc_0(s, frame_data, plane, input, temp, slice_start, slice_end);
+
+        // The rest.
+        s->evalfunc_1(s, frame_data, plane, input, temp, slice_start, slice_end);
+    }
+
+    return 0;
+}
+
 static int get_frame(AVFilterContext *ctx, int is_second)
 {
     NNEDIContext *s = ctx->priv;
@@ -693,7 +735,6 @@ static int get_frame(AVFilterContext *ctx, int is_second)
     AVFrame *src = s->src;
     FrameData *frame_data;
     int effective_field = s->field;
-    size_t temp_size;
     int field_n;
     int plane;
 
@@ -765,28 +806,11 @@ static int get_frame(AVFilterContext *ctx, int is_second)
         frame_data->field[plane] = field_n;
     }
 
-    if (!frame_data->input) {
-        frame_data->input = av_malloc(512 * sizeof(float));
-        if (!frame_data->input)
-            return AVERROR(ENOMEM);
-    }
-    // evalfunc_0 requires at least padded_width[0] bytes.
-    // evalfunc_1 requires at least 512 floats.
-    if (!frame_data->temp) {
-        temp_size = FFMAX(frame_data->padded_width[0], 512 * sizeof(float));
-        frame_data->temp = av_malloc(temp_size);
-        if (!frame_data->temp)
-            return AVERROR(ENOMEM);
-    }
-
     // Copy src to a padded "frame" in frame_data and mirror the edges.
     s->copy_pad(src, frame_data, s, field_n);
 
-    // Handles prescreening and the cubic interpolation.
-    s->evalfunc_0(s, frame_data);
-
-    // The rest.
-    s->evalfunc_1(s, frame_data);
+    ctx->internal->execute(ctx, filter_slice, NULL, NULL,
+                           FFMIN((s->planeheight[1] + 1) / 2, s->nb_threads));
 
     return 0;
 }
@@ -1027,7 +1051,7 @@ static av_cold int init(AVFilterContext *ctx)
                 mval = FFMAX(mval, FFABS((bdw[offt[j * 64 + k]] - mean[j]) / 127.5));
             scale = 32767.0 / mval;
             for (k = 0; k < 64; k++)
-                ws[offt[j * 64 + k]] = roundds(((bdw[offt[j * 64 + k]] - mean[j]) / 127.5) * scale);
+                ws[j * 64 + k] = roundds(((bdw[offt[j * 64 + k]] - mean[j]) / 127.5) * scale);
             wf[j] = (float)(mval / 32767.0);
         }
         memcpy(wf + 4, bdw + 4 * 64, (dims0new - 4 * 64) * sizeof(float));
@@ -1146,6 +1170,7 @@ static av_cold int init(AVFilterContext *ctx)
     s->max_value = 65535 >> 8;
 
     select_functions(s);
+    ff_nnedi_init(&s->dsp);
 
     s->fdsp = avpriv_float_dsp_alloc(0);
     if (!s->fdsp)
@@ -1207,5 +1232,5 @@ AVFilter ff_vf_nnedi = {
     .query_formats = query_formats,
     .inputs        = inputs,
     .outputs       = outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,47 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_NNEDI_H
+#define AVFILTER_NNEDI_H
+
+#include <stdint.h>
+
+typedef struct NNEDIDSPContext {
+    /**
+     * Evaluate n neurons of len inputs each, with the n biases stored after
+     * the n * len weights:
+     * vals[i] = dot(data, weights + i * len) * scale[0] + weights[n * len + i]
+     * n must be a multiple of 4 and len a multiple of 16.
+     */
+    void (*dot_prods)(const float *data, const float *weights, float *vals,
+                      int n, int len, const float *scale);
+
+    /**
+     * Same with int16 data and weights. The weights are followed by float
+     * groups of 4 neuron scales and 4 biases:
+     * vals[i] = dot(data, weights + i * len) * wf[off] * scale[0] + wf[off + 4]
+     * with wf = (float *)(weights + n * len) and off = (i >> 2) * 8 + (i & 3).
+     */
+    void (*dot_prods_i16)(const int16_t *data, const int16_t *weights, float *vals,
+                          int n, int len, const float *scale);
+} NNEDIDSPContext;
+
+void ff_nnedi_init(NNEDIDSPContext *dsp);
+void ff_nnedi_init_x86(NNEDIDSPContext *dsp);
+
+#endif /* AVFILTER_NNEDI_H */
@@ -100,6 +100,9 @@ typedef struct PadContext {
     FFDrawColor color;
 
     int eval_mode;          ///< expression evaluation mode
+
+    AVBufferPool *pool;     ///< padded buffers handed out to the input link
+    int pool_size;
 } PadContext;
 
 static int config_input(AVFilterLink *inlink)
@@ -225,24 +228,93 @@ static int config_output(AVFilterLink *outlink)
     return 0;
 }
 
+/* tag the buffers with the context, so that frame_is_padded() recognizes them */
+static AVBufferRef *pool_alloc(void *opaque, int size)
+{
+    uint8_t *data = av_malloc(size);
+    AVBufferRef *buf;
+
+    if (!data)
+        return NULL;
+    buf = av_buffer_create(data, size, av_buffer_default_free, opaque, 0);
+    if (!buf)
+        av_free(data);
+    return buf;
+}
+
+/* allocate a frame of the padded size from the private pool; only this
+ * instance ever writes to the area around the picture of such a frame */
+static AVFrame *get_padded_buffer(AVFilterLink *inlink, int w, int h)
+{
+    PadContext *s = inlink->dst->priv;
+    uint8_t *data[4];
+    int linesize[4], size, i;
+    AVFrame *frame;
+
+    if (av_image_fill_linesizes(linesize, inlink->format, FFALIGN(w, 32)) < 0)
+        return NULL;
+    for (i = 0; i < 4; i++)
+        linesize[i] = FFALIGN(linesize[i], 32);
+
+    size = av_image_fill_pointers(data, inlink->format, h, NULL, linesize);
+    if (size < 0)
+        return NULL;
+
+    /* leave room for SIMD code reading past the end of the last line */
+    size += 16 + 16 - 1;
+
+    if (!s->pool || s->pool_size != size) {
+        av_buffer_pool_uninit(&s->pool);
+        s->pool = av_buffer_pool_init2(size, s, pool_alloc, NULL);
+        if (!s->pool)
+            return NULL;
+        s->pool_size = size;
+    }
+
+    frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+
+    frame->buf[0] = av_buffer_pool_get(s->pool);
+    if (!frame->buf[0]) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    av_image_fill_pointers(frame->data, inlink->format, h,
+                           frame->buf[0]->data, linesize);
+    memcpy(frame->linesize, linesize, sizeof(linesize));
+    frame->extended_data       = frame->data;
+    frame->format              = inlink->format;
+    frame->sample_aspect_ratio = inlink->sample_aspect_ratio;
+
+    return frame;
+}
+
 static AVFrame *get_video_buffer(AVFilterLink *inlink, int w, int h)
 {
     PadContext *s = inlink->dst->priv;
+    AVFilterLink *outlink = inlink->dst->outputs[0];
     AVFrame *frame;
     int plane;
 
     if (s->inlink_w <= 0)
         return NULL;
 
-    frame = ff_get_video_buffer(inlink->dst->outputs[0],
-                                w + (s->w - s->in_w),
-                                h + (s->h - s->in_h) + (s->x > 0));
+    w += s->w - s->in_w;
+    h += s->h - s->in_h + (s->x > 0);
+
+    /* let a downstream filter with its own buffer requirements (e.g. another
+     * pad) allocate the frame, so that the padding is nested */
+    if (outlink->dstpad->get_video_buffer)
+        frame = ff_get_video_buffer(outlink, w, h);
+    else
+        frame = get_padded_buffer(inlink, w, h);
 
     if (!frame)
         return NULL;
 
-    frame->width  = w;
-    frame->height = h;
+    frame->width  = w - (s->w - s->in_w);
+    frame->height = h - (s->h - s->in_h + (s->x > 0));
 
     for (plane = 0; plane < 4 && frame->data[plane] && frame->linesize[plane]; plane++) {
         int hsub = s->draw.hsub[plane];
@@ -307,11 +379,25 @@ static int buffer_needs_copy(PadContext *s, AVFrame *frame, AVBufferRef *buf)
     return 0;
 }
 
+/* check whether all the buffers of the frame come from our pool */
+static int frame_is_padded(PadContext *s, AVFrame *frame)
+{
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(frame->buf) && frame->buf[i]; i++)
+        if (av_buffer_pool_buffer_get_opaque(frame->buf[i]) != s)
+            return 0;
+    return i > 0;
+}
+
 static int frame_needs_copy(PadContext *s, AVFrame *frame)
 {
     int i;
 
-    if (!av_frame_is_writable(frame))
+    /* Borders are written outside of the picture only, so a frame still
+     * referenced elsewhere can be padded in place if its buffers were
+     * allocated by us: nobody else uses the area around the picture. */
+    if (!av_frame_is_writable(frame) && !frame_is_padded(s, frame))
         return 1;
 
     for (i = 0; i < 4 && frame->buf[i]; i++)
@@ -413,6 +499,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     return ff_filter_frame(inlink->dst->outputs[0], out);
 }
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    PadContext *s = ctx->priv;
+
+    av_buffer_pool_uninit(&s->pool);
+}
+
 #define OFFSET(x) offsetof(PadContext, x)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
 
@@ -458,6 +551,7 @@ AVFilter ff_vf_pad = {
     .description   = NULL_IF_CONFIG_SMALL("Pad the input video."),
     .priv_size     = sizeof(PadContext),
     .priv_class    = &pad_class,
+    .uninit        = uninit,
     .query_formats = query_formats,
     .inputs        = avfilter_vf_pad_inputs,
     .outputs       = avfilter_vf_pad_outputs,
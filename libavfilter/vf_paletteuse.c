@@ -31,6 +31,7 @@
 #include "filters.h"
 #include "framesync.h"
 #include "internal.h"
+#include "paletteuse.h"
 
 enum dithering_mode {
     DITHERING_NONE,
@@ -64,6 +65,7 @@ struct color_node {
 
 #define NBITS 5
 #define CACHE_SIZE (1<<(3*NBITS))
+#define LUT_SIZE (1<<24)
 
 struct cached_color {
     uint32_t color;
@@ -77,13 +79,22 @@ struct cache_node {
 
 struct PaletteUseContext;
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
+typedef int (*set_frame_func)(struct PaletteUseContext *s, struct cache_node *cache,
+                              AVFrame *out, AVFrame *in,
                               int x_start, int y_start, int width, int height);
 
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct cache_node *cache;               /* lookup cache, one per job */
+    int nb_caches;
+    int *jobs_ret;
+    int use_lut;
+    uint8_t *lut;                           /* nearest opaque color index for each RGB value */
+    int lut_r[AVPALETTE_COUNT], lut_g[AVPALETTE_COUNT], lut_b[AVPALETTE_COUNT];
+    int lut_idx[AVPALETTE_COUNT];
+    int nb_lut_entries;
+    PaletteUseDSPContext dsp;
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
     uint32_t palette[AVPALETTE_COUNT];
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
@@ -120,6 +131,7 @@ static const AVOption paletteuse_options[] = {
         { "rectangle", "process smallest different rectangle", 0, AV_OPT_TYPE_CONST, {.i64=DIFF_MODE_RECTANGLE}, INT_MIN, INT_MAX, FLAGS, "diff_mode" },
     { "new", "take new palette for each output frame", OFFSET(new), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
     { "alpha_threshold", "set the alpha threshold for transparency", OFFSET(trans_thresh), AV_OPT_TYPE_INT, {.i64=128}, 0, 255 },
+    { "use_lut", "use a full RGB lookup table for the color search", OFFSET(use_lut), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
 
     /* following are the debug options, not part of the official API */
     { "debug_kdtree", "save Graphviz graph of the kdtree in specified file", OFFSET(dot_filename), AV_OPT_TYPE_STRING, {.str=NULL}, CHAR_MIN, CHAR_MAX, FLAGS },
@@ -338,7 +350,8 @@ end:
  * Note: a, r, g, and b are the components of color, but are passed as well to avoid
  * recomputing them (they are generally computed by the caller for other uses).
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
+static av_always_inline int color_get(PaletteUseContext *s, struct cache_node *cache,
+                                      uint32_t color,
                                       uint8_t a, uint8_t r, uint8_t g, uint8_t b,
                                       const enum color_search_method search_method)
 {
@@ -348,7 +361,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     const uint8_t ghash = g & ((1<<NBITS)-1);
     const uint8_t bhash = b & ((1<<NBITS)-1);
     const unsigned hash = rhash<<(NBITS*2) | ghash<<NBITS | bhash;
-    struct cache_node *node = &s->cache[hash];
+    struct cache_node *node = &cache[hash];
     struct cached_color *e;
 
     // first, check for transparency
@@ -356,6 +369,9 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
         return s->transparency_index;
     }
 
+    if (s->lut && a >= s->trans_thresh)
+        return s->lut[r<<16 | g<<8 | b];
+
     for (i = 0; i < node->nb_entries; i++) {
         e = &node->entries[i];
         if (e->color == color)
@@ -372,7 +388,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct cache_node *cache,
                                               uint32_t c, int *er, int *eg, int *eb,
                                               const enum color_search_method search_method)
 {
@@ -381,7 +397,7 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     const uint8_t g = c >>  8 & 0xff;
     const uint8_t b = c       & 0xff;
     uint32_t dstc;
-    const int dstx = color_get(s, c, a, r, g, b, search_method);
+    const int dstx = color_get(s, cache, c, a, r, g, b, search_method);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -391,7 +407,8 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
+static av_always_inline int set_frame(PaletteUseContext *s, struct cache_node *cache,
+                                      AVFrame *out, AVFrame *in,
                                       int x_start, int y_start, int w, int h,
                                       enum dithering_mode dither,
                                       const enum color_search_method search_method)
@@ -418,7 +435,8 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = av_clip_uint8(r8 + d);
                 const uint8_t g = av_clip_uint8(g8 + d);
                 const uint8_t b = av_clip_uint8(b8 + d);
-                const int color = color_get(s, src[x], a8, r, g, b, search_method);
+                const int color = color_get(s, cache, (uint32_t)a8<<24 | r<<16 | g<<8 | b,
+                                            a8, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -426,7 +444,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_HECKBERT) {
                 const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -438,7 +456,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_FLOYD_STEINBERG) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -452,7 +470,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA2) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -471,7 +489,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_SIERRA2_4A) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -486,7 +504,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = src[x] >> 16 & 0xff;
                 const uint8_t g = src[x] >>  8 & 0xff;
                 const uint8_t b = src[x]       & 0xff;
-                const int color = color_get(s, src[x], a, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -894,11 +912,38 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+static void free_caches(PaletteUseContext *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_caches * CACHE_SIZE; i++)
+        av_freep(&s->cache[i].entries);
+    av_freep(&s->cache);
+    s->nb_caches = 0;
+}
+
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int x, y, w, h;
+} ThreadData;
+
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int slice_start = td->y + (td->h *  jobnr     ) / nb_jobs;
+    const int slice_end   = td->y + (td->h * (jobnr + 1)) / nb_jobs;
+
+    return s->set_frame(s, s->cache + jobnr * CACHE_SIZE, td->out, td->in,
+                        td->x, slice_start, td->w, slice_end - slice_start);
+}
+
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
-    int x, y, w, h, ret;
+    int x, y, w, h, i, nb_jobs, ret = 0;
     AVFilterContext *ctx = inlink->dst;
     PaletteUseContext *s = ctx->priv;
+    ThreadData td;
     AVFilterLink *outlink = inlink->dst->outputs[0];
 
     AVFrame *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
@@ -926,7 +971,19 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    /* Only the ordered dithers can be split, each job using its own cache;
+     * error diffusion needs the pixels to be processed in order. */
+    td.in  = in;
+    td.out = out;
+    td.x   = x;
+    td.y   = y;
+    td.w   = w;
+    td.h   = h;
+    nb_jobs = FFMIN(h, s->nb_caches);
+    ctx->internal->execute(ctx, set_frame_slice, &td, s->jobs_ret, nb_jobs);
+    for (i = 0; i < nb_jobs; i++)
+        if (s->jobs_ret[i] < 0)
+            ret = s->jobs_ret[i];
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -946,6 +1003,21 @@ static int config_output(AVFilterLink *outlink)
     AVFilterContext *ctx = outlink->src;
     PaletteUseContext *s = ctx->priv;
 
+    free_caches(s);
+    av_freep(&s->jobs_ret);
+    s->nb_caches = s->dither == DITHERING_NONE || s->dither == DITHERING_BAYER ?
+                   ff_filter_get_nb_threads(ctx) : 1;
+    s->cache    = av_calloc(s->nb_caches, CACHE_SIZE * sizeof(*s->cache));
+    s->jobs_ret = av_calloc(s->nb_caches, sizeof(*s->jobs_ret));
+    if (!s->cache || !s->jobs_ret)
+        return AVERROR(ENOMEM);
+
+    if (s->use_lut && !s->lut) {
+        s->lut = av_malloc(LUT_SIZE);
+        if (!s->lut)
+            return AVERROR(ENOMEM);
+    }
+
     ret = ff_framesync_init_dualinput(&s->fs, ctx);
     if (ret < 0)
         return ret;
@@ -977,8 +1049,63 @@ static int config_input_palette(AVFilterLink *inlink)
     return 0;
 }
 
-static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
+static int build_lut_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const int r_start = (256 *  jobnr     ) / nb_jobs;
+    const int r_end   = (256 * (jobnr + 1)) / nb_jobs;
+    int base[AVPALETTE_COUNT];
+    int r, g, i;
+
+    for (r = r_start; r < r_end; r++) {
+        for (g = 0; g < 256; g++) {
+            for (i = 0; i < s->nb_lut_entries; i++) {
+                const int dr = r - s->lut_r[i];
+                const int dg = g - s->lut_g[i];
+                base[i] = dr*dr + dg*dg;
+            }
+            s->dsp.nearest_row(s->lut + (r<<16 | g<<8), base, s->lut_b,
+                               s->lut_idx, s->nb_lut_entries);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Fill the lookup table with the nearest of the palette colors that are not
+ * below the alpha threshold, without duplicates. Among equidistant colors,
+ * the first one of the palette is picked, which may differ from the tree
+ * search.
+ */
+static void load_lut(AVFilterContext *ctx)
+{
+    PaletteUseContext *s = ctx->priv;
+    int i;
+
+    s->nb_lut_entries = 0;
+    for (i = 0; i < AVPALETTE_COUNT; i++) {
+        const uint32_t c = s->palette[i];
+
+        if ((c >> 24) < s->trans_thresh || (i && c == s->palette[i - 1]))
+            continue;
+        s->lut_r[s->nb_lut_entries]   = c >> 16 & 0xff;
+        s->lut_g[s->nb_lut_entries]   = c >>  8 & 0xff;
+        s->lut_b[s->nb_lut_entries]   = c       & 0xff;
+        s->lut_idx[s->nb_lut_entries] = i;
+        s->nb_lut_entries++;
+    }
+
+    if (!s->nb_lut_entries) {
+        memset(s->lut, 0, LUT_SIZE);
+        return;
+    }
+    ctx->internal->execute(ctx, build_lut_slice, NULL, NULL,
+                           FFMIN(256, ff_filter_get_nb_threads(ctx)));
+}
+
+static void load_palette(AVFilterContext *ctx, const AVFrame *palette_frame)
 {
+    PaletteUseContext *s = ctx->priv;
     int i, x, y;
     const uint32_t *p = (const uint32_t *)palette_frame->data[0];
     const int p_linesize = palette_frame->linesize[0] >> 2;
@@ -988,9 +1115,9 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     if (s->new) {
         memset(s->palette, 0, sizeof(s->palette));
         memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
+        for (i = 0; i < s->nb_caches * CACHE_SIZE; i++)
             av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
+        memset(s->cache, 0, s->nb_caches * CACHE_SIZE * sizeof(*s->cache));
     }
 
     i = 0;
@@ -1006,6 +1133,8 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     }
 
     load_colormap(s);
+    if (s->lut)
+        load_lut(ctx);
 
     if (!s->new)
         s->palette_loaded = 1;
@@ -1028,7 +1157,7 @@ static int load_apply_palette(FFFrameSync *fs)
         goto error;
     }
     if (!s->palette_loaded) {
-        load_palette(s, second);
+        load_palette(ctx, second);
     }
     ret = apply_palette(inlink, master, &out);
     if (ret < 0)
@@ -1041,10 +1170,12 @@ error:
 }
 
 #define DEFINE_SET_FRAME(color_search, name, value)                             \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
+static int set_frame_##name(PaletteUseContext *s, struct cache_node *cache,     \
+                            AVFrame *out, AVFrame *in,                          \
                             int x_start, int y_start, int w, int h)             \
 {                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value, color_search);  \
+    return set_frame(s, cache, out, in, x_start, y_start, w, h,                 \
+                     value, color_search);                                      \
 }
 
 #define DEFINE_SET_FRAME_COLOR_SEARCH(color_search, color_search_macro)                                 \
@@ -1082,11 +1213,40 @@ static int dither_value(int p)
            | (p & 1) << 4 | (q & 1) << 5;
 }
 
+static void nearest_row_c(uint8_t *dst, const int *base, const int *comp,
+                          const int *idx, int nb_entries)
+{
+    int x, i;
+
+    for (x = 0; x < 256; x++) {
+        int min_dist = INT_MAX, pal_id = 0;
+
+        for (i = 0; i < nb_entries; i++) {
+            const int d = base[i] + (x - comp[i]) * (x - comp[i]);
+
+            if (d < min_dist) {
+                pal_id = idx[i];
+                min_dist = d;
+            }
+        }
+        dst[x] = pal_id;
+    }
+}
+
+void ff_paletteuse_init(PaletteUseDSPContext *dsp)
+{
+    dsp->nearest_row = nearest_row_c;
+
+    if (ARCH_X86)
+        ff_paletteuse_init_x86(dsp);
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     PaletteUseContext *s = ctx->priv;
 
     s->set_frame = set_frame_lut[s->color_search_method][s->dither];
+    ff_paletteuse_init(&s->dsp);
 
     if (s->dither == DITHERING_BAYER) {
         int i;
@@ -1107,12 +1267,12 @@ static int activate(AVFilterContext *ctx)
 
 static av_cold void uninit(AVFilterContext *ctx)
 {
-    int i;
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (i = 0; i < CACHE_SIZE; i++)
-        av_freep(&s->cache[i].entries);
+    free_caches(s);
+    av_freep(&s->jobs_ret);
+    av_freep(&s->lut);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
 }
@@ -1149,4 +1309,5 @@ AVFilter ff_vf_paletteuse = {
     .inputs        = paletteuse_inputs,
     .outputs       = paletteuse_outputs,
     .priv_class    = &paletteuse_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -43,24 +43,41 @@
 #include "formats.h"
 #include "framesync.h"
 #include "internal.h"
+#include "remap.h"
 #include "video.h"
 
 typedef struct RemapContext {
     const AVClass *class;
+    int interp;
+    int frac;
     int nb_planes;
     int nb_components;
     int step;
+    int depth;
     FFFrameSync fs;
 
-    void (*remap)(struct RemapContext *s, const AVFrame *in,
-                  const AVFrame *xin, const AVFrame *yin,
-                  AVFrame *out);
+    RemapDSPContext dsp;
+    remap_line_fn remap_line;
+    int (*remap_slice)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
 } RemapContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *xin, *yin, *out;
+} ThreadData;
+
+enum InterpMode {
+    INTERP_NEAREST,
+    INTERP_BILINEAR,
+};
+
 #define OFFSET(x) offsetof(RemapContext, x)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
 
 static const AVOption remap_options[] = {
+    { "interp", "set the interpolation mode", OFFSET(interp), AV_OPT_TYPE_INT, {.i64=INTERP_NEAREST}, 0, INTERP_BILINEAR, FLAGS, "interp" },
+        { "nearest",  "nearest neighbour", 0, AV_OPT_TYPE_CONST, {.i64=INTERP_NEAREST},  0, 0, FLAGS, "interp" },
+        { "bilinear", "bilinear",          0, AV_OPT_TYPE_CONST, {.i64=INTERP_BILINEAR}, 0, 0, FLAGS, "interp" },
+    { "frac", "set the number of fractional bits of the map values", OFFSET(frac), AV_OPT_TYPE_INT, {.i64=0}, 0, 8, FLAGS },
     { NULL }
 };
 
@@ -116,71 +133,96 @@ fail:
     return ret;
 }
 
+void ff_remap_line8_c(uint8_t *dst, const uint8_t *src, ptrdiff_t slinesize,
+                      const uint16_t *xmap, const uint16_t *ymap,
+                      int w, int sw, int sh)
+{
+    int x;
+
+    for (x = 0; x < w; x++) {
+        if (ymap[x] < sh && xmap[x] < sw) {
+            dst[x] = src[ymap[x] * slinesize + xmap[x]];
+        } else {
+            dst[x] = 0;
+        }
+    }
+}
+
+void ff_remap_line16_c(uint8_t *dstp, const uint8_t *srcp, ptrdiff_t slinesize,
+                       const uint16_t *xmap, const uint16_t *ymap,
+                       int w, int sw, int sh)
+{
+    uint16_t *dst = (uint16_t *)dstp;
+    const uint16_t *src = (const uint16_t *)srcp;
+    int x;
+
+    slinesize /= 2;
+    for (x = 0; x < w; x++) {
+        if (ymap[x] < sh && xmap[x] < sw) {
+            dst[x] = src[ymap[x] * slinesize + xmap[x]];
+        } else {
+            dst[x] = 0;
+        }
+    }
+}
+
+void ff_remap_line32_c(uint8_t *dstp, const uint8_t *srcp, ptrdiff_t slinesize,
+                       const uint16_t *xmap, const uint16_t *ymap,
+                       int w, int sw, int sh)
+{
+    uint32_t *dst = (uint32_t *)dstp;
+    const uint32_t *src = (const uint32_t *)srcp;
+    int x;
+
+    slinesize /= 4;
+    for (x = 0; x < w; x++) {
+        if (ymap[x] < sh && xmap[x] < sw) {
+            dst[x] = src[ymap[x] * slinesize + xmap[x]];
+        } else {
+            dst[x] = 0;
+        }
+    }
+}
+
 /**
  * remap_planar algorithm expects planes of same size
  * pixels are copied from source to target using :
  * Target_frame[y][x] = Source_frame[ ymap[y][x] ][ [xmap[y][x] ];
+ * Packed formats with 4 bytes per pixel are remapped as a single plane of
+ * 32-bit samples.
  */
-static void remap_planar(RemapContext *s, const AVFrame *in,
-                         const AVFrame *xin, const AVFrame *yin,
-                         AVFrame *out)
+static int remap_planar_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    RemapContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *in  = td->in;
+    const AVFrame *xin = td->xin;
+    const AVFrame *yin = td->yin;
+    AVFrame *out = td->out;
+    const int slice_start = (out->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (out->height * (jobnr+1)) / nb_jobs;
     const int xlinesize = xin->linesize[0] / 2;
     const int ylinesize = yin->linesize[0] / 2;
-    int x , y, plane;
+    int y, plane;
 
     for (plane = 0; plane < s->nb_planes ; plane++) {
-        uint8_t *dst         = out->data[plane];
+        uint8_t *dst         = out->data[plane] + slice_start * out->linesize[plane];
         const int dlinesize  = out->linesize[plane];
         const uint8_t *src   = in->data[plane];
         const int slinesize  = in->linesize[plane];
-        const uint16_t *xmap = (const uint16_t *)xin->data[0];
-        const uint16_t *ymap = (const uint16_t *)yin->data[0];
-
-        for (y = 0; y < out->height; y++) {
-            for (x = 0; x < out->width; x++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x] = src[ymap[x] * slinesize + xmap[x]];
-                } else {
-                    dst[x] = 0;
-                }
-            }
-            dst  += dlinesize;
-            xmap += xlinesize;
-            ymap += ylinesize;
-        }
-    }
-}
-
-static void remap_planar16(RemapContext *s, const AVFrame *in,
-                           const AVFrame *xin, const AVFrame *yin,
-                           AVFrame *out)
-{
-    const int xlinesize = xin->linesize[0] / 2;
-    const int ylinesize = yin->linesize[0] / 2;
-    int x , y, plane;
+        const uint16_t *xmap = (const uint16_t *)xin->data[0] + slice_start * xlinesize;
+        const uint16_t *ymap = (const uint16_t *)yin->data[0] + slice_start * ylinesize;
 
-    for (plane = 0; plane < s->nb_planes ; plane++) {
-        uint16_t *dst        = (uint16_t *)out->data[plane];
-        const int dlinesize  = out->linesize[plane] / 2;
-        const uint16_t *src  = (const uint16_t *)in->data[plane];
-        const int slinesize  = in->linesize[plane] / 2;
-        const uint16_t *xmap = (const uint16_t *)xin->data[0];
-        const uint16_t *ymap = (const uint16_t *)yin->data[0];
-
-        for (y = 0; y < out->height; y++) {
-            for (x = 0; x < out->width; x++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x] = src[ymap[x] * slinesize + xmap[x]];
-                } else {
-                    dst[x] = 0;
-                }
-            }
+        for (y = slice_start; y < slice_end; y++) {
+            s->remap_line(dst, src, slinesize, xmap, ymap,
+                          out->width, in->width, in->height);
             dst  += dlinesize;
             xmap += xlinesize;
             ymap += ylinesize;
         }
     }
+
+    return 0;
 }
 
 /**
@@ -189,66 +231,137 @@ static void remap_planar16(RemapContext *s, const AVFrame *in,
  * pixels are copied from source to target using :
  * Target_frame[y][x] = Source_frame[ ymap[y][x] ][ [xmap[y][x] ];
  */
-static void remap_packed(RemapContext *s, const AVFrame *in,
-                         const AVFrame *xin, const AVFrame *yin,
-                         AVFrame *out)
-{
-    uint8_t *dst = out->data[0];
-    const uint8_t *src  = in->data[0];
-    const int dlinesize = out->linesize[0];
-    const int slinesize = in->linesize[0];
-    const int xlinesize = xin->linesize[0] / 2;
-    const int ylinesize = yin->linesize[0] / 2;
-    const uint16_t *xmap = (const uint16_t *)xin->data[0];
-    const uint16_t *ymap = (const uint16_t *)yin->data[0];
-    const int step = s->step;
-    int c, x, y;
-
-    for (y = 0; y < out->height; y++) {
-        for (x = 0; x < out->width; x++) {
-            for (c = 0; c < s->nb_components; c++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x * step + c] = src[ymap[x] * slinesize + xmap[x] * step + c];
-                } else {
-                    dst[x * step + c] = 0;
-                }
-            }
-        }
-        dst  += dlinesize;
-        xmap += xlinesize;
-        ymap += ylinesize;
-    }
+#define DEFINE_REMAP_PACKED(name, type)                                                 \
+static int remap_packed##name##_slice(AVFilterContext *ctx, void *arg,                  \
+                                      int jobnr, int nb_jobs)                           \
+{                                                                                       \
+    RemapContext *s = ctx->priv;                                                        \
+    ThreadData *td = arg;                                                               \
+    const AVFrame *in  = td->in;                                                        \
+    const AVFrame *xin = td->xin;                                                       \
+    const AVFrame *yin = td->yin;                                                       \
+    AVFrame *out = td->out;                                                             \
+    const int slice_start = (out->height *  jobnr   ) / nb_jobs;                        \
+    const int slice_end   = (out->height * (jobnr+1)) / nb_jobs;                        \
+    const type *src  = (const type *)in->data[0];                                       \
+    const int dlinesize = out->linesize[0] / sizeof(type);                              \
+    const int slinesize = in->linesize[0] / sizeof(type);                               \
+    const int xlinesize = xin->linesize[0] / 2;                                         \
+    const int ylinesize = yin->linesize[0] / 2;                                         \
+    type *dst = (type *)out->data[0] + slice_start * dlinesize;                         \
+    const uint16_t *xmap = (const uint16_t *)xin->data[0] + slice_start * xlinesize;    \
+    const uint16_t *ymap = (const uint16_t *)yin->data[0] + slice_start * ylinesize;    \
+    const int step = s->step / sizeof(type);                                            \
+    int c, x, y;                                                                        \
+                                                                                        \
+    for (y = slice_start; y < slice_end; y++) {                                         \
+        for (x = 0; x < out->width; x++) {                                              \
+            for (c = 0; c < s->nb_components; c++) {                                    \
+                if (ymap[x] < in->height && xmap[x] < in->width) {                      \
+                    dst[x * step + c] = src[ymap[x] * slinesize + xmap[x] * step + c];  \
+                } else {                                                                \
+                    dst[x * step + c] = 0;                                              \
+                }                                                                       \
+            }                                                                           \
+        }                                                                               \
+        dst  += dlinesize;                                                              \
+        xmap += xlinesize;                                                              \
+        ymap += ylinesize;                                                              \
+    }                                                                                   \
+                                                                                        \
+    return 0;                                                                           \
+}
+
+DEFINE_REMAP_PACKED(8,  uint8_t)
+DEFINE_REMAP_PACKED(16, uint16_t)
+
+/**
+ * Remapping with map values in fixed point with s->frac fractional bits,
+ * either rounded to the nearest source pixel or interpolated between the 4
+ * surrounding ones. The pixels right of and below the last source column
+ * and row repeat them.
+ */
+#define DEFINE_REMAP_FRAC(name, type)                                                   \
+static int remap_frac##name##_slice(AVFilterContext *ctx, void *arg,                    \
+                                    int jobnr, int nb_jobs)                             \
+{                                                                                       \
+    RemapContext *s = ctx->priv;                                                        \
+    ThreadData *td = arg;                                                               \
+    const AVFrame *in  = td->in;                                                        \
+    const AVFrame *xin = td->xin;                                                       \
+    const AVFrame *yin = td->yin;                                                       \
+    AVFrame *out = td->out;                                                             \
+    const int slice_start = (out->height *  jobnr   ) / nb_jobs;                        \
+    const int slice_end   = (out->height * (jobnr+1)) / nb_jobs;                        \
+    const int xlinesize = xin->linesize[0] / 2;                                         \
+    const int ylinesize = yin->linesize[0] / 2;                                         \
+    const int frac  = s->frac;                                                          \
+    const unsigned one  = 1 << frac;                                                    \
+    const unsigned mask = one - 1;                                                      \
+    const unsigned round = 1U << 2 * frac >> 1;                                         \
+    const int packed = s->nb_planes == 1 && s->nb_components > 1;                       \
+    const int step  = packed ? s->step / sizeof(type) : 1;                              \
+    const int nb_components = packed ? s->nb_components : 1;                            \
+    int c, x, y, plane;                                                                 \
+                                                                                        \
+    for (plane = 0; plane < s->nb_planes; plane++) {                                    \
+        const type *src = (const type *)in->data[plane];                                \
+        const int dlinesize = out->linesize[plane] / sizeof(type);                      \
+        const int slinesize = in->linesize[plane] / sizeof(type);                       \
+        type *dst = (type *)out->data[plane] + slice_start * dlinesize;                 \
+        const uint16_t *xmap = (const uint16_t *)xin->data[0] + slice_start * xlinesize;\
+        const uint16_t *ymap = (const uint16_t *)yin->data[0] + slice_start * ylinesize;\
+                                                                                        \
+        for (y = slice_start; y < slice_end; y++) {                                     \
+            for (x = 0; x < out->width; x++) {                                          \
+                int xi, yi;                                                             \
+                                                                                        \
+                if (s->interp == INTERP_NEAREST) {                                      \
+                    xi = (xmap[x] + (one >> 1)) >> frac;                                \
+                    yi = (ymap[x] + (one >> 1)) >> frac;                                \
+                } else {                                                                \
+                    xi = xmap[x] >> frac;                                               \
+                    yi = ymap[x] >> frac;                                               \
+                }                                                                       \
+                if (yi >= in->height || xi >= in->width) {                              \
+                    for (c = 0; c < nb_components; c++)                                 \
+                        dst[x * step + c] = 0;                                          \
+                } else if (s->interp == INTERP_NEAREST) {                               \
+                    const type *p = src + yi * slinesize + xi * step;                   \
+                    for (c = 0; c < nb_components; c++)                                 \
+                        dst[x * step + c] = p[c];                                       \
+                } else {                                                                \
+                    const unsigned fx = xmap[x] & mask, fy = ymap[x] & mask;            \
+                    const int dx = xi < in->width  - 1 ? step      : 0;                 \
+                    const int dy = yi < in->height - 1 ? slinesize : 0;                 \
+                    const type *p = src + yi * slinesize + xi * step;                   \
+                    for (c = 0; c < nb_components; c++)                                 \
+                        dst[x * step + c] =                                             \
+                            ((p[c     ] * (one - fx) + p[c + dx     ] * fx) * (one - fy) + \
+                             (p[c + dy] * (one - fx) + p[c + dy + dx] * fx) * fy +      \
+                             round) >> 2 * frac;                                        \
+                }                                                                       \
+            }                                                                           \
+            dst  += dlinesize;                                                          \
+            xmap += xlinesize;                                                          \
+            ymap += ylinesize;                                                          \
+        }                                                                               \
+    }                                                                                   \
+                                                                                        \
+    return 0;                                                                           \
 }
 
-static void remap_packed16(RemapContext *s, const AVFrame *in,
-                           const AVFrame *xin, const AVFrame *yin,
-                           AVFrame *out)
+DEFINE_REMAP_FRAC(8,  uint8_t)
+DEFINE_REMAP_FRAC(16, uint16_t)
+
+av_cold void ff_remap_init(RemapDSPContext *dsp)
 {
-    uint16_t *dst = (uint16_t *)out->data[0];
-    const uint16_t *src  = (const uint16_t *)in->data[0];
-    const int dlinesize = out->linesize[0] / 2;
-    const int slinesize = in->linesize[0] / 2;
-    const int xlinesize = xin->linesize[0] / 2;
-    const int ylinesize = yin->linesize[0] / 2;
-    const uint16_t *xmap = (const uint16_t *)xin->data[0];
-    const uint16_t *ymap = (const uint16_t *)yin->data[0];
-    const int step = s->step / 2;
-    int c, x, y;
-
-    for (y = 0; y < out->height; y++) {
-        for (x = 0; x < out->width; x++) {
-            for (c = 0; c < s->nb_components; c++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x * step + c] = src[ymap[x] * slinesize + xmap[x] * step + c];
-                } else {
-                    dst[x * step + c] = 0;
-                }
-            }
-        }
-        dst  += dlinesize;
-        xmap += xlinesize;
-        ymap += ylinesize;
-    }
+    dsp->remap_line8  = ff_remap_line8_c;
+    dsp->remap_line16 = ff_remap_line16_c;
+    dsp->remap_line32 = ff_remap_line32_c;
+
+    if (ARCH_X86)
+        ff_remap_init_x86(dsp);
 }
 
 static int config_input(AVFilterLink *inlink)
@@ -259,22 +372,30 @@ static int config_input(AVFilterLink *inlink)
 
     s->nb_planes = av_pix_fmt_count_planes(inlink->format);
     s->nb_components = desc->nb_components;
+    s->depth = desc->comp[0].depth;
+    s->step = av_get_padded_bits_per_pixel(desc) >> 3;
 
-    if (desc->comp[0].depth == 8) {
-        if (s->nb_planes > 1 || s->nb_components == 1) {
-            s->remap = remap_planar;
-        } else {
-            s->remap = remap_packed;
-        }
+    ff_remap_init(&s->dsp);
+
+    if (s->frac && (inlink->w > 1 << (16 - s->frac) ||
+                    inlink->h > 1 << (16 - s->frac))) {
+        av_log(ctx, AV_LOG_ERROR, "Maps with %d fractional bits can only address "
+               "inputs up to %dx%d.\n", s->frac, 1 << (16 - s->frac), 1 << (16 - s->frac));
+        return AVERROR(EINVAL);
+    }
+
+    if (s->frac) {
+        s->remap_slice = s->depth == 8 ? remap_frac8_slice : remap_frac16_slice;
+    } else if (s->nb_planes > 1 || s->nb_components == 1) {
+        s->remap_slice = remap_planar_slice;
+        s->remap_line  = s->depth == 8 ? s->dsp.remap_line8 : s->dsp.remap_line16;
+    } else if (s->depth == 8 && s->step == 4) {
+        s->remap_slice = remap_planar_slice;
+        s->remap_line  = s->dsp.remap_line32;
     } else {
-        if (s->nb_planes > 1 || s->nb_components == 1) {
-            s->remap = remap_planar16;
-        } else {
-            s->remap = remap_packed16;
-        }
+        s->remap_slice = s->depth == 8 ? remap_packed8_slice : remap_packed16_slice;
     }
 
-    s->step = av_get_padded_bits_per_pixel(desc) >> 3;
     return 0;
 }
 
@@ -284,6 +405,7 @@ static int process_frame(FFFrameSync *fs)
     RemapContext *s = fs->opaque;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out, *in, *xpic, *ypic;
+    ThreadData td;
     int ret;
 
     if ((ret = ff_framesync_get_frame(&s->fs, 0, &in,   0)) < 0 ||
@@ -301,7 +423,12 @@ static int process_frame(FFFrameSync *fs)
             return AVERROR(ENOMEM);
         av_frame_copy_props(out, in);
 
-        s->remap(s, in, xpic, ypic, out);
+        td.in  = in;
+        td.xin = xpic;
+        td.yin = ypic;
+        td.out = out;
+        ctx->internal->execute(ctx, s->remap_slice, &td, NULL,
+                               FFMIN(outlink->h, ff_filter_get_nb_threads(ctx)));
     }
     out->pts = av_rescale_q(in->pts, s->fs.time_base, outlink->time_base);
 
@@ -406,5 +533,5 @@ AVFilter ff_vf_remap = {
     .inputs        = remap_inputs,
     .outputs       = remap_outputs,
     .priv_class    = &remap_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
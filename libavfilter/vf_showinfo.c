@@ -181,6 +181,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
         case AV_FRAME_DATA_AFD:
             av_log(ctx, AV_LOG_INFO, "afd: value of %"PRIu8, sd->data[0]);
             break;
+        case AV_FRAME_DATA_SCENE_SCORE:
+            if (sd->size >= sizeof(double))
+                av_log(ctx, AV_LOG_INFO, "scene score: %f", *(double *)sd->data);
+            break;
         default:
             av_log(ctx, AV_LOG_WARNING, "unknown side data type %d (%d bytes)",
                    sd->type, sd->size);
@@ -31,12 +31,14 @@
 #include "libavutil/internal.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mastering_display_metadata.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
+#include "tonemap.h"
 #include "video.h"
 
 #define REFERENCE_WHITE 100.0f
@@ -76,8 +78,21 @@ typedef struct TonemapContext {
     double peak;
 
     const LumaCoefficients *coeffs;
+
+    /* gain curve sampled over [0, lut_peak], rebuilt when the peak changes */
+    float *lut;
+    double lut_peak;
+    DECLARE_ALIGNED(16, float, params)[TONEMAP_PARAM_NB];
+
+    TonemapDSPContext dsp;
 } TonemapContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    const AVPixFmtDescriptor *desc;
+    double peak;
+} ThreadData;
+
 static const enum AVPixelFormat pix_fmts[] = {
     AV_PIX_FMT_GBRPF32,
     AV_PIX_FMT_GBRAPF32,
@@ -89,6 +104,154 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_formats(ctx, ff_make_format_list(pix_fmts));
 }
 
+static float hable(float in)
+{
+    float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f, f = 0.30f;
+    return (in * (in * a + b * c) + d * e) / (in * (in * a + b) + d * f) - e / f;
+}
+
+static float mobius(float in, float j, double peak)
+{
+    float a, b;
+
+    if (in <= j)
+        return in;
+
+    a = -j * j * (peak - 1.0f) / (j * j - 2.0f * j + peak);
+    b = (j * j - 2.0f * j * peak + peak) / FFMAX(peak - 1.0f, 1e-6);
+
+    return (b * b + 2.0f * b * j + j * j) / (b - a) * (in + a) / (in + b);
+}
+
+static float tonemap_curve(TonemapContext *s, float sig, double peak)
+{
+    switch(s->tonemap) {
+    default:
+    case TONEMAP_NONE:
+        // do nothing
+        break;
+    case TONEMAP_LINEAR:
+        sig = sig * s->param / peak;
+        break;
+    case TONEMAP_GAMMA:
+        sig = sig > 0.05f ? pow(sig / peak, 1.0f / s->param)
+                          : sig * pow(0.05f / peak, 1.0f / s->param) / 0.05f;
+        break;
+    case TONEMAP_CLIP:
+        sig = av_clipf(sig * s->param, 0, 1.0f);
+        break;
+    case TONEMAP_HABLE:
+        sig = hable(sig) / hable(peak);
+        break;
+    case TONEMAP_REINHARD:
+        sig = sig / (sig + s->param) * (peak + s->param) / peak;
+        break;
+    case TONEMAP_MOBIUS:
+        sig = mobius(sig, s->param, peak);
+        break;
+    }
+
+    return sig;
+}
+
+/* the remaining curves are cheap enough to evaluate directly, and unlike
+ * these they are not meant to saturate at the signal peak */
+static int use_lut(TonemapContext *s)
+{
+    return s->tonemap == TONEMAP_GAMMA    ||
+           s->tonemap == TONEMAP_REINHARD ||
+           s->tonemap == TONEMAP_HABLE    ||
+           s->tonemap == TONEMAP_MOBIUS;
+}
+
+static void build_lut(TonemapContext *s, double peak)
+{
+    int i;
+
+    /* The samples are spaced quadratically, so that the shadows, where most
+     * of the curves change fastest relative to the signal, are sampled
+     * finely even for a high peak. The gain is stored rather than the curve
+     * itself, since it is smooth near black where the curve is linear. */
+    for (i = 0; i <= TONEMAP_LUT_SIZE; i++) {
+        double sig = FFMAX(peak * i * i / (TONEMAP_LUT_SIZE * TONEMAP_LUT_SIZE), 1e-6);
+        s->lut[i] = tonemap_curve(s, sig, peak) / sig;
+    }
+    s->lut[TONEMAP_LUT_SIZE + 1] = s->lut[TONEMAP_LUT_SIZE];
+
+    s->lut_peak = peak;
+    s->params[TONEMAP_PARAM_LUT_SCALE] = TONEMAP_LUT_SIZE * TONEMAP_LUT_SIZE / peak;
+    s->params[TONEMAP_PARAM_PEAK]      = peak;
+}
+
+#define MIX(x,y,a) (x) * (1 - (a)) + (y) * (a)
+static av_always_inline void map_row(float *dst_r, float *dst_g, float *dst_b,
+                                     const float *src_r, const float *src_g,
+                                     const float *src_b, const float *lut,
+                                     const float *params, int width, int desat)
+{
+    const float scale = params[TONEMAP_PARAM_LUT_SCALE];
+    const float peak  = params[TONEMAP_PARAM_PEAK];
+    int x;
+
+    for (x = 0; x < width; x++) {
+        float r = src_r[x], g = src_g[x], b = src_b[x];
+        float sig, pos, frac;
+        int idx;
+
+        /* desaturate to prevent unnatural colors */
+        if (desat) {
+            float luma = params[TONEMAP_PARAM_CR] * r +
+                         params[TONEMAP_PARAM_CG] * g +
+                         params[TONEMAP_PARAM_CB] * b;
+            float overbright = FFMAX(luma - params[TONEMAP_PARAM_DESAT], 1e-6f) /
+                               FFMAX(luma, 1e-6f);
+            r = MIX(r, luma, overbright);
+            g = MIX(g, luma, overbright);
+            b = MIX(b, luma, overbright);
+        }
+
+        /* pick the brightest component, reducing the value range as necessary
+         * to keep the entire signal in range and preventing discoloration due to
+         * out-of-bounds clipping */
+        sig  = FFMAX(FFMAX3(r, g, b), 1e-6f);
+        pos  = FFMIN(sqrtf(sig * scale), TONEMAP_LUT_SIZE);
+        idx  = pos;
+        frac = pos - idx;
+
+        /* apply the computed scale factor to the color,
+         * linearly to prevent discoloration */
+        sig = (lut[idx] + frac * (lut[idx + 1] - lut[idx])) * FFMIN(sig, peak) / sig;
+        dst_r[x] = r * sig;
+        dst_g[x] = g * sig;
+        dst_b[x] = b * sig;
+    }
+}
+
+static void map_row_c(float *dst_r, float *dst_g, float *dst_b,
+                      const float *src_r, const float *src_g,
+                      const float *src_b, const float *lut,
+                      const float *params, int width)
+{
+    map_row(dst_r, dst_g, dst_b, src_r, src_g, src_b, lut, params, width, 0);
+}
+
+static void map_row_desat_c(float *dst_r, float *dst_g, float *dst_b,
+                            const float *src_r, const float *src_g,
+                            const float *src_b, const float *lut,
+                            const float *params, int width)
+{
+    map_row(dst_r, dst_g, dst_b, src_r, src_g, src_b, lut, params, width, 1);
+}
+
+void ff_tonemap_dsp_init(TonemapDSPContext *dsp)
+{
+    dsp->map_row       = map_row_c;
+    dsp->map_row_desat = map_row_desat_c;
+
+    if (ARCH_X86)
+        ff_tonemap_dsp_init_x86(dsp);
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     TonemapContext *s = ctx->priv;
@@ -111,9 +274,24 @@ static av_cold int init(AVFilterContext *ctx)
     if (isnan(s->param))
         s->param = 1.0f;
 
+    if (use_lut(s)) {
+        s->lut = av_malloc_array(TONEMAP_LUT_SIZE + 2, sizeof(*s->lut));
+        if (!s->lut)
+            return AVERROR(ENOMEM);
+    }
+
+    ff_tonemap_dsp_init(&s->dsp);
+
     return 0;
 }
 
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    TonemapContext *s = ctx->priv;
+
+    av_freep(&s->lut);
+}
+
 static double determine_signal_peak(AVFrame *in)
 {
     AVFrameSideData *sd = av_frame_get_side_data(in, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
@@ -139,101 +317,81 @@ static double determine_signal_peak(AVFrame *in)
     return peak;
 }
 
-static float hable(float in)
+static void tonemap_row(TonemapContext *s, float *dst_r, float *dst_g, float *dst_b,
+                        const float *src_r, const float *src_g, const float *src_b,
+                        int width, double peak)
 {
-    float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f, f = 0.30f;
-    return (in * (in * a + b * c) + d * e) / (in * (in * a + b) + d * f) - e / f;
-}
-
-static float mobius(float in, float j, double peak)
-{
-    float a, b;
-
-    if (in <= j)
-        return in;
+    int x;
+
+    for (x = 0; x < width; x++) {
+        float r = src_r[x], g = src_g[x], b = src_b[x];
+        float sig, sig_orig;
+
+        if (s->desat > 0) {
+            float luma = s->coeffs->cr * r + s->coeffs->cg * g + s->coeffs->cb * b;
+            float overbright = FFMAX(luma - s->desat, 1e-6) / FFMAX(luma, 1e-6);
+            r = MIX(r, luma, overbright);
+            g = MIX(g, luma, overbright);
+            b = MIX(b, luma, overbright);
+        }
 
-    a = -j * j * (peak - 1.0f) / (j * j - 2.0f * j + peak);
-    b = (j * j - 2.0f * j * peak + peak) / FFMAX(peak - 1.0f, 1e-6);
+        sig = FFMAX(FFMAX3(r, g, b), 1e-6);
+        sig_orig = sig;
+        sig = tonemap_curve(s, sig, peak);
 
-    return (b * b + 2.0f * b * j + j * j) / (b - a) * (in + a) / (in + b);
+        dst_r[x] = r * (sig / sig_orig);
+        dst_g[x] = g * (sig / sig_orig);
+        dst_b[x] = b * (sig / sig_orig);
+    }
 }
 
-#define MIX(x,y,a) (x) * (1 - (a)) + (y) * (a)
-static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
-                    const AVPixFmtDescriptor *desc, int x, int y, double peak)
+#define PLANE_ROW(frame, c, y) \
+    ((float *)((frame)->data[desc->comp[c].plane] + (y) * (frame)->linesize[desc->comp[c].plane]))
+
+static int tonemap_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    const float *r_in = (const float *)(in->data[0] + x * desc->comp[0].step + y * in->linesize[0]);
-    const float *b_in = (const float *)(in->data[1] + x * desc->comp[1].step + y * in->linesize[1]);
-    const float *g_in = (const float *)(in->data[2] + x * desc->comp[2].step + y * in->linesize[2]);
-    float *r_out = (float *)(out->data[0] + x * desc->comp[0].step + y * out->linesize[0]);
-    float *b_out = (float *)(out->data[1] + x * desc->comp[1].step + y * out->linesize[1]);
-    float *g_out = (float *)(out->data[2] + x * desc->comp[2].step + y * out->linesize[2]);
-    float sig, sig_orig;
-
-    /* load values */
-    *r_out = *r_in;
-    *b_out = *b_in;
-    *g_out = *g_in;
-
-    /* desaturate to prevent unnatural colors */
-    if (s->desat > 0) {
-        float luma = s->coeffs->cr * *r_in + s->coeffs->cg * *g_in + s->coeffs->cb * *b_in;
-        float overbright = FFMAX(luma - s->desat, 1e-6) / FFMAX(luma, 1e-6);
-        *r_out = MIX(*r_in, luma, overbright);
-        *g_out = MIX(*g_in, luma, overbright);
-        *b_out = MIX(*b_in, luma, overbright);
+    TonemapContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *in = td->in;
+    AVFrame *out = td->out;
+    const AVPixFmtDescriptor *desc = td->desc;
+    const int slice_start = (out->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (out->height * (jobnr+1)) / nb_jobs;
+    tonemap_row_fn map = s->desat > 0 ? s->dsp.map_row_desat : s->dsp.map_row;
+    int y;
+
+    for (y = slice_start; y < slice_end; y++) {
+        if (s->lut)
+            map(PLANE_ROW(out, 0, y), PLANE_ROW(out, 1, y), PLANE_ROW(out, 2, y),
+                PLANE_ROW(in,  0, y), PLANE_ROW(in,  1, y), PLANE_ROW(in,  2, y),
+                s->lut, s->params, out->width);
+        else
+            tonemap_row(s, PLANE_ROW(out, 0, y), PLANE_ROW(out, 1, y), PLANE_ROW(out, 2, y),
+                        PLANE_ROW(in,  0, y), PLANE_ROW(in,  1, y), PLANE_ROW(in,  2, y),
+                        out->width, td->peak);
     }
 
-    /* pick the brightest component, reducing the value range as necessary
-     * to keep the entire signal in range and preventing discoloration due to
-     * out-of-bounds clipping */
-    sig = FFMAX(FFMAX3(*r_out, *g_out, *b_out), 1e-6);
-    sig_orig = sig;
+    /* copy alpha if needed, input and output formats always match */
+    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA)
+        av_image_copy_plane(out->data[3] + slice_start * out->linesize[3], out->linesize[3],
+                            in->data[3]  + slice_start * in->linesize[3],  in->linesize[3],
+                            out->width * sizeof(float), slice_end - slice_start);
 
-    switch(s->tonemap) {
-    default:
-    case TONEMAP_NONE:
-        // do nothing
-        break;
-    case TONEMAP_LINEAR:
-        sig = sig * s->param / peak;
-        break;
-    case TONEMAP_GAMMA:
-        sig = sig > 0.05f ? pow(sig / peak, 1.0f / s->param)
-                          : sig * pow(0.05f / peak, 1.0f / s->param) / 0.05f;
-        break;
-    case TONEMAP_CLIP:
-        sig = av_clipf(sig * s->param, 0, 1.0f);
-        break;
-    case TONEMAP_HABLE:
-        sig = hable(sig) / hable(peak);
-        break;
-    case TONEMAP_REINHARD:
-        sig = sig / (sig + s->param) * (peak + s->param) / peak;
-        break;
-    case TONEMAP_MOBIUS:
-        sig = mobius(sig, s->param, peak);
-        break;
-    }
-
-    /* apply the computed scale factor to the color,
-     * linearly to prevent discoloration */
-    *r_out *= sig / sig_orig;
-    *g_out *= sig / sig_orig;
-    *b_out *= sig / sig_orig;
+    return 0;
 }
 
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
-    TonemapContext *s = link->dst->priv;
-    AVFilterLink *outlink = link->dst->outputs[0];
+    AVFilterContext *ctx = link->dst;
+    TonemapContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
-    const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(outlink->format);
-    int ret, x, y;
+    ThreadData td;
+    int ret;
     double peak = s->peak;
 
-    if (!desc || !odesc) {
+    if (!desc) {
         av_frame_free(&in);
         return AVERROR_BUG;
     }
@@ -276,24 +434,20 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         s->desat = 0;
     }
 
+    s->params[TONEMAP_PARAM_CR]    = s->coeffs->cr;
+    s->params[TONEMAP_PARAM_CG]    = s->coeffs->cg;
+    s->params[TONEMAP_PARAM_CB]    = s->coeffs->cb;
+    s->params[TONEMAP_PARAM_DESAT] = s->desat;
+    if (s->lut && peak != s->lut_peak)
+        build_lut(s, peak);
+
     /* do the tone map */
-    for (y = 0; y < out->height; y++)
-        for (x = 0; x < out->width; x++)
-            tonemap(s, out, in, desc, x, y, peak);
-
-    /* copy/generate alpha if needed */
-    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-        av_image_copy_plane(out->data[3], out->linesize[3],
-                            in->data[3], in->linesize[3],
-                            out->linesize[3], outlink->h);
-    } else if (odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-        for (y = 0; y < out->height; y++) {
-            for (x = 0; x < out->width; x++) {
-                AV_WN32(out->data[3] + x * odesc->comp[3].step + y * out->linesize[3],
-                        av_float2int(1.0f));
-            }
-        }
-    }
+    td.in   = in;
+    td.out  = out;
+    td.desc = desc;
+    td.peak = peak;
+    ctx->internal->execute(ctx, tonemap_slice, &td, NULL,
+                           FFMIN(outlink->h, ff_filter_get_nb_threads(ctx)));
 
     av_frame_free(&in);
 
@@ -346,9 +500,11 @@ AVFilter ff_vf_tonemap = {
     .name            = "tonemap",
     .description     = NULL_IF_CONFIG_SMALL("Conversion to/from different dynamic ranges."),
     .init            = init,
+    .uninit          = uninit,
     .query_formats   = query_formats,
     .priv_size       = sizeof(TonemapContext),
     .priv_class      = &tonemap_class,
     .inputs          = tonemap_inputs,
     .outputs         = tonemap_outputs,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -49,9 +49,11 @@ typedef struct VagueDenoiserContext {
     int planewidth[4];
 
     float *block;
-    float *in;
+    float *in;      ///< line buffers, one per thread
     float *out;
     float *tmp;
+    int line_size;
+    int nb_threads;
 
     int hlowsize[4][32];
     int hhighsize[4][32];
@@ -129,6 +131,13 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_formats(ctx, fmts_list);
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int plane;
+    int nb_lines;   ///< number of rows or columns to transform
+    int size;       ///< their length
+} ThreadData;
+
 static int config_input(AVFilterLink *inlink)
 {
     VagueDenoiserContext *s = inlink->dst->priv;
@@ -144,10 +153,13 @@ static int config_input(AVFilterLink *inlink)
     s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
     s->planewidth[0]  = s->planewidth[3]  = inlink->w;
 
+    s->nb_threads = ff_filter_get_nb_threads(inlink->dst);
+    s->line_size = 32 + FFMAX(inlink->w, inlink->h);
+
     s->block = av_malloc_array(inlink->w * inlink->h, sizeof(*s->block));
-    s->in    = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->in));
-    s->out   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->out));
-    s->tmp   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->tmp));
+    s->in    = av_malloc_array(s->line_size * s->nb_threads, sizeof(*s->in));
+    s->out   = av_malloc_array(s->line_size * s->nb_threads, sizeof(*s->out));
+    s->tmp   = av_malloc_array(s->line_size * s->nb_threads, sizeof(*s->tmp));
 
     if (!s->block || !s->in || !s->out || !s->tmp)
         return AVERROR(ENOMEM);
@@ -392,23 +404,195 @@ static void qian_thresholding(float *block, const int width, const int height,
     }
 }
 
-static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
+static int import_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int p, y, x, i, j;
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int p = td->plane;
+    const int width = s->planewidth[p];
+    const int slice_start = (s->planeheight[p] *  jobnr   ) / nb_jobs;
+    const int slice_end   = (s->planeheight[p] * (jobnr+1)) / nb_jobs;
+    const int linesize = td->in->linesize[p];
+    float *output = s->block + slice_start * width;
+    int y, x;
+
+    if (s->depth <= 8) {
+        const uint8_t *srcp8 = td->in->data[p] + slice_start * linesize;
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                output[x] = srcp8[x];
+            srcp8 += linesize;
+            output += width;
+        }
+    } else {
+        const uint16_t *srcp16 = (const uint16_t *)(td->in->data[p] + slice_start * linesize);
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                output[x] = srcp16[x];
+            srcp16 += linesize / 2;
+            output += width;
+        }
+    }
+
+    return 0;
+}
+
+static int export_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int p = td->plane;
+    const int width = s->planewidth[p];
+    const int slice_start = (s->planeheight[p] *  jobnr   ) / nb_jobs;
+    const int slice_end   = (s->planeheight[p] * (jobnr+1)) / nb_jobs;
+    const int linesize = td->out->linesize[p];
+    const float *input = s->block + slice_start * width;
+    int y, x;
+
+    if (s->depth <= 8) {
+        uint8_t *dstp8 = td->out->data[p] + slice_start * linesize;
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                dstp8[x] = av_clip_uint8(input[x] + 0.5f);
+            input += width;
+            dstp8 += linesize;
+        }
+    } else {
+        uint16_t *dstp16 = (uint16_t *)(td->out->data[p] + slice_start * linesize);
+
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < width; x++)
+                dstp16[x] = av_clip(input[x] + 0.5f, 0, s->peak);
+            input += width;
+            dstp16 += linesize / 2;
+        }
+    }
+
+    return 0;
+}
+
+static int transform_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    const int low_size = (td->size + 1) >> 1;
+    const int slice_start = (td->nb_lines *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->nb_lines * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    float *input = s->block + slice_start * width;
+    int j;
+
+    for (j = slice_start; j < slice_end; j++) {
+        copy(input, in + NPAD, td->size);
+        transform_step(in, out, td->size, low_size, s);
+        copy(out + NPAD, input, td->size);
+        input += width;
+    }
+
+    return 0;
+}
+
+static int transform_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    const int low_size = (td->size + 1) >> 1;
+    const int slice_start = (td->nb_lines *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->nb_lines * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    float *input = s->block + slice_start;
+    int j;
+
+    for (j = slice_start; j < slice_end; j++) {
+        copyv(input, width, in + NPAD, td->size);
+        transform_step(in, out, td->size, low_size, s);
+        copyh(out + NPAD, input, width, td->size);
+        input++;
+    }
+
+    return 0;
+}
+
+static int invert_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    const int slice_start = (td->nb_lines *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->nb_lines * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    float *tmp = s->tmp + jobnr * s->line_size;
+    float *idx3 = s->block + slice_start * width;
+    int i;
+
+    for (i = slice_start; i < slice_end; i++) {
+        copy(idx3, in + NPAD, td->size);
+        invert_step(in, out, tmp, td->size, s);
+        copy(out + NPAD, idx3, td->size);
+        idx3 += width;
+    }
+
+    return 0;
+}
+
+static int invert_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    const int slice_start = (td->nb_lines *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->nb_lines * (jobnr+1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    float *tmp = s->tmp + jobnr * s->line_size;
+    float *idx3 = s->block + slice_start;
+    int i;
+
+    for (i = slice_start; i < slice_end; i++) {
+        copyv(idx3, width, in + NPAD, td->size);
+        invert_step(in, out, tmp, td->size, s);
+        copyh(out + NPAD, idx3, width, td->size);
+        idx3++;
+    }
+
+    return 0;
+}
+
+/* run one pass over nb_lines rows or columns of length size */
+static void run_pass(AVFilterContext *ctx, avfilter_action_func *func,
+                     ThreadData *td, int nb_lines, int size)
+{
+    VagueDenoiserContext *s = ctx->priv;
+
+    td->nb_lines = nb_lines;
+    td->size     = size;
+    ctx->internal->execute(ctx, func, td, NULL, FFMIN(nb_lines, s->nb_threads));
+}
+
+static void filter(AVFilterContext *ctx, AVFrame *in, AVFrame *out)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData td;
+    int p;
+
+    td.in  = in;
+    td.out = out;
 
     for (p = 0; p < s->nb_planes; p++) {
         const int height = s->planeheight[p];
         const int width = s->planewidth[p];
-        const uint8_t *srcp8 = in->data[p];
-        const uint16_t *srcp16 = (const uint16_t *)in->data[p];
-        uint8_t *dstp8 = out->data[p];
-        uint16_t *dstp16 = (uint16_t *)out->data[p];
-        float *output = s->block;
         int h_low_size0 = width;
         int v_low_size0 = height;
         int nsteps_transform = s->nsteps;
         int nsteps_invert = s->nsteps;
-        const float *input = s->block;
 
         if (!((1 << p) & s->planes)) {
             av_image_copy_plane(out->data[p], out->linesize[p], in->data[p], in->linesize[p],
@@ -416,40 +600,12 @@ static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
             continue;
         }
 
-        if (s->depth <= 8) {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    output[x] = srcp8[x];
-                srcp8 += in->linesize[p];
-                output += width;
-            }
-        } else {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    output[x] = srcp16[x];
-                srcp16 += in->linesize[p] / 2;
-                output += width;
-            }
-        }
+        td.plane = p;
+        run_pass(ctx, import_slice, &td, height, width);
 
         while (nsteps_transform--) {
-            int low_size = (h_low_size0 + 1) >> 1;
-            float *input = s->block;
-            for (j = 0; j < v_low_size0; j++) {
-                copy(input, s->in + NPAD, h_low_size0);
-                transform_step(s->in, s->out, h_low_size0, low_size, s);
-                copy(s->out + NPAD, input, h_low_size0);
-                input += width;
-            }
-
-            low_size = (v_low_size0 + 1) >> 1;
-            input = s->block;
-            for (j = 0; j < h_low_size0; j++) {
-                copyv(input, width, s->in + NPAD, v_low_size0);
-                transform_step(s->in, s->out, v_low_size0, low_size, s);
-                copyh(s->out + NPAD, input, width, v_low_size0);
-                input++;
-            }
+            run_pass(ctx, transform_rows,    &td, v_low_size0, h_low_size0);
+            run_pass(ctx, transform_columns, &td, h_low_size0, v_low_size0);
 
             h_low_size0 = (h_low_size0 + 1) >> 1;
             v_low_size0 = (v_low_size0 + 1) >> 1;
@@ -460,45 +616,18 @@ static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
         while (nsteps_invert--) {
             const int idx = s->vlowsize[p][nsteps_invert]  + s->vhighsize[p][nsteps_invert];
             const int idx2 = s->hlowsize[p][nsteps_invert] + s->hhighsize[p][nsteps_invert];
-            float * idx3 = s->block;
-            for (i = 0; i < idx2; i++) {
-                copyv(idx3, width, s->in + NPAD, idx);
-                invert_step(s->in, s->out, s->tmp, idx, s);
-                copyh(s->out + NPAD, idx3, width, idx);
-                idx3++;
-            }
 
-            idx3 = s->block;
-            for (i = 0; i < idx; i++) {
-                copy(idx3, s->in + NPAD, idx2);
-                invert_step(s->in, s->out, s->tmp, idx2, s);
-                copy(s->out + NPAD, idx3, idx2);
-                idx3 += width;
-            }
+            run_pass(ctx, invert_columns, &td, idx2, idx);
+            run_pass(ctx, invert_rows,    &td, idx,  idx2);
         }
 
-        if (s->depth <= 8) {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    dstp8[x] = av_clip_uint8(input[x] + 0.5f);
-                input += width;
-                dstp8 += out->linesize[p];
-            }
-        } else {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    dstp16[x] = av_clip(input[x] + 0.5f, 0, s->peak);
-                input += width;
-                dstp16 += out->linesize[p] / 2;
-            }
-        }
+        run_pass(ctx, export_slice, &td, height, width);
     }
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx  = inlink->dst;
-    VagueDenoiserContext *s = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out;
     int direct = av_frame_is_writable(in);
@@ -515,7 +644,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         av_frame_copy_props(out, in);
     }
 
-    filter(s, in, out);
+    filter(ctx, in, out);
 
     if (!direct)
         av_frame_free(&in);
@@ -581,5 +710,5 @@ AVFilter ff_vf_vaguedenoiser = {
     .query_formats = query_formats,
     .inputs        = vaguedenoiser_inputs,
     .outputs       = vaguedenoiser_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -59,8 +59,9 @@ static const AVOption vmafmotion_options[] = {
 
 AVFILTER_DEFINE_CLASS(vmafmotion);
 
-static uint64_t image_sad(const uint16_t *img1, const uint16_t *img2, int w,
-                          int h, ptrdiff_t _img1_stride, ptrdiff_t _img2_stride)
+uint64_t ff_vmafmotion_sad_c(const uint16_t *img1, const uint16_t *img2,
+                             int w, int h, ptrdiff_t _img1_stride,
+                             ptrdiff_t _img2_stride)
 {
     ptrdiff_t img1_stride = _img1_stride / sizeof(*img1);
     ptrdiff_t img2_stride = _img2_stride / sizeof(*img2);
@@ -78,128 +79,131 @@ static uint64_t image_sad(const uint16_t *img1, const uint16_t *img2, int w,
     return sum;
 }
 
-static void convolution_x(const uint16_t *filter, int filt_w, const uint16_t *src,
+static void convolution_x(const uint16_t *filter, const uint16_t *src,
                           uint16_t *dst, int w, int h, ptrdiff_t _src_stride,
                           ptrdiff_t _dst_stride)
 {
     ptrdiff_t src_stride = _src_stride / sizeof(*src);
     ptrdiff_t dst_stride = _dst_stride / sizeof(*dst);
-    int radius = filt_w / 2;
-    int borders_left = radius;
-    int borders_right = w - (filt_w - radius);
     int i, j, k;
-    int sum = 0;
 
     for (i = 0; i < h; i++) {
-        for (j = 0; j < borders_left; j++) {
-            sum = 0;
-            for (k = 0; k < filt_w; k++) {
-                int j_tap = FFABS(j - radius + k);
-                if (j_tap >= w) {
-                    j_tap = w - (j_tap - w + 1);
-                }
-                sum += filter[k] * src[i * src_stride + j_tap];
-            }
-            dst[i * dst_stride + j] = sum >> BIT_SHIFT;
-        }
-
-        for (j = borders_left; j < borders_right; j++) {
+        for (j = 0; j < w; j++) {
             int sum = 0;
-            for (k = 0; k < filt_w; k++) {
-                sum += filter[k] * src[i * src_stride + j - radius + k];
+            for (k = 0; k < 5; k++) {
+                sum += filter[k] * src[j - 2 + k];
             }
-            dst[i * dst_stride + j] = sum >> BIT_SHIFT;
-        }
-
-        for (j = borders_right; j < w; j++) {
-            sum = 0;
-            for (k = 0; k < filt_w; k++) {
-                int j_tap = FFABS(j - radius + k);
-                if (j_tap >= w) {
-                    j_tap = w - (j_tap - w + 1);
-                }
-                sum += filter[k] * src[i * src_stride + j_tap];
-            }
-            dst[i * dst_stride + j] = sum >> BIT_SHIFT;
+            dst[j] = sum >> BIT_SHIFT;
         }
+        src += src_stride;
+        dst += dst_stride;
     }
 }
 
 #define conv_y_fn(type, bits) \
-static void convolution_y_##bits##bit(const uint16_t *filter, int filt_w, \
-                                      const uint8_t *_src, uint16_t *dst, \
-                                      int w, int h, ptrdiff_t _src_stride, \
-                                      ptrdiff_t _dst_stride) \
+void ff_vmafmotion_convolution_y_##bits##bit_c(const uint16_t *filter, \
+                                               const uint8_t *const *_src, \
+                                               uint16_t *dst, int w) \
 { \
-    const type *src = (const type *) _src; \
-    ptrdiff_t src_stride = _src_stride / sizeof(*src); \
-    ptrdiff_t dst_stride = _dst_stride / sizeof(*dst); \
-    int radius = filt_w / 2; \
-    int borders_top = radius; \
-    int borders_bottom = h - (filt_w - radius); \
-    int i, j, k; \
-    int sum = 0; \
+    const type *src[5]; \
+    int j, k; \
     \
-    for (i = 0; i < borders_top; i++) { \
-        for (j = 0; j < w; j++) { \
-            sum = 0; \
-            for (k = 0; k < filt_w; k++) { \
-                int i_tap = FFABS(i - radius + k); \
-                if (i_tap >= h) { \
-                    i_tap = h - (i_tap - h + 1); \
-                } \
-                sum += filter[k] * src[i_tap * src_stride + j]; \
-            } \
-            dst[i * dst_stride + j] = sum >> bits; \
-        } \
-    } \
-    for (i = borders_top; i < borders_bottom; i++) { \
-        for (j = 0; j < w; j++) { \
-            sum = 0; \
-            for (k = 0; k < filt_w; k++) { \
-                sum += filter[k] * src[(i - radius + k) * src_stride + j]; \
-            } \
-            dst[i * dst_stride + j] = sum >> bits; \
-        } \
-    } \
-    for (i = borders_bottom; i < h; i++) { \
-        for (j = 0; j < w; j++) { \
-            sum = 0; \
-            for (k = 0; k < filt_w; k++) { \
-                int i_tap = FFABS(i - radius + k); \
-                if (i_tap >= h) { \
-                    i_tap = h - (i_tap - h + 1); \
-                } \
-                sum += filter[k] * src[i_tap * src_stride + j]; \
-            } \
-            dst[i * dst_stride + j] = sum >> bits; \
+    for (k = 0; k < 5; k++) \
+        src[k] = (const type *) _src[k]; \
+    \
+    for (j = 0; j < w; j++) { \
+        int sum = 0; \
+        for (k = 0; k < 5; k++) { \
+            sum += filter[k] * src[k][j]; \
         } \
+        dst[j] = sum >> bits; \
     } \
 }
 
 conv_y_fn(uint8_t, 8);
 conv_y_fn(uint16_t, 10);
 
-static void vmafmotiondsp_init(VMAFMotionDSPContext *dsp, int bpp) {
+av_cold void ff_vmafmotion_dsp_init(VMAFMotionDSPContext *dsp, int bpp)
+{
     dsp->convolution_x = convolution_x;
-    dsp->convolution_y = bpp == 10 ? convolution_y_10bit : convolution_y_8bit;
-    dsp->sad = image_sad;
+    dsp->convolution_y = bpp == 10 ? ff_vmafmotion_convolution_y_10bit_c
+                                   : ff_vmafmotion_convolution_y_8bit_c;
+    dsp->sad = ff_vmafmotion_sad_c;
+
+    if (ARCH_X86)
+        ff_vmafmotion_init_x86(dsp, bpp);
 }
 
-double ff_vmafmotion_process(VMAFMotionData *s, AVFrame *ref)
+/* mirror the index of a tap outside of [0, size) back into the image */
+static av_always_inline int mirror(int tap, int size)
 {
+    tap = FFABS(tap);
+    return tap >= size ? size - (tap - size + 1) : tap;
+}
+
+typedef struct ThreadData {
+    VMAFMotionData *s;
+    const AVFrame *ref;
+} ThreadData;
+
+static int vmafmotion_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    VMAFMotionData *s = td->s;
+    const AVFrame *ref = td->ref;
+    const int slice_start = (s->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (s->height * (jobnr+1)) / nb_jobs;
+    const int w = s->width;
+    const ptrdiff_t temp_stride = s->temp_stride / sizeof(*s->temp_data);
+    uint16_t *temp = s->temp_data + slice_start * temp_stride + VMAFMOTION_TEMP_PAD;
+    int i, k;
+
+    for (i = slice_start; i < slice_end; i++) {
+        const uint8_t *src[5];
+
+        for (k = 0; k < 5; k++)
+            src[k] = ref->data[0] + mirror(i - 2 + k, s->height) * ref->linesize[0];
+        s->vmafdsp.convolution_y(s->filter, src, temp, w);
+
+        temp[-1]    = temp[1];
+        temp[-2]    = temp[2];
+        temp[w]     = temp[w - 1];
+        temp[w + 1] = temp[w - 2];
+        temp += temp_stride;
+    }
+
+    s->vmafdsp.convolution_x(s->filter,
+                             s->temp_data + slice_start * temp_stride + VMAFMOTION_TEMP_PAD,
+                             s->blur_data[0] + slice_start * s->stride / sizeof(uint16_t),
+                             w, slice_end - slice_start, s->temp_stride, s->stride);
+
+    if (s->nb_frames) {
+        s->job_sad[jobnr] = s->vmafdsp.sad(s->blur_data[1] + slice_start * s->stride / sizeof(uint16_t),
+                                           s->blur_data[0] + slice_start * s->stride / sizeof(uint16_t),
+                                           w, slice_end - slice_start, s->stride, s->stride);
+    }
+
+    return 0;
+}
+
+double ff_vmafmotion_process(AVFilterContext *ctx, VMAFMotionData *s, AVFrame *ref)
+{
+    const int nb_jobs = FFMIN(s->height, s->nb_threads);
+    ThreadData td;
     double score;
+    int i;
 
-    s->vmafdsp.convolution_y(s->filter, 5, ref->data[0], s->temp_data,
-                             s->width, s->height, ref->linesize[0], s->stride);
-    s->vmafdsp.convolution_x(s->filter, 5, s->temp_data, s->blur_data[0],
-                             s->width, s->height, s->stride, s->stride);
+    td.s   = s;
+    td.ref = ref;
+    ctx->internal->execute(ctx, vmafmotion_slice, &td, NULL, nb_jobs);
 
     if (!s->nb_frames) {
         score = 0.0;
     } else {
-        uint64_t sad = s->vmafdsp.sad(s->blur_data[1], s->blur_data[0],
-                                      s->width, s->height, s->stride, s->stride);
+        uint64_t sad = 0;
+
+        for (i = 0; i < nb_jobs; i++)
+            sad += s->job_sad[i];
         // the output score is always normalized to 8 bits
         score = (double) (sad * 1.0 / (s->width * s->height << (BIT_SHIFT - 8)));
     }
@@ -223,7 +227,7 @@ static void do_vmafmotion(AVFilterContext *ctx, AVFrame *ref)
     VMAFMotionContext *s = ctx->priv;
     double score;
 
-    score = ff_vmafmotion_process(&s->data, ref);
+    score = ff_vmafmotion_process(ctx, &s->data, ref);
     set_meta(&ref->metadata, "lavfi.vmafmotion.score", score);
     if (s->stats_file) {
         fprintf(s->stats_file,
@@ -233,7 +237,7 @@ static void do_vmafmotion(AVFilterContext *ctx, AVFrame *ref)
 
 
 int ff_vmafmotion_init(VMAFMotionData *s,
-                       int w, int h, enum AVPixelFormat fmt)
+                       int w, int h, enum AVPixelFormat fmt, int nb_threads)
 {
     size_t data_sz;
     int i;
@@ -242,11 +246,14 @@ int ff_vmafmotion_init(VMAFMotionData *s,
     s->width = w;
     s->height = h;
     s->stride = FFALIGN(w * sizeof(uint16_t), 32);
+    s->temp_stride = FFALIGN((w + 2 * VMAFMOTION_TEMP_PAD) * sizeof(uint16_t), 32);
+    s->nb_threads = nb_threads;
 
     data_sz = (size_t) s->stride * h;
     if (!(s->blur_data[0] = av_malloc(data_sz)) ||
         !(s->blur_data[1] = av_malloc(data_sz)) ||
-        !(s->temp_data    = av_malloc(data_sz))) {
+        !(s->temp_data    = av_mallocz((size_t) s->temp_stride * h)) ||
+        !(s->job_sad      = av_calloc(nb_threads, sizeof(*s->job_sad)))) {
         return AVERROR(ENOMEM);
     }
 
@@ -254,7 +261,7 @@ int ff_vmafmotion_init(VMAFMotionData *s,
         s->filter[i] = lrint(FILTER_5[i] * (1 << BIT_SHIFT));
     }
 
-    vmafmotiondsp_init(&s->vmafdsp, desc->comp[0].depth);
+    ff_vmafmotion_dsp_init(&s->vmafdsp, desc->comp[0].depth);
 
     return 0;
 }
@@ -283,7 +290,8 @@ static int config_input_ref(AVFilterLink *inlink)
     VMAFMotionContext *s = ctx->priv;
 
     return ff_vmafmotion_init(&s->data, ctx->inputs[0]->w,
-                              ctx->inputs[0]->h, ctx->inputs[0]->format);
+                              ctx->inputs[0]->h, ctx->inputs[0]->format,
+                              ff_filter_get_nb_threads(ctx));
 }
 
 double ff_vmafmotion_uninit(VMAFMotionData *s)
@@ -291,6 +299,7 @@ double ff_vmafmotion_uninit(VMAFMotionData *s)
     av_free(s->blur_data[0]);
     av_free(s->blur_data[1]);
     av_free(s->temp_data);
+    av_freep(&s->job_sad);
 
     return s->nb_frames > 0 ? s->motion_sum / s->nb_frames : 0.0;
 }
@@ -366,4 +375,5 @@ AVFilter ff_vf_vmafmotion = {
     .priv_class    = &vmafmotion_class,
     .inputs        = vmafmotion_inputs,
     .outputs       = vmafmotion_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
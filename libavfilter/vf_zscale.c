@@ -44,6 +44,8 @@
 #include "libavutil/imgutils.h"
 #include "libavutil/avassert.h"
 
+#define MAX_THREADS 32
+
 static const char *const var_names[] = {
     "in_w",   "iw",
     "in_h",   "ih",
@@ -110,21 +112,31 @@ typedef struct ZScaleContext {
 
     int force_original_aspect_ratio;
 
-    void *tmp;
-    size_t tmp_size;
+    int nb_threads;
+    int params_changed;
+    int out_slice_start[MAX_THREADS], out_slice_end[MAX_THREADS];
+    double in_slice_start[MAX_THREADS], in_slice_end[MAX_THREADS];
+
+    void *tmp[MAX_THREADS];
+    size_t tmp_size[MAX_THREADS];
 
     zimg_image_format src_format, dst_format;
     zimg_image_format alpha_src_format, alpha_dst_format;
     zimg_graph_builder_params alpha_params, params;
-    zimg_filter_graph *alpha_graph, *graph;
+    zimg_filter_graph *alpha_graph[MAX_THREADS], *graph[MAX_THREADS];
 
-    enum AVColorSpace in_colorspace, out_colorspace;
-    enum AVColorTransferCharacteristic in_trc, out_trc;
-    enum AVColorPrimaries in_primaries, out_primaries;
-    enum AVColorRange in_range, out_range;
-    enum AVChromaLocation in_chromal, out_chromal;
+    enum AVColorSpace in_colorspace;
+    enum AVColorTransferCharacteristic in_trc;
+    enum AVColorPrimaries in_primaries;
+    enum AVColorRange in_range;
+    enum AVChromaLocation in_chromal;
 } ZScaleContext;
 
+typedef struct ThreadData {
+    const AVPixFmtDescriptor *desc, *odesc;
+    AVFrame *in, *out;
+} ThreadData;
+
 static av_cold int init_dict(AVFilterContext *ctx, AVDictionary **opts)
 {
     ZScaleContext *s = ctx->priv;
@@ -502,16 +514,137 @@ static int graph_build(zimg_filter_graph **graph, zimg_graph_builder_params *par
     return 0;
 }
 
+static void slice_params(ZScaleContext *s, int out_h, int in_h, int vsub)
+{
+    int i;
+
+    /* Output slices start on chroma rows; the matching input slices are
+     * given to zimg as fractional active regions of the whole input. */
+    s->out_slice_start[0] = 0;
+    for (i = 1; i < s->nb_threads; i++) {
+        const int slice_end = FFALIGN(out_h * i / s->nb_threads, 1 << vsub);
+
+        s->out_slice_end[i - 1] = s->out_slice_start[i] = slice_end;
+    }
+    s->out_slice_end[s->nb_threads - 1] = out_h;
+
+    for (i = 0; i < s->nb_threads; i++) {
+        s->in_slice_start[i] = s->out_slice_start[i] * in_h / (double)out_h;
+        s->in_slice_end[i]   = s->out_slice_end[i]   * in_h / (double)out_h;
+    }
+}
+
+static int graphs_build(ZScaleContext *s, int jobnr, int alpha)
+{
+    zimg_image_format src_format = s->src_format;
+    zimg_image_format dst_format = s->dst_format;
+    const int out_height = s->out_slice_end[jobnr] - s->out_slice_start[jobnr];
+    int ret;
+
+    src_format.active_region.left   = 0;
+    src_format.active_region.top    = s->in_slice_start[jobnr];
+    src_format.active_region.width  = src_format.width;
+    src_format.active_region.height = s->in_slice_end[jobnr] - s->in_slice_start[jobnr];
+    dst_format.height = out_height;
+
+    ret = graph_build(&s->graph[jobnr], &s->params, &src_format, &dst_format,
+                      &s->tmp[jobnr], &s->tmp_size[jobnr]);
+    if (ret < 0)
+        return ret;
+
+    if (alpha) {
+        src_format = s->alpha_src_format;
+        dst_format = s->alpha_dst_format;
+
+        src_format.active_region.left   = 0;
+        src_format.active_region.top    = s->in_slice_start[jobnr];
+        src_format.active_region.width  = src_format.width;
+        src_format.active_region.height = s->in_slice_end[jobnr] - s->in_slice_start[jobnr];
+        dst_format.height = out_height;
+
+        ret = graph_build(&s->alpha_graph[jobnr], &s->alpha_params, &src_format, &dst_format,
+                          &s->tmp[jobnr], &s->tmp_size[jobnr]);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ZScaleContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVPixFmtDescriptor *desc = td->desc;
+    const AVPixFmtDescriptor *odesc = td->odesc;
+    AVFrame *in = td->in;
+    AVFrame *out = td->out;
+    const int slice_start = s->out_slice_start[jobnr];
+    const int slice_end = s->out_slice_end[jobnr];
+    zimg_image_buffer_const src_buf = { ZIMG_API_VERSION };
+    zimg_image_buffer dst_buf = { ZIMG_API_VERSION };
+    int ret, plane;
+
+    for (plane = 0; plane < 3; plane++) {
+        const int vsub = plane ? odesc->log2_chroma_h : 0;
+        int p = desc->comp[plane].plane;
+
+        src_buf.plane[plane].data   = in->data[p];
+        src_buf.plane[plane].stride = in->linesize[p];
+        src_buf.plane[plane].mask   = -1;
+
+        p = odesc->comp[plane].plane;
+        dst_buf.plane[plane].data   = out->data[p] + (slice_start >> vsub) * out->linesize[p];
+        dst_buf.plane[plane].stride = out->linesize[p];
+        dst_buf.plane[plane].mask   = -1;
+    }
+
+    ret = zimg_filter_graph_process(s->graph[jobnr], &src_buf, &dst_buf, s->tmp[jobnr], 0, 0, 0, 0);
+    if (ret)
+        return print_zimg_error(ctx);
+
+    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
+        src_buf.plane[0].data   = in->data[3];
+        src_buf.plane[0].stride = in->linesize[3];
+        src_buf.plane[0].mask   = -1;
+
+        dst_buf.plane[0].data   = out->data[3] + slice_start * out->linesize[3];
+        dst_buf.plane[0].stride = out->linesize[3];
+        dst_buf.plane[0].mask   = -1;
+
+        ret = zimg_filter_graph_process(s->alpha_graph[jobnr], &src_buf, &dst_buf, s->tmp[jobnr], 0, 0, 0, 0);
+        if (ret)
+            return print_zimg_error(ctx);
+    } else if (odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
+        int x, y;
+
+        if (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) {
+            for (y = slice_start; y < slice_end; y++) {
+                for (x = 0; x < out->width; x++) {
+                    AV_WN32(out->data[3] + x * odesc->comp[3].step + y * out->linesize[3],
+                            av_float2int(1.0f));
+                }
+            }
+        } else {
+            for (y = slice_start; y < slice_end; y++)
+                memset(out->data[3] + y * out->linesize[3], 0xff, out->width);
+        }
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
-    ZScaleContext *s = link->dst->priv;
-    AVFilterLink *outlink = link->dst->outputs[0];
+    AVFilterContext *ctx = link->dst;
+    ZScaleContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
     const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(outlink->format);
-    zimg_image_buffer_const src_buf = { ZIMG_API_VERSION };
-    zimg_image_buffer dst_buf = { ZIMG_API_VERSION };
+    int rets[MAX_THREADS];
+    ThreadData td;
     char buf[32];
-    int ret = 0, plane;
+    int ret = 0, i;
     AVFrame *out;
 
     out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
@@ -524,19 +657,18 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     out->width  = outlink->w;
     out->height = outlink->h;
 
-    if(   in->width  != link->w
+    /* The output properties only depend on the input ones and the options,
+     * so the graphs are only rebuilt when either of them changes. */
+    if(   !s->graph[0]
+       || s->params_changed
+       || in->width  != link->w
        || in->height != link->h
        || in->format != link->format
        || s->in_colorspace != in->colorspace
        || s->in_trc  != in->color_trc
        || s->in_primaries != in->color_primaries
        || s->in_range != in->color_range
-       || s->out_colorspace != out->colorspace
-       || s->out_trc  != out->color_trc
-       || s->out_primaries != out->color_primaries
-       || s->out_range != out->color_range
-       || s->in_chromal != in->chroma_location
-       || s->out_chromal != out->chroma_location) {
+       || s->in_chromal != in->chroma_location) {
         snprintf(buf, sizeof(buf)-1, "%d", outlink->w);
         av_opt_set(s, "w", buf, 0);
         snprintf(buf, sizeof(buf)-1, "%d", outlink->h);
@@ -583,19 +715,11 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         if (s->chromal != -1)
             out->chroma_location = (int)s->dst_format.chroma_location - 1;
 
-        ret = graph_build(&s->graph, &s->params, &s->src_format, &s->dst_format,
-                          &s->tmp, &s->tmp_size);
-        if (ret < 0)
-            goto fail;
-
         s->in_colorspace  = in->colorspace;
         s->in_trc         = in->color_trc;
         s->in_primaries   = in->color_primaries;
         s->in_range       = in->color_range;
-        s->out_colorspace = out->colorspace;
-        s->out_trc        = out->color_trc;
-        s->out_primaries  = out->color_primaries;
-        s->out_range      = out->color_range;
+        s->in_chromal     = in->chroma_location;
 
         if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
             zimg_image_format_default(&s->alpha_src_format, ZIMG_API_VERSION);
@@ -617,14 +741,24 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
             s->alpha_dst_format.depth = odesc->comp[0].depth;
             s->alpha_dst_format.pixel_type = (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) ? ZIMG_PIXEL_FLOAT : odesc->comp[0].depth > 8 ? ZIMG_PIXEL_WORD : ZIMG_PIXEL_BYTE;
             s->alpha_dst_format.color_family = ZIMG_COLOR_GREY;
+        }
+
+        s->nb_threads = FFMIN3(ff_filter_get_nb_threads(ctx), MAX_THREADS,
+                               FFMAX(out->height >> (odesc->log2_chroma_h + 3), 1));
+        slice_params(s, out->height, in->height, odesc->log2_chroma_h);
 
-            zimg_filter_graph_free(s->alpha_graph);
-            s->alpha_graph = zimg_filter_graph_build(&s->alpha_src_format, &s->alpha_dst_format, &s->alpha_params);
-            if (!s->alpha_graph) {
-                ret = print_zimg_error(link->dst);
+        for (i = 0; i < MAX_THREADS; i++) {
+            zimg_filter_graph_free(s->graph[i]);
+            zimg_filter_graph_free(s->alpha_graph[i]);
+            s->graph[i] = s->alpha_graph[i] = NULL;
+        }
+        for (i = 0; i < s->nb_threads; i++) {
+            ret = graphs_build(s, i, desc->flags & AV_PIX_FMT_FLAG_ALPHA &&
+                                     odesc->flags & AV_PIX_FMT_FLAG_ALPHA);
+            if (ret < 0)
                 goto fail;
-            }
         }
+        s->params_changed = 0;
     }
 
     if (s->colorspace != -1)
@@ -639,57 +773,24 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     if (s->trc != -1)
         out->color_trc = (int)s->dst_format.transfer_characteristics;
 
+    if (s->chromal != -1)
+        out->chroma_location = (int)s->dst_format.chroma_location - 1;
+
     av_reduce(&out->sample_aspect_ratio.num, &out->sample_aspect_ratio.den,
               (int64_t)in->sample_aspect_ratio.num * outlink->h * link->w,
               (int64_t)in->sample_aspect_ratio.den * outlink->w * link->h,
               INT_MAX);
 
-    for (plane = 0; plane < 3; plane++) {
-        int p = desc->comp[plane].plane;
-        src_buf.plane[plane].data   = in->data[p];
-        src_buf.plane[plane].stride = in->linesize[p];
-        src_buf.plane[plane].mask   = -1;
-
-        p = odesc->comp[plane].plane;
-        dst_buf.plane[plane].data   = out->data[p];
-        dst_buf.plane[plane].stride = out->linesize[p];
-        dst_buf.plane[plane].mask   = -1;
-    }
-
-    ret = zimg_filter_graph_process(s->graph, &src_buf, &dst_buf, s->tmp, 0, 0, 0, 0);
-    if (ret) {
-        ret = print_zimg_error(link->dst);
-        goto fail;
-    }
-
-    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-        src_buf.plane[0].data   = in->data[3];
-        src_buf.plane[0].stride = in->linesize[3];
-        src_buf.plane[0].mask   = -1;
-
-        dst_buf.plane[0].data   = out->data[3];
-        dst_buf.plane[0].stride = out->linesize[3];
-        dst_buf.plane[0].mask   = -1;
-
-        ret = zimg_filter_graph_process(s->alpha_graph, &src_buf, &dst_buf, s->tmp, 0, 0, 0, 0);
-        if (ret) {
-            ret = print_zimg_error(link->dst);
+    td.desc  = desc;
+    td.odesc = odesc;
+    td.in    = in;
+    td.out   = out;
+    ctx->internal->execute(ctx, filter_slice, &td, rets, s->nb_threads);
+    for (i = 0; i < s->nb_threads; i++) {
+        if (rets[i] < 0) {
+            ret = rets[i];
             goto fail;
         }
-    } else if (odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-        int x, y;
-
-        if (odesc->flags & AV_PIX_FMT_FLAG_FLOAT) {
-            for (y = 0; y < out->height; y++) {
-                for (x = 0; x < out->width; x++) {
-                    AV_WN32(out->data[3] + x * odesc->comp[3].step + y * out->linesize[3],
-                            av_float2int(1.0f));
-                }
-            }
-        } else {
-            for (y = 0; y < outlink->h; y++)
-                memset(out->data[3] + y * out->linesize[3], 0xff, outlink->w);
-        }
     }
 
 fail:
@@ -706,10 +807,14 @@ static void uninit(AVFilterContext *ctx)
 {
     ZScaleContext *s = ctx->priv;
 
-    zimg_filter_graph_free(s->graph);
-    zimg_filter_graph_free(s->alpha_graph);
-    av_freep(&s->tmp);
-    s->tmp_size = 0;
+    int i;
+
+    for (i = 0; i < MAX_THREADS; i++) {
+        zimg_filter_graph_free(s->graph[i]);
+        zimg_filter_graph_free(s->alpha_graph[i]);
+        av_freep(&s->tmp[i]);
+        s->tmp_size[i] = 0;
+    }
 }
 
 static int process_command(AVFilterContext *ctx, const char *cmd, const char *args,
@@ -729,6 +834,8 @@ static int process_command(AVFilterContext *ctx, const char *cmd, const char *ar
         if ((ret = config_props(outlink)) < 0) {
             s->w = old_w;
             s->h = old_h;
+        } else {
+            s->params_changed = 1;
         }
     } else
         ret = AVERROR(ENOSYS);
@@ -896,4 +1003,5 @@ AVFilter ff_vf_zscale = {
     .inputs          = avfilter_vf_zscale_inputs,
     .outputs         = avfilter_vf_zscale_outputs,
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -35,6 +35,15 @@
 
 #define BUFFER_ALIGN 32
 
+static FFFramePool *video_pool_init(AVFilterLink *link, int w, int h)
+{
+    if (link->graph)
+        return ff_frame_pool_cache_get_video(link->graph->internal->frame_pools,
+                                             av_buffer_allocz, w, h,
+                                             link->format, BUFFER_ALIGN);
+    return ff_frame_pool_video_init(av_buffer_allocz, w, h,
+                                    link->format, BUFFER_ALIGN);
+}
 
 AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
 {
@@ -65,8 +74,7 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
     }
 
     if (!link->frame_pool) {
-        link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz, w, h,
-                                                    link->format, BUFFER_ALIGN);
+        link->frame_pool = video_pool_init(link, w, h);
         if (!link->frame_pool)
             return NULL;
     } else {
@@ -80,8 +88,7 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
             pool_format != link->format || pool_align != BUFFER_ALIGN) {
 
             ff_frame_pool_uninit((FFFramePool **)&link->frame_pool);
-            link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz, w, h,
-                                                        link->format, BUFFER_ALIGN);
+            link->frame_pool = video_pool_init(link, w, h);
             if (!link->frame_pool)
                 return NULL;
         }
@@ -26,33 +26,59 @@
 #include <stdint.h>
 #include "video.h"
 
+/* number of padding samples on each side of the rows of the vertically
+ * filtered temporary image; the 2 samples next to the image hold the mirrored
+ * edge so that convolution_x needs no border handling */
+#define VMAFMOTION_TEMP_PAD 16
+
 typedef struct VMAFMotionDSPContext {
+    /* sum of absolute differences of two w x h images */
     uint64_t (*sad)(const uint16_t *img1, const uint16_t *img2, int w, int h,
                     ptrdiff_t img1_stride, ptrdiff_t img2_stride);
-    void (*convolution_x)(const uint16_t *filter, int filt_w, const uint16_t *src,
-                          uint16_t *dst, int w, int h, ptrdiff_t src_stride,
-                          ptrdiff_t dst_stride);
-    void (*convolution_y)(const uint16_t *filter, int filt_w, const uint8_t *src,
+    /* 5-tap horizontal filter of h rows; the 2 samples on each side of the src
+     * rows must be readable, and dst may be written up to a multiple of 16
+     * samples */
+    void (*convolution_x)(const uint16_t *filter, const uint16_t *src,
                           uint16_t *dst, int w, int h, ptrdiff_t src_stride,
                           ptrdiff_t dst_stride);
+    /* 5-tap vertical filter of one row, src pointing to the 5 input rows */
+    void (*convolution_y)(const uint16_t *filter, const uint8_t *const *src,
+                          uint16_t *dst, int w);
 } VMAFMotionDSPContext;
 
-void ff_vmafmotion_init_x86(VMAFMotionDSPContext *dsp);
+void ff_vmafmotion_dsp_init(VMAFMotionDSPContext *dsp, int bpp);
+void ff_vmafmotion_init_x86(VMAFMotionDSPContext *dsp, int bpp);
+
+/* C versions, used for the left-over samples of the SIMD versions */
+uint64_t ff_vmafmotion_sad_c(const uint16_t *img1, const uint16_t *img2,
+                             int w, int h, ptrdiff_t img1_stride,
+                             ptrdiff_t img2_stride);
+void ff_vmafmotion_convolution_y_8bit_c(const uint16_t *filter,
+                                        const uint8_t *const *src,
+                                        uint16_t *dst, int w);
+void ff_vmafmotion_convolution_y_10bit_c(const uint16_t *filter,
+                                         const uint8_t *const *src,
+                                         uint16_t *dst, int w);
 
 typedef struct VMAFMotionData {
     uint16_t filter[5];
     int width;
     int height;
     ptrdiff_t stride;
+    ptrdiff_t temp_stride;
     uint16_t *blur_data[2 /* cur, prev */];
     uint16_t *temp_data;
     double motion_sum;
     uint64_t nb_frames;
+    int nb_threads;
+    uint64_t *job_sad;
     VMAFMotionDSPContext vmafdsp;
 } VMAFMotionData;
 
-int ff_vmafmotion_init(VMAFMotionData *data, int w, int h, enum AVPixelFormat fmt);
-double ff_vmafmotion_process(VMAFMotionData *data, AVFrame *frame);
+int ff_vmafmotion_init(VMAFMotionData *data, int w, int h, enum AVPixelFormat fmt,
+                       int nb_threads);
+double ff_vmafmotion_process(AVFilterContext *ctx, VMAFMotionData *data,
+                             AVFrame *frame);
 double ff_vmafmotion_uninit(VMAFMotionData *data);
 
 #endif /* AVFILTER_VMAF_MOTION_H */
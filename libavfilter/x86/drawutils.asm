@@ -0,0 +1,107 @@
+;*****************************************************************************
+;* x86-optimized functions for the drawing utilities
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION_RODATA 32
+
+pd_0x1010101: times 8 dd 0x1010101
+
+SECTION .text
+
+; void ff_blend_row8(uint8_t *dst, const uint8_t *mask,
+;                    unsigned src, unsigned alpha, int w)
+;
+; dst = ((0x1010101 - alpha * mask) * dst + alpha * mask * src) >> 24,
+; computed modulo 2^32 like the C version.
+%macro BLEND_ROW8 0
+cglobal blend_row8, 5, 7, 6, dst, mask, src, alpha, w, tmp, tmp2
+    movsxdifnidn     wq, wd
+    movd            xm3, srcd
+    movd            xm4, alphad
+%if cpuflag(avx2)
+    vpbroadcastd     m3, xm3
+    vpbroadcastd     m4, xm4
+%else
+    pshufd           m3, m3, 0
+    pshufd           m4, m4, 0
+%endif
+    mova             m5, [pd_0x1010101]
+    add            dstq, wq
+    add           maskq, wq
+    neg              wq
+    add              wq, mmsize / 4
+    jg .tail_init
+
+.loop:
+    pmovzxbd         m0, [maskq + wq - mmsize / 4]
+    pmovzxbd         m1, [dstq  + wq - mmsize / 4]
+    pmulld           m0, m4
+    psubd            m2, m5, m0
+    pmulld           m1, m2
+    pmulld           m0, m3
+    paddd            m0, m1
+    psrld            m0, 24
+%if mmsize == 32
+    vextracti128    xm1, m0, 1
+    packusdw        xm0, xm1
+    packuswb        xm0, xm0
+    movq [dstq + wq - mmsize / 4], xm0
+%else
+    packusdw         m0, m0
+    packuswb         m0, m0
+    movd [dstq + wq - mmsize / 4], m0
+%endif
+    add              wq, mmsize / 4
+    jle .loop
+
+.tail_init:
+    sub              wq, mmsize / 4
+    jz .end
+
+; dst * 0x1010101 + alpha * mask * (src - dst), equal modulo 2^32
+.tail:
+    movzx          tmpd, byte [maskq + wq]
+    imul           tmpd, alphad
+    movzx         tmp2d, byte [dstq + wq]
+    neg           tmp2d
+    add           tmp2d, srcd
+    imul          tmp2d, tmpd
+    movzx          tmpd, byte [dstq + wq]
+    imul           tmpd, tmpd, 0x1010101
+    add            tmpd, tmp2d
+    shr            tmpd, 24
+    mov   [dstq + wq], tmpb
+    inc              wq
+    jl .tail
+
+.end:
+    RET
+%endmacro
+
+%if ARCH_X86_64
+INIT_XMM sse4
+BLEND_ROW8
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+BLEND_ROW8
+%endif
+%endif
@@ -0,0 +1,156 @@
+;*****************************************************************************
+;* x86-optimized functions for the lut filters
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION_RODATA 32
+
+pd_1:        times 8 dd 1
+pd_even:     times 8 dd 0xfffffffe
+pd_255:      times 8 dd 255
+pd_65535:    times 8 dd 65535
+
+SECTION .text
+
+; Gather the 16-bit entries lut[m%2] into the dwords of m%1. The gather is
+; done on the aligned dword holding each entry, so it never reads past the
+; end of the table. Clobbers m%2, m%3 and m%4.
+%macro LOOKUP 4 ; dst, index, tmp, mask
+    pand             m%3, m%2, [pd_1]
+    pslld            m%3, 4
+    pand             m%2, [pd_even]
+    pcmpeqd          m%4, m%4
+    vpgatherdd       m%1, [lutq + m%2 * 2], m%4
+    vpsrlvd          m%1, m%1, m%3
+%endmacro
+
+; store the 8 dwords of m%1 as bytes or words at dstq + wq + %4, clobbers m%2
+%macro STORE 4 ; src, tmp, bits, offset
+%if %3 == 8
+    pand             m%1, [pd_255]
+%else
+    pand             m%1, [pd_65535]
+%endif
+    vextracti128    xm%2, m%1, 1
+    packusdw        xm%1, xm%2
+%if %3 == 8
+    packuswb        xm%1, xm%1
+    movq    [dstq + wq %4], xm%1
+%else
+    movu    [dstq + wq %4], xm%1
+%endif
+%endmacro
+
+; store the low byte or word of r%1d at dstq + wq, clobbers xm%2
+%macro STORE_SCALAR 3 ; src, tmp, bits
+%if %3 == 8
+    movd             xm%2, r%1d
+    pextrb    [dstq + wq], xm%2, 0
+%else
+    mov       [dstq + wq], r%1w
+%endif
+%endmacro
+
+; %1 bits, %2 b or w, %3 byte or word
+%macro LUT_ROW 3
+cglobal lut_row%1, 4, 5, 4, dst, src, lut, w, tmp
+    movsxdifnidn       wq, wd
+%if %1 == 16
+    add                wq, wq
+%endif
+    add              srcq, wq
+    add              dstq, wq
+    neg                wq
+    add                wq, 8 * %1 / 8
+    jg .tail
+.loop:
+    pmovzx%2d          m0, [srcq + wq - 8 * %1 / 8]
+    LOOKUP              1, 0, 2, 3
+    STORE               1, 2, %1, - 8 * %1 / 8
+    add                wq, 8 * %1 / 8
+    jle .loop
+.tail:
+    sub                wq, 8 * %1 / 8
+    jge .end
+.tail_loop:
+    movzx            tmpd, %3 [srcq + wq]
+    movzx            tmpd, word [lutq + tmpq * 2]
+    STORE_SCALAR        4, 0, %1
+    add                wq, %1 / 8
+    jl .tail_loop
+.end:
+    RET
+
+; The table has 1 << (2 * depthx) entries, both samples are masked to
+; depthx bits so that the index stays within it.
+cglobal lut2_row%1, 6, 6, 7, dst, srcx, srcy, lut, depthx, w
+    movd              xm6, depthxd
+    pcmpeqd            m5, m5
+    pslld              m5, xm6
+    pcmpeqd            m3, m3
+    pxor               m5, m3
+    movsxdifnidn       wq, wd
+%if %1 == 16
+    add                wq, wq
+%endif
+    add             srcxq, wq
+    add             srcyq, wq
+    add              dstq, wq
+    neg                wq
+    add                wq, 8 * %1 / 8
+    jg .tail
+.loop:
+    pmovzx%2d          m0, [srcxq + wq - 8 * %1 / 8]
+    pmovzx%2d          m1, [srcyq + wq - 8 * %1 / 8]
+    pand               m0, m5
+    pand               m1, m5
+    pslld              m1, xm6
+    por                m0, m1
+    LOOKUP              1, 0, 2, 3
+    STORE               1, 2, %1, - 8 * %1 / 8
+    add                wq, 8 * %1 / 8
+    jle .loop
+.tail:
+    sub                wq, 8 * %1 / 8
+    jge .end
+    ; depthx is in xm6 now, its register is free
+.tail_loop:
+    movzx         depthxd, %3 [srcyq + wq]
+    movd              xm1, depthxd
+    movzx         depthxd, %3 [srcxq + wq]
+    movd              xm0, depthxd
+    pand              xm0, xm5
+    pand              xm1, xm5
+    pslld             xm1, xm6
+    por               xm0, xm1
+    movd          depthxd, xm0
+    movzx         depthxd, word [lutq + depthxq * 2]
+    STORE_SCALAR        4, 0, %1
+    add                wq, %1 / 8
+    jl .tail_loop
+.end:
+    RET
+%endmacro
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+LUT_ROW 8, b, byte
+LUT_ROW 16, w, word
+%endif
@@ -0,0 +1,43 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/lutdsp.h"
+
+void ff_lut_row8_avx2(uint8_t *dst, const uint8_t *src,
+                      const uint16_t *lut, int w);
+void ff_lut_row16_avx2(uint16_t *dst, const uint16_t *src,
+                       const uint16_t *lut, int w);
+void ff_lut2_row8_avx2(uint8_t *dst, const uint8_t *srcx, const uint8_t *srcy,
+                       const uint16_t *lut, int depthx, int w);
+void ff_lut2_row16_avx2(uint16_t *dst, const uint16_t *srcx, const uint16_t *srcy,
+                        const uint16_t *lut, int depthx, int w);
+
+av_cold void ff_lutdsp_init_x86(LutDSPContext *dsp)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (EXTERNAL_AVX2_FAST(cpu_flags)) {
+        dsp->lut_row8   = ff_lut_row8_avx2;
+        dsp->lut_row16  = ff_lut_row16_avx2;
+        dsp->lut2_row8  = ff_lut2_row8_avx2;
+        dsp->lut2_row16 = ff_lut2_row16_avx2;
+    }
+}
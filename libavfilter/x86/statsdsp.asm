@@ -0,0 +1,185 @@
+;*****************************************************************************
+;* x86-optimized functions for the video statistics filters
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION_RODATA 32
+
+pb_1: times 32 db 1
+
+SECTION .text
+
+%if ARCH_X86_64
+
+; add the qwords of m%1 together into the low dword of xm%1, clobbers m%2
+%macro HADDQ 2
+%if mmsize == 32
+    vextracti128    xm%2, m%1, 1
+    paddq           xm%1, xm%2
+%endif
+    pshufd          xm%2, xm%1, q0032
+    paddq           xm%1, xm%2
+%endmacro
+
+%macro STATS_FUNCS 0
+;------------------------------------------------------------------------------
+; int ff_stats_count_le(const uint8_t *src, int w, int threshold)
+;------------------------------------------------------------------------------
+cglobal stats_count_le, 3, 5, 5, src, w, thr, cnt, x
+    movsxdifnidn     wq, wd
+    movd            xm2, thrd
+%if cpuflag(avx2)
+    vpbroadcastb     m2, xm2
+%else
+    punpcklbw        m2, m2
+    pshuflw          m2, m2, 0
+    punpcklqdq       m2, m2
+%endif
+    mova             m3, [pb_1]
+    pxor             m4, m4
+    pxor             m1, m1
+    mov              xq, wq
+    and              xq, -mmsize
+    add            srcq, xq
+    neg              xq
+    jz .reduce
+.loop:
+    movu             m0, [srcq + xq]
+    pmaxub           m0, m2
+    pcmpeqb          m0, m2
+    pand             m0, m3
+    psadbw           m0, m1
+    paddq            m4, m0
+    add              xq, mmsize
+    jl .loop
+.reduce:
+    HADDQ             4, 0
+    movd           cntd, xm4
+    and              wd, mmsize - 1
+    jz .end
+.tail:
+    movzx            xd, byte [srcq]
+    cmp            thrd, xd
+    sbb            cntd, -1
+    inc            srcq
+    dec              wd
+    jnz .tail
+.end:
+    mov             eax, cntd
+    RET
+
+;------------------------------------------------------------------------------
+; int ff_stats_row_sum(const uint8_t *src, int w)
+;------------------------------------------------------------------------------
+cglobal stats_row_sum, 2, 4, 3, src, w, sum, x
+    movsxdifnidn     wq, wd
+    pxor             m1, m1
+    pxor             m2, m2
+    mov              xq, wq
+    and              xq, -mmsize
+    add            srcq, xq
+    neg              xq
+    jz .reduce
+.loop:
+    movu             m0, [srcq + xq]
+    psadbw           m0, m1
+    paddq            m2, m0
+    add              xq, mmsize
+    jl .loop
+.reduce:
+    HADDQ             2, 0
+    movd           sumd, xm2
+    and              wd, mmsize - 1
+    jz .end
+.tail:
+    movzx            xd, byte [srcq]
+    add            sumd, xd
+    inc            srcq
+    dec              wd
+    jnz .tail
+.end:
+    mov             eax, sumd
+    RET
+
+;------------------------------------------------------------------------------
+; void ff_stats_col_sum(uint32_t *sum, const uint8_t *src, int w)
+;------------------------------------------------------------------------------
+cglobal stats_col_sum, 3, 5, 6, sum, src, w, x, tmp
+    movsxdifnidn     wq, wd
+    mov              xq, wq
+    and              xq, -mmsize
+    add            srcq, xq
+    lea            sumq, [sumq + 4 * xq]
+    neg              xq
+    jz .tail
+%if notcpuflag(avx2)
+    pxor             m5, m5
+%endif
+.loop:
+%if cpuflag(avx2)
+    pmovzxbd         m0, [srcq + xq]
+    pmovzxbd         m1, [srcq + xq +  8]
+    pmovzxbd         m2, [srcq + xq + 16]
+    pmovzxbd         m3, [srcq + xq + 24]
+%else
+    movu             m2, [srcq + xq]
+    punpckhbw        m3, m2, m5
+    punpcklbw        m2, m5
+    punpcklwd        m0, m2, m5
+    punpckhwd        m1, m2, m5
+    punpcklwd        m2, m3, m5
+    punpckhwd        m3, m5
+%endif
+    movu             m4, [sumq + 4 * xq]
+    paddd            m0, m4
+    movu             m4, [sumq + 4 * xq +     mmsize]
+    paddd            m1, m4
+    movu             m4, [sumq + 4 * xq + 2 * mmsize]
+    paddd            m2, m4
+    movu             m4, [sumq + 4 * xq + 3 * mmsize]
+    paddd            m3, m4
+    movu [sumq + 4 * xq             ], m0
+    movu [sumq + 4 * xq +     mmsize], m1
+    movu [sumq + 4 * xq + 2 * mmsize], m2
+    movu [sumq + 4 * xq + 3 * mmsize], m3
+    add              xq, mmsize
+    jl .loop
+.tail:
+    and              wd, mmsize - 1
+    jz .end
+.tail_loop:
+    movzx          tmpd, byte [srcq + xq]
+    add [sumq + 4 * xq], tmpd
+    inc              xq
+    cmp              xd, wd
+    jl .tail_loop
+.end:
+    RET
+%endmacro
+
+INIT_XMM sse2
+STATS_FUNCS
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+STATS_FUNCS
+%endif
+
+%endif ; ARCH_X86_64
@@ -0,0 +1,45 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/statsdsp.h"
+
+int ff_stats_count_le_sse2(const uint8_t *src, int w, int threshold);
+int ff_stats_count_le_avx2(const uint8_t *src, int w, int threshold);
+int ff_stats_row_sum_sse2(const uint8_t *src, int w);
+int ff_stats_row_sum_avx2(const uint8_t *src, int w);
+void ff_stats_col_sum_sse2(uint32_t *sum, const uint8_t *src, int w);
+void ff_stats_col_sum_avx2(uint32_t *sum, const uint8_t *src, int w);
+
+av_cold void ff_statsdsp_init_x86(StatsDSPContext *dsp)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (ARCH_X86_64 && EXTERNAL_SSE2(cpu_flags)) {
+        dsp->count_le = ff_stats_count_le_sse2;
+        dsp->row_sum  = ff_stats_row_sum_sse2;
+        dsp->col_sum  = ff_stats_col_sum_sse2;
+    }
+    if (ARCH_X86_64 && EXTERNAL_AVX2_FAST(cpu_flags)) {
+        dsp->count_le = ff_stats_count_le_avx2;
+        dsp->row_sum  = ff_stats_row_sum_avx2;
+        dsp->col_sum  = ff_stats_col_sum_avx2;
+    }
+}
@@ -0,0 +1,173 @@
+;*****************************************************************************
+;* x86-optimized functions for nnedi filter
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION .text
+
+%if ARCH_X86_64
+
+;------------------------------------------------------------------------------
+; void ff_nnedi_dot_prods(const float *data, const float *weights, float *vals,
+;                         int n, int len, const float *scale)
+;------------------------------------------------------------------------------
+
+%macro DOT_PRODS 0
+cglobal nnedi_dot_prods, 6, 10, 8, data, weights, vals, n, len, scale, w1, w2, w3, i
+    movsxdifnidn nq, nd
+    movsxdifnidn lenq, lend
+    movss       xm7, [scaleq]
+    shufps      xm7, xm7, 0
+    shl         lenq, 2
+    mov         scaleq, nq
+    imul        scaleq, lenq
+    add         scaleq, weightsq        ; biases
+.loop_n:
+    lea         w1q, [weightsq + lenq]
+    lea         w2q, [weightsq + 2*lenq]
+    lea         w3q, [w1q + 2*lenq]
+    xorps       m0, m0
+    xorps       m1, m1
+    xorps       m2, m2
+    xorps       m3, m3
+    xor         iq, iq
+.loop_len:
+    movu        m4, [dataq + iq]
+%if cpuflag(fma3)
+    fmaddps     m0, m4, [weightsq + iq], m0
+    fmaddps     m1, m4, [w1q + iq], m1
+    fmaddps     m2, m4, [w2q + iq], m2
+    fmaddps     m3, m4, [w3q + iq], m3
+%else
+    movu        m5, [weightsq + iq]
+    movu        m6, [w1q + iq]
+    mulps       m5, m4
+    mulps       m6, m4
+    addps       m0, m5
+    addps       m1, m6
+    movu        m5, [w2q + iq]
+    movu        m6, [w3q + iq]
+    mulps       m5, m4
+    mulps       m6, m4
+    addps       m2, m5
+    addps       m3, m6
+%endif
+    add         iq, mmsize
+    cmp         iq, lenq
+    jl .loop_len
+
+    haddps      m0, m1
+    haddps      m2, m3
+    haddps      m0, m2
+%if mmsize == 32
+    vextractf128 xm1, m0, 1
+    addps       xm0, xm1
+%endif
+    movu        xm1, [scaleq]
+    mulps       xm0, xm7
+    addps       xm0, xm1
+    movu        [valsq], xm0
+
+    add         valsq, 16
+    add         scaleq, 16
+    lea         weightsq, [weightsq + 4*lenq]
+    sub         nd, 4
+    jg .loop_n
+    RET
+%endmacro
+
+;------------------------------------------------------------------------------
+; void ff_nnedi_dot_prods_i16(const int16_t *data, const int16_t *weights,
+;                             float *vals, int n, int len, const float *scale)
+;------------------------------------------------------------------------------
+
+%macro DOT_PRODS_I16 0
+cglobal nnedi_dot_prods_i16, 6, 10, 8, data, weights, vals, n, len, scale, w1, w2, w3, i
+    movsxdifnidn nq, nd
+    movsxdifnidn lenq, lend
+    movss       xm7, [scaleq]
+    shufps      xm7, xm7, 0
+    add         lenq, lenq
+    mov         scaleq, nq
+    imul        scaleq, lenq
+    add         scaleq, weightsq        ; neuron scales and biases
+.loop_n:
+    lea         w1q, [weightsq + lenq]
+    lea         w2q, [weightsq + 2*lenq]
+    lea         w3q, [w1q + 2*lenq]
+    pxor        m0, m0
+    pxor        m1, m1
+    pxor        m2, m2
+    pxor        m3, m3
+    xor         iq, iq
+.loop_len:
+    movu        m4, [dataq + iq]
+    movu        m5, [weightsq + iq]
+    movu        m6, [w1q + iq]
+    pmaddwd     m5, m4
+    pmaddwd     m6, m4
+    paddd       m0, m5
+    paddd       m1, m6
+    movu        m5, [w2q + iq]
+    movu        m6, [w3q + iq]
+    pmaddwd     m5, m4
+    pmaddwd     m6, m4
+    paddd       m2, m5
+    paddd       m3, m6
+    add         iq, mmsize
+    cmp         iq, lenq
+    jl .loop_len
+
+    phaddd      m0, m1
+    phaddd      m2, m3
+    phaddd      m0, m2
+%if mmsize == 32
+    vextracti128 xm1, m0, 1
+    paddd       xm0, xm1
+%endif
+    cvtdq2ps    xm0, xm0
+    movu        xm1, [scaleq]
+    movu        xm2, [scaleq + 16]
+    mulps       xm0, xm1
+    mulps       xm0, xm7
+    addps       xm0, xm2
+    movu        [valsq], xm0
+
+    add         valsq, 16
+    add         scaleq, 32
+    lea         weightsq, [weightsq + 4*lenq]
+    sub         nd, 4
+    jg .loop_n
+    RET
+%endmacro
+
+INIT_XMM sse3
+DOT_PRODS
+INIT_XMM ssse3
+DOT_PRODS_I16
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM fma3
+DOT_PRODS
+INIT_YMM avx2
+DOT_PRODS_I16
+%endif
+
+%endif ; ARCH_X86_64
@@ -0,0 +1,45 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/vf_nnedi.h"
+
+void ff_nnedi_dot_prods_sse3(const float *data, const float *weights, float *vals,
+                             int n, int len, const float *scale);
+void ff_nnedi_dot_prods_fma3(const float *data, const float *weights, float *vals,
+                             int n, int len, const float *scale);
+void ff_nnedi_dot_prods_i16_ssse3(const int16_t *data, const int16_t *weights, float *vals,
+                                  int n, int len, const float *scale);
+void ff_nnedi_dot_prods_i16_avx2(const int16_t *data, const int16_t *weights, float *vals,
+                                 int n, int len, const float *scale);
+
+av_cold void ff_nnedi_init_x86(NNEDIDSPContext *dsp)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (ARCH_X86_64 && EXTERNAL_SSE3(cpu_flags))
+        dsp->dot_prods = ff_nnedi_dot_prods_sse3;
+    if (ARCH_X86_64 && EXTERNAL_SSSE3(cpu_flags))
+        dsp->dot_prods_i16 = ff_nnedi_dot_prods_i16_ssse3;
+    if (ARCH_X86_64 && EXTERNAL_FMA3_FAST(cpu_flags))
+        dsp->dot_prods = ff_nnedi_dot_prods_fma3;
+    if (ARCH_X86_64 && EXTERNAL_AVX2_FAST(cpu_flags))
+        dsp->dot_prods_i16 = ff_nnedi_dot_prods_i16_avx2;
+}
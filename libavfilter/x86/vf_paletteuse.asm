@@ -0,0 +1,117 @@
+;*****************************************************************************
+;* x86-optimized functions for paletteuse filter
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+
+SECTION_RODATA 32
+
+; the x values of the 4 dword vectors are interleaved so that packing them
+; per lane gives the bytes in order
+pd_x:   dd 0, 1, 2, 3, 16, 17, 18, 19
+pd_4:   times 8 dd 4
+pd_8:   times 8 dd 8
+pd_12:  times 8 dd 12
+pd_16:  times 8 dd 16
+pd_32:  times 8 dd 32
+pd_max: times 8 dd 0x7fffffff
+
+SECTION .text
+
+%if ARCH_X86_64
+
+%macro BROADCASTD 2
+%if cpuflag(avx2)
+    vpbroadcastd %1, %2
+%else
+    movd        %1, %2
+    pshufd      %1, %1, 0
+%endif
+%endmacro
+
+; %1 distance register, %2 index register, %3 x offset
+%macro UPDATE 3
+%if %3
+    psubd       m12, m9, [pd_%3]
+%else
+    mova        m12, m9
+%endif
+    pmulld      m12, m12
+    paddd       m12, m10
+    pcmpgtd     m13, m%1, m12
+    pminsd      m%1, m12
+    pxor        m12, m11, m%2
+    pand        m12, m13
+    pxor        m%2, m12
+%endmacro
+
+;------------------------------------------------------------------------------
+; void ff_paletteuse_nearest_row(uint8_t *dst, const int *base, const int *comp,
+;                                const int *idx, int nb_entries)
+;------------------------------------------------------------------------------
+
+%macro NEAREST_ROW 0
+cglobal paletteuse_nearest_row, 5, 7, 14, dst, base, comp, idx, n, x, i
+    movsxdifnidn nq, nd
+    mova        m8, [pd_x]
+    xor         xq, xq
+.loop_x:
+    mova        m0, [pd_max]
+    mova        m1, m0
+    mova        m2, m0
+    mova        m3, m0
+    pxor        m4, m4
+    pxor        m5, m5
+    pxor        m6, m6
+    pxor        m7, m7
+    xor         iq, iq
+.loop_i:
+    BROADCASTD  m9,  [compq + 4*iq]
+    BROADCASTD  m10, [baseq + 4*iq]
+    BROADCASTD  m11, [idxq  + 4*iq]
+    psubd       m9, m8              ; (c - x)^2 == (x - c)^2
+    UPDATE       0, 4, 0
+    UPDATE       1, 5, 4
+    UPDATE       2, 6, 8
+    UPDATE       3, 7, 12
+    inc         iq
+    cmp         iq, nq
+    jl .loop_i
+
+    packusdw    m4, m5
+    packusdw    m6, m7
+    packuswb    m4, m6
+    movu        [dstq + xq], m4
+    paddd       m8, [pd_ %+ mmsize]
+    add         xq, mmsize
+    cmp         xq, 256
+    jl .loop_x
+    RET
+%endmacro
+
+INIT_XMM sse4
+NEAREST_ROW
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+NEAREST_ROW
+%endif
+
+%endif ; ARCH_X86_64
@@ -0,0 +1,106 @@
+;*****************************************************************************
+;* x86-optimized functions for remap filter
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION_RODATA 32
+
+pd_255:   times 8 dd 255
+pd_65535: times 8 dd 65535
+
+SECTION .text
+
+;------------------------------------------------------------------------------
+; void ff_remap_line<bits>(uint8_t *dst, const uint8_t *src, ptrdiff_t slinesize,
+;                          const uint16_t *xmap, const uint16_t *ymap,
+;                          int w, int sw, int sh, int end)
+;
+; w is a multiple of 8. Each source sample is fetched with a dword gather at
+; its byte offset, the lanes whose coordinates are out of range are masked
+; out of the gather and stay 0. end is the offset of the last dword of the
+; source: the 8 and 16-bit samples past it are gathered from there and
+; shifted down, so that the gathers never read past the source.
+;------------------------------------------------------------------------------
+%macro REMAP_LINE 1 ; bits per sample
+cglobal remap_line%1, 9, 10, 9, dst, src, slinesize, xmap, ymap, w, sw, sh, end, x
+%if %1 < 32
+    movd            xm8, endd
+    vpbroadcastd     m8, xm8
+%endif
+    movd            xm5, swd
+    vpbroadcastd     m5, xm5
+    movd            xm6, shd
+    vpbroadcastd     m6, xm6
+    movd            xm7, slinesized
+    vpbroadcastd     m7, xm7
+    movsxdifnidn     wq, wd
+    test             wq, wq
+    jle .end
+    xor              xq, xq
+.loop:
+    pmovzxwd         m0, [xmapq + 2 * xq]
+    pmovzxwd         m1, [ymapq + 2 * xq]
+    pcmpgtd          m2, m5, m0
+    pcmpgtd          m3, m6, m1
+    pand             m2, m3
+    pmulld           m1, m7
+%if %1 == 16
+    paddd            m0, m0
+%elif %1 == 32
+    pslld            m0, 2
+%endif
+    paddd            m1, m0
+    pxor             m4, m4
+%if %1 < 32
+    pminsd           m3, m1, m8
+    psubd            m1, m3
+    pslld            m1, 3
+    vpgatherdd       m4, [srcq + m3], m2
+    vpsrlvd          m4, m4, m1
+%else
+    vpgatherdd       m4, [srcq + m1], m2
+%endif
+%if %1 == 8
+    pand             m4, [pd_255]
+    packusdw         m4, m4
+    vpermq           m4, m4, q3120
+    packuswb        xm4, xm4
+    movq    [dstq + xq], xm4
+%elif %1 == 16
+    pand             m4, [pd_65535]
+    packusdw         m4, m4
+    vpermq           m4, m4, q3120
+    movu [dstq + 2 * xq], xm4
+%else
+    movu [dstq + 4 * xq], m4
+%endif
+    add              xq, 8
+    cmp              xq, wq
+    jl .loop
+.end:
+    RET
+%endmacro
+
+%if ARCH_X86_64 && HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+REMAP_LINE 8
+REMAP_LINE 16
+REMAP_LINE 32
+%endif
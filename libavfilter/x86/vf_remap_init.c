@@ -0,0 +1,64 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/remap.h"
+
+/* declares ff_remap_line<BITS>_<OPT>() and a wrapper completing the
+ * left-over samples in C */
+#define REMAP_LINE_FUNC(BITS, OPT)                                                  \
+void ff_remap_line##BITS##_##OPT(uint8_t *dst, const uint8_t *src,                  \
+                                 ptrdiff_t slinesize, const uint16_t *xmap,         \
+                                 const uint16_t *ymap, int w, int sw, int sh,       \
+                                 int end);                                          \
+static void remap_line##BITS##_##OPT(uint8_t *dst, const uint8_t *src,              \
+                                     ptrdiff_t slinesize, const uint16_t *xmap,     \
+                                     const uint16_t *ymap, int w, int sw, int sh)   \
+{                                                                                   \
+    /* offset of the last dword of the source, which the gathers stop at */         \
+    const ptrdiff_t end = FFMAX((sh - 1) * slinesize, 0) + sw * (BITS / 8) - 4;     \
+    int left_over = w & 7;                                                          \
+                                                                                    \
+    if (end < 0)                                                                    \
+        left_over = w;                                                              \
+    w -= left_over;                                                                 \
+    if (w > 0)                                                                      \
+        ff_remap_line##BITS##_##OPT(dst, src, slinesize, xmap, ymap, w, sw, sh,     \
+                                    end);                                           \
+    if (left_over > 0)                                                              \
+        ff_remap_line##BITS##_c(dst + w * (BITS / 8), src, slinesize,               \
+                                xmap + w, ymap + w, left_over, sw, sh);             \
+}
+
+REMAP_LINE_FUNC(8,  avx2)
+REMAP_LINE_FUNC(16, avx2)
+REMAP_LINE_FUNC(32, avx2)
+
+av_cold void ff_remap_init_x86(RemapDSPContext *dsp)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (ARCH_X86_64 && EXTERNAL_AVX2_FAST(cpu_flags)) {
+        dsp->remap_line8  = remap_line8_avx2;
+        dsp->remap_line16 = remap_line16_avx2;
+        dsp->remap_line32 = remap_line32_avx2;
+    }
+}
@@ -0,0 +1,155 @@
+;*****************************************************************************
+;* x86-optimized functions for tonemap filter
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION_RODATA 32
+
+pf_1:        times 8 dd 1.0
+pf_eps:      times 8 dd 1.0e-6
+pf_lut_size: times 8 dd 1024.0 ; TONEMAP_LUT_SIZE
+
+SECTION .text
+
+; load lut[idx] into m%1 and lut[idx + 1] into m%2 for every lane of m%3
+%macro GATHER_LUT 3
+%if cpuflag(avx2)
+    pcmpeqd           m7, m7
+    vgatherdps       m%1, [lutq + m%3 * 4], m7
+    pcmpeqd           m7, m7
+    vgatherdps       m%2, [lutq + m%3 * 4 + 4], m7
+%else
+    movd            idxd, m%3
+    movss            m%1, [lutq + idxq * 4]
+    movss            m%2, [lutq + idxq * 4 + 4]
+%assign i 1
+%rep 3
+    pextrd          idxd, m%3, i
+    insertps         m%1, [lutq + idxq * 4], i << 4
+    insertps         m%2, [lutq + idxq * 4 + 4], i << 4
+%assign i i+1
+%endrep
+%endif
+%endmacro
+
+; tone map the pixels of m0, m1 and m2 in place, %1 desaturate
+%macro TONEMAP_PIXELS 1
+%if %1
+    mulps             m3, m0, m8
+    mulps             m4, m1, m9
+    addps             m3, m4
+    mulps             m4, m2, m10
+    addps             m3, m4            ; luma
+    subps             m4, m3, m11
+    maxps             m4, m13
+    maxps             m5, m3, m13
+    divps             m4, m5            ; overbright
+    mova              m5, [pf_1]
+    subps             m5, m4
+    mulps             m3, m4
+    mulps             m0, m5
+    mulps             m1, m5
+    mulps             m2, m5
+    addps             m0, m3
+    addps             m1, m3
+    addps             m2, m3
+%endif
+    maxps             m3, m0, m1
+    maxps             m3, m2
+    maxps             m3, m13           ; sig
+    mulps             m4, m3, m12
+    sqrtps            m4, m4
+    minps             m4, m14
+    cvttps2dq         m5, m4
+    cvtdq2ps          m6, m5
+    subps             m4, m6            ; frac
+    GATHER_LUT         6, 15, 5
+    subps            m15, m6
+    mulps            m15, m4
+    addps            m15, m6           ; gain at min(sig, peak)
+    VBROADCASTSS      m5, [paramsq + 20]
+    minps             m5, m3
+    mulps            m15, m5
+    divps            m15, m3
+    mulps             m0, m15
+    mulps             m1, m15
+    mulps             m2, m15
+%endmacro
+
+; %1 function name suffix, %2 desaturate
+%macro TONEMAP_ROW 2
+cglobal tonemap_map_row%1, 9, 10, 16, dstr, dstg, dstb, srcr, srcg, srcb, lut, params, w, idx
+    movsxdifnidn      wq, wd
+    VBROADCASTSS      m8, [paramsq +  0]
+    VBROADCASTSS      m9, [paramsq +  4]
+    VBROADCASTSS     m10, [paramsq +  8]
+    VBROADCASTSS     m11, [paramsq + 12]
+    VBROADCASTSS     m12, [paramsq + 16]
+    mova             m13, [pf_eps]
+    mova             m14, [pf_lut_size]
+    shl               wq, 2
+    add            dstrq, wq
+    add            dstgq, wq
+    add            dstbq, wq
+    add            srcrq, wq
+    add            srcgq, wq
+    add            srcbq, wq
+    neg               wq
+    add               wq, mmsize
+    jg .tail
+.loop:
+    movu              m0, [srcrq + wq - mmsize]
+    movu              m1, [srcgq + wq - mmsize]
+    movu              m2, [srcbq + wq - mmsize]
+    TONEMAP_PIXELS    %2
+    movu   [dstrq + wq - mmsize], m0
+    movu   [dstgq + wq - mmsize], m1
+    movu   [dstbq + wq - mmsize], m2
+    add               wq, mmsize
+    jle .loop
+.tail:
+    sub               wq, mmsize
+    jge .end
+    ; one pixel at a time in the first lane, the other lanes are zero
+.tail_loop:
+    movss            xm0, [srcrq + wq]
+    movss            xm1, [srcgq + wq]
+    movss            xm2, [srcbq + wq]
+    TONEMAP_PIXELS    %2
+    movss  [dstrq + wq], xm0
+    movss  [dstgq + wq], xm1
+    movss  [dstbq + wq], xm2
+    add               wq, 4
+    jl .tail_loop
+.end:
+    RET
+%endmacro
+
+%if ARCH_X86_64
+INIT_XMM sse4
+TONEMAP_ROW , 0
+TONEMAP_ROW _desat, 1
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+TONEMAP_ROW , 0
+TONEMAP_ROW _desat, 1
+%endif
+%endif
@@ -0,0 +1,47 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/tonemap.h"
+
+#define TONEMAP_FUNC(name, opt)                                               \
+void ff_tonemap_##name##_##opt(float *dst_r, float *dst_g, float *dst_b,      \
+                               const float *src_r, const float *src_g,        \
+                               const float *src_b, const float *lut,          \
+                               const float *params, int width);
+
+TONEMAP_FUNC(map_row, sse4)
+TONEMAP_FUNC(map_row, avx2)
+TONEMAP_FUNC(map_row_desat, sse4)
+TONEMAP_FUNC(map_row_desat, avx2)
+
+av_cold void ff_tonemap_dsp_init_x86(TonemapDSPContext *dsp)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (ARCH_X86_64 && EXTERNAL_SSE4(cpu_flags)) {
+        dsp->map_row       = ff_tonemap_map_row_sse4;
+        dsp->map_row_desat = ff_tonemap_map_row_desat_sse4;
+    }
+    if (ARCH_X86_64 && EXTERNAL_AVX2_FAST(cpu_flags)) {
+        dsp->map_row       = ff_tonemap_map_row_avx2;
+        dsp->map_row_desat = ff_tonemap_map_row_desat_avx2;
+    }
+}
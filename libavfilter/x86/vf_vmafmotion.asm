@@ -0,0 +1,208 @@
+;*****************************************************************************
+;* x86-optimized functions for vmafmotion filter
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION_RODATA 32
+
+pw_1: times 16 dw 1
+
+SECTION .text
+
+; broadcast the filter taps as word pairs: m5 = (f0, f1), m6 = (f2, f3),
+; m7 = (f4, 0)
+%macro LOAD_FILTER 0
+    movd         xm5, [filterq]
+    movd         xm6, [filterq + 4]
+    pxor         xm7, xm7
+    pinsrw       xm7, [filterq + 8], 0
+%if cpuflag(avx2)
+    vpbroadcastd  m5, xm5
+    vpbroadcastd  m6, xm6
+    vpbroadcastd  m7, xm7
+%else
+    pshufd        m5, m5, 0
+    pshufd        m6, m6, 0
+    pshufd        m7, m7, 0
+%endif
+%endmacro
+
+; multiply the interleaved words of %1 and %3 by the tap pair %4 and sum the
+; pairs, giving the dwords of the low half in %1 and of the high half in %2
+%macro MADD_PAIR 4
+    punpckhwd     %2, %1, %3
+    punpcklwd     %1, %3
+    pmaddwd       %1, %4
+    pmaddwd       %2, %4
+%endmacro
+
+; apply the 5 taps to the samples loaded by the macro %1 (taking a register
+; and a tap index), shift the sums right by %3 and store the words to %2
+%macro FILTER_5 3 ; load macro, dst, shift
+    %1            m0, 0
+    %1            m2, 1
+    MADD_PAIR     m0, m1, m2, m5
+    %1            m2, 2
+    %1            m4, 3
+    MADD_PAIR     m2, m3, m4, m6
+    paddd         m0, m2
+    paddd         m1, m3
+    %1            m2, 4
+    MADD_PAIR     m2, m3, m8, m7
+    paddd         m0, m2
+    paddd         m1, m3
+    psrad         m0, %3
+    psrad         m1, %3
+    packssdw      m0, m1
+    movu          %2, m0
+%endmacro
+
+%if ARCH_X86_64
+
+;------------------------------------------------------------------------------
+; void ff_vmafmotion_convolution_y_<bits>bit(const uint16_t *filter,
+;                                            const uint8_t *const *src,
+;                                            uint16_t *dst, int w)
+;
+; w is a multiple of mmsize / 2.
+;------------------------------------------------------------------------------
+%macro LOAD_ROW8 2
+%if cpuflag(avx2)
+    pmovzxbw      %1, [row%2q + xq]
+%else
+    movq          %1, [row%2q + xq]
+    punpcklbw     %1, m8
+%endif
+%endmacro
+
+%macro LOAD_ROW10 2
+    movu          %1, [row%2q + xq*2]
+%endmacro
+
+%macro CONV_Y 1 ; bits
+cglobal vmafmotion_convolution_y_%1bit, 4, 10, 9, filter, src, dst, w, row0, row1, row2, row3, row4, x
+    movsxdifnidn  wq, wd
+    mov        row0q, [srcq + 0 * gprsize]
+    mov        row1q, [srcq + 1 * gprsize]
+    mov        row2q, [srcq + 2 * gprsize]
+    mov        row3q, [srcq + 3 * gprsize]
+    mov        row4q, [srcq + 4 * gprsize]
+    LOAD_FILTER
+    pxor          m8, m8
+    xor           xd, xd
+.loop:
+    FILTER_5      LOAD_ROW%1, [dstq + xq*2], %1
+    add           xq, mmsize / 2
+    cmp           xq, wq
+    jl .loop
+    RET
+%endmacro
+
+;------------------------------------------------------------------------------
+; void ff_vmafmotion_convolution_x(const uint16_t *filter, const uint16_t *src,
+;                                  uint16_t *dst, int w, int h,
+;                                  ptrdiff_t src_stride, ptrdiff_t dst_stride)
+;
+; The rows of dst are written up to a multiple of mmsize / 2 samples.
+;------------------------------------------------------------------------------
+%macro LOAD_TAP 2
+    movu          %1, [srcq + xq*2 + (%2 - 2) * 2]
+%endmacro
+
+%macro CONV_X 0
+cglobal vmafmotion_convolution_x, 7, 8, 9, filter, src, dst, w, h, sstride, dstride, x
+    movsxdifnidn  wq, wd
+    LOAD_FILTER
+    pxor          m8, m8
+.loop_y:
+    xor           xd, xd
+.loop_x:
+    FILTER_5      LOAD_TAP, [dstq + xq*2], 15
+    add           xq, mmsize / 2
+    cmp           xq, wq
+    jl .loop_x
+    add         srcq, sstrideq
+    add         dstq, dstrideq
+    dec           hd
+    jg .loop_y
+    RET
+%endmacro
+
+;------------------------------------------------------------------------------
+; uint64_t ff_vmafmotion_sad(const uint16_t *img1, const uint16_t *img2,
+;                            int w, int h, ptrdiff_t img1_stride,
+;                            ptrdiff_t img2_stride)
+;
+; w is a multiple of mmsize / 2. The sums are kept in dwords over a row and
+; added to qwords after each row.
+;------------------------------------------------------------------------------
+%macro SAD 0
+cglobal vmafmotion_sad, 6, 7, 7, img1, img2, w, h, stride1, stride2, x
+    movsxdifnidn  wq, wd
+    pxor          m4, m4
+    pxor          m5, m5
+    mova          m6, [pw_1]
+.loop_y:
+    pxor          m3, m3
+    xor           xd, xd
+.loop_x:
+    movu          m0, [img1q + xq*2]
+    movu          m1, [img2q + xq*2]
+    psubusw       m2, m0, m1
+    psubusw       m1, m0
+    por           m1, m2
+    pmaddwd       m1, m6
+    paddd         m3, m1
+    add           xq, mmsize / 2
+    cmp           xq, wq
+    jl .loop_x
+    punpckhdq     m0, m3, m5
+    punpckldq     m3, m5
+    paddq         m4, m0
+    paddq         m4, m3
+    add        img1q, stride1q
+    add        img2q, stride2q
+    dec           hd
+    jg .loop_y
+%if cpuflag(avx2)
+    vextracti128 xm0, m4, 1
+    paddq        xm4, xm0
+%endif
+    pshufd       xm0, xm4, q1032
+    paddq        xm4, xm0
+    movq         rax, xm4
+    RET
+%endmacro
+
+INIT_XMM sse2
+CONV_Y 8
+CONV_Y 10
+CONV_X
+SAD
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+CONV_Y 8
+CONV_Y 10
+CONV_X
+SAD
+%endif
+
+%endif ; ARCH_X86_64
@@ -0,0 +1,96 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/vmaf_motion.h"
+
+/* declare the asm functions of an instruction set and wrappers completing
+ * the left-over samples in C */
+#define VMAFMOTION_FUNCS(OPT, STEP)                                                 \
+uint64_t ff_vmafmotion_sad_##OPT(const uint16_t *img1, const uint16_t *img2,        \
+                                 int w, int h, ptrdiff_t img1_stride,               \
+                                 ptrdiff_t img2_stride);                            \
+void ff_vmafmotion_convolution_x_##OPT(const uint16_t *filter, const uint16_t *src, \
+                                       uint16_t *dst, int w, int h,                 \
+                                       ptrdiff_t src_stride, ptrdiff_t dst_stride); \
+                                                                                    \
+static uint64_t sad_##OPT(const uint16_t *img1, const uint16_t *img2,               \
+                          int w, int h, ptrdiff_t img1_stride,                      \
+                          ptrdiff_t img2_stride)                                    \
+{                                                                                   \
+    const int left_over = w & (STEP - 1);                                           \
+    uint64_t sum = 0;                                                               \
+                                                                                    \
+    w -= left_over;                                                                 \
+    if (w > 0)                                                                      \
+        sum = ff_vmafmotion_sad_##OPT(img1, img2, w, h, img1_stride, img2_stride);  \
+    if (left_over > 0)                                                              \
+        sum += ff_vmafmotion_sad_c(img1 + w, img2 + w, left_over, h,                \
+                                   img1_stride, img2_stride);                       \
+    return sum;                                                                     \
+}                                                                                   \
+                                                                                    \
+CONV_Y_FUNC(8,  OPT, STEP)                                                          \
+CONV_Y_FUNC(10, OPT, STEP)
+
+#define CONV_Y_FUNC(BITS, OPT, STEP)                                                \
+void ff_vmafmotion_convolution_y_##BITS##bit_##OPT(const uint16_t *filter,          \
+                                                   const uint8_t *const *src,       \
+                                                   uint16_t *dst, int w);           \
+static void convolution_y_##BITS##bit_##OPT(const uint16_t *filter,                 \
+                                            const uint8_t *const *src,              \
+                                            uint16_t *dst, int w)                   \
+{                                                                                   \
+    const int left_over = w & (STEP - 1);                                           \
+                                                                                    \
+    w -= left_over;                                                                 \
+    if (w > 0)                                                                      \
+        ff_vmafmotion_convolution_y_##BITS##bit_##OPT(filter, src, dst, w);         \
+    if (left_over > 0) {                                                            \
+        const uint8_t *tail[5];                                                     \
+        int k;                                                                      \
+                                                                                    \
+        for (k = 0; k < 5; k++)                                                     \
+            tail[k] = src[k] + w * ((BITS + 7) / 8);                                \
+        ff_vmafmotion_convolution_y_##BITS##bit_c(filter, tail, dst + w, left_over);\
+    }                                                                               \
+}
+
+VMAFMOTION_FUNCS(sse2, 8)
+VMAFMOTION_FUNCS(avx2, 16)
+
+av_cold void ff_vmafmotion_init_x86(VMAFMotionDSPContext *dsp, int bpp)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (ARCH_X86_64 && EXTERNAL_SSE2(cpu_flags)) {
+        dsp->sad           = sad_sse2;
+        dsp->convolution_x = ff_vmafmotion_convolution_x_sse2;
+        dsp->convolution_y = bpp == 10 ? convolution_y_10bit_sse2
+                                       : convolution_y_8bit_sse2;
+    }
+
+    if (ARCH_X86_64 && EXTERNAL_AVX2_FAST(cpu_flags)) {
+        dsp->sad           = sad_avx2;
+        dsp->convolution_x = ff_vmafmotion_convolution_x_avx2;
+        dsp->convolution_y = bpp == 10 ? convolution_y_10bit_avx2
+                                       : convolution_y_8bit_avx2;
+    }
+}
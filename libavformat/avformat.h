@@ -1494,6 +1494,13 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_FAST_SEEK   0x80000 ///< Enable fast, but inaccurate seeks for some formats
 #define AVFMT_FLAG_SHORTEST   0x100000 ///< Stop muxing when the shortest stream stops.
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+/**
+ * When demuxing, return packets referencing the I/O buffer instead of
+ * copies of it where possible, i.e. for the data ending the buffer, whose
+ * padding is zeroed. The buffers stay allocated as long as packets
+ * reference them.
+ */
+#define AVFMT_FLAG_ZEROCOPY   0x400000
 
     /**
      * Maximum size of the data read from input for determining
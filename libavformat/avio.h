@@ -349,6 +349,46 @@ typedef struct AVIOContext {
      * Try to buffer at least this amount of data before flushing it
      */
     int min_packet_size;
+
+    /**
+     * Read statistic, number of calls to read_packet
+     * This field is internal to libavformat and access from outside is not allowed.
+     */
+    int64_t read_count;
+
+    /**
+     * Size up to which the buffer grows while the data is read sequentially,
+     * 0 to keep the buffer size fixed.
+     * This field is internal to libavformat and access from outside is not allowed.
+     */
+    int buffer_size_limit;
+
+    /**
+     * Number of consecutive buffer fills with sequential data
+     * This field is internal to libavformat and access from outside is not allowed.
+     */
+    int sequential_fills;
+
+    /**
+     * If set, the data of the read buffer may be exported as packets
+     * referencing it, see ffio_read_ref().
+     * This field is internal to libavformat and access from outside is not allowed.
+     */
+    int zerocopy;
+
+    /**
+     * Reference to the buffer if it is refcounted, NULL otherwise.
+     * This field is internal to libavformat and access from outside is not allowed.
+     */
+    struct AVBufferRef *buffer_ref;
+
+    /**
+     * Pool the refcounted buffers are allocated from, and the size of its
+     * buffers without padding.
+     * This field is internal to libavformat and access from outside is not allowed.
+     */
+    struct AVBufferPool *buffer_pool;
+    int buffer_pool_size;
 } AVIOContext;
 
 /**
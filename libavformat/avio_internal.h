@@ -22,6 +22,8 @@
 #include "avio.h"
 #include "url.h"
 
+#include "libavcodec/avcodec.h"
+
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -53,6 +55,38 @@ int ffio_init_context(AVIOContext *s,
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Make the data read from s exportable as packets referencing the read
+ * buffer instead of copies of it. Only possible for contexts opened with
+ * ffio_fdopen(), as the buffer is owned by the context.
+ *
+ * @return 0 on success, AVERROR(ENOSYS) if the context does not support it
+ */
+int ffio_enable_zerocopy(AVIOContext *s);
+
+/**
+ * Read size bytes from AVIOContext into pkt, which references the read
+ * buffer if zero-copy is enabled and the data is exactly what is left in
+ * it. The padding following the data, which is then the end of the buffer,
+ * is zeroed.
+ *
+ * @return size on success, AVERROR(EAGAIN) if the data has to be read
+ *         into a new packet instead, another AVERROR on failure
+ */
+int ffio_read_ref(AVIOContext *s, AVPacket *pkt, int size);
+
+/**
+ * Make pkt reference size bytes starting at data, which must have been
+ * returned by the last ffio_read_indirect() call on s, instead of copying
+ * them. As with ffio_read_ref(), only data ending the read buffer can be
+ * referenced.
+ *
+ * @return 0 on success, AVERROR(EAGAIN) if data is not at the end of a
+ *         refcounted buffer, another AVERROR on failure
+ */
+int ffio_ref_indirect(AVIOContext *s, AVPacket *pkt,
+                      const unsigned char *data, int size);
+
 void ffio_fill(AVIOContext *s, int b, int count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
@@ -20,6 +20,7 @@
  */
 
 #include "libavutil/bprint.h"
+#include "libavutil/buffer.h"
 #include "libavutil/crc.h"
 #include "libavutil/dict.h"
 #include "libavutil/intreadwrite.h"
@@ -35,6 +36,18 @@
 
 #define IO_BUFFER_SIZE 32768
 
+/**
+ * Size up to which the buffer of a context read sequentially grows, to
+ * need fewer calls to the protocol read function.
+ */
+#define IO_BUFFER_MAX_SIZE (1 << 20)
+
+/**
+ * Number of consecutive reads filling the whole buffer with sequential
+ * data after which the buffer size is doubled.
+ */
+#define IO_BUFFER_GROW_FILLS 4
+
 /**
  * Do seeks within this distance ahead of the current buffer by skipping
  * data instead of calling the protocol seek function, for seekable
@@ -76,6 +89,8 @@ const AVClass ff_avio_class = {
 };
 
 static void fill_buffer(AVIOContext *s);
+static void free_buffer(AVIOContext *s);
+static int resize_buffer(AVIOContext *s, int buf_size);
 static int url_resetbuf(AVIOContext *s, int flags);
 
 int ffio_init_context(AVIOContext *s,
@@ -307,6 +322,7 @@ int64_t avio_seek(AVIOContext *s, int64_t offset, int whence)
         s->buf_ptr = s->buffer;
         s->pos = pos;
         s->eof_reached = 0;
+        s->sequential_fills = 0;
         fill_buffer(s);
         return avio_seek(s, offset, SEEK_SET | force);
     } else {
@@ -319,6 +335,11 @@ int64_t avio_seek(AVIOContext *s, int64_t offset, int whence)
         if ((res = s->seek(s->opaque, offset, SEEK_SET)) < 0)
             return res;
         s->seek_count ++;
+        /* random access, read less data ahead of the next seek */
+        if (s->buffer_size_limit && s->buffer_size > IO_BUFFER_SIZE &&
+            s->buffer_size == s->orig_buffer_size)
+            resize_buffer(s, FFMAX(s->buffer_size >> 1, IO_BUFFER_SIZE));
+        s->sequential_fills = 0;
         if (!s->write_flag)
             s->buf_end = s->buffer;
         s->buf_ptr = s->buf_ptr_max = s->buffer;
@@ -533,6 +554,7 @@ static int read_packet_wrapper(AVIOContext *s, uint8_t *buf, int size)
     if (!s->read_packet)
         return AVERROR(EINVAL);
     ret = s->read_packet(s->opaque, buf, size);
+    s->read_count++;
 #if FF_API_OLD_AVIO_EOF_0
     if (!ret && !s->max_packet_size) {
         av_log(NULL, AV_LOG_WARNING, "Invalid return value 0 for stream protocol\n");
@@ -553,6 +575,8 @@ static void fill_buffer(AVIOContext *s)
     uint8_t *dst        = s->buf_end - s->buffer + max_buffer_size < s->buffer_size ?
                           s->buf_end : s->buffer;
     int len             = s->buffer_size - (dst - s->buffer);
+    int sequential      = s->buf_ptr >= s->buf_end;
+    AVBufferRef *new_ref = NULL;
 
     /* can't fill the buffer without read_packet, just set EOF if appropriate */
     if (!s->read_packet && s->buf_ptr >= s->buf_end)
@@ -572,7 +596,7 @@ static void fill_buffer(AVIOContext *s)
     /* make buffer smaller in case it ended up large after probing */
     if (s->read_packet && s->orig_buffer_size && s->buffer_size > s->orig_buffer_size) {
         if (dst == s->buffer && s->buf_ptr != dst) {
-            int ret = ffio_set_buf_size(s, s->orig_buffer_size);
+            int ret = resize_buffer(s, s->orig_buffer_size);
             if (ret < 0)
                 av_log(s, AV_LOG_WARNING, "Failed to decrease buffer size\n");
 
@@ -582,7 +606,59 @@ static void fill_buffer(AVIOContext *s)
         len = s->orig_buffer_size;
     }
 
+    /* make buffer larger if the previous reads filled it with sequential data */
+    if (s->buffer_size_limit > s->buffer_size && dst == s->buffer && sequential &&
+        s->sequential_fills >= IO_BUFFER_GROW_FILLS &&
+        s->buffer_size == s->orig_buffer_size) {
+        int ret = resize_buffer(s, FFMIN(2 * s->buffer_size, s->buffer_size_limit));
+        if (ret < 0) {
+            av_log(s, AV_LOG_WARNING, "Failed to increase buffer size\n");
+            s->buffer_size_limit = 0;
+        }
+
+        s->checksum_ptr = dst = s->buffer;
+        len = s->buffer_size;
+        s->sequential_fills = 0;
+    }
+
+    /* packets may reference the buffer, read into a new one instead of
+     * overwriting their data or padding */
+    if (s->zerocopy && (s->buffer_ref ? !av_buffer_is_writable(s->buffer_ref) :
+                                        dst == s->buffer)) {
+        if (s->buffer_pool_size != s->buffer_size) {
+            av_buffer_pool_uninit(&s->buffer_pool);
+            s->buffer_pool = av_buffer_pool_init(s->buffer_size + AV_INPUT_BUFFER_PADDING_SIZE,
+                                                 NULL);
+            s->buffer_pool_size = s->buffer_pool ? s->buffer_size : 0;
+        }
+        if (s->buffer_pool)
+            new_ref = av_buffer_pool_get(s->buffer_pool);
+        if (!new_ref) {
+            s->eof_reached = 1;
+            s->error = AVERROR(ENOMEM);
+            return;
+        }
+        memset(new_ref->data + s->buffer_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+        if (s->update_checksum && dst != s->buffer && s->buf_end > s->checksum_ptr) {
+            s->checksum = s->update_checksum(s->checksum, s->checksum_ptr,
+                                             s->buf_end - s->checksum_ptr);
+            s->checksum_ptr = s->buf_end;
+        }
+        len += dst - s->buffer;
+        dst  = new_ref->data;
+    }
+
     len = read_packet_wrapper(s, dst, len);
+    if (new_ref) {
+        if (len < 0) {
+            av_buffer_unref(&new_ref);
+        } else {
+            free_buffer(s);
+            s->buffer_ref = new_ref;
+            s->buffer = s->buf_ptr_max = s->checksum_ptr = dst;
+        }
+    }
     if (len == AVERROR_EOF) {
         /* do not modify buffer if EOF reached so that a seek back can
            be done without rereading data */
@@ -595,6 +671,8 @@ static void fill_buffer(AVIOContext *s)
         s->buf_ptr = dst;
         s->buf_end = dst + len;
         s->bytes_read += len;
+        s->sequential_fills = sequential && s->buf_end == s->buffer + s->buffer_size ?
+                              s->sequential_fills + 1 : 0;
     }
 }
 
@@ -645,6 +723,20 @@ int avio_r8(AVIOContext *s)
     return 0;
 }
 
+/**
+ * Reads of this size into an empty buffer are done directly into the
+ * destination, the buffer would only add a copy. The buffer size is not
+ * compared against while it grows, nor while seekback is ensured.
+ */
+static int read_bypasses_buffer(AVIOContext *s, int size)
+{
+    if (s->update_checksum)
+        return 0;
+    return s->direct || size > s->buffer_size ||
+           (s->buffer_size_limit && s->buffer_size == s->orig_buffer_size &&
+            size >= IO_BUFFER_SIZE);
+}
+
 int avio_read(AVIOContext *s, unsigned char *buf, int size)
 {
     int len, size1;
@@ -653,7 +745,7 @@ int avio_read(AVIOContext *s, unsigned char *buf, int size)
     while (size > 0) {
         len = FFMIN(s->buf_end - s->buf_ptr, size);
         if (len == 0 || s->write_flag) {
-            if((s->direct || size > s->buffer_size) && !s->update_checksum) {
+            if (read_bypasses_buffer(s, size)) {
                 // bypass the buffer and read data directly into buf
                 len = read_packet_wrapper(s, buf, size);
                 if (len == AVERROR_EOF) {
@@ -714,6 +806,46 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+/* Only the data ending the buffer can be referenced, as its padding is
+ * zeroed: the buffer is not written to any more once referenced, see
+ * fill_buffer(). */
+static int ref_buffer(AVIOContext *s, AVPacket *pkt, const unsigned char *data,
+                      int size)
+{
+    if (!s->buffer_ref || data < s->buffer || data + size != s->buf_end ||
+        s->buf_end + AV_INPUT_BUFFER_PADDING_SIZE > s->buffer_ref->data + s->buffer_ref->size)
+        return AVERROR(EAGAIN);
+
+    pkt->buf = av_buffer_ref(s->buffer_ref);
+    if (!pkt->buf)
+        return AVERROR(ENOMEM);
+    memset(s->buf_end, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    pkt->data = (uint8_t *)data;
+    pkt->size = size;
+    return 0;
+}
+
+int ffio_read_ref(AVIOContext *s, AVPacket *pkt, int size)
+{
+    int ret;
+
+    if (!s->zerocopy || s->update_checksum || size <= 0)
+        return AVERROR(EAGAIN);
+
+    if (s->buf_ptr >= s->buf_end && !read_bypasses_buffer(s, size))
+        fill_buffer(s);
+    if ((ret = ref_buffer(s, pkt, s->buf_ptr, size)) < 0)
+        return ret;
+    s->buf_ptr += size;
+    return size;
+}
+
+int ffio_ref_indirect(AVIOContext *s, AVPacket *pkt, const unsigned char *data,
+                      int size)
+{
+    return ref_buffer(s, pkt, data, size);
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -729,6 +861,20 @@ int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
     }
 
     len = s->buf_end - s->buf_ptr;
+    if (len == 0 && read_bypasses_buffer(s, size)) {
+        /* bypass the buffer and read data directly into buf */
+        len = read_packet_wrapper(s, buf, size);
+        if (len >= 0) {
+            s->pos += len;
+            s->bytes_read += len;
+            s->buf_end = s->buf_ptr = s->buffer;
+        } else {
+            s->eof_reached = 1;
+            if (len != AVERROR_EOF)
+                s->error = len;
+        }
+        return len;
+    }
     if (len == 0) {
         /* Reset the buf_end pointer to the start of the buffer, to make sure
          * the fill_buffer call tries to read as much data as fits into the
@@ -1028,6 +1174,8 @@ int ffio_fdopen(AVIOContext **s, URLContext *h)
             (*s)->seekable |= AVIO_SEEKABLE_TIME;
     }
     (*s)->short_seek_get = io_short_seek;
+    if (!max_packet_size && !(*s)->write_flag && !(*s)->direct)
+        (*s)->buffer_size_limit = IO_BUFFER_MAX_SIZE;
     (*s)->av_class = &ff_avio_class;
     return 0;
 fail:
@@ -1049,6 +1197,14 @@ URLContext* ffio_geturlcontext(AVIOContext *s)
         return NULL;
 }
 
+int ffio_enable_zerocopy(AVIOContext *s)
+{
+    if (s->write_flag || s->read_packet != io_read_packet)
+        return AVERROR(ENOSYS);
+    s->zerocopy = 1;
+    return 0;
+}
+
 int ffio_ensure_seekback(AVIOContext *s, int64_t buf_size)
 {
     uint8_t *buffer;
@@ -1068,9 +1224,9 @@ int ffio_ensure_seekback(AVIOContext *s, int64_t buf_size)
         return AVERROR(ENOMEM);
 
     memcpy(buffer, s->buffer, filled);
-    av_free(s->buffer);
     s->buf_ptr = buffer + (s->buf_ptr - s->buffer);
     s->buf_end = buffer + (s->buf_end - s->buffer);
+    free_buffer(s);
     s->buffer = buffer;
     s->buffer_size = buf_size;
     if (checksum_ptr_offset >= 0)
@@ -1078,14 +1234,23 @@ int ffio_ensure_seekback(AVIOContext *s, int64_t buf_size)
     return 0;
 }
 
-int ffio_set_buf_size(AVIOContext *s, int buf_size)
+/* packets may still reference the buffer, it is then freed with them */
+static void free_buffer(AVIOContext *s)
+{
+    if (s->buffer_ref && s->buffer_ref->data == s->buffer)
+        s->buffer = NULL;
+    av_buffer_unref(&s->buffer_ref);
+    av_freep(&s->buffer);
+}
+
+static int resize_buffer(AVIOContext *s, int buf_size)
 {
     uint8_t *buffer;
     buffer = av_malloc(buf_size);
     if (!buffer)
         return AVERROR(ENOMEM);
 
-    av_free(s->buffer);
+    free_buffer(s);
     s->buffer = buffer;
     s->orig_buffer_size =
     s->buffer_size = buf_size;
@@ -1094,6 +1259,13 @@ int ffio_set_buf_size(AVIOContext *s, int buf_size)
     return 0;
 }
 
+int ffio_set_buf_size(AVIOContext *s, int buf_size)
+{
+    /* keep the size chosen by the caller */
+    s->buffer_size_limit = 0;
+    return resize_buffer(s, buf_size);
+}
+
 static int url_resetbuf(AVIOContext *s, int flags)
 {
     av_assert1(flags == AVIO_FLAG_WRITE || flags == AVIO_FLAG_READ);
@@ -1141,7 +1313,7 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char **bufp, int buf_si
         buf_size = new_size;
     }
 
-    av_free(s->buffer);
+    free_buffer(s);
     s->buf_ptr = s->buffer = buf;
     s->buffer_size = alloc_size;
     s->pos = buf_size;
@@ -1200,11 +1372,13 @@ int avio_close(AVIOContext *s)
     h        = internal->h;
 
     av_freep(&s->opaque);
-    av_freep(&s->buffer);
+    free_buffer(s);
+    av_buffer_pool_uninit(&s->buffer_pool);
     if (s->write_flag)
         av_log(s, AV_LOG_VERBOSE, "Statistics: %d seeks, %d writeouts\n", s->seek_count, s->writeout_count);
     else
-        av_log(s, AV_LOG_VERBOSE, "Statistics: %"PRId64" bytes read, %d seeks\n", s->bytes_read, s->seek_count);
+        av_log(s, AV_LOG_VERBOSE, "Statistics: %"PRId64" bytes read, %"PRId64" reads, %d seeks\n",
+               s->bytes_read, s->read_count, s->seek_count);
     av_opt_free(s);
 
     avio_context_free(&s);
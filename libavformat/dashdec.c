@@ -20,6 +20,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 #include <libxml/parser.h>
+#include "libavutil/bprint.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/time.h"
@@ -27,8 +28,12 @@
 #include "internal.h"
 #include "avio_internal.h"
 #include "dash.h"
+#include "http.h"
+#include "prefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
+#define DEFAULT_MANIFEST_SIZE (8 * 1024)
+#define MAX_MANIFEST_SIZE (16 * 1024 * 1024)
 
 struct fragment {
     int64_t url_offset;
@@ -117,6 +122,12 @@ struct representation {
     uint32_t init_sec_buf_read_offset;
     int64_t cur_timestamp;
     int is_restart_needed;
+
+    /* background fragment downloads, see schedule_prefetch() */
+    FFPrefetch *prefetch;
+    AVDictionary *prefetch_opts;
+    char *prefetch_cookies;
+    int cur_prefetched;
 };
 
 typedef struct DASHContext {
@@ -154,6 +165,9 @@ typedef struct DASHContext {
     int is_init_section_common_video;
     int is_init_section_common_audio;
 
+    int prefetch_segments;
+    int64_t prefetch_max_size;
+    int64_t manifest_load_time;         ///< time of the last manifest (re)load, av_gettime_relative() time base
 } DASHContext;
 
 static int ishttp(char *url)
@@ -338,6 +352,9 @@ static void free_timelines_list(struct representation *pls)
 
 static void free_representation(struct representation *pls)
 {
+    ff_prefetch_free(&pls->prefetch);
+    av_dict_free(&pls->prefetch_opts);
+    av_freep(&pls->prefetch_cookies);
     free_fragment_list(pls);
     free_timelines_list(pls);
     free_fragment(&pls->cur_seg);
@@ -396,7 +413,8 @@ static void update_options(char **dest, const char *name, void *src)
 }
 
 static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary *opts, AVDictionary *opts2, int *is_http)
+                    AVDictionary *opts, AVDictionary *opts2, char **cookies,
+                    int *is_http)
 {
     DASHContext *c = s->priv_data;
     AVDictionary *tmp = NULL;
@@ -448,11 +466,11 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
             av_opt_get(*pb, "cookies", AV_OPT_SEARCH_CHILDREN, (uint8_t**)&new_cookies);
 
         if (new_cookies) {
-            av_free(c->cookies);
-            c->cookies = new_cookies;
+            av_free(*cookies);
+            *cookies = new_cookies;
         }
 
-        av_dict_set(&opts, "cookies", c->cookies, 0);
+        av_dict_set(&opts, "cookies", *cookies, 0);
     }
 
     av_dict_free(&tmp);
@@ -1120,6 +1138,7 @@ static int parse_manifest(AVFormatContext *s, const char *url, AVIOContext *in)
     uint8_t *new_url = NULL;
     int64_t filesize = 0;
     char *buffer = NULL;
+    AVBPrint buf;
     AVDictionary *opts = NULL;
     xmlDoc *doc = NULL;
     xmlNodePtr root_element = NULL;
@@ -1152,18 +1171,26 @@ static int parse_manifest(AVFormatContext *s, const char *url, AVIOContext *in)
         c->base_url = av_strdup(url);
     }
 
+    /* the size is unknown for chunked HTTP responses and for manifests
+     * refreshed in the background, read them to the end */
     filesize = avio_size(in);
-    if (filesize <= 0) {
-        filesize = 8 * 1024;
-    }
-
-    buffer = av_mallocz(filesize);
-    if (!buffer) {
-        av_free(c->base_url);
-        return AVERROR(ENOMEM);
+    av_bprint_init(&buf, filesize > 0 ? filesize + 1 : DEFAULT_MANIFEST_SIZE,
+                   AV_BPRINT_SIZE_UNLIMITED);
+    ret = avio_read_to_bprint(in, &buf, MAX_MANIFEST_SIZE);
+    if (ret >= 0 && !av_bprint_is_complete(&buf))
+        ret = AVERROR(ENOMEM);
+    filesize = buf.len;
+    if (ret >= 0)
+        ret = av_bprint_finalize(&buf, &buffer);
+    else
+        av_bprint_finalize(&buf, NULL);
+    if (ret < 0) {
+        av_freep(&c->base_url);
+        if (close_in)
+            avio_close(in);
+        return ret;
     }
 
-    filesize = avio_read(in, buffer, filesize);
     if (filesize <= 0) {
         av_log(s, AV_LOG_ERROR, "Unable to read to offset '%s'\n", url);
         ret = AVERROR_INVALIDDATA;
@@ -1385,11 +1412,43 @@ static void move_segments(struct representation *rep_src, struct representation
 }
 
 
-static int refresh_manifest(AVFormatContext *s)
+/* The live manifest is refreshed in the background by the prefetch thread
+ * of the first representation. */
+static FFPrefetch *manifest_prefetch(DASHContext *c)
+{
+    if (!c->is_live)
+        return NULL;
+    if (c->n_videos)
+        return c->videos[0]->prefetch;
+    if (c->n_audios)
+        return c->audios[0]->prefetch;
+    return NULL;
+}
+
+static void schedule_refresh(AVFormatContext *s)
+{
+    DASHContext *c = s->priv_data;
+    FFPrefetch *pf = manifest_prefetch(c);
+
+    if (pf)
+        ff_prefetch_schedule_refresh(pf, s->url, c->manifest_load_time +
+                                     FFMAX(c->minimum_update_period, 1) * AV_TIME_BASE);
+}
+
+/* Reload the manifest, using the copy downloaded by the prefetch thread.
+ * If the reload is needed, wait for the pending background download rather
+ * than polling the server, otherwise keep the current manifest until it
+ * completes. */
+static int refresh_manifest(AVFormatContext *s, int needed)
 {
 
     int ret = 0, i;
     DASHContext *c = s->priv_data;
+    FFPrefetch *pf = manifest_prefetch(c);
+    AVIOContext pb, *in = NULL;
+    uint8_t *buf = NULL;
+    char *url = NULL;
+    int size;
 
     // save current context
     int n_videos = c->n_videos;
@@ -1398,12 +1457,27 @@ static int refresh_manifest(AVFormatContext *s)
     struct representation **audios = c->audios;
     char *base_url = c->base_url;
 
+    if (pf) {
+        ret = ff_prefetch_get_refresh(pf, needed, c->manifest_load_time, &buf, &size, &url);
+        if (ret == AVERROR_EXIT)
+            return ret;
+        if (ret == AVERROR(EAGAIN) && !needed)
+            return 0;
+        if (ret >= 0) {
+            ffio_init_context(&pb, buf, size, 0, NULL, NULL, NULL, NULL);
+            in = &pb;
+        }
+    }
+
     c->base_url = NULL;
     c->n_videos = 0;
     c->videos = NULL;
     c->n_audios = 0;
     c->audios = NULL;
-    ret = parse_manifest(s, s->url, NULL);
+    c->manifest_load_time = av_gettime_relative();
+    ret = parse_manifest(s, in ? url : s->url, in);
+    av_free(buf);
+    av_free(url);
     if (ret)
         goto finish;
 
@@ -1411,13 +1485,15 @@ static int refresh_manifest(AVFormatContext *s)
         av_log(c, AV_LOG_ERROR,
                "new manifest has mismatched no. of video representations, %d -> %d\n",
                n_videos, c->n_videos);
-        return AVERROR_INVALIDDATA;
+        ret = AVERROR_INVALIDDATA;
+        goto finish;
     }
     if (c->n_audios != n_audios) {
         av_log(c, AV_LOG_ERROR,
                "new manifest has mismatched no. of audio representations, %d -> %d\n",
                n_audios, c->n_audios);
-        return AVERROR_INVALIDDATA;
+        ret = AVERROR_INVALIDDATA;
+        goto finish;
     }
 
     for (i = 0; i < n_videos; i++) {
@@ -1467,34 +1543,73 @@ finish:
     c->audios = audios;
     c->n_videos = n_videos;
     c->videos = videos;
+    schedule_refresh(s);
     return ret;
 }
 
+/* Allocate a copy of the fragment seq_no, taken from the SegmentList or
+ * built from the SegmentTemplate of the representation. */
+static struct fragment *get_fragment(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    struct fragment *seg = av_mallocz(sizeof(struct fragment));
+    char *tmpfilename;
+
+    if (!seg)
+        return NULL;
+
+    if (pls->n_fragments > 0) {
+        struct fragment *seg_ptr;
+
+        if (seq_no < 0 || seq_no >= pls->n_fragments) {
+            av_free(seg);
+            return NULL;
+        }
+        seg_ptr = pls->fragments[seq_no];
+        seg->url = av_strdup(seg_ptr->url);
+        if (!seg->url) {
+            av_free(seg);
+            return NULL;
+        }
+        seg->size = seg_ptr->size;
+        seg->url_offset = seg_ptr->url_offset;
+        return seg;
+    }
+
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename) {
+        av_free(seg);
+        return NULL;
+    }
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!seg->url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        seg->url = av_strdup(pls->url_template);
+        if (!seg->url) {
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+            av_free(tmpfilename);
+            av_free(seg);
+            return NULL;
+        }
+    }
+    av_free(tmpfilename);
+    seg->size = -1;
+
+    return seg;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
     int64_t max_seq_no = 0;
-    struct fragment *seg = NULL;
-    struct fragment *seg_ptr = NULL;
     DASHContext *c = pls->parent->priv_data;
 
     while (( !ff_check_interrupt(c->interrupt_callback)&& pls->n_fragments > 0)) {
         if (pls->cur_seq_no < pls->n_fragments) {
-            seg_ptr = pls->fragments[pls->cur_seq_no];
-            seg = av_mallocz(sizeof(struct fragment));
-            if (!seg) {
-                return NULL;
-            }
-            seg->url = av_strdup(seg_ptr->url);
-            if (!seg->url) {
-                av_free(seg);
-                return NULL;
-            }
-            seg->size = seg_ptr->size;
-            seg->url_offset = seg_ptr->url_offset;
-            return seg;
+            return get_fragment(pls, pls->cur_seq_no);
         } else if (c->is_live) {
-            refresh_manifest(pls->parent);
+            refresh_manifest(pls->parent, 1);
         } else {
             break;
         }
@@ -1504,7 +1619,7 @@ static struct fragment *get_current_fragment(struct representation *pls)
         max_seq_no = calc_max_seg_no(pls, c);
 
         if (pls->timelines || pls->fragments) {
-            refresh_manifest(pls->parent);
+            refresh_manifest(pls->parent, pls->cur_seq_no > max_seq_no);
         }
         if (pls->cur_seq_no <= min_seq_no) {
             av_log(pls->parent, AV_LOG_VERBOSE, "old fragment: cur[%"PRId64"] min[%"PRId64"] max[%"PRId64"], playlist %d\n", (int64_t)pls->cur_seq_no, min_seq_no, max_seq_no, (int)pls->rep_idx);
@@ -1512,37 +1627,12 @@ static struct fragment *get_current_fragment(struct representation *pls)
         } else if (pls->cur_seq_no > max_seq_no) {
             av_log(pls->parent, AV_LOG_VERBOSE, "new fragment: min[%"PRId64"] max[%"PRId64"], playlist %d\n", min_seq_no, max_seq_no, (int)pls->rep_idx);
         }
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
+        return get_fragment(pls, pls->cur_seq_no);
     } else if (pls->cur_seq_no <= pls->last_seq_no) {
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
-    }
-    if (seg) {
-        char *tmpfilename= av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
-            return NULL;
-        }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
-        seg->size = -1;
+        return get_fragment(pls, pls->cur_seq_no);
     }
 
-    return seg;
+    return NULL;
 }
 
 enum ReadFromURLMode {
@@ -1595,7 +1685,7 @@ static int open_input(DASHContext *c, struct representation *pls, struct fragmen
     ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
     av_log(pls->parent, AV_LOG_VERBOSE, "DASH request for url '%s', offset %"PRId64", playlist %d\n",
            url, seg->url_offset, pls->rep_idx);
-    ret = open_url(pls->parent, &pls->input, url, c->avio_opts, opts, NULL);
+    ret = open_url(pls->parent, &pls->input, url, c->avio_opts, opts, &c->cookies, NULL);
     if (ret < 0) {
         goto cleanup;
     }
@@ -1655,10 +1745,139 @@ static int update_init_section(struct representation *pls)
     return 0;
 }
 
+static int prefetch_open(void *opaque, AVIOContext **pb, const char *url,
+                         int64_t offset, int64_t size)
+{
+    struct representation *pls = opaque;
+    AVDictionary *opts = NULL;
+    int ret, is_http = 0;
+
+    if (*pb) {
+#if CONFIG_HTTP_PROTOCOL
+        /* reuse the connection if the previous request was not limited to
+         * a byte range */
+        URLContext *uc = ffio_geturlcontext(*pb);
+        int64_t end_offset = -1;
+
+        if (size < 0 && uc && av_strstart(url, "http", NULL) &&
+            av_opt_get_int(*pb, "end_offset", AV_OPT_SEARCH_CHILDREN, &end_offset) >= 0 &&
+            !end_offset) {
+            (*pb)->eof_reached = 0;
+            if (ff_http_do_new_request(uc, url) >= 0)
+                return 0;
+        }
+#endif
+        ff_format_io_close(pls->parent, pb);
+    }
+
+    if (size >= 0) {
+        av_dict_set_int(&opts, "offset", offset, 0);
+        av_dict_set_int(&opts, "end_offset", offset + size, 0);
+    } else {
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+    }
+
+    /* the worker thread has its own copy of the options and cookies */
+    ret = open_url(pls->parent, pb, url, pls->prefetch_opts, opts,
+                   &pls->prefetch_cookies, &is_http);
+    if (ret >= 0 && !is_http && offset) {
+        int64_t seekret = avio_seek(*pb, offset, SEEK_SET);
+        if (seekret < 0) {
+            ret = seekret;
+            ff_format_io_close(pls->parent, pb);
+        }
+    }
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int init_prefetch(AVFormatContext *s, struct representation *pls)
+{
+    DASHContext *c = s->priv_data;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (!c->prefetch_segments || pls->prefetch)
+        return 0;
+
+    set_httpheader_options(c, &opts);
+    ret = av_dict_copy(&pls->prefetch_opts, c->avio_opts, 0);
+    if (ret >= 0)
+        ret = av_dict_copy(&pls->prefetch_opts, opts, 0);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+    if (c->cookies && !(pls->prefetch_cookies = av_strdup(c->cookies)))
+        return AVERROR(ENOMEM);
+
+    ret = ff_prefetch_alloc(&pls->prefetch, s, prefetch_open, pls,
+                            c->prefetch_segments, c->prefetch_max_size);
+    if (ret == AVERROR(ENOSYS)) {
+        av_log(s, AV_LOG_WARNING,
+               "Fragment prefetching is not supported on this build\n");
+        c->prefetch_segments = 0;
+        return 0;
+    }
+    return ret;
+}
+
+/* Queue the fragments following the current one for download by the
+ * prefetch thread, return 1 if the current fragment is served by it. */
+static int schedule_prefetch(struct representation *pls)
+{
+    DASHContext *c = pls->parent->priv_data;
+    int64_t seq_no, last_seq_no, max_seq_no;
+    char *url;
+    int ret;
+
+    /* a SegmentList without initialization section is read through
+     * seek_data(), and its fragments are renumbered on live refreshes */
+    if (!pls->prefetch ||
+        (pls->n_fragments && (c->is_live || pls->n_fragments == 1 ||
+                              !pls->init_sec_data_len)))
+        return 0;
+
+    if (pls->n_fragments)
+        max_seq_no = pls->n_fragments - 1;
+    else if (c->is_live)
+        max_seq_no = calc_max_seg_no(pls, c);
+    else
+        max_seq_no = pls->last_seq_no;
+
+    url = av_mallocz(c->max_url_size);
+    if (!url)
+        return 0;
+
+    ret = ff_prefetch_sync(pls->prefetch, pls->cur_seq_no, &last_seq_no);
+    for (seq_no = FFMAX(last_seq_no + 1, pls->cur_seq_no); seq_no <= max_seq_no; seq_no++) {
+        struct fragment *seg = get_fragment(pls, seq_no);
+        int err;
+
+        if (!seg)
+            break;
+        ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+        err = ff_prefetch_add(pls->prefetch, seq_no, url, seg->url_offset, seg->size);
+        free_fragment(&seg);
+        if (err < 0)
+            break;
+        if (seq_no == pls->cur_seq_no)
+            ret = 1;
+    }
+    av_free(url);
+    return ret;
+}
+
+static void release_prefetched(struct representation *pls)
+{
+    if (pls->cur_prefetched)
+        ff_prefetch_release(pls->prefetch);
+    pls->cur_prefetched = 0;
+}
+
 static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
-    if (v->n_fragments && !v->init_sec_data_len) {
+    if (v->n_fragments && !v->init_sec_data_len && v->input) {
         return avio_seek(v->input, offset, whence);
     }
 
@@ -1672,7 +1891,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->cur_prefetched) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1685,8 +1904,9 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
-        if (ret < 0) {
+        if (schedule_prefetch(v)) {
+            v->cur_prefetched = 1;
+        } else if ((ret = open_input(c, v, v->cur_seg)) < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 goto end;
                 ret = AVERROR_EXIT;
@@ -1714,7 +1934,23 @@ restart:
         ret = AVERROR_EOF;
         goto end;
     }
-    ret = read_from_url(v, v->cur_seg, buf, buf_size, READ_NORMAL);
+    if (v->cur_prefetched) {
+        /* the fragment is released when the demuxer is restarted, until
+         * then it keeps returning its end */
+        ret = ff_prefetch_read(v->prefetch, buf, buf_size);
+        if (ret == AVERROR_EXIT)
+            goto end;
+        if (ret < 0 && ret != AVERROR_EOF) {
+            /* nothing was downloaded, skip the fragment like open_input()
+             * failures */
+            av_log(v->parent, AV_LOG_WARNING, "Failed to open fragment of playlist %d\n", v->rep_idx);
+            release_prefetched(v);
+            v->cur_seq_no++;
+            goto restart;
+        }
+    } else {
+        ret = read_from_url(v, v->cur_seg, buf, buf_size, READ_NORMAL);
+    }
     if (ret > 0)
         goto end;
 
@@ -1850,6 +2086,9 @@ static int open_demux_for_component(AVFormatContext *s, struct representation *p
     pls->parent = s;
     pls->cur_seq_no  = calc_cur_seg_no(s, pls);
 
+    if ((ret = init_prefetch(s, pls)) < 0)
+        goto fail;
+
     if (!pls->last_seq_no) {
         pls->last_seq_no = calc_max_seg_no(pls, s->priv_data);
     }
@@ -1924,6 +2163,7 @@ static int dash_read_header(AVFormatContext *s)
         update_options(&c->headers, "headers", u);
     }
 
+    c->manifest_load_time = av_gettime_relative();
     if ((ret = parse_manifest(s, s->url, s->pb)) < 0)
         goto fail;
 
@@ -1967,6 +2207,8 @@ static int dash_read_header(AVFormatContext *s)
         ++stream_index;
     }
 
+    schedule_refresh(s);
+
     if (!stream_index) {
         ret = AVERROR_INVALIDDATA;
         goto fail;
@@ -2028,6 +2270,9 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
             close_demux_for_component(pls);
             if (pls->input)
                 ff_format_io_close(pls->parent, &pls->input);
+            if (pls->prefetch)
+                ff_prefetch_flush(pls->prefetch);
+            pls->cur_prefetched = 0;
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2078,6 +2323,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->init_sec_buf_read_offset = 0;
             if (cur->input)
                 ff_format_io_close(cur->parent, &cur->input);
+            release_prefetched(cur);
             ret = reopen_demux_for_component(s, cur);
             cur->is_restart_needed = 0;
         }
@@ -2120,6 +2366,9 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
 
     if (pls->input)
         ff_format_io_close(pls->parent, &pls->input);
+    if (pls->prefetch)
+        ff_prefetch_flush(pls->prefetch);
+    pls->cur_prefetched = 0;
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2212,6 +2461,10 @@ static const AVOption dash_options[] = {
         OFFSET(allowed_extensions), AV_OPT_TYPE_STRING,
         {.str = "aac,m4a,m4s,m4v,mov,mp4"},
         INT_MIN, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of fragments per representation downloaded ahead by a background thread",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_max_size", "Maximum number of prefetched bytes per representation",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 32 * 1024 * 1024}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
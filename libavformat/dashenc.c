@@ -44,6 +44,7 @@
 #include "internal.h"
 #include "isom.h"
 #include "os_support.h"
+#include "upload.h"
 #include "url.h"
 #include "vpcc.h"
 #include "dash.h"
@@ -133,6 +134,10 @@ typedef struct DASHContext {
     char *format_options_str;
     SegmentType segment_type;
     const char *format_name;
+    int upload_threads;
+    int upload_queue_size;
+    int upload_retries;
+    FFUploadQueue *upload;
 } DASHContext;
 
 static struct codec_string {
@@ -160,7 +165,9 @@ static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     DASHContext *c = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
-    if (!*pb || !http_base_proto || !c->http_persistent) {
+    if (c->upload && http_base_proto) {
+        err = ff_upload_open(c->upload, pb, filename, options);
+    } else if (!*pb || !http_base_proto || !c->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -172,11 +179,16 @@ static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     return err;
 }
 
-static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename) {
+static int dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename) {
     DASHContext *c = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
+    int ret = 0;
 
-    if (!http_base_proto || !c->http_persistent) {
+    if (ff_upload_owns(c->upload, *pb)) {
+        /* manifests must not reference segments not uploaded yet */
+        int flags = pb == &c->mpd_out || pb == &c->m3u8_out ? FF_UPLOAD_ORDERED : 0;
+        ret = ff_upload_close(c->upload, pb, flags);
+    } else if (!http_base_proto || !c->http_persistent) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -186,6 +198,7 @@ static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filenam
         ffurl_shutdown(http_url_context, AVIO_FLAG_WRITE);
 #endif
     }
+    return ret;
 }
 
 static const char *get_format_str(SegmentType segment_type) {
@@ -353,6 +366,8 @@ static int flush_init_segment(AVFormatContext *s, OutputStream *os)
         return ret;
 
     os->pos = os->init_range_length = range_length;
+    if (c->upload)
+        return dashenc_io_close(s, &os->out, NULL);
     if (!c->single_file)
         ff_format_io_close(s, &os->out);
     return 0;
@@ -378,6 +393,7 @@ static void dash_free(AVFormatContext *s)
             av_write_trailer(os->ctx);
         if (os->ctx && os->ctx->pb)
             ffio_free_dyn_buf(&os->ctx->pb);
+        ff_upload_discard(c->upload, &os->out);
         ff_format_io_close(s, &os->out);
         if (os->ctx)
             avformat_free_context(os->ctx);
@@ -387,8 +403,11 @@ static void dash_free(AVFormatContext *s)
     }
     av_freep(&c->streams);
 
+    ff_upload_discard(c->upload, &c->mpd_out);
+    ff_upload_discard(c->upload, &c->m3u8_out);
     ff_format_io_close(s, &c->mpd_out);
     ff_format_io_close(s, &c->m3u8_out);
+    ff_upload_queue_free(&c->upload);
 }
 
 static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatContext *s,
@@ -854,7 +873,8 @@ static int write_manifest(AVFormatContext *s, int final)
 
     avio_printf(out, "</MPD>\n");
     avio_flush(out);
-    dashenc_io_close(s, &c->mpd_out, temp_filename);
+    if ((ret = dashenc_io_close(s, &c->mpd_out, temp_filename)) < 0)
+        return ret;
 
     if (use_rename) {
         if ((ret = avpriv_io_move(temp_filename, s->url)) < 0)
@@ -875,7 +895,10 @@ static int write_manifest(AVFormatContext *s, int final)
         snprintf(temp_filename, sizeof(temp_filename), use_rename ? "%s.tmp" : "%s", filename_hls);
 
         set_http_options(&opts, c);
-        ret = avio_open2(&out, temp_filename, AVIO_FLAG_WRITE, NULL, &opts);
+        if (c->upload && ff_is_http_proto(temp_filename))
+            ret = ff_upload_open(c->upload, &out, temp_filename, &opts);
+        else
+            ret = avio_open2(&out, temp_filename, AVIO_FLAG_WRITE, NULL, &opts);
         if (ret < 0) {
             av_log(s, AV_LOG_ERROR, "Unable to open %s for writing\n", temp_filename);
             return ret;
@@ -911,7 +934,12 @@ static int write_manifest(AVFormatContext *s, int final)
             get_hls_playlist_name(playlist_file, sizeof(playlist_file), NULL, i);
             ff_hls_write_stream_info(st, out, stream_bitrate, playlist_file, agroup, NULL, NULL);
         }
-        avio_close(out);
+        if (ff_upload_owns(c->upload, out)) {
+            if ((ret = ff_upload_close(c->upload, &out, FF_UPLOAD_ORDERED)) < 0)
+                return ret;
+        } else {
+            avio_close(out);
+        }
         if (use_rename)
             if ((ret = avpriv_io_move(temp_filename, filename_hls)) < 0)
                 return ret;
@@ -962,6 +990,21 @@ static int dash_init(AVFormatContext *s)
     if (ptr)
         *ptr = '\0';
 
+    if (c->upload_threads > 0 && ff_is_http_proto(s->url)) {
+        if (c->single_file || c->streaming) {
+            av_log(s, AV_LOG_WARNING, "Asynchronous upload is not supported "
+                   "in single file or streaming mode, uploading synchronously\n");
+        } else {
+            ret = ff_upload_queue_alloc(&c->upload, s, c->upload_threads,
+                                        c->upload_queue_size, c->upload_retries);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "Asynchronous upload requires threads, "
+                       "uploading synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     c->streams = av_mallocz(sizeof(*c->streams) * s->nb_streams);
     if (!c->streams)
         return AVERROR(ENOMEM);
@@ -1040,7 +1083,10 @@ static int dash_init(AVFormatContext *s)
         }
         snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->initfile);
         set_http_options(&opts, c);
-        ret = s->io_open(s, &os->out, filename, AVIO_FLAG_WRITE, &opts);
+        if (c->upload && ff_is_http_proto(filename))
+            ret = ff_upload_open(c->upload, &os->out, filename, &opts);
+        else
+            ret = s->io_open(s, &os->out, filename, AVIO_FLAG_WRITE, &opts);
         if (ret < 0)
             return ret;
         av_dict_free(&opts);
@@ -1232,6 +1278,13 @@ static void dashenc_delete_file(AVFormatContext *s, char *filename) {
         set_http_options(&http_opts, c);
         av_dict_set(&http_opts, "method", "DELETE", 0);
 
+        if (c->upload) {
+            if (ff_upload_request(c->upload, filename, http_opts, FF_UPLOAD_ORDERED) < 0)
+                av_log(s, AV_LOG_ERROR, "failed to delete %s\n", filename);
+            av_dict_free(&http_opts);
+            return;
+        }
+
         if (dashenc_io_open(s, &out, filename, &http_opts) < 0) {
             av_log(s, AV_LOG_ERROR, "failed to delete %s\n", filename);
         }
@@ -1302,7 +1355,8 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
         if (c->single_file) {
             find_index_range(s, os->full_path, os->pos, &index_length);
         } else {
-            dashenc_io_close(s, &os->out, os->temp_path);
+            if ((ret = dashenc_io_close(s, &os->out, os->temp_path)) < 0)
+                break;
 
             if (use_rename) {
                 ret = avpriv_io_move(os->temp_path, os->full_path);
@@ -1522,6 +1576,8 @@ static int dash_write_trailer(AVFormatContext *s)
         dashenc_delete_file(s, s->url);
     }
 
+    if (c->upload)
+        return ff_upload_queue_wait(c->upload);
     return 0;
 }
 
@@ -1577,6 +1633,9 @@ static const AVOption options[] = {
     { "dash_segment_type", "set dash segment files type", OFFSET(segment_type), AV_OPT_TYPE_INT, {.i64 = SEGMENT_TYPE_MP4 }, 0, SEGMENT_TYPE_NB - 1, E, "segment_type"},
     { "mp4", "make segment file in ISOBMFF format", 0, AV_OPT_TYPE_CONST, {.i64 = SEGMENT_TYPE_MP4 }, 0, UINT_MAX,   E, "segment_type"},
     { "webm", "make segment file in WebM format", 0, AV_OPT_TYPE_CONST, {.i64 = SEGMENT_TYPE_WEBM }, 0, UINT_MAX,   E, "segment_type"},
+    { "upload_threads", "number of threads uploading the HTTP outputs asynchronously (0: upload synchronously)", OFFSET(upload_threads), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 16, E },
+    { "upload_queue_size", "maximum number of pending asynchronous uploads", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, { .i64 = 16 }, 1, 1024, E },
+    { "upload_retries", "number of times a failed asynchronous upload is retried", OFFSET(upload_retries), AV_OPT_TYPE_INT, { .i64 = 2 }, 0, 100, E },
     { NULL },
 };
 
@@ -33,6 +33,9 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <stdlib.h>
 #include "os_support.h"
@@ -65,6 +68,9 @@
 #  endif
 #endif
 
+/* number of consecutive nearby reads after which the access is sequential */
+#define SEQUENTIAL_READS 4
+
 /* standard file protocol */
 
 typedef struct FileContext {
@@ -73,6 +79,19 @@ typedef struct FileContext {
     int trunc;
     int blocksize;
     int follow;
+    int use_mmap;
+    int readahead_size;
+    int64_t pos;
+#if HAVE_MMAP
+    uint8_t *map;
+    int64_t map_size;
+#endif
+#if HAVE_POSIX_FADVISE
+    int advice;
+    int seq_reads;
+    int64_t last_end;
+    int64_t readahead_end;
+#endif
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -82,6 +101,8 @@ static const AVOption file_options[] = {
     { "truncate", "truncate existing files on write", offsetof(FileContext, trunc), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, AV_OPT_FLAG_ENCODING_PARAM },
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "mmap", "map the file into memory when reading", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "readahead_size", "advise the kernel of the access pattern and prefetch this many bytes ahead of sequential reads", offsetof(FileContext, readahead_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -104,12 +125,60 @@ static const AVClass pipe_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+/* Advise the kernel of the access pattern before reading size bytes at
+ * c->pos: random after seeks longer than the readahead size, sequential
+ * with an explicit readahead window after a few nearby reads. */
+static void file_advise(FileContext *c, int size)
+{
+#if HAVE_POSIX_FADVISE
+    int64_t readahead_size = c->readahead_size;
+    int advice;
+
+    if (FFABS(c->pos - c->last_end) > readahead_size) {
+        c->seq_reads     = 0;
+        c->readahead_end = 0;
+    } else if (c->seq_reads < SEQUENTIAL_READS) {
+        c->seq_reads++;
+    }
+    c->last_end = c->pos + size;
+
+    advice = c->seq_reads >= SEQUENTIAL_READS ? POSIX_FADV_SEQUENTIAL :
+             c->seq_reads                     ? POSIX_FADV_NORMAL     :
+                                                POSIX_FADV_RANDOM;
+    if (advice != c->advice) {
+        posix_fadvise(c->fd, 0, 0, advice);
+        c->advice = advice;
+    }
+    if (advice == POSIX_FADV_SEQUENTIAL &&
+        c->readahead_end < c->pos + size + readahead_size / 2) {
+        int64_t start = FFMAX(c->pos, c->readahead_end);
+        int64_t end   = c->pos + size + readahead_size;
+        posix_fadvise(c->fd, start, end - start, POSIX_FADV_WILLNEED);
+        c->readahead_end = end;
+    }
+#endif
+}
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->readahead_size)
+        file_advise(c, size);
+#if HAVE_MMAP
+    if (c->map) {
+        if (c->pos >= c->map_size)
+            return AVERROR_EOF;
+        ret = FFMIN(size, c->map_size - c->pos);
+        memcpy(buf, c->map + c->pos, ret);
+        c->pos += ret;
+        return ret;
+    }
+#endif
     ret = read(c->fd, buf, size);
+    if (ret > 0)
+        c->pos += ret;
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
     if (ret == 0)
@@ -234,6 +303,26 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (!h->is_streamed && flags & AVIO_FLAG_WRITE)
         h->min_packet_size = h->max_packet_size = 262144;
 
+    c->pos = 0;
+#if HAVE_POSIX_FADVISE
+    c->advice = POSIX_FADV_NORMAL;
+#endif
+#if HAVE_MMAP
+    /* reads become copies from the page cache, and seeks are free */
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow &&
+        !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (uint64_t)st.st_size <= SIZE_MAX) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            av_log(h, AV_LOG_WARNING, "Cannot map '%s' into memory: %s\n",
+                   filename, av_err2str(AVERROR(errno)));
+        } else {
+            c->map      = map;
+            c->map_size = st.st_size;
+        }
+    }
+#endif
+
     return 0;
 }
 
@@ -249,7 +338,23 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+#if HAVE_MMAP
+    if (c->map) {
+        switch (whence) {
+        case SEEK_SET:                     break;
+        case SEEK_CUR: pos += c->pos;      break;
+        case SEEK_END: pos += c->map_size; break;
+        default:       return AVERROR(EINVAL);
+        }
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return c->pos = pos;
+    }
+#endif
+
     ret = lseek(c->fd, pos, whence);
+    if (ret >= 0)
+        c->pos = ret;
 
     return ret < 0 ? AVERROR(errno) : ret;
 }
@@ -257,6 +362,10 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
+#if HAVE_MMAP
+    if (c->map)
+        munmap(c->map, c->map_size);
+#endif
     return close(c->fd);
 }
 
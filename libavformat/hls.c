@@ -38,6 +38,7 @@
 #include "internal.h"
 #include "avio_internal.h"
 #include "id3v2.h"
+#include "prefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 
@@ -98,6 +99,10 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    /* background segment and playlist downloads, see schedule_prefetch() */
+    FFPrefetch *prefetch;
+    AVDictionary *prefetch_opts;
+    int cur_prefetched;
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -208,6 +213,8 @@ typedef struct HLSContext {
     int max_reload;
     int http_persistent;
     int http_multiple;
+    int prefetch_segments;
+    int64_t prefetch_max_size;
     AVIOContext *playlist_pb;
 } HLSContext;
 
@@ -260,6 +267,8 @@ static void free_playlist_list(HLSContext *c)
         if (pls->input_next)
             ff_format_io_close(c->ctx, &pls->input_next);
         pls->input_next_requested = 0;
+        ff_prefetch_free(&pls->prefetch);
+        av_dict_free(&pls->prefetch_opts);
         if (pls->ctx) {
             pls->ctx->pb = NULL;
             avformat_close_input(&pls->ctx);
@@ -1350,6 +1359,128 @@ static int playlist_needed(struct playlist *pls)
     return 0;
 }
 
+static int prefetch_open(void *opaque, AVIOContext **pb, const char *url,
+                         int64_t offset, int64_t size)
+{
+    struct playlist *pls = opaque;
+    HLSContext *c = pls->parent->priv_data;
+    AVDictionary *opts = NULL;
+    int ret, is_http = 0;
+
+    /* open_url() only reuses persistent HTTP connections */
+    if (*pb && !(c->http_persistent && av_strstart(url, "http", NULL)))
+        ff_format_io_close(pls->parent, pb);
+
+    if (c->http_persistent)
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+    if (size >= 0) {
+        av_dict_set_int(&opts, "offset", offset, 0);
+        av_dict_set_int(&opts, "end_offset", offset + size, 0);
+    }
+
+    /* the worker thread has its own copy of the options, open_url()
+     * updates the cookies in it */
+    ret = open_url(pls->parent, pb, url, pls->prefetch_opts, opts, &is_http);
+    if (ret >= 0 && !is_http && offset) {
+        int64_t seekret = avio_seek(*pb, offset, SEEK_SET);
+        if (seekret < 0) {
+            ret = seekret;
+            ff_format_io_close(pls->parent, pb);
+        }
+    }
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int init_prefetch(HLSContext *c, struct playlist *pls)
+{
+    int ret;
+
+    if (!c->prefetch_segments || pls->prefetch)
+        return 0;
+
+    pls->parent = c->ctx;
+    if ((ret = av_dict_copy(&pls->prefetch_opts, c->avio_opts, 0)) < 0)
+        return ret;
+    ret = ff_prefetch_alloc(&pls->prefetch, c->ctx, prefetch_open, pls,
+                            c->prefetch_segments, c->prefetch_max_size);
+    if (ret == AVERROR(ENOSYS)) {
+        av_log(c->ctx, AV_LOG_WARNING,
+               "Segment prefetching is not supported on this build\n");
+        c->prefetch_segments = 0;
+        return 0;
+    }
+    return ret;
+}
+
+/* Let the prefetch thread download the next version of a live playlist
+ * once it is due. */
+static void schedule_refresh(struct playlist *pls)
+{
+    if (pls->prefetch)
+        ff_prefetch_schedule_refresh(pls->prefetch, pls->url,
+                                     pls->finished ? INT64_MAX :
+                                     pls->last_load_time + default_reload_interval(pls));
+}
+
+/* Reload a playlist, using the copy downloaded by the prefetch thread if
+ * there is a recent enough one. */
+static int reload_playlist(HLSContext *c, struct playlist *pls, int wait)
+{
+    int ret = AVERROR(EAGAIN);
+
+    if (pls->prefetch) {
+        int64_t min_time = av_gettime_relative() - pls->target_duration / 2;
+        uint8_t *buf;
+        char *url;
+        int size;
+
+        ret = ff_prefetch_get_refresh(pls->prefetch, wait, wait ? INT64_MIN : min_time,
+                                      &buf, &size, &url);
+        if (ret == AVERROR_EXIT)
+            return ret;
+        if (ret >= 0) {
+            AVIOContext pb;
+
+            ffio_init_context(&pb, buf, size, 0, NULL, NULL, NULL, NULL);
+            ret = parse_playlist(c, url, pls, &pb);
+            av_free(buf);
+            av_free(url);
+        }
+    }
+    if (ret < 0)
+        ret = parse_playlist(c, pls->url, pls, NULL);
+    if (ret >= 0)
+        schedule_refresh(pls);
+    return ret;
+}
+
+/* Queue the segments following the current one for download by the
+ * prefetch thread, return 1 if the current segment is served by it. */
+static int schedule_prefetch(struct playlist *pls)
+{
+    int64_t last_seq_no;
+    int seq_no, ret;
+
+    if (!pls->prefetch)
+        return 0;
+
+    ret = ff_prefetch_sync(pls->prefetch, pls->cur_seq_no, &last_seq_no);
+    for (seq_no = FFMAX(last_seq_no + 1, pls->cur_seq_no);
+         seq_no < pls->start_seq_no + pls->n_segments; seq_no++) {
+        struct segment *seg = pls->segments[seq_no - pls->start_seq_no];
+
+        /* encrypted segments are left to open_input() */
+        if (seg->key_type != KEY_NONE ||
+            ff_prefetch_add(pls->prefetch, seq_no, seg->url,
+                            seg->url_offset, seg->size) < 0)
+            break;
+        if (seq_no == pls->cur_seq_no)
+            ret = 1;
+    }
+    return ret;
+}
+
 static int read_data(void *opaque, uint8_t *buf, int buf_size)
 {
     struct playlist *v = opaque;
@@ -1363,7 +1494,8 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->cur_prefetched) ||
+        (c->http_persistent && v->input_read_done && !v->cur_prefetched)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1373,6 +1505,8 @@ restart:
         if (!v->needed) {
             av_log(v->parent, AV_LOG_INFO, "No longer receiving playlist %d\n",
                 v->index);
+            if (v->prefetch)
+                ff_prefetch_flush(v->prefetch);
             return AVERROR_EOF;
         }
 
@@ -1386,7 +1520,7 @@ reload:
             return AVERROR_EOF;
         if (!v->finished &&
             av_gettime_relative() - v->last_load_time >= reload_interval) {
-            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0) {
+            if ((ret = reload_playlist(c, v, 0)) < 0) {
                 if (ret != AVERROR_EXIT)
                     av_log(v->parent, AV_LOG_WARNING, "Failed to reload playlist %d\n",
                            v->index);
@@ -1423,7 +1557,10 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (schedule_prefetch(v)) {
+            v->cur_prefetched = 1;
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->input_next_requested = 0;
             ret = 0;
@@ -1442,7 +1579,7 @@ reload:
         just_opened = 1;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1452,7 +1589,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !v->prefetch &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1475,7 +1612,10 @@ reload:
     }
 
     seg = current_segment(v);
-    ret = read_from_url(v, seg, buf, buf_size);
+    if (v->cur_prefetched)
+        ret = ff_prefetch_read(v->prefetch, buf, buf_size);
+    else
+        ret = read_from_url(v, seg, buf, buf_size);
     if (ret > 0) {
         if (just_opened && v->is_id3_timestamped != 0) {
             /* Intercept ID3 tags here, elementary audio streams are required
@@ -1485,7 +1625,15 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->cur_prefetched) {
+        if (ret == AVERROR_EXIT)
+            return ret;
+        if (ret != AVERROR_EOF)
+            av_log(v->parent, AV_LOG_WARNING, "Failed to download segment %d of playlist %d: %s\n",
+                   v->cur_seq_no, v->index, av_err2str(ret));
+        ff_prefetch_release(v->prefetch);
+        v->cur_prefetched = 0;
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1787,9 +1935,17 @@ static int hls_read_header(AVFormatContext *s)
     /* If the playlist only contained playlists (Master Playlist),
      * parse each individual playlist. */
     if (c->n_playlists > 1 || c->playlists[0]->n_segments == 0) {
+        /* with prefetching, the playlists are downloaded in parallel */
         for (i = 0; i < c->n_playlists; i++) {
             struct playlist *pls = c->playlists[i];
-            if ((ret = parse_playlist(c, pls->url, pls, NULL)) < 0)
+            if ((ret = init_prefetch(c, pls)) < 0)
+                goto fail;
+            if (pls->prefetch)
+                ff_prefetch_schedule_refresh(pls->prefetch, pls->url, 0);
+        }
+        for (i = 0; i < c->n_playlists; i++) {
+            struct playlist *pls = c->playlists[i];
+            if ((ret = reload_playlist(c, pls, 1)) < 0)
                 goto fail;
         }
     }
@@ -1860,6 +2016,12 @@ static int hls_read_header(AVFormatContext *s)
         pls->needed = 1;
         pls->parent = s;
 
+        if (!pls->prefetch) {
+            if ((ret = init_prefetch(c, pls)) < 0)
+                goto fail;
+            schedule_refresh(pls);
+        }
+
         /*
          * If this is a live stream and this playlist looks like it is one segment
          * behind, try to sync it up so that every substream starts at the same
@@ -1986,6 +2148,9 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             if (pls->input_next)
                 ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            if (pls->prefetch)
+                ff_prefetch_flush(pls->prefetch);
+            pls->cur_prefetched = 0;
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2234,6 +2399,9 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         if (pls->input_next)
             ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        if (pls->prefetch)
+            ff_prefetch_flush(pls->prefetch);
+        pls->cur_prefetched = 0;
         av_packet_unref(&pls->pkt);
         reset_packet(&pls->pkt);
         pls->pb.eof_reached = 0;
@@ -2292,6 +2460,10 @@ static const AVOption hls_options[] = {
         OFFSET(http_persistent), AV_OPT_TYPE_BOOL, {.i64 = 1}, 0, 1, FLAGS },
     {"http_multiple", "Use multiple HTTP connections for fetching segments",
         OFFSET(http_multiple), AV_OPT_TYPE_BOOL, {.i64 = -1}, -1, 1, FLAGS},
+    {"prefetch_segments", "Number of segments per playlist downloaded ahead by a background thread",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_max_size", "Maximum number of prefetched bytes per playlist",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 32 * 1024 * 1024}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
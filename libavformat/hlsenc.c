@@ -51,6 +51,7 @@
 #include "hlsplaylist.h"
 #include "internal.h"
 #include "os_support.h"
+#include "upload.h"
 
 typedef enum {
   HLS_START_SEQUENCE_AS_START_NUMBER = 0,
@@ -228,6 +229,11 @@ typedef struct HLSContext {
     AVIOContext *m3u8_out;
     AVIOContext *sub_m3u8_out;
     int64_t timeout;
+
+    int upload_threads;
+    int upload_queue_size;
+    int upload_retries;
+    FFUploadQueue *upload;
 } HLSContext;
 
 static int mkdir_p(const char *path) {
@@ -268,7 +274,9 @@ static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
-    if (!*pb || !http_base_proto || !hls->http_persistent) {
+    if (hls->upload && http_base_proto) {
+        err = ff_upload_open(hls->upload, pb, filename, options);
+    } else if (!*pb || !http_base_proto || !hls->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -280,10 +288,17 @@ static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     return err;
 }
 
-static void hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename) {
+static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename) {
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
-    if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
+    int ret = 0;
+    if (!*pb)
+        return ret;
+    if (ff_upload_owns(hls->upload, *pb)) {
+        /* playlists must not reference segments not uploaded yet */
+        int flags = pb == &hls->m3u8_out || pb == &hls->sub_m3u8_out ? FF_UPLOAD_ORDERED : 0;
+        ret = ff_upload_close(hls->upload, pb, flags);
+    } else if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -293,6 +308,7 @@ static void hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename
         ffurl_shutdown(http_url_context, AVIO_FLAG_WRITE);
 #endif
     }
+    return ret;
 }
 
 static void set_http_options(AVFormatContext *s, AVDictionary **options, HLSContext *c)
@@ -524,9 +540,14 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         proto = avio_find_protocol_name(s->url);
         if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
             av_dict_set(&options, "method", "DELETE", 0);
-            if ((ret = vs->avf->io_open(vs->avf, &out, path, AVIO_FLAG_WRITE, &options)) < 0)
-                goto fail;
-            ff_format_io_close(vs->avf, &out);
+            if (hls->upload && ff_is_http_proto(path)) {
+                if ((ret = ff_upload_request(hls->upload, path, options, FF_UPLOAD_ORDERED)) < 0)
+                    goto fail;
+            } else {
+                if ((ret = vs->avf->io_open(vs->avf, &out, path, AVIO_FLAG_WRITE, &options)) < 0)
+                    goto fail;
+                ff_format_io_close(vs->avf, &out);
+            }
         } else if (unlink(path) < 0) {
             av_log(hls, AV_LOG_ERROR, "failed to delete old segment %s: %s\n",
                                      path, strerror(errno));
@@ -545,11 +566,15 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
 
             if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
                 av_dict_set(&options, "method", "DELETE", 0);
-                if ((ret = vs->avf->io_open(vs->avf, &out, sub_path, AVIO_FLAG_WRITE, &options)) < 0) {
+                if (hls->upload && ff_is_http_proto(sub_path)) {
+                    ret = ff_upload_request(hls->upload, sub_path, options, FF_UPLOAD_ORDERED);
+                } else if ((ret = vs->avf->io_open(vs->avf, &out, sub_path, AVIO_FLAG_WRITE, &options)) >= 0) {
+                    ff_format_io_close(vs->avf, &out);
+                }
+                if (ret < 0) {
                     av_free(sub_path);
                     goto fail;
                 }
-                ff_format_io_close(vs->avf, &out);
             } else if (unlink(sub_path) < 0) {
                 av_log(hls, AV_LOG_ERROR, "failed to delete old segment %s: %s\n",
                                          sub_path, strerror(errno));
@@ -1370,7 +1395,7 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     HLSContext *hls = s->priv_data;
     HLSSegment *en;
     int target_duration = 0;
-    int ret = 0;
+    int ret = 0, err;
     char temp_filename[1024];
     int64_t sequence = FFMAX(hls->start_sequence, vs->sequence - vs->nb_entries);
     const char *proto = avio_find_protocol_name(s->url);
@@ -1470,8 +1495,10 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
 fail:
     av_dict_free(&options);
-    hlsenc_io_close(s, &hls->m3u8_out, temp_filename);
-    hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
+    if ((err = hlsenc_io_close(s, &hls->m3u8_out, temp_filename)) < 0 && ret >= 0)
+        ret = err;
+    if ((err = hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name)) < 0 && ret >= 0)
+        ret = err;
     if (ret >= 0 && use_rename)
         ff_rename(temp_filename, vs->m3u8_name, s);
 
@@ -2239,13 +2266,15 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
                 vs->packets_written = 0;
                 vs->start_pos = range_length;
                 if (!byterange_mode) {
-                    ff_format_io_close(s, &vs->out);
+                    if (!hls->upload)
+                        ff_format_io_close(s, &vs->out);
                     hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
                 }
             }
         } else {
             if (!byterange_mode) {
-                hlsenc_io_close(s, &oc->pb, oc->url);
+                if ((ret = hlsenc_io_close(s, &oc->pb, oc->url)) < 0)
+                    return ret;
             }
         }
         if (!byterange_mode) {
@@ -2285,7 +2314,12 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
                 if (ret < 0) {
                     return ret;
                 }
-                ff_format_io_close(s, &vs->out);
+                if (hls->upload) {
+                    if ((ret = hlsenc_io_close(s, &vs->out, vs->avf->url)) < 0)
+                        return ret;
+                } else {
+                    ff_format_io_close(s, &vs->out);
+                }
             }
         }
 
@@ -2380,7 +2414,10 @@ static int hls_write_trailer(struct AVFormatContext *s)
             if (ret < 0) {
                 goto failed;
             }
-            ff_format_io_close(s, &vs->out);
+            if (hls->upload)
+                hlsenc_io_close(s, &vs->out, vs->avf->url);
+            else
+                ff_format_io_close(s, &vs->out);
         }
 
 failed:
@@ -2391,8 +2428,12 @@ failed:
             } else {
                 vs->size = avio_tell(vs->avf->pb);
             }
-            if (hls->segment_type != SEGMENT_TYPE_FMP4)
-                ff_format_io_close(s, &oc->pb);
+            if (hls->segment_type != SEGMENT_TYPE_FMP4) {
+                if (hls->upload)
+                    hlsenc_io_close(s, &oc->pb, oc->url);
+                else
+                    ff_format_io_close(s, &oc->pb);
+            }
 
             if ((hls->flags & HLS_TEMP_FILE) && oc->url[0]) {
                 hls_rename_temp_file(s, oc);
@@ -2414,7 +2455,10 @@ failed:
             if (vtt_oc->pb)
                 av_write_trailer(vtt_oc);
             vs->size = avio_tell(vs->vtt_avf->pb) - vs->start_pos;
-            ff_format_io_close(s, &vtt_oc->pb);
+            if (hls->upload)
+                hlsenc_io_close(s, &vtt_oc->pb, vtt_oc->url);
+            else
+                ff_format_io_close(s, &vtt_oc->pb);
         }
         av_freep(&vs->basename);
         av_freep(&vs->base_output_dirname);
@@ -2453,9 +2497,19 @@ failed:
     av_freep(&hls->var_streams);
     av_freep(&hls->cc_streams);
     av_freep(&hls->master_m3u8_url);
+
+    if (hls->upload)
+        return ff_upload_queue_wait(hls->upload);
     return 0;
 }
 
+static void hls_deinit(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+
+    ff_upload_queue_free(&hls->upload);
+}
+
 
 static int hls_init(AVFormatContext *s)
 {
@@ -2536,6 +2590,23 @@ static int hls_init(AVFormatContext *s)
         av_log(hls, AV_LOG_DEBUG, "start_number evaluated to %"PRId64"\n", hls->start_sequence);
     }
 
+    if (hls->upload_threads > 0 && ff_is_http_proto(s->url)) {
+        if ((hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0) {
+            av_log(s, AV_LOG_WARNING, "Asynchronous upload is not supported "
+                   "with byte range segments, uploading synchronously\n");
+        } else {
+            ret = ff_upload_queue_alloc(&hls->upload, s, hls->upload_threads,
+                                        hls->upload_queue_size, hls->upload_retries);
+            if (ret == AVERROR(ENOSYS)) {
+                av_log(s, AV_LOG_WARNING, "Asynchronous upload requires threads, "
+                       "uploading synchronously\n");
+            } else if (ret < 0) {
+                goto fail;
+            }
+            ret = 0;
+        }
+    }
+
     hls->recording_time = (hls->init_time ? hls->init_time : hls->time) * AV_TIME_BASE;
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
@@ -2858,6 +2929,9 @@ static const AVOption options[] = {
     {"master_pl_publish_rate", "Publish master play list every after this many segment intervals", OFFSET(master_publish_rate), AV_OPT_TYPE_INT, {.i64 = 0}, 0, UINT_MAX, E},
     {"http_persistent", "Use persistent HTTP connections", OFFSET(http_persistent), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, E },
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
+    {"upload_threads", "number of threads uploading the HTTP outputs asynchronously (0: upload synchronously)", OFFSET(upload_threads), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 16, E},
+    {"upload_queue_size", "maximum number of pending asynchronous uploads", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, {.i64 = 16}, 1, 1024, E},
+    {"upload_retries", "number of times a failed asynchronous upload is retried", OFFSET(upload_retries), AV_OPT_TYPE_INT, {.i64 = 2}, 0, 100, E},
     { NULL },
 };
 
@@ -2882,5 +2956,6 @@ AVOutputFormat ff_hls_muxer = {
     .write_header   = hls_write_header,
     .write_packet   = hls_write_packet,
     .write_trailer  = hls_write_trailer,
+    .deinit         = hls_deinit,
     .priv_class     = &hls_class,
 };
@@ -60,7 +60,8 @@
 static const AVOption options[] = {
     { "movflags", "MOV muxer flags", offsetof(MOVMuxContext, flags), AV_OPT_TYPE_FLAGS, {.i64 = 0}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "rtphint", "Add RTP hint tracks", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RTP_HINT}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
-    { "moov_size", "maximum moov size so it can be placed at the begin", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, 0 },
+    { "moov_size", "maximum moov size so it can be placed at the begin", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, -1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "moov_size" },
+    { "auto", "estimate the moov size from the stream parameters and durations", 0, AV_OPT_TYPE_CONST, {.i64 = -1}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "moov_size" },
     { "empty_moov", "Make the initial moov atom empty", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_EMPTY_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "frag_keyframe", "Fragment at video keyframes", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_KEYFRAME}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "frag_every_frame", "Fragment at every frame", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_EVERY_FRAME}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
@@ -6013,6 +6014,92 @@ static int mov_create_dvd_sub_decoder_specific_info(MOVTrack *track,
     return 0;
 }
 
+static int64_t estimate_metadata_size(AVDictionary *m)
+{
+    AVDictionaryEntry *t = NULL;
+    int64_t size = 0;
+
+    while ((t = av_dict_get(m, "", t, AV_DICT_IGNORE_SUFFIX)))
+        size += 64 + strlen(t->key) + strlen(t->value);
+    return size;
+}
+
+/*
+ * Estimate an upper bound of the moov atom size from the stream parameters
+ * and durations. The durations are only valid in the time bases set by the
+ * caller, so this has to be called before the track time bases are set.
+ * Returns 0 if the size cannot be estimated.
+ */
+static int64_t estimate_moov_size(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int64_t duration = 0;
+    double size;
+    int i;
+
+    /* the number of hint samples depends on the packetization */
+    if (mov->flags & FF_MOV_FLAG_RTP_HINT)
+        return 0;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        if (st->duration > 0 && st->time_base.num > 0 && st->time_base.den > 0)
+            duration = FFMAX(duration, av_rescale_q(st->duration, st->time_base,
+                                                    AV_TIME_BASE_Q));
+    }
+    if (s->duration > 0)
+        duration = duration ? FFMIN(duration, s->duration) : s->duration;
+    if (duration <= 0)
+        return 0;
+
+    size = 4096 + estimate_metadata_size(s->metadata);
+    if (s->nb_chapters)
+        size += 1024 + s->nb_chapters * 256;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        /* stsz entry, and stsc and co64 entries for a sample per chunk */
+        int entry_size = 4 + 12 + 8;
+        double rate;
+
+        size += 1024 + par->extradata_size + estimate_metadata_size(st->metadata);
+
+        if (st->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+            size += entry_size;
+            continue;
+        }
+
+        switch (par->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            if (st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0)
+                rate = av_q2d(st->avg_frame_rate);
+            else if (st->time_base.num > 0 && st->time_base.den > 0)
+                rate = FFMIN(av_q2d(av_inv_q(st->time_base)), 120);
+            else
+                return 0;
+            /* stts, ctts and stss entries, and a possible tmcd track */
+            entry_size += 8 + 8 + 4;
+            size += 1024;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            if (par->sample_rate <= 0)
+                return 0;
+            rate = par->sample_rate / (double)(par->frame_size > 0 ? par->frame_size : 1024);
+            break;
+        default:
+            /* a sample per second, plus the subtitle end samples */
+            rate = 2;
+            entry_size += 8;
+            break;
+        }
+        size += (duration / (double)AV_TIME_BASE * rate + 1) * entry_size;
+    }
+
+    size += size / 8;
+    return size <= INT_MAX ? (int64_t)size : 0;
+}
+
 static int mov_init(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -6059,7 +6146,23 @@ static int mov_init(AVFormatContext *s)
         s->flags &= ~AVFMT_FLAG_AUTO_BSF;
     }
 
-    if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+    if (mov->reserved_moov_size == -1) {
+        mov->reserved_moov_size = 0;
+        if (!(mov->flags & FF_MOV_FLAG_FRAGMENT)) {
+            int64_t size = estimate_moov_size(s);
+            if (size > 0) {
+                mov->reserved_moov_size = size;
+                mov->auto_moov_size = 1;
+                av_log(s, AV_LOG_VERBOSE, "Reserving %"PRId64" bytes for the moov atom\n", size);
+            } else {
+                av_log(s, AV_LOG_WARNING, "Unable to estimate the moov size, %s\n",
+                       mov->flags & FF_MOV_FLAG_FASTSTART ? "using a second pass"
+                                                          : "writing it at the end");
+            }
+        }
+    }
+
+    if (mov->flags & FF_MOV_FLAG_FASTSTART && !mov->auto_moov_size) {
         mov->reserved_moov_size = -1;
     }
 
@@ -6411,7 +6514,7 @@ static int mov_write_header(AVFormatContext *s)
             !mov->max_fragment_duration && !mov->max_fragment_size)
             mov->flags |= FF_MOV_FLAG_FRAG_KEYFRAME;
     } else {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->reserved_moov_size < 0)
             mov->reserved_header_pos = avio_tell(pb);
         mov_write_mdat_tag(pb, mov);
     }
@@ -6544,28 +6647,27 @@ static int compute_sidx_size(AVFormatContext *s)
     return sidx_size;
 }
 
-static int shift_data(AVFormatContext *s)
+/*
+ * Move the data from pos up to the current output position forward by
+ * shift bytes, making room for the index.
+ */
+static int move_data(AVFormatContext *s, int64_t pos, int shift)
 {
-    int ret = 0, moov_size;
-    MOVMuxContext *mov = s->priv_data;
-    int64_t pos, pos_end = avio_tell(s->pb);
+    int ret = 0;
+    int64_t pos_end;
     uint8_t *buf, *read_buf[2];
     int read_buf_id = 0;
     int read_size[2];
+    /* the blocks have to be at least as large as the shift, so that the
+     * data is read before it is overwritten */
+    int block_size = FFMAX(shift, 1 << 20);
     AVIOContext *read_pb;
 
-    if (mov->flags & FF_MOV_FLAG_FRAGMENT)
-        moov_size = compute_sidx_size(s);
-    else
-        moov_size = compute_moov_size(s);
-    if (moov_size < 0)
-        return moov_size;
-
-    buf = av_malloc(moov_size * 2);
+    buf = av_malloc(block_size * 2);
     if (!buf)
         return AVERROR(ENOMEM);
     read_buf[0] = buf;
-    read_buf[1] = buf + moov_size;
+    read_buf[1] = buf + block_size;
 
     /* Shift the data: the AVIO context of the output can only be used for
      * writing, so we re-open the same output, but for reading. It also avoids
@@ -6581,18 +6683,18 @@ static int shift_data(AVFormatContext *s)
     /* mark the end of the shift to up to the last data we wrote, and get ready
      * for writing */
     pos_end = avio_tell(s->pb);
-    avio_seek(s->pb, mov->reserved_header_pos + moov_size, SEEK_SET);
+    avio_seek(s->pb, pos + shift, SEEK_SET);
 
-    /* start reading at where the new moov will be placed */
-    avio_seek(read_pb, mov->reserved_header_pos, SEEK_SET);
+    /* start reading at where the new index will be placed */
+    avio_seek(read_pb, pos, SEEK_SET);
     pos = avio_tell(read_pb);
 
 #define READ_BLOCK do {                                                             \
-    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id], moov_size);  \
+    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id], block_size); \
     read_buf_id ^= 1;                                                               \
 } while (0)
 
-    /* shift data by chunk of at most moov_size */
+    /* shift data by chunk of at most block_size */
     READ_BLOCK;
     do {
         int n;
@@ -6610,6 +6712,63 @@ end:
     return ret;
 }
 
+static int shift_data(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int moov_size;
+
+    if (mov->flags & FF_MOV_FLAG_FRAGMENT)
+        moov_size = compute_sidx_size(s);
+    else
+        moov_size = compute_moov_size(s);
+    if (moov_size < 0)
+        return moov_size;
+
+    return move_data(s, mov->reserved_header_pos, moov_size);
+}
+
+/*
+ * Make the moov atom fit in the space reserved from the estimate, either
+ * exactly or followed by a free atom, by moving the data after it forward
+ * if needed. end is updated to the new end of the output.
+ */
+static int fit_reserved_moov(AVFormatContext *s, int64_t *end)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int i, moov_size, shift = 0, ret;
+
+    for (;;) {
+        int new_shift;
+
+        moov_size = get_moov_size(s);
+        if (moov_size < 0)
+            return moov_size;
+        if (moov_size == mov->reserved_moov_size + shift ||
+            moov_size + 8 <= mov->reserved_moov_size + shift)
+            break;
+        /* moving the data can switch the chunk offsets to co64, recompute
+         * the size until it is stable */
+        new_shift = (moov_size < mov->reserved_moov_size ? moov_size + 8 : moov_size) -
+                    mov->reserved_moov_size;
+        for (i = 0; i < mov->nb_streams; i++)
+            mov->tracks[i].data_offset += new_shift - shift;
+        shift = new_shift;
+    }
+    if (!shift)
+        return 0;
+
+    av_log(s, AV_LOG_WARNING, "The moov atom is %d bytes larger than estimated, "
+           "moving the data\n", shift);
+    avio_seek(s->pb, *end, SEEK_SET);
+    ret = move_data(s, mov->reserved_header_pos + mov->reserved_moov_size, shift);
+    if (ret < 0)
+        return ret;
+    mov->reserved_moov_size += shift;
+    *end += shift;
+    avio_seek(s->pb, mov->reserved_header_pos, SEEK_SET);
+    return 0;
+}
+
 static int mov_write_trailer(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -6674,7 +6833,7 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->reserved_moov_size < 0) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
@@ -6684,16 +6843,20 @@ static int mov_write_trailer(AVFormatContext *s)
                 return res;
         } else if (mov->reserved_moov_size > 0) {
             int64_t size;
+            if (mov->auto_moov_size && (res = fit_reserved_moov(s, &moov_pos)) < 0)
+                return res;
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
                 return res;
             size = mov->reserved_moov_size - (avio_tell(pb) - mov->reserved_header_pos);
-            if (size < 8){
+            if (size < 8 && !(mov->auto_moov_size && !size)) {
                 av_log(s, AV_LOG_ERROR, "reserved_moov_size is too small, needed %"PRId64" additional\n", 8-size);
                 return AVERROR(EINVAL);
             }
-            avio_wb32(pb, size);
-            ffio_wfourcc(pb, "free");
-            ffio_fill(pb, 0, size - 8);
+            if (size) {
+                avio_wb32(pb, size);
+                ffio_wfourcc(pb, "free");
+                ffio_fill(pb, 0, size - 8);
+            }
             avio_seek(pb, moov_pos, SEEK_SET);
         } else {
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
@@ -208,6 +208,7 @@ typedef struct MOVMuxContext {
 
     int reserved_moov_size; ///< 0 for disabled, -1 for automatic, size otherwise
     int64_t reserved_header_pos;
+    int auto_moov_size;     ///< reserved_moov_size was estimated, and is enlarged if needed
 
     char *major_brand;
 
@@ -25,6 +25,7 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/log.h"
 #include "libavutil/dict.h"
+#include "libavutil/fifo.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/avassert.h"
@@ -37,6 +38,9 @@
 #include "avio_internal.h"
 #include "mpeg.h"
 #include "isom.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 /* maximum size in which we look for synchronization if
  * synchronization is lost */
@@ -149,6 +153,7 @@ struct MpegTSContext {
 
     int resync_size;
     int merge_pmt_versions;
+    int program_threads;
 
     /******************************************/
     /* private mpegts data */
@@ -161,6 +166,35 @@ struct MpegTSContext {
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
     int current_pid;
+
+    /** pids only carried by programs with .discard=AVDISCARD_ALL,
+     *  recomputed by update_discard_pids() when discard_dirty is set */
+    uint8_t discard_pids[NB_PID_MAX];
+    int discard_dirty;
+    /** AVProgram.discard values discard_pids was computed from */
+    uint8_t *prg_discard;
+    unsigned int nb_prg_discard;
+
+    /** PES buffer pools, indexed by the log2 of the buffer size */
+    AVBufferPool *pools[32];
+
+    /** per program demuxing threads, see start_program_workers() */
+    struct ProgramWorker **workers;
+    int nb_workers;
+    int workers_started;
+    /** index + 1 of the worker demuxing each pid, negated until the pid
+     *  is handed over to it at the start of a PES packet */
+    int16_t worker_pids[NB_PID_MAX];
+    /** whether the current PES packet of each worker pid is discarded */
+    uint8_t skip_pids[NB_PID_MAX];
+#if HAVE_PTHREADS
+    int nb_worker_packets;
+    int workers_eof;
+    int workers_abort;
+    int workers_mutex_init;
+    pthread_mutex_t workers_mutex;
+    pthread_cond_t workers_cond;
+#endif
 };
 
 #define MPEGTS_OPTIONS \
@@ -182,6 +216,8 @@ static const AVOption options[] = {
      {.i64 = 0}, 0, 1, 0 },
     {"skip_clear", "skip clearing programs", offsetof(MpegTSContext, skip_clear), AV_OPT_TYPE_BOOL,
      {.i64 = 0}, 0, 1, 0 },
+    {"program_threads", "demux each program on its own thread", offsetof(MpegTSContext, program_threads), AV_OPT_TYPE_BOOL,
+     {.i64 = 0}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL },
 };
 
@@ -248,6 +284,7 @@ typedef struct PESContext {
     AVBufferRef *buffer;
     SLConfigDescr sl;
     int merged_st;
+    int size_hint; /**< expected payload size of unbounded PES packets */
 } PESContext;
 
 extern AVInputFormat ff_mpegts_demuxer;
@@ -288,12 +325,14 @@ static void clear_program(MpegTSContext *ts, unsigned int programid)
             ts->prg[i].nb_pids = 0;
             ts->prg[i].pmt_found = 0;
         }
+    ts->discard_dirty = 1;
 }
 
 static void clear_programs(MpegTSContext *ts)
 {
     av_freep(&ts->prg);
     ts->nb_prg = 0;
+    ts->discard_dirty = 1;
 }
 
 static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
@@ -308,6 +347,7 @@ static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
     p->nb_pids = 0;
     p->pmt_found = 0;
     ts->nb_prg++;
+    ts->discard_dirty = 1;
 }
 
 static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid,
@@ -326,6 +366,7 @@ static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid,
             return;
 
     p->pids[p->nb_pids++] = pid;
+    ts->discard_dirty = 1;
 }
 
 static void set_pmt_found(MpegTSContext *ts, unsigned int programid)
@@ -360,45 +401,86 @@ static void update_av_program_info(AVFormatContext *s, unsigned int programid,
 }
 
 /**
- * @brief discard_pid() decides if the pid is to be discarded according
- *                      to caller's programs selection
+ * Check whether the caller changed the discard flag of any program since
+ * discard_pids was last computed, and mark it for recomputation if so.
+ */
+static void check_discard_changes(MpegTSContext *ts)
+{
+    AVFormatContext *s = ts->stream;
+    int k;
+
+    if (ts->discard_dirty)
+        return;
+    if (ts->nb_prg_discard != s->nb_programs) {
+        ts->discard_dirty = 1;
+        return;
+    }
+    for (k = 0; k < s->nb_programs; k++) {
+        if (ts->prg_discard[k] != (s->programs[k]->discard == AVDISCARD_ALL)) {
+            ts->discard_dirty = 1;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief update_discard_pids() decides which pids are to be discarded
+ *                              according to caller's programs selection
  * @param ts    : - TS context
- * @param pid   : - pid
- * @return 1 if the pid is only comprised in programs that have .discard=AVDISCARD_ALL
- *         0 otherwise
+ *
+ * A pid is discarded if it is only comprised in programs that have
+ * .discard=AVDISCARD_ALL. The result is cached in ts->discard_pids so
+ * that handle_packet() does not need to walk the programs for every
+ * packet.
  */
-static int discard_pid(MpegTSContext *ts, unsigned int pid)
+static void update_discard_pids(MpegTSContext *ts)
 {
-    int i, j, k;
-    int used = 0, discarded = 0;
+    AVFormatContext *s = ts->stream;
+    int i, j, k, any_discarded = 0;
     struct Program *p;
 
+    ts->discard_dirty = 0;
+    memset(ts->discard_pids, 0, sizeof(ts->discard_pids));
+
+    if (av_reallocp_array(&ts->prg_discard, s->nb_programs,
+                          sizeof(*ts->prg_discard)) < 0) {
+        ts->nb_prg_discard = 0;
+        ts->discard_dirty  = 1;
+        return;
+    }
+    ts->nb_prg_discard = s->nb_programs;
+    for (k = 0; k < s->nb_programs; k++) {
+        ts->prg_discard[k] = s->programs[k]->discard == AVDISCARD_ALL;
+        any_discarded     |= ts->prg_discard[k];
+    }
+
     /* If none of the programs have .discard=AVDISCARD_ALL then there's
-     * no way we have to discard this packet */
-    for (k = 0; k < ts->stream->nb_programs; k++)
-        if (ts->stream->programs[k]->discard == AVDISCARD_ALL)
-            break;
-    if (k == ts->stream->nb_programs)
-        return 0;
+     * no way we have to discard any packet */
+    if (!any_discarded)
+        return;
 
+    /* first mark the pids of the discarded programs, then unmark those
+     * that are also part of a program in use */
     for (i = 0; i < ts->nb_prg; i++) {
         p = &ts->prg[i];
-        for (j = 0; j < p->nb_pids; j++) {
-            if (p->pids[j] != pid)
-                continue;
-            // is program with id p->id set to be discarded?
-            for (k = 0; k < ts->stream->nb_programs; k++) {
-                if (ts->stream->programs[k]->id == p->id) {
-                    if (ts->stream->programs[k]->discard == AVDISCARD_ALL)
-                        discarded++;
-                    else
-                        used++;
-                }
-            }
-        }
+        for (k = 0; k < s->nb_programs; k++)
+            if (s->programs[k]->id == p->id && ts->prg_discard[k])
+                break;
+        if (k == s->nb_programs)
+            continue;
+        for (j = 0; j < p->nb_pids; j++)
+            ts->discard_pids[p->pids[j]] = 1;
+    }
+    for (i = 0; i < ts->nb_prg; i++) {
+        p = &ts->prg[i];
+        for (k = 0; k < s->nb_programs; k++)
+            if (s->programs[k]->id == p->id && !ts->prg_discard[k])
+                break;
+        if (k == s->nb_programs)
+            continue;
+        for (j = 0; j < p->nb_pids; j++)
+            ts->discard_pids[p->pids[j]] = 0;
     }
-
-    return !used && discarded;
 }
 
 /**
@@ -560,6 +642,7 @@ static void mpegts_close_filter(MpegTSContext *ts, MpegTSFilter *filter)
 
     av_free(filter);
     ts->pids[pid] = NULL;
+    ts->worker_pids[pid] = 0;
 }
 
 static int analyze(const uint8_t *buf, int size, int packet_size,
@@ -916,6 +999,50 @@ static void new_data_packet(const uint8_t *buffer, int len, AVPacket *pkt)
     pkt->size = len;
 }
 
+static AVBufferRef *buffer_pool_get(MpegTSContext *ts, int size)
+{
+    int index = av_log2(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!ts->pools[index]) {
+        int pool_size = FFMIN(MAX_PES_PAYLOAD + AV_INPUT_BUFFER_PADDING_SIZE, 2 << index);
+        ts->pools[index] = av_buffer_pool_init(pool_size, NULL);
+        if (!ts->pools[index])
+            return NULL;
+    }
+    return av_buffer_pool_get(ts->pools[index]);
+}
+
+/**
+ * Allocate the payload buffer of a new PES packet. Unbounded packets,
+ * which are mostly video, start with the size seen for the previous
+ * packets of the stream rather than MAX_PES_PAYLOAD and get grown by
+ * grow_pes_buffer() if needed.
+ */
+static int alloc_pes_buffer(PESContext *pes)
+{
+    int size = pes->total_size;
+
+    if (size == MAX_PES_PAYLOAD && pes->size_hint)
+        size = FFMIN(pes->size_hint + (pes->size_hint >> 2), MAX_PES_PAYLOAD);
+    pes->buffer = buffer_pool_get(pes->ts, size);
+    if (!pes->buffer)
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+static int grow_pes_buffer(PESContext *pes, int size)
+{
+    AVBufferRef *buf;
+
+    size = FFMAX(size, 2 * (pes->buffer->size - AV_INPUT_BUFFER_PADDING_SIZE));
+    buf  = buffer_pool_get(pes->ts, FFMIN(size, pes->total_size));
+    if (!buf)
+        return AVERROR(ENOMEM);
+    memcpy(buf->data, pes->buffer->data, pes->data_index);
+    av_buffer_unref(&pes->buffer);
+    pes->buffer = buf;
+    return 0;
+}
+
 static int new_pes_packet(PESContext *pes, AVPacket *pkt)
 {
     char *sd;
@@ -945,6 +1072,10 @@ static int new_pes_packet(PESContext *pes, AVPacket *pkt)
     pkt->pos   = pes->ts_packet_pos;
     pkt->flags = pes->flags;
 
+    if (pes->total_size == MAX_PES_PAYLOAD)
+        pes->size_hint = FFMAX(pes->data_index,
+                               pes->size_hint - (pes->size_hint >> 4));
+
     pes->buffer = NULL;
     reset_pes_packet_state(pes);
 
@@ -1108,10 +1239,9 @@ static int mpegts_push_data(MpegTSFilter *filter,
                         pes->total_size = MAX_PES_PAYLOAD;
 
                     /* allocate pes buffer */
-                    pes->buffer = av_buffer_alloc(pes->total_size +
-                                                  AV_INPUT_BUFFER_PADDING_SIZE);
-                    if (!pes->buffer)
-                        return AVERROR(ENOMEM);
+                    ret = alloc_pes_buffer(pes);
+                    if (ret < 0)
+                        return ret;
 
                     if (code != 0x1bc && code != 0x1bf && /* program_stream_map, private_stream_2 */
                         code != 0x1f0 && code != 0x1f1 && /* ECM, EMM */
@@ -1269,10 +1399,9 @@ skip:
                     if (ret < 0)
                         return ret;
                     pes->total_size = MAX_PES_PAYLOAD;
-                    pes->buffer = av_buffer_alloc(pes->total_size +
-                                                  AV_INPUT_BUFFER_PADDING_SIZE);
-                    if (!pes->buffer)
-                        return AVERROR(ENOMEM);
+                    ret = alloc_pes_buffer(pes);
+                    if (ret < 0)
+                        return ret;
                     ts->stop_parse = 1;
                 } else if (pes->data_index == 0 &&
                            buf_size > pes->total_size) {
@@ -1280,6 +1409,12 @@ skip:
                     // not sure if this is legal in ts but see issue #2392
                     buf_size = pes->total_size;
                 }
+                if (pes->data_index + buf_size >
+                    pes->buffer->size - AV_INPUT_BUFFER_PADDING_SIZE) {
+                    ret = grow_pes_buffer(pes, pes->data_index + buf_size);
+                    if (ret < 0)
+                        return ret;
+                }
                 memcpy(pes->buffer->data + pes->data_index, p, buf_size);
                 pes->data_index += buf_size;
                 /* emit complete packets with known packet size
@@ -2453,17 +2588,19 @@ static void sdt_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
 static int parse_pcr(int64_t *ppcr_high, int *ppcr_low,
                      const uint8_t *packet);
 
-/* handle one TS packet */
-static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
+/* handle one TS packet, pos is the position following it as returned by
+ * avio_tell() */
+static int handle_packet(MpegTSContext *ts, const uint8_t *packet, int64_t pos)
 {
     MpegTSFilter *tss;
     int len, pid, cc, expected_cc, cc_ok, afc, is_start, is_discontinuity,
         has_adaptation, has_payload;
     const uint8_t *p, *p_end;
-    int64_t pos;
 
     pid = AV_RB16(packet + 1) & 0x1fff;
-    if (pid && discard_pid(ts, pid))
+    if (ts->discard_dirty)
+        update_discard_pids(ts);
+    if (pid && ts->discard_pids[pid])
         return 0;
     is_start = packet[1] & 0x40;
     tss = ts->pids[pid];
@@ -2480,6 +2617,24 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
         return 0;
     has_adaptation   = afc & 2;
     has_payload      = afc & 1;
+
+    /* The payload of a PES filter skipping until the next PES header is
+     * dropped, and so are the continuity and TEI flags, which get reset
+     * when that header arrives; only keep track of the PCR and position. */
+    if (tss->type == MPEGTS_PES && !is_start &&
+        ((PESContext *)tss->u.pes_filter.opaque)->state == MPEGTS_SKIP) {
+        tss->last_cc = -1;
+        if (has_adaptation) {
+            int64_t pcr_h;
+            int pcr_l;
+            if (parse_pcr(&pcr_h, &pcr_l, packet) == 0)
+                tss->last_pcr = pcr_h * 300 + pcr_l;
+        }
+        if (has_payload && pos >= 0)
+            ts->pos47_full = pos - TS_PACKET_SIZE;
+        return 0;
+    }
+
     is_discontinuity = has_adaptation &&
                        packet[4] != 0 && /* with length > 0 */
                        (packet[5] & 0x80); /* and discontinuity indicated */
@@ -2525,7 +2680,6 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     if (p >= p_end || !has_payload)
         return 0;
 
-    pos = avio_tell(ts->stream->pb);
     if (pos >= 0) {
         av_assert0(pos >= TS_PACKET_SIZE);
         ts->pos47_full = pos - TS_PACKET_SIZE;
@@ -2592,6 +2746,592 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     return 0;
 }
 
+static int handle_packets(MpegTSContext *ts, int64_t nb_packets);
+static void mpegts_free(MpegTSContext *ts);
+
+/* Whether the PMTs of all the programs of the PAT have been parsed. */
+static int all_pmts_found(MpegTSContext *ts)
+{
+    int i;
+
+    for (i = 0; i < ts->nb_prg; i++)
+        if (!ts->prg[i].pmt_found)
+            return 0;
+    return ts->nb_prg > 0;
+}
+
+#if HAVE_PTHREADS
+#define WORKER_CHUNK_PACKETS 128
+#define WORKER_MAX_CHUNKS    16
+
+/* TS packets queued for a program worker */
+typedef struct WorkerChunk {
+    int nb_packets;
+    int64_t pos[WORKER_CHUNK_PACKETS];
+    uint8_t discard[WORKER_CHUNK_PACKETS];
+    uint8_t data[WORKER_CHUNK_PACKETS * TS_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
+} WorkerChunk;
+
+/**
+ * Demuxer of the PES packets of one program. The reader thread parses the
+ * PAT and PMTs and queues the TS packets of the program pids, which the
+ * worker thread turns into AVPackets with its own MpegTSContext.
+ */
+typedef struct ProgramWorker {
+    MpegTSContext *parent;
+    MpegTSContext *ts;
+    AVFormatContext *fc;
+    /** index of the parent stream for each stream of fc */
+    int *stream_map;
+
+    WorkerChunk *staging; /**< chunk being filled by the reader */
+    AVFifoBuffer *in;     /**< queued WorkerChunk pointers */
+    AVFifoBuffer *out;    /**< demuxed AVPackets */
+    int done;
+    int ret;
+
+    pthread_cond_t cond;
+    pthread_t thread;
+    int thread_started;
+} ProgramWorker;
+
+static int worker_output(ProgramWorker *w, AVPacket *pkt)
+{
+    MpegTSContext *ts = w->parent;
+    int ret = 0;
+
+    pkt->stream_index = w->stream_map[pkt->stream_index];
+
+    pthread_mutex_lock(&ts->workers_mutex);
+    if (av_fifo_space(w->out) < sizeof(*pkt))
+        ret = av_fifo_grow(w->out, FFMAX(av_fifo_size(w->out), sizeof(*pkt)));
+    if (ret >= 0) {
+        av_fifo_generic_write(w->out, pkt, sizeof(*pkt), NULL);
+        ts->nb_worker_packets++;
+        pthread_cond_signal(&ts->workers_cond);
+    }
+    pthread_mutex_unlock(&ts->workers_mutex);
+
+    if (ret < 0)
+        av_packet_unref(pkt);
+    return ret;
+}
+
+static int worker_demux_chunk(ProgramWorker *w, WorkerChunk *c)
+{
+    MpegTSContext *ts = w->ts;
+    AVPacket pkt;
+    int i, ret;
+
+    for (i = 0; i < c->nb_packets; i++) {
+        const uint8_t *packet = c->data + i * TS_PACKET_SIZE;
+        MpegTSFilter *f = ts->pids[AV_RB16(packet + 1) & 0x1fff];
+
+        if (f && f->type == MPEGTS_PES) {
+            PESContext *pes = f->u.pes_filter.opaque;
+            pes->st->discard = c->discard[i] ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+            if (pes->sub_st)
+                pes->sub_st->discard = pes->st->discard;
+        }
+
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        ts->pkt        = &pkt;
+        ts->stop_parse = 0;
+        ret = handle_packet(ts, packet, c->pos[i]);
+        if (ret < 0) {
+            av_packet_unref(&pkt);
+            return ret;
+        }
+        if (ts->stop_parse && (ret = worker_output(w, &pkt)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static int worker_flush(ProgramWorker *w)
+{
+    MpegTSContext *ts = w->ts;
+    AVPacket pkt;
+    int i, ret;
+
+    for (i = 0; i < NB_PID_MAX; i++) {
+        if (ts->pids[i] && ts->pids[i]->type == MPEGTS_PES) {
+            PESContext *pes = ts->pids[i]->u.pes_filter.opaque;
+            if (pes->state == MPEGTS_PAYLOAD && pes->data_index > 0) {
+                ret = new_pes_packet(pes, &pkt);
+                pes->state = MPEGTS_SKIP;
+                if (ret < 0) {
+                    av_packet_unref(&pkt);
+                    return ret;
+                }
+                if ((ret = worker_output(w, &pkt)) < 0)
+                    return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+static void *program_worker_thread(void *arg)
+{
+    ProgramWorker *w  = arg;
+    MpegTSContext *ts = w->parent;
+    WorkerChunk *c;
+    int ret = 0;
+
+    pthread_mutex_lock(&ts->workers_mutex);
+    while (!ts->workers_abort) {
+        if (!av_fifo_size(w->in)) {
+            if (ts->workers_eof)
+                break;
+            pthread_cond_wait(&w->cond, &ts->workers_mutex);
+            continue;
+        }
+        av_fifo_generic_read(w->in, &c, sizeof(c), NULL);
+        pthread_cond_signal(&ts->workers_cond);
+        pthread_mutex_unlock(&ts->workers_mutex);
+
+        ret = worker_demux_chunk(w, c);
+        av_free(c);
+
+        pthread_mutex_lock(&ts->workers_mutex);
+        if (ret < 0)
+            break;
+    }
+    if (ret >= 0 && !ts->workers_abort) {
+        pthread_mutex_unlock(&ts->workers_mutex);
+        ret = worker_flush(w);
+        pthread_mutex_lock(&ts->workers_mutex);
+    }
+    w->ret  = ret;
+    w->done = 1;
+    pthread_cond_signal(&ts->workers_cond);
+    pthread_mutex_unlock(&ts->workers_mutex);
+
+    return NULL;
+}
+
+static void free_program_worker(ProgramWorker **pw)
+{
+    ProgramWorker *w = *pw;
+    WorkerChunk *c;
+    AVPacket pkt;
+
+    if (w->in) {
+        while (av_fifo_size(w->in) >= sizeof(c)) {
+            av_fifo_generic_read(w->in, &c, sizeof(c), NULL);
+            av_free(c);
+        }
+        av_fifo_freep(&w->in);
+    }
+    if (w->out) {
+        while (av_fifo_size(w->out) >= sizeof(pkt)) {
+            av_fifo_generic_read(w->out, &pkt, sizeof(pkt), NULL);
+            av_packet_unref(&pkt);
+        }
+        av_fifo_freep(&w->out);
+    }
+    av_freep(&w->staging);
+    if (w->ts) {
+        mpegts_free(w->ts);
+        av_freep(&w->ts);
+    }
+    /* frees the PESContexts, referenced as the stream private data */
+    avformat_free_context(w->fc);
+    av_freep(&w->stream_map);
+    pthread_cond_destroy(&w->cond);
+    av_freep(pw);
+}
+
+static ProgramWorker *alloc_program_worker(MpegTSContext *ts)
+{
+    ProgramWorker **workers, *w;
+
+    workers = av_realloc_array(ts->workers, ts->nb_workers + 1, sizeof(*ts->workers));
+    if (!workers)
+        return NULL;
+    ts->workers = workers;
+    w = av_mallocz(sizeof(*w));
+    if (!w)
+        return NULL;
+    if (pthread_cond_init(&w->cond, NULL)) {
+        av_free(w);
+        return NULL;
+    }
+    ts->workers[ts->nb_workers++] = w;
+
+    w->parent = ts;
+    w->fc     = avformat_alloc_context();
+    w->ts     = av_mallocz(sizeof(*w->ts));
+    w->in     = av_fifo_alloc_array(WORKER_MAX_CHUNKS, sizeof(WorkerChunk *));
+    w->out    = av_fifo_alloc(16 * sizeof(AVPacket));
+    if (!w->fc || !w->ts || !w->in || !w->out)
+        return NULL;
+
+    w->fc->iformat         = ts->stream->iformat;
+    w->ts->class           = ts->class;
+    w->ts->stream          = w->fc;
+    w->ts->raw_packet_size = ts->raw_packet_size;
+    return w;
+}
+
+static int worker_add_stream(ProgramWorker *w, AVStream *st, AVStream **pwst)
+{
+    AVStream *wst = avformat_new_stream(w->fc, NULL);
+    int ret;
+
+    if (!wst)
+        return AVERROR(ENOMEM);
+    if ((ret = av_reallocp_array(&w->stream_map, w->fc->nb_streams,
+                                 sizeof(*w->stream_map))) < 0)
+        return ret;
+    w->stream_map[wst->index] = st->index;
+    wst->id = st->id;
+    *pwst   = wst;
+    return avcodec_parameters_copy(wst->codecpar, st->codecpar);
+}
+
+static int worker_add_pid(ProgramWorker *w, PESContext *pes)
+{
+    PESContext *wpes = add_pes_stream(w->ts, pes->pid, pes->pcr_pid);
+    int ret;
+
+    if (!wpes)
+        return AVERROR(ENOMEM);
+    wpes->stream_type = pes->stream_type;
+    wpes->sl          = pes->sl;
+    wpes->size_hint   = pes->size_hint;
+    if ((ret = worker_add_stream(w, pes->st, &wpes->st)) < 0)
+        return ret;
+    wpes->st->priv_data = wpes;
+    if (pes->sub_st)
+        return worker_add_stream(w, pes->sub_st, &wpes->sub_st);
+    return 0;
+}
+
+/* Update the worker copy of the streams of a pid from the reader ones,
+ * which were probed before the pid is handed over. */
+static int worker_update_pid(ProgramWorker *w, PESContext *pes)
+{
+    PESContext *wpes = w->ts->pids[pes->pid]->u.pes_filter.opaque;
+    int ret;
+
+    wpes->stream_type       = pes->stream_type;
+    wpes->st->request_probe = pes->st->request_probe;
+    if ((ret = avcodec_parameters_copy(wpes->st->codecpar, pes->st->codecpar)) < 0)
+        return ret;
+    if (pes->sub_st && wpes->sub_st)
+        return avcodec_parameters_copy(wpes->sub_st->codecpar, pes->sub_st->codecpar);
+    return 0;
+}
+
+/* Whether the codec of a pid is still probed from the packets of the reader. */
+static int pes_probing(PESContext *pes)
+{
+    return pes->st->request_probe > 0 ||
+           (!pes->st->request_probe && pes->st->codecpar->codec_id == AV_CODEC_ID_NONE);
+}
+
+static void stop_program_workers(MpegTSContext *ts)
+{
+    int i;
+
+    if (ts->nb_workers) {
+        if (ts->workers_mutex_init) {
+            pthread_mutex_lock(&ts->workers_mutex);
+            ts->workers_abort = 1;
+            for (i = 0; i < ts->nb_workers; i++)
+                pthread_cond_signal(&ts->workers[i]->cond);
+            pthread_mutex_unlock(&ts->workers_mutex);
+        }
+        for (i = 0; i < ts->nb_workers; i++) {
+            if (ts->workers[i]->thread_started)
+                pthread_join(ts->workers[i]->thread, NULL);
+            free_program_worker(&ts->workers[i]);
+        }
+        av_freep(&ts->workers);
+        ts->nb_workers = 0;
+        memset(ts->worker_pids, 0, sizeof(ts->worker_pids));
+    }
+    ts->nb_worker_packets = 0;
+    ts->workers_eof       = 0;
+    ts->workers_abort     = 0;
+    ts->workers_started   = 0;
+    if (ts->workers_mutex_init) {
+        pthread_cond_destroy(&ts->workers_cond);
+        pthread_mutex_destroy(&ts->workers_mutex);
+        ts->workers_mutex_init = 0;
+    }
+}
+
+/**
+ * Move the PES pids of each program to a worker thread. The pids are
+ * handed over at the start of their next PES packet once their codec is
+ * probed, and those added by later PMT updates stay demuxed by the reader.
+ */
+static int start_program_workers(MpegTSContext *ts)
+{
+    int i, j, ret;
+
+    ts->workers_started = 1;
+    if (ts->discard_dirty)
+        update_discard_pids(ts);
+
+    for (i = 0; i < ts->nb_prg; i++) {
+        struct Program *p = &ts->prg[i];
+        ProgramWorker *w  = NULL;
+
+        for (j = 0; j < p->nb_pids; j++) {
+            int pid = p->pids[j];
+            MpegTSFilter *f = ts->pids[pid];
+            PESContext *pes;
+
+            if (!f || f->type != MPEGTS_PES ||
+                ts->worker_pids[pid] || ts->discard_pids[pid])
+                continue;
+            pes = f->u.pes_filter.opaque;
+            /* the teletext timestamps are fixed up from the PCR of the
+             * program, which is parsed by the reader */
+            if (!pes->st || (ts->fix_teletext_pts &&
+                (pes->st->codecpar->codec_id == AV_CODEC_ID_DVB_TELETEXT ||
+                 pes->st->codecpar->codec_id == AV_CODEC_ID_DVB_SUBTITLE)))
+                continue;
+            if (!w && !(w = alloc_program_worker(ts))) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            if ((ret = worker_add_pid(w, pes)) < 0)
+                goto fail;
+            ts->worker_pids[pid] = -ts->nb_workers;
+        }
+    }
+    if (!ts->nb_workers)
+        return 0;
+
+    if ((ret = pthread_mutex_init(&ts->workers_mutex, NULL))) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = pthread_cond_init(&ts->workers_cond, NULL))) {
+        pthread_mutex_destroy(&ts->workers_mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    ts->workers_mutex_init = 1;
+
+    for (i = 0; i < ts->nb_workers; i++) {
+        ProgramWorker *w = ts->workers[i];
+        if ((ret = pthread_create(&w->thread, NULL, program_worker_thread, w))) {
+            av_log(ts->stream, AV_LOG_ERROR, "pthread_create failed : %s\n",
+                   av_err2str(AVERROR(ret)));
+            ret = AVERROR(ret);
+            goto fail;
+        }
+        w->thread_started = 1;
+    }
+    av_log(ts->stream, AV_LOG_VERBOSE, "Demuxing %d programs on worker threads\n",
+           ts->nb_workers);
+    return 0;
+fail:
+    stop_program_workers(ts);
+    return ret;
+}
+
+static int send_chunk(MpegTSContext *ts, ProgramWorker *w)
+{
+    WorkerChunk *c = w->staging;
+    int ret = 0;
+
+    if (!c)
+        return 0;
+    w->staging = NULL;
+    memset(c->data + c->nb_packets * TS_PACKET_SIZE, 0,
+           AV_INPUT_BUFFER_PADDING_SIZE);
+
+    pthread_mutex_lock(&ts->workers_mutex);
+    while (!w->done && av_fifo_space(w->in) < sizeof(c))
+        pthread_cond_wait(&ts->workers_cond, &ts->workers_mutex);
+    if (w->done) {
+        ret = w->ret;
+        av_free(c);
+    } else {
+        av_fifo_generic_write(w->in, &c, sizeof(c), NULL);
+        pthread_cond_signal(&w->cond);
+    }
+    /* let the caller return the packets demuxed so far */
+    if (ts->nb_worker_packets)
+        ts->stop_parse = 1;
+    pthread_mutex_unlock(&ts->workers_mutex);
+
+    return ret;
+}
+
+static int dispatch_packet(MpegTSContext *ts, const uint8_t *packet, int64_t pos)
+{
+    int pid      = AV_RB16(packet + 1) & 0x1fff;
+    int is_start = packet[1] & 0x40;
+    int index    = ts->worker_pids[pid];
+    PESContext *pes;
+    WorkerChunk *c;
+    ProgramWorker *w;
+    int ret;
+
+    if (!index)
+        return handle_packet(ts, packet, pos);
+    if (ts->discard_dirty)
+        update_discard_pids(ts);
+    if (ts->discard_pids[pid])
+        return 0;
+
+    pes = ts->pids[pid]->u.pes_filter.opaque;
+    if (index < 0) {
+        /* the probing happens on the streams of the reader, keep the pid
+         * until it is done */
+        if (!is_start || pes_probing(pes))
+            return handle_packet(ts, packet, pos);
+        /* return what the reader assembled so far and hand the pid over */
+        if (pes->state == MPEGTS_PAYLOAD && pes->data_index > 0) {
+            if ((ret = new_pes_packet(pes, ts->pkt)) < 0)
+                return ret;
+            ts->stop_parse = 1;
+        } else {
+            reset_pes_packet_state(pes);
+        }
+        pes->state = MPEGTS_SKIP;
+        if ((ret = worker_update_pid(ts->workers[-index - 1], pes)) < 0)
+            return ret;
+        ts->worker_pids[pid] = index = -index;
+    }
+
+    if (is_start)
+        ts->skip_pids[pid] = pes->st->discard == AVDISCARD_ALL &&
+                             (!pes->sub_st || pes->sub_st->discard == AVDISCARD_ALL);
+    else if (ts->skip_pids[pid])
+        return 0;
+
+    w = ts->workers[index - 1];
+    if (!w->staging) {
+        w->staging = av_malloc(sizeof(*w->staging));
+        if (!w->staging)
+            return AVERROR(ENOMEM);
+        w->staging->nb_packets = 0;
+    }
+    c = w->staging;
+    memcpy(c->data + c->nb_packets * TS_PACKET_SIZE, packet, TS_PACKET_SIZE);
+    c->pos[c->nb_packets]     = pos;
+    c->discard[c->nb_packets] = ts->skip_pids[pid];
+    if (++c->nb_packets == WORKER_CHUNK_PACKETS)
+        return send_chunk(ts, w);
+    return 0;
+}
+
+/* Return the demuxed packet with the lowest position, if any. */
+static int receive_worker_packet(MpegTSContext *ts, AVPacket *pkt)
+{
+    ProgramWorker *best;
+    AVPacket head;
+    int64_t best_pos = 0;
+    int i, ret, done;
+
+    pthread_mutex_lock(&ts->workers_mutex);
+    for (;;) {
+        best = NULL;
+        done = 1;
+        ret  = 0;
+        for (i = 0; i < ts->nb_workers; i++) {
+            ProgramWorker *w = ts->workers[i];
+            if (av_fifo_size(w->out)) {
+                av_fifo_generic_peek(w->out, &head, sizeof(head), NULL);
+                if (!best || head.pos < best_pos) {
+                    best     = w;
+                    best_pos = head.pos;
+                }
+            }
+            if (w->ret < 0)
+                ret = w->ret;
+            done &= w->done;
+        }
+        if (best) {
+            av_fifo_generic_read(best->out, pkt, sizeof(*pkt), NULL);
+            ts->nb_worker_packets--;
+            ret = 0;
+            break;
+        }
+        if (ret < 0)
+            break;
+        if (!ts->workers_eof) {
+            ret = AVERROR(EAGAIN);
+            break;
+        }
+        if (done) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        pthread_cond_wait(&ts->workers_cond, &ts->workers_mutex);
+    }
+    pthread_mutex_unlock(&ts->workers_mutex);
+
+    return ret;
+}
+
+static int read_worker_packet(MpegTSContext *ts, AVPacket *pkt)
+{
+    int i, ret;
+
+    for (;;) {
+        ret = receive_worker_packet(ts, pkt);
+        if (ret != AVERROR(EAGAIN))
+            return ret;
+
+        pkt->size = -1;
+        ts->pkt   = pkt;
+        ret = handle_packets(ts, 0);
+        if (ret < 0)
+            av_packet_unref(pkt);
+        else if (pkt->size >= 0)
+            return 0;
+        if (ret == AVERROR(EAGAIN))
+            return ret;
+        if (ret < 0) {
+            /* end of the input, let the workers demux what is left */
+            for (i = 0; i < ts->nb_workers; i++)
+                if ((ret = send_chunk(ts, ts->workers[i])) < 0)
+                    return ret;
+            pthread_mutex_lock(&ts->workers_mutex);
+            ts->workers_eof = 1;
+            for (i = 0; i < ts->nb_workers; i++)
+                pthread_cond_signal(&ts->workers[i]->cond);
+            pthread_mutex_unlock(&ts->workers_mutex);
+        }
+    }
+}
+#else
+static void stop_program_workers(MpegTSContext *ts)
+{
+    ts->workers_started = 0;
+}
+
+static int start_program_workers(MpegTSContext *ts)
+{
+    av_log(ts->stream, AV_LOG_WARNING,
+           "program_threads requires pthreads, demuxing on a single thread\n");
+    ts->workers_started = 1;
+    return 0;
+}
+
+static int dispatch_packet(MpegTSContext *ts, const uint8_t *packet, int64_t pos)
+{
+    return handle_packet(ts, packet, pos);
+}
+
+static int read_worker_packet(MpegTSContext *ts, AVPacket *pkt)
+{
+    return AVERROR_EOF;
+}
+#endif /* HAVE_PTHREADS */
+
 static void reanalyze(MpegTSContext *ts) {
     AVIOContext *pb = ts->stream->pb;
     int64_t pos = avio_tell(pb);
@@ -2700,6 +3440,8 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
     int64_t packet_num;
     int ret = 0;
 
+    check_discard_changes(ts);
+
     if (avio_tell(s->pb) != ts->last_pos) {
         int i;
         av_log(ts->stream, AV_LOG_TRACE, "Skipping after seek\n");
@@ -2736,7 +3478,10 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
-        ret = handle_packet(ts, data);
+        if (ts->nb_workers)
+            ret = dispatch_packet(ts, data, avio_tell(s->pb));
+        else
+            ret = handle_packet(ts, data, avio_tell(s->pb));
         finished_reading_packet(s, ts->raw_packet_size);
         if (ret != 0)
             break;
@@ -2939,18 +3684,22 @@ static int mpegts_raw_read_packet(AVFormatContext *s, AVPacket *pkt)
     int64_t pcr_h, next_pcr_h, pos;
     int pcr_l, next_pcr_l;
     uint8_t pcr_buf[12];
+    uint8_t packet[TS_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
     const uint8_t *data;
 
-    if (av_new_packet(pkt, TS_PACKET_SIZE) < 0)
-        return AVERROR(ENOMEM);
-    ret = read_packet(s, pkt->data, ts->raw_packet_size, &data);
-    pkt->pos = avio_tell(s->pb);
-    if (ret < 0) {
-        av_packet_unref(pkt);
+    ret = read_packet(s, packet, ts->raw_packet_size, &data);
+    if (ret < 0)
         return ret;
+    /* reference the packet in the I/O buffer if zero-copy is enabled */
+    ret = data != packet ? ffio_ref_indirect(s->pb, pkt, data, TS_PACKET_SIZE)
+                         : AVERROR(EAGAIN);
+    if (ret == AVERROR(EAGAIN)) {
+        if ((ret = av_new_packet(pkt, TS_PACKET_SIZE)) >= 0)
+            memcpy(pkt->data, data, TS_PACKET_SIZE);
     }
-    if (data != pkt->data)
-        memcpy(pkt->data, data, ts->raw_packet_size);
+    if (ret < 0)
+        return ret;
+    pkt->pos = avio_tell(s->pb);
     finished_reading_packet(s, ts->raw_packet_size);
     if (ts->mpeg2ts_compute_pcr) {
         /* compute exact PCR for each packet */
@@ -2985,6 +3734,18 @@ static int mpegts_read_packet(AVFormatContext *s, AVPacket *pkt)
     MpegTSContext *ts = s->priv_data;
     int ret, i;
 
+    if (ts->workers_started && avio_tell(s->pb) != ts->last_pos)
+        stop_program_workers(ts);
+    if (ts->program_threads && !ts->workers_started && all_pmts_found(ts) &&
+        (ret = start_program_workers(ts)) < 0)
+        return ret;
+    if (ts->nb_workers) {
+        ret = read_worker_packet(ts, pkt);
+        if (ret != AVERROR_EOF)
+            return ret;
+        /* flush the PES packets the reader did not hand over yet */
+    }
+
     pkt->size = -1;
     ts->pkt = pkt;
     ret = handle_packets(ts, 0);
@@ -3014,7 +3775,12 @@ static void mpegts_free(MpegTSContext *ts)
 {
     int i;
 
+    stop_program_workers(ts);
     clear_programs(ts);
+    av_freep(&ts->prg_discard);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(ts->pools); i++)
+        av_buffer_pool_uninit(&ts->pools[i]);
 
     for (i = 0; i < NB_PID_MAX; i++)
         if (ts->pids[i])
@@ -3125,6 +3891,7 @@ int avpriv_mpegts_parse_packet(MpegTSContext *ts, AVPacket *pkt,
 
     len1 = len;
     ts->pkt = pkt;
+    check_discard_changes(ts);
     for (;;) {
         ts->stop_parse = 0;
         if (len < TS_PACKET_SIZE)
@@ -3133,7 +3900,7 @@ int avpriv_mpegts_parse_packet(MpegTSContext *ts, AVPacket *pkt,
             buf++;
             len--;
         } else {
-            handle_packet(ts, buf);
+            handle_packet(ts, buf, avio_tell(ts->stream->pb));
             buf += TS_PACKET_SIZE;
             len -= TS_PACKET_SIZE;
             if (ts->stop_parse == 1)
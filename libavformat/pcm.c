@@ -21,6 +21,7 @@
 
 #include "libavutil/mathematics.h"
 #include "avformat.h"
+#include "avio_internal.h"
 #include "internal.h"
 #include "pcm.h"
 
@@ -41,7 +42,10 @@ int ff_pcm_read_packet(AVFormatContext *s, AVPacket *pkt)
     size = FFMAX(par->sample_rate/25, 1);
     size = FFMIN(size, RAW_SAMPLES) * par->block_align;
 
-    ret = av_get_packet(s->pb, pkt, size);
+    pkt->pos = avio_tell(s->pb);
+    ret = ffio_read_ref(s->pb, pkt, size);
+    if (ret == AVERROR(EAGAIN))
+        ret = av_get_packet(s->pb, pkt, size);
 
     pkt->flags &= ~AV_PKT_FLAG_CORRUPT;
     pkt->stream_index = 0;
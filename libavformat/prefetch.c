@@ -0,0 +1,594 @@
+/*
+ * Background segment prefetching for segmented streaming demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+#include "internal.h"
+#include "prefetch.h"
+#include "url.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+
+#define PREFETCH_CHUNK_SIZE (64 * 1024)
+#define MAX_MANIFEST_SIZE   (16 * 1024 * 1024)
+
+typedef struct PrefetchEntry {
+    int64_t seq_no;
+    char *url;
+    int64_t offset;
+    int64_t size;
+
+    uint8_t *data;
+    int64_t alloc;
+    int64_t len;
+    int64_t read_pos;
+    int started;
+    int done;
+    int ret;
+} PrefetchEntry;
+
+struct FFPrefetch {
+    AVFormatContext *s;
+    ff_prefetch_open_fn open;
+    void *opaque;
+    int64_t max_size;
+
+    /* queue of segments, entries[first] being the one read by the demuxer */
+    PrefetchEntry *entries;
+    int max_entries;
+    int first;
+    int nb_entries;
+    int64_t buffered;
+    /* incremented whenever a segment being downloaded is dropped */
+    unsigned generation;
+
+    char *refresh_url;
+    int64_t refresh_time;
+    unsigned refresh_generation;
+    int refresh_done;
+    int refresh_ret;
+    int64_t refresh_start;
+    uint8_t *refresh_buf;
+    int refresh_size;
+    char *refresh_final_url;
+
+    /* persistent connections, only used by the worker thread */
+    AVIOContext *seg_pb;
+    AVIOContext *manifest_pb;
+
+    int abort;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_worker;
+    pthread_cond_t cond_reader;
+    pthread_t thread;
+};
+
+static void cond_wait_for(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t delay)
+{
+    int64_t t = av_gettime() + delay;
+    struct timespec tv = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+    pthread_cond_timedwait(cond, mutex, &tv);
+}
+
+static void free_entry(FFPrefetch *pf, PrefetchEntry *e)
+{
+    pf->buffered -= e->len;
+    av_freep(&e->url);
+    av_freep(&e->data);
+    memset(e, 0, sizeof(*e));
+}
+
+static PrefetchEntry *get_entry(FFPrefetch *pf, int i)
+{
+    return &pf->entries[(pf->first + i) % pf->max_entries];
+}
+
+/* Number of buffered bytes besides the segment being read. */
+static int64_t buffered_ahead(FFPrefetch *pf)
+{
+    return pf->buffered - (pf->nb_entries ? get_entry(pf, 0)->len : 0);
+}
+
+static void drop_head(FFPrefetch *pf)
+{
+    PrefetchEntry *e = get_entry(pf, 0);
+
+    if (e->started && !e->done)
+        pf->generation++;
+    free_entry(pf, e);
+    pf->first = (pf->first + 1) % pf->max_entries;
+    pf->nb_entries--;
+    pthread_cond_signal(&pf->cond_worker);
+}
+
+static int append_data(PrefetchEntry *e, const uint8_t *buf, int size)
+{
+    if (e->len + size > e->alloc) {
+        int64_t alloc = FFMAX(e->len + size, 2 * e->alloc);
+        int ret;
+
+        if (alloc > INT_MAX)
+            return AVERROR(ENOMEM);
+        if ((ret = av_reallocp(&e->data, alloc)) < 0) {
+            e->alloc = 0;
+            return ret;
+        }
+        e->alloc = alloc;
+    }
+    memcpy(e->data + e->len, buf, size);
+    e->len += size;
+    return 0;
+}
+
+/* Called with the mutex locked, download the first segment not started. */
+static void download_segment(FFPrefetch *pf, int index)
+{
+    PrefetchEntry *e = get_entry(pf, index);
+    unsigned generation = pf->generation;
+    char *url = av_strdup(e->url);
+    int64_t offset = e->offset, remaining = e->size;
+    uint8_t *buf = av_malloc(PREFETCH_CHUNK_SIZE);
+    int ret;
+
+    e->started = 1;
+    pthread_mutex_unlock(&pf->mutex);
+
+    ret = url && buf ? pf->open(pf->opaque, &pf->seg_pb, url, offset, remaining)
+                     : AVERROR(ENOMEM);
+    while (1) {
+        int size = PREFETCH_CHUNK_SIZE;
+
+        if (ret >= 0) {
+            if (remaining >= 0)
+                size = FFMIN(size, remaining);
+            ret = size ? avio_read_partial(pf->seg_pb, buf, size) : AVERROR_EOF;
+            if (!ret)
+                ret = AVERROR_EOF;
+        }
+
+        pthread_mutex_lock(&pf->mutex);
+        if (generation != pf->generation || pf->abort) {
+            /* the segment was dropped, the connection is in an unknown state */
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (ret > 0) {
+            int n = ret;
+
+            if (remaining >= 0)
+                remaining -= n;
+            if ((ret = append_data(e, buf, n)) >= 0)
+                pf->buffered += n;
+        }
+        if (ret < 0) {
+            e->ret  = ret == AVERROR_EOF ? 0 : ret;
+            e->done = 1;
+            pthread_cond_signal(&pf->cond_reader);
+            break;
+        }
+        pthread_cond_signal(&pf->cond_reader);
+
+        /* only the segment being read may exceed the buffering limit */
+        while (!pf->abort && generation == pf->generation &&
+               e != get_entry(pf, 0) && buffered_ahead(pf) >= pf->max_size)
+            pthread_cond_wait(&pf->cond_worker, &pf->mutex);
+        pthread_mutex_unlock(&pf->mutex);
+    }
+
+    /* keep the connection only after a complete download */
+    if (ret != AVERROR_EOF) {
+        pthread_mutex_unlock(&pf->mutex);
+        ff_format_io_close(pf->s, &pf->seg_pb);
+        pthread_mutex_lock(&pf->mutex);
+    }
+    av_free(url);
+    av_free(buf);
+}
+
+static int download_manifest(FFPrefetch *pf, const char *url,
+                             uint8_t **out, int *out_size, char **final_url)
+{
+    uint8_t *buf = NULL;
+    char *new_url = NULL;
+    int size = 0, ret;
+
+    ret = pf->open(pf->opaque, &pf->manifest_pb, url, 0, -1);
+    if (ret < 0)
+        return ret;
+
+    if (av_opt_get(pf->manifest_pb, "location", AV_OPT_SEARCH_CHILDREN,
+                   (uint8_t **)&new_url) < 0 || !new_url)
+        new_url = av_strdup(url);
+    if (!new_url) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    while (1) {
+        if ((ret = av_reallocp(&buf, size + PREFETCH_CHUNK_SIZE + 1)) < 0)
+            goto fail;
+        ret = avio_read(pf->manifest_pb, buf + size, PREFETCH_CHUNK_SIZE);
+        if (ret == AVERROR_EOF || !ret)
+            break;
+        if (ret < 0)
+            goto fail;
+        size += ret;
+        if (size > MAX_MANIFEST_SIZE) {
+            ret = AVERROR_INVALIDDATA;
+            goto fail;
+        }
+    }
+    buf[size] = 0;
+
+    *out       = buf;
+    *out_size  = size;
+    *final_url = new_url;
+    return 0;
+fail:
+    ff_format_io_close(pf->s, &pf->manifest_pb);
+    av_free(buf);
+    av_free(new_url);
+    return ret;
+}
+
+/* Called with the mutex locked. */
+static void refresh_manifest(FFPrefetch *pf)
+{
+    unsigned generation = pf->refresh_generation;
+    char *url = av_strdup(pf->refresh_url);
+    int64_t start = av_gettime_relative();
+    uint8_t *buf = NULL;
+    char *final_url = NULL;
+    int size = 0, ret;
+
+    pf->refresh_time = INT64_MAX;
+    pthread_mutex_unlock(&pf->mutex);
+
+    ret = url ? download_manifest(pf, url, &buf, &size, &final_url) : AVERROR(ENOMEM);
+    av_free(url);
+
+    pthread_mutex_lock(&pf->mutex);
+    if (generation != pf->refresh_generation) {
+        av_free(buf);
+        av_free(final_url);
+        return;
+    }
+    pf->refresh_done      = 1;
+    pf->refresh_ret       = ret;
+    pf->refresh_start     = start;
+    pf->refresh_buf       = buf;
+    pf->refresh_size      = size;
+    pf->refresh_final_url = final_url;
+    pthread_cond_signal(&pf->cond_reader);
+}
+
+static void *prefetch_thread(void *arg)
+{
+    FFPrefetch *pf = arg;
+
+    pthread_mutex_lock(&pf->mutex);
+    while (!pf->abort) {
+        int64_t now = av_gettime_relative();
+        int i;
+
+        if (pf->refresh_url && !pf->refresh_done && now >= pf->refresh_time) {
+            refresh_manifest(pf);
+            continue;
+        }
+
+        for (i = 0; i < pf->nb_entries; i++)
+            if (!get_entry(pf, i)->started)
+                break;
+        if (i < pf->nb_entries && (!i || buffered_ahead(pf) < pf->max_size)) {
+            download_segment(pf, i);
+            continue;
+        }
+
+        if (pf->refresh_url && !pf->refresh_done && pf->refresh_time != INT64_MAX)
+            cond_wait_for(&pf->cond_worker, &pf->mutex, pf->refresh_time - now);
+        else
+            pthread_cond_wait(&pf->cond_worker, &pf->mutex);
+    }
+    pthread_mutex_unlock(&pf->mutex);
+
+    ff_format_io_close(pf->s, &pf->seg_pb);
+    ff_format_io_close(pf->s, &pf->manifest_pb);
+    return NULL;
+}
+
+int ff_prefetch_alloc(FFPrefetch **ppf, AVFormatContext *s,
+                      ff_prefetch_open_fn open, void *opaque,
+                      int max_segments, int64_t max_size)
+{
+    FFPrefetch *pf;
+    int ret;
+
+    *ppf = NULL;
+    pf = av_mallocz(sizeof(*pf));
+    if (!pf)
+        return AVERROR(ENOMEM);
+    pf->entries = av_mallocz_array(max_segments, sizeof(*pf->entries));
+    if (!pf->entries) {
+        av_free(pf);
+        return AVERROR(ENOMEM);
+    }
+    pf->s            = s;
+    pf->open         = open;
+    pf->opaque       = opaque;
+    pf->max_entries  = max_segments;
+    pf->max_size     = max_size;
+    pf->refresh_time = INT64_MAX;
+
+    if ((ret = pthread_mutex_init(&pf->mutex, NULL))) {
+        ret = AVERROR(ret);
+        goto mutex_fail;
+    }
+    if ((ret = pthread_cond_init(&pf->cond_worker, NULL))) {
+        ret = AVERROR(ret);
+        goto cond_worker_fail;
+    }
+    if ((ret = pthread_cond_init(&pf->cond_reader, NULL))) {
+        ret = AVERROR(ret);
+        goto cond_reader_fail;
+    }
+    if ((ret = pthread_create(&pf->thread, NULL, prefetch_thread, pf))) {
+        av_log(s, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(AVERROR(ret)));
+        ret = AVERROR(ret);
+        goto thread_fail;
+    }
+
+    *ppf = pf;
+    return 0;
+thread_fail:
+    pthread_cond_destroy(&pf->cond_reader);
+cond_reader_fail:
+    pthread_cond_destroy(&pf->cond_worker);
+cond_worker_fail:
+    pthread_mutex_destroy(&pf->mutex);
+mutex_fail:
+    av_free(pf->entries);
+    av_free(pf);
+    return ret;
+}
+
+void ff_prefetch_free(FFPrefetch **ppf)
+{
+    FFPrefetch *pf = *ppf;
+    int i;
+
+    if (!pf)
+        return;
+
+    pthread_mutex_lock(&pf->mutex);
+    pf->abort = 1;
+    pthread_cond_signal(&pf->cond_worker);
+    pthread_mutex_unlock(&pf->mutex);
+    pthread_join(pf->thread, NULL);
+
+    for (i = 0; i < pf->max_entries; i++)
+        free_entry(pf, &pf->entries[i]);
+    av_freep(&pf->entries);
+    av_freep(&pf->refresh_url);
+    av_freep(&pf->refresh_buf);
+    av_freep(&pf->refresh_final_url);
+    pthread_cond_destroy(&pf->cond_reader);
+    pthread_cond_destroy(&pf->cond_worker);
+    pthread_mutex_destroy(&pf->mutex);
+    av_freep(ppf);
+}
+
+int ff_prefetch_add(FFPrefetch *pf, int64_t seq_no, const char *url,
+                    int64_t offset, int64_t size)
+{
+    PrefetchEntry *e;
+    int ret = 0;
+
+    pthread_mutex_lock(&pf->mutex);
+    if (pf->nb_entries == pf->max_entries) {
+        ret = AVERROR(EAGAIN);
+        goto end;
+    }
+    e = get_entry(pf, pf->nb_entries);
+    e->url = av_strdup(url);
+    if (!e->url) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    e->seq_no = seq_no;
+    e->offset = offset;
+    e->size   = size;
+    pf->nb_entries++;
+    pthread_cond_signal(&pf->cond_worker);
+end:
+    pthread_mutex_unlock(&pf->mutex);
+    return ret;
+}
+
+int ff_prefetch_sync(FFPrefetch *pf, int64_t seq_no, int64_t *last_seq_no)
+{
+    int ret;
+
+    pthread_mutex_lock(&pf->mutex);
+    while (pf->nb_entries && get_entry(pf, 0)->seq_no < seq_no)
+        drop_head(pf);
+    *last_seq_no = pf->nb_entries ? get_entry(pf, pf->nb_entries - 1)->seq_no
+                                  : seq_no - 1;
+    ret = pf->nb_entries && get_entry(pf, 0)->seq_no == seq_no;
+    pthread_mutex_unlock(&pf->mutex);
+    return ret;
+}
+
+int ff_prefetch_read(FFPrefetch *pf, uint8_t *buf, int buf_size)
+{
+    PrefetchEntry *e;
+    int ret;
+
+    pthread_mutex_lock(&pf->mutex);
+    if (!pf->nb_entries) {
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    e = get_entry(pf, 0);
+    while (e->read_pos == e->len && !e->done) {
+        if (ff_check_interrupt(&pf->s->interrupt_callback)) {
+            ret = AVERROR_EXIT;
+            goto end;
+        }
+        cond_wait_for(&pf->cond_reader, &pf->mutex, 100000);
+    }
+    if (e->read_pos < e->len) {
+        ret = FFMIN(buf_size, e->len - e->read_pos);
+        memcpy(buf, e->data + e->read_pos, ret);
+        e->read_pos += ret;
+    } else {
+        ret = e->ret < 0 && !e->len ? e->ret : AVERROR_EOF;
+    }
+end:
+    pthread_mutex_unlock(&pf->mutex);
+    return ret;
+}
+
+void ff_prefetch_release(FFPrefetch *pf)
+{
+    pthread_mutex_lock(&pf->mutex);
+    if (pf->nb_entries)
+        drop_head(pf);
+    pthread_mutex_unlock(&pf->mutex);
+}
+
+void ff_prefetch_flush(FFPrefetch *pf)
+{
+    pthread_mutex_lock(&pf->mutex);
+    while (pf->nb_entries)
+        drop_head(pf);
+    pthread_mutex_unlock(&pf->mutex);
+}
+
+void ff_prefetch_schedule_refresh(FFPrefetch *pf, const char *url, int64_t time)
+{
+    pthread_mutex_lock(&pf->mutex);
+    pf->refresh_generation++;
+    pf->refresh_done = 0;
+    av_freep(&pf->refresh_buf);
+    av_freep(&pf->refresh_final_url);
+    if (time == INT64_MAX || !url || av_reallocp(&pf->refresh_url, strlen(url) + 1) < 0) {
+        av_freep(&pf->refresh_url);
+    } else {
+        strcpy(pf->refresh_url, url);
+        pf->refresh_time = time;
+    }
+    pthread_cond_signal(&pf->cond_worker);
+    pthread_mutex_unlock(&pf->mutex);
+}
+
+int ff_prefetch_get_refresh(FFPrefetch *pf, int wait, int64_t min_time,
+                            uint8_t **buf, int *size, char **url)
+{
+    int ret;
+
+    pthread_mutex_lock(&pf->mutex);
+    while (wait && pf->refresh_url && !pf->refresh_done) {
+        if (ff_check_interrupt(&pf->s->interrupt_callback)) {
+            ret = AVERROR_EXIT;
+            goto end;
+        }
+        cond_wait_for(&pf->cond_reader, &pf->mutex, 100000);
+    }
+    if (!pf->refresh_url || !pf->refresh_done) {
+        ret = AVERROR(EAGAIN);
+        goto end;
+    }
+
+    ret = pf->refresh_ret;
+    if (ret >= 0 && pf->refresh_start < min_time)
+        ret = AVERROR(EAGAIN);
+    if (ret >= 0) {
+        *buf  = pf->refresh_buf;
+        *size = pf->refresh_size;
+        *url  = pf->refresh_final_url;
+        pf->refresh_buf       = NULL;
+        pf->refresh_final_url = NULL;
+    }
+    /* the manifest is consumed, wait for the next schedule */
+    av_freep(&pf->refresh_url);
+    av_freep(&pf->refresh_buf);
+    av_freep(&pf->refresh_final_url);
+    pf->refresh_done = 0;
+end:
+    pthread_mutex_unlock(&pf->mutex);
+    return ret;
+}
+
+#else
+
+int ff_prefetch_alloc(FFPrefetch **ppf, AVFormatContext *s,
+                      ff_prefetch_open_fn open, void *opaque,
+                      int max_segments, int64_t max_size)
+{
+    *ppf = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void ff_prefetch_free(FFPrefetch **ppf)
+{
+}
+
+int ff_prefetch_add(FFPrefetch *pf, int64_t seq_no, const char *url,
+                    int64_t offset, int64_t size)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_prefetch_sync(FFPrefetch *pf, int64_t seq_no, int64_t *last_seq_no)
+{
+    *last_seq_no = seq_no - 1;
+    return 0;
+}
+
+int ff_prefetch_read(FFPrefetch *pf, uint8_t *buf, int buf_size)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_prefetch_release(FFPrefetch *pf)
+{
+}
+
+void ff_prefetch_flush(FFPrefetch *pf)
+{
+}
+
+void ff_prefetch_schedule_refresh(FFPrefetch *pf, const char *url, int64_t time)
+{
+}
+
+int ff_prefetch_get_refresh(FFPrefetch *pf, int wait, int64_t min_time,
+                            uint8_t **buf, int *size, char **url)
+{
+    return AVERROR(ENOSYS);
+}
+
+#endif /* HAVE_PTHREADS */
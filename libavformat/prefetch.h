@@ -0,0 +1,131 @@
+/*
+ * Background segment prefetching for segmented streaming demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_PREFETCH_H
+#define AVFORMAT_PREFETCH_H
+
+#include <stdint.h>
+
+#include "avformat.h"
+
+/**
+ * A prefetcher owns one worker thread which downloads the queued segments
+ * of one playlist/representation into memory, in order, and refreshes its
+ * manifest in the background. The demuxer queues segments with
+ * ff_prefetch_add() and reads them with ff_prefetch_read(); at most
+ * max_size bytes are buffered in addition to the segment being read.
+ *
+ * The worker thread opens and closes its connections with s->io_open() and
+ * s->io_close(), concurrently with the demuxer thread, so these callbacks
+ * have to be thread-safe.
+ */
+typedef struct FFPrefetch FFPrefetch;
+
+/**
+ * Open url for reading the byte range starting at offset, of size bytes
+ * (size < 0 reads to the end). It is called on the worker thread, while
+ * the demuxer keeps running, and must not access the demuxer state without
+ * synchronization.
+ *
+ * @param pb the connection used by the previous request of the same kind
+ *           (segment or manifest) or NULL; the callback may reuse it for
+ *           a persistent connection or has to close it
+ */
+typedef int (*ff_prefetch_open_fn)(void *opaque, AVIOContext **pb, const char *url,
+                                   int64_t offset, int64_t size);
+
+/**
+ * Allocate a prefetcher and start its worker thread.
+ *
+ * @param max_segments maximum number of queued segments
+ * @param max_size     maximum number of buffered bytes besides the head segment
+ * @return 0 on success, a negative AVERROR code on failure (notably
+ *         AVERROR(ENOSYS) in builds without threads)
+ */
+int ff_prefetch_alloc(FFPrefetch **ppf, AVFormatContext *s,
+                      ff_prefetch_open_fn open, void *opaque,
+                      int max_segments, int64_t max_size);
+
+/**
+ * Stop the worker thread and free the prefetcher and all buffered data.
+ */
+void ff_prefetch_free(FFPrefetch **ppf);
+
+/**
+ * Queue the download of a segment, identified by its sequence number,
+ * which must be greater than the one of the previously queued segment.
+ *
+ * @return 0 on success, AVERROR(EAGAIN) if the queue is full
+ */
+int ff_prefetch_add(FFPrefetch *pf, int64_t seq_no, const char *url,
+                    int64_t offset, int64_t size);
+
+/**
+ * Drop the queued segments with a sequence number below seq_no.
+ *
+ * @param last_seq_no set to the sequence number of the last queued
+ *                    segment, or seq_no - 1 if the queue is empty
+ * @return 1 if the segment seq_no is at the head of the queue, 0 otherwise
+ */
+int ff_prefetch_sync(FFPrefetch *pf, int64_t seq_no, int64_t *last_seq_no);
+
+/**
+ * Read from the segment at the head of the queue, waiting for the worker
+ * thread if no data is available yet.
+ *
+ * @return the number of bytes read, AVERROR_EOF at the end of the segment,
+ *         the download error if it failed before any data was read, or
+ *         AVERROR_EXIT if the interrupt callback fired
+ */
+int ff_prefetch_read(FFPrefetch *pf, uint8_t *buf, int buf_size);
+
+/**
+ * Drop the segment at the head of the queue, aborting its download if
+ * still in progress.
+ */
+void ff_prefetch_release(FFPrefetch *pf);
+
+/**
+ * Drop all queued segments, e.g. after seeking.
+ */
+void ff_prefetch_flush(FFPrefetch *pf);
+
+/**
+ * Make the worker thread download the manifest at url once time (in the
+ * av_gettime_relative() time base) is reached. INT64_MAX cancels the
+ * pending refresh.
+ */
+void ff_prefetch_schedule_refresh(FFPrefetch *pf, const char *url, int64_t time);
+
+/**
+ * Get the manifest downloaded by the worker thread. On success, the caller
+ * takes ownership of *buf, which is zero terminated, and *url, the final
+ * url of the manifest after redirections.
+ *
+ * @param wait     wait for the scheduled download to complete
+ * @param min_time discard the manifest if its download started before
+ *                 min_time (av_gettime_relative() time base)
+ * @return 0 on success, AVERROR(EAGAIN) if no manifest is available, the
+ *         download error if it failed
+ */
+int ff_prefetch_get_refresh(FFPrefetch *pf, int wait, int64_t min_time,
+                            uint8_t **buf, int *size, char **url);
+
+#endif /* AVFORMAT_PREFETCH_H */
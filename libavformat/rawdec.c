@@ -34,21 +34,27 @@
 
 int ff_raw_read_partial_packet(AVFormatContext *s, AVPacket *pkt)
 {
+    int64_t pos = avio_tell(s->pb);
     int ret, size;
 
     size = RAW_PACKET_SIZE;
 
-    if (av_new_packet(pkt, size) < 0)
-        return AVERROR(ENOMEM);
+    ret = ffio_read_ref(s->pb, pkt, size);
+    if (ret == AVERROR(EAGAIN)) {
+        if (av_new_packet(pkt, size) < 0)
+            return AVERROR(ENOMEM);
 
-    pkt->pos= avio_tell(s->pb);
-    pkt->stream_index = 0;
-    ret = avio_read_partial(s->pb, pkt->data, size);
-    if (ret < 0) {
-        av_packet_unref(pkt);
+        ret = avio_read_partial(s->pb, pkt->data, size);
+        if (ret < 0) {
+            av_packet_unref(pkt);
+            return ret;
+        }
+        av_shrink_packet(pkt, ret);
+    } else if (ret < 0) {
         return ret;
     }
-    av_shrink_packet(pkt, ret);
+    pkt->pos = pos;
+    pkt->stream_index = 0;
     return ret;
 }
 
@@ -77,6 +77,14 @@ int num_warnings;
 
 int check_faults;
 
+/* seekable and readable output kept in memory, starting at mem_start */
+int mem_out;
+int64_t mem_start;
+uint8_t *mem_buf;
+int64_t mem_size, mem_pos, mem_read_pos;
+int num_reopens;
+int64_t out_duration;
+
 
 static void count_warnings(void *avcl, int level, const char *fmt, va_list vl)
 {
@@ -134,6 +142,94 @@ static int io_write_data_type(void *opaque, uint8_t *buf, int size,
     return io_write(opaque, buf, size);
 }
 
+static int mem_write(void *opaque, uint8_t *buf, int size)
+{
+    int64_t end = mem_pos - mem_start + size;
+    if (mem_pos < mem_start)
+        return AVERROR(EINVAL);
+    if (end > mem_size) {
+        if (av_reallocp(&mem_buf, end) < 0)
+            return AVERROR(ENOMEM);
+        memset(mem_buf + mem_size, 0, end - mem_size);
+        mem_size = end;
+    }
+    memcpy(mem_buf + mem_pos - mem_start, buf, size);
+    mem_pos += size;
+    return size;
+}
+
+static int64_t mem_seek_pos(int64_t *pos, int64_t offset, int whence)
+{
+    switch (whence) {
+    case AVSEEK_SIZE: return mem_start + mem_size;
+    case SEEK_SET:    *pos  = offset; break;
+    case SEEK_CUR:    *pos += offset; break;
+    case SEEK_END:    *pos  = mem_start + mem_size + offset; break;
+    default:          return AVERROR(EINVAL);
+    }
+    return *pos;
+}
+
+static int64_t mem_seek(void *opaque, int64_t offset, int whence)
+{
+    return mem_seek_pos(&mem_pos, offset, whence);
+}
+
+static int mem_read(void *opaque, uint8_t *buf, int size)
+{
+    int64_t left = mem_start + mem_size - mem_read_pos;
+    if (mem_read_pos < mem_start)
+        return AVERROR(EINVAL);
+    if (left <= 0)
+        return AVERROR_EOF;
+    size = FFMIN(size, left);
+    memcpy(buf, mem_buf + mem_read_pos - mem_start, size);
+    mem_read_pos += size;
+    return size;
+}
+
+static int64_t mem_read_seek(void *opaque, int64_t offset, int whence)
+{
+    return mem_seek_pos(&mem_read_pos, offset, whence);
+}
+
+/* Reopen the output for reading, as done by the muxer to move the data. */
+static int mem_io_open(AVFormatContext *s, AVIOContext **pb, const char *url,
+                       int flags, AVDictionary **options)
+{
+    uint8_t *buf;
+    if (!mem_out || flags != AVIO_FLAG_READ)
+        return AVERROR(EINVAL);
+    buf = av_malloc(sizeof(iobuf));
+    if (!buf)
+        return AVERROR(ENOMEM);
+    *pb = avio_alloc_context(buf, sizeof(iobuf), 0, NULL, mem_read, NULL, mem_read_seek);
+    if (!*pb) {
+        av_free(buf);
+        return AVERROR(ENOMEM);
+    }
+    mem_read_pos = mem_start;
+    num_reopens++;
+    return 0;
+}
+
+static void mem_io_close(AVFormatContext *s, AVIOContext *pb)
+{
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+}
+
+/* Find an atom type in the output kept in memory, returning its offset
+ * from mem_start, or -1. */
+static int64_t mem_find(const char *type)
+{
+    int64_t i;
+    for (i = 0; i + 4 <= mem_size; i++)
+        if (!memcmp(mem_buf + i, type, 4))
+            return i;
+    return -1;
+}
+
 static void init_out(const char *name)
 {
     char buf[100];
@@ -147,11 +243,19 @@ static void init_out(const char *name)
             perror(buf);
     }
     out_size = 0;
+    mem_size = 0;
+    num_reopens = 0;
 }
 
 static void close_out(void)
 {
     int i;
+    if (mem_out) {
+        out_size = mem_size;
+        av_md5_update(md5, mem_buf, mem_size);
+        if (out)
+            fwrite(mem_buf, 1, mem_size, out);
+    }
     av_md5_final(md5, hash);
     for (i = 0; i < HASH_SIZE; i++)
         printf("%02x", hash[i]);
@@ -185,11 +289,22 @@ static void init_fps(int bf, int audio_preroll, int fps)
     ctx->oformat = av_guess_format(format, NULL, NULL);
     if (!ctx->oformat)
         exit(1);
-    ctx->pb = avio_alloc_context(iobuf, iobuf_size, AVIO_FLAG_WRITE, NULL, NULL, io_write, NULL);
-    if (!ctx->pb)
-        exit(1);
-    ctx->pb->write_data_type = io_write_data_type;
+    if (mem_out) {
+        ctx->pb = avio_alloc_context(iobuf, iobuf_size, AVIO_FLAG_WRITE, NULL, NULL, mem_write, mem_seek);
+        if (!ctx->pb)
+            exit(1);
+        mem_pos = 0;
+        avio_seek(ctx->pb, mem_start, SEEK_SET);
+        ctx->io_open  = mem_io_open;
+        ctx->io_close = mem_io_close;
+    } else {
+        ctx->pb = avio_alloc_context(iobuf, iobuf_size, AVIO_FLAG_WRITE, NULL, NULL, io_write, NULL);
+        if (!ctx->pb)
+            exit(1);
+        ctx->pb->write_data_type = io_write_data_type;
+    }
     ctx->flags |= AVFMT_FLAG_BITEXACT;
+    ctx->duration = out_duration;
 
     st = avformat_new_stream(ctx, NULL);
     if (!st)
@@ -785,6 +900,66 @@ int main(int argc, char **argv)
     finish();
     close_out();
 
+    // Reserve the space for the moov atom from the stream durations, with
+    // an output which is seekable and can be reopened for reading.
+    mem_out = 1;
+    out_duration = 2 * AV_TIME_BASE;
+    init_out("moov-size-auto");
+    av_dict_set(&opts, "moov_size", "auto", 0);
+    init(0, 0);
+    mux_gops(2);
+    finish();
+    close_out();
+    check(mem_find("moov") == AV_RB32(mem_buf) + 4, "moov not at the beginning");
+    check(mem_find("free") > mem_find("moov"), "No free atom after the moov");
+    check(num_reopens == 0, "Data moved although the estimate was sufficient");
+
+    // Underestimate the duration, so that the moov atom does not fit and
+    // the data has to be moved. The result is the same as with faststart.
+    out_duration = AV_TIME_BASE;
+    init_out("moov-size-auto-shift");
+    av_dict_set(&opts, "moov_size", "auto", 0);
+    init(0, 0);
+    mux_gops(20);
+    finish();
+    close_out();
+    memcpy(content, hash, HASH_SIZE);
+    check(num_reopens == 1, "Data not moved for an insufficient estimate");
+
+    out_duration = 0;
+    init_out("moov-size-faststart");
+    av_dict_set(&opts, "movflags", "faststart", 0);
+    init(0, 0);
+    mux_gops(20);
+    finish();
+    close_out();
+    check(!memcmp(hash, content, HASH_SIZE), "moov_size auto differs from faststart");
+
+    // Start the same output just below 4 GiB, so that moving the data
+    // pushes the last chunks past it and the chunk offsets switch to co64,
+    // which makes the moov atom larger again.
+    mem_start = (1LL << 32) - 23000;
+    out_duration = AV_TIME_BASE;
+    init_out("moov-size-auto-co64");
+    av_dict_set(&opts, "moov_size", "auto", 0);
+    init(0, 0);
+    mux_gops(20);
+    finish();
+    close_out();
+    memcpy(content, hash, HASH_SIZE);
+    check(mem_find("co64") >= 0, "No switch to co64");
+
+    out_duration = 0;
+    init_out("moov-size-faststart-co64");
+    av_dict_set(&opts, "movflags", "faststart", 0);
+    init(0, 0);
+    mux_gops(20);
+    finish();
+    close_out();
+    check(!memcmp(hash, content, HASH_SIZE), "moov_size auto differs from faststart with co64");
+
+    mem_out = 0;
+    av_freep(&mem_buf);
     av_free(md5);
 
     return check_faults > 0 ? 1 : 0;
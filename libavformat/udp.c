@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() with glibc */
 
 #include "avformat.h"
 #include "avio_internal.h"
@@ -62,6 +63,13 @@
 
 #if HAVE_PTHREAD_CANCEL
 #include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#if HAVE_PTHREAD_CANCEL && HAVE_RECVMMSG && HAVE_SENDMMSG && defined(MSG_WAITFORONE)
+#define UDP_MMSG 1
+#else
+#define UDP_MMSG 0
 #endif
 
 #ifndef IPV6_ADD_MEMBERSHIP
@@ -101,6 +109,31 @@ typedef struct UDPContext {
     pthread_mutex_t mutex;
     pthread_cond_t cond;
     int thread_started;
+#endif
+    int batch_size;
+    int64_t rx_timestamp;
+    /* packet batch of the transmit thread */
+    uint8_t *tx_buf;
+    int *tx_len;
+    int tx_buf_size;
+#if UDP_MMSG
+    /* Single producer, single consumer datagram ring filled by the batch
+     * receive thread. Slots [ring_tail, ring_head) hold received datagrams,
+     * the mutex and cond are only used to wake a waiting reader. */
+    uint8_t *ring;
+    int *ring_len;
+    int64_t *ring_ts;
+    int ring_slots;
+    int ring_slot_size;
+    atomic_uint ring_head;
+    atomic_uint ring_tail;
+    atomic_int ring_waiting;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    union {
+        struct cmsghdr hdr;
+        uint8_t buf[CMSG_SPACE(sizeof(struct timeval))];
+    } cmsg;
 #endif
     uint8_t tmp[UDP_MAX_PKT_SIZE+4];
     int remaining_in_dg;
@@ -130,6 +163,8 @@ static const AVOption options[] = {
     { "connect",        "set if connect() should be called on socket",     OFFSET(is_connected),   AV_OPT_TYPE_BOOL,   { .i64 =  0 },     0, 1,       .flags = D|E },
     { "fifo_size",      "set the UDP receiving circular buffer size, expressed as a number of packets with size of 188 bytes", OFFSET(circular_buffer_size), AV_OPT_TYPE_INT, {.i64 = 7*4096}, 0, INT_MAX, D },
     { "overrun_nonfatal", "survive in case of UDP receiving circular buffer overrun", OFFSET(overrun_nonfatal), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1,    D },
+    { "batch_size",     "set the number of datagrams received or sent per system call by the circular buffer thread", OFFSET(batch_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1024, .flags = D|E },
+    { "rx_timestamp",   "kernel receive time of the last datagram read, in microseconds (batch receive only)", OFFSET(rx_timestamp), AV_OPT_TYPE_INT64, { .i64 = AV_NOPTS_VALUE }, INT64_MIN, INT64_MAX, D | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "timeout",        "set raise error timeout (only in read mode)",     OFFSET(timeout),        AV_OPT_TYPE_INT,    { .i64 = 0 },      0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
@@ -549,6 +584,196 @@ end:
     return NULL;
 }
 
+#if UDP_MMSG
+static int64_t udp_msg_timestamp(struct msghdr *msg)
+{
+#ifdef SO_TIMESTAMP
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP) {
+            struct timeval tv;
+            memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+            return tv.tv_sec * INT64_C(1000000) + tv.tv_usec;
+        }
+    }
+#endif
+    return av_gettime();
+}
+
+static void ring_publish(UDPContext *s, unsigned head)
+{
+    /* Pairs with the store to ring_waiting and the head reload in
+     * udp_read_ring(): either the reader sees the new head, or we see it
+     * waiting and wake it up. */
+    atomic_store(&s->ring_head, head);
+    if (atomic_load(&s->ring_waiting)) {
+        pthread_mutex_lock(&s->mutex);
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
+
+/* Receive thread of the batch mode: every recvmmsg() call fills up to
+ * batch_size free ring slots directly, and all datagrams of a batch share
+ * the kernel receive timestamp of its first one. */
+static void *circular_buffer_task_rx_mmsg(void *_URLContext)
+{
+    URLContext *h = _URLContext;
+    UDPContext *s = h->priv_data;
+    unsigned head = 0;
+    int old_cancelstate, err = 0;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
+    if (ff_socket_nonblock(s->udp_fd, 0) < 0) {
+        av_log(h, AV_LOG_ERROR, "Failed to set blocking mode");
+        err = AVERROR(EIO);
+        goto end;
+    }
+    while (1) {
+        unsigned tail = atomic_load_explicit(&s->ring_tail, memory_order_acquire);
+        int nb = FFMIN(s->ring_slots - (int)(head - tail), s->batch_size);
+        int64_t timestamp;
+        int i, ret;
+
+        if (!nb) {
+            unsigned slot;
+
+            /* No free slot; keep the datagram only if the reader made room
+             * in the meantime. */
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
+            ret = recv(s->udp_fd, s->tmp, sizeof(s->tmp), 0);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
+            if (ret < 0) {
+                if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
+                    err = ff_neterrno();
+                    goto end;
+                }
+                continue;
+            }
+            tail = atomic_load_explicit(&s->ring_tail, memory_order_acquire);
+            if (head - tail >= s->ring_slots) {
+                if (s->overrun_nonfatal) {
+                    av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                            "Surviving due to overrun_nonfatal option\n");
+                    continue;
+                } else {
+                    av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                            "To avoid, increase fifo_size URL option. "
+                            "To survive in such case, use overrun_nonfatal option\n");
+                    err = AVERROR(EIO);
+                    goto end;
+                }
+            }
+            slot = head % s->ring_slots;
+            if (ret > s->ring_slot_size) {
+                av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+                ret = s->ring_slot_size;
+            }
+            memcpy(s->ring + (size_t)slot * s->ring_slot_size, s->tmp, ret);
+            s->ring_len[slot] = ret;
+            s->ring_ts[slot]  = av_gettime();
+            ring_publish(s, ++head);
+            continue;
+        }
+
+        for (i = 0; i < nb; i++) {
+            unsigned slot = (head + i) % s->ring_slots;
+            s->iov[i].iov_base = s->ring + (size_t)slot * s->ring_slot_size;
+            s->iov[i].iov_len  = s->ring_slot_size;
+        }
+        s->msgs[0].msg_hdr.msg_control    = &s->cmsg;
+        s->msgs[0].msg_hdr.msg_controllen = sizeof(s->cmsg);
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
+        ret = recvmmsg(s->udp_fd, s->msgs, nb, MSG_WAITFORONE, NULL);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
+        if (ret < 0) {
+            if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
+                err = ff_neterrno();
+                goto end;
+            }
+            continue;
+        }
+
+        timestamp = udp_msg_timestamp(&s->msgs[0].msg_hdr);
+        for (i = 0; i < ret; i++) {
+            unsigned slot = (head + i) % s->ring_slots;
+            if (s->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+            s->ring_len[slot] = s->msgs[i].msg_len;
+            s->ring_ts[slot]  = timestamp;
+        }
+        head += ret;
+        ring_publish(s, head);
+    }
+
+end:
+    pthread_mutex_lock(&s->mutex);
+    s->circular_buffer_error = err;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+#endif
+
+static int udp_send_packets(UDPContext *s, const uint8_t *buf, const int *len, int nb)
+{
+    int i = 0;
+
+#if UDP_MMSG
+    if (s->msgs) {
+        const uint8_t *p = buf;
+
+        for (i = 0; i < nb; i++) {
+            struct msghdr *msg = &s->msgs[i].msg_hdr;
+            s->iov[i].iov_base  = (uint8_t *)p;
+            s->iov[i].iov_len   = len[i];
+            msg->msg_name       = s->is_connected ? NULL : &s->dest_addr;
+            msg->msg_namelen    = s->is_connected ? 0    : s->dest_addr_len;
+            p += len[i];
+        }
+        i = 0;
+        while (i < nb) {
+            int ret = sendmmsg(s->udp_fd, s->msgs + i, nb - i, 0);
+            if (ret < 0) {
+                ret = ff_neterrno();
+                if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                    return ret;
+                continue;
+            }
+            i += ret;
+        }
+    }
+#endif
+
+    for (; i < nb; i++) {
+        const uint8_t *p = buf;
+        int size = len[i];
+
+        buf += size;
+        while (size) {
+            int ret;
+            av_assert0(size > 0);
+            if (!s->is_connected) {
+                ret = sendto (s->udp_fd, p, size, 0,
+                            (struct sockaddr *) &s->dest_addr,
+                            s->dest_addr_len);
+            } else
+                ret = send(s->udp_fd, p, size, 0);
+            if (ret >= 0) {
+                size -= ret;
+                p    += ret;
+            } else {
+                ret = ff_neterrno();
+                if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                    return ret;
+            }
+        }
+    }
+    return 0;
+}
+
 static void *circular_buffer_task_tx( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -558,7 +783,11 @@ static void *circular_buffer_task_tx( void *_URLContext)
     int64_t start_timestamp = av_gettime_relative();
     int64_t sent_bits = 0;
     int64_t burst_interval = s->bitrate ? (s->burst_bits * 1000000 / s->bitrate) : 0;
-    int64_t max_delay = s->bitrate ?  ((int64_t)h->max_packet_size * 8 * 1000000 / s->bitrate + 1) : 0;
+    uint8_t *buf  = s->tx_buf ? s->tx_buf       : s->tmp;
+    int buf_size  = s->tx_buf ? s->tx_buf_size  : sizeof(s->tmp);
+    int max_nb    = s->tx_buf ? s->batch_size   : 1;
+    int single_len, *lens = s->tx_buf ? s->tx_len : &single_len;
+    int64_t max_delay = s->bitrate ?  ((int64_t)h->max_packet_size * max_nb * 8 * 1000000 / s->bitrate + 1) : 0;
 
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
     pthread_mutex_lock(&s->mutex);
@@ -570,8 +799,7 @@ static void *circular_buffer_task_tx( void *_URLContext)
     }
 
     for(;;) {
-        int len;
-        const uint8_t *p;
+        int len, nb, ret;
         uint8_t tmp[4];
         int64_t timestamp;
 
@@ -586,13 +814,24 @@ static void *circular_buffer_task_tx( void *_URLContext)
             len=av_fifo_size(s->fifo);
         }
 
-        av_fifo_generic_read(s->fifo, tmp, 4, NULL);
-        len=AV_RL32(tmp);
+        /* take up to max_nb queued packets at once */
+        len = nb = 0;
+        do {
+            int pkt_len;
 
-        av_assert0(len >= 0);
-        av_assert0(len <= sizeof(s->tmp));
+            av_fifo_generic_peek(s->fifo, tmp, 4, NULL);
+            pkt_len = AV_RL32(tmp);
 
-        av_fifo_generic_read(s->fifo, s->tmp, len, NULL);
+            av_assert0(pkt_len >= 0);
+            av_assert0(pkt_len <= sizeof(s->tmp));
+
+            if (nb && len + pkt_len > buf_size)
+                break;
+            av_fifo_drain(s->fifo, 4);
+            av_fifo_generic_read(s->fifo, buf + len, pkt_len, NULL);
+            lens[nb++] = pkt_len;
+            len += pkt_len;
+        } while (nb < max_nb && av_fifo_size(s->fifo) >= 4);
 
         pthread_mutex_unlock(&s->mutex);
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
@@ -617,28 +856,12 @@ static void *circular_buffer_task_tx( void *_URLContext)
             target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
         }
 
-        p = s->tmp;
-        while (len) {
-            int ret;
-            av_assert0(len > 0);
-            if (!s->is_connected) {
-                ret = sendto (s->udp_fd, p, len, 0,
-                            (struct sockaddr *) &s->dest_addr,
-                            s->dest_addr_len);
-            } else
-                ret = send(s->udp_fd, p, len, 0);
-            if (ret >= 0) {
-                len -= ret;
-                p   += ret;
-            } else {
-                ret = ff_neterrno();
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
-                    pthread_mutex_lock(&s->mutex);
-                    s->circular_buffer_error = ret;
-                    pthread_mutex_unlock(&s->mutex);
-                    return NULL;
-                }
-            }
+        ret = udp_send_packets(s, buf, lens, nb);
+        if (ret < 0) {
+            pthread_mutex_lock(&s->mutex);
+            s->circular_buffer_error = ret;
+            pthread_mutex_unlock(&s->mutex);
+            return NULL;
         }
 
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
@@ -674,6 +897,19 @@ static int parse_source_list(char *buf, char **sources, int *num_sources,
     return 0;
 }
 
+static void udp_free_buffers(UDPContext *s)
+{
+    av_freep(&s->tx_buf);
+    av_freep(&s->tx_len);
+#if UDP_MMSG
+    av_freep(&s->ring);
+    av_freep(&s->ring_len);
+    av_freep(&s->ring_ts);
+    av_freep(&s->msgs);
+    av_freep(&s->iov);
+#endif
+}
+
 /* put it in UDP context */
 /* return non zero if error */
 static int udp_open(URLContext *h, const char *uri, int flags)
@@ -769,6 +1005,13 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "burst_bits", p)) {
             s->burst_bits = strtoll(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "batch_size", p)) {
+            s->batch_size = strtol(buf, NULL, 10);
+            if (!UDP_MMSG)
+                av_log(h, AV_LOG_WARNING,
+                       "'batch_size' option was set but it is not supported "
+                       "on this build (pthread and recvmmsg support is required)\n");
+        }
         if (av_find_info_tag(buf, sizeof(buf), "localaddr", p)) {
             av_strlcpy(localaddr, buf, sizeof(localaddr));
         }
@@ -962,6 +1205,45 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     if ((!is_output && s->circular_buffer_size) || (is_output && s->bitrate && s->circular_buffer_size)) {
         int ret;
 
+#if UDP_MMSG
+        if (s->batch_size > 1) {
+            s->msgs = av_mallocz_array(s->batch_size, sizeof(*s->msgs));
+            s->iov  = av_mallocz_array(s->batch_size, sizeof(*s->iov));
+            if (!s->msgs || !s->iov)
+                goto fail;
+            for (i = 0; i < s->batch_size; i++) {
+                s->msgs[i].msg_hdr.msg_iov    = &s->iov[i];
+                s->msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+        }
+#endif
+        if (s->batch_size > 1 && is_output) {
+            s->tx_buf_size = av_clip64((int64_t)s->batch_size * h->max_packet_size,
+                                       sizeof(s->tmp), INT_MAX);
+            s->tx_buf = av_malloc(s->tx_buf_size);
+            s->tx_len = av_malloc_array(s->batch_size, sizeof(*s->tx_len));
+            if (!s->tx_buf || !s->tx_len)
+                goto fail;
+        }
+#if UDP_MMSG
+        if (s->batch_size > 1 && !is_output) {
+            s->ring_slot_size = s->pkt_size > 0 ? FFMIN(s->pkt_size, UDP_MAX_PKT_SIZE) : UDP_MAX_PKT_SIZE;
+            s->ring_slots     = FFMAX(s->circular_buffer_size / s->ring_slot_size, 2 * s->batch_size);
+            s->ring     = av_malloc_array(s->ring_slots, s->ring_slot_size);
+            s->ring_len = av_malloc_array(s->ring_slots, sizeof(*s->ring_len));
+            s->ring_ts  = av_malloc_array(s->ring_slots, sizeof(*s->ring_ts));
+            if (!s->ring || !s->ring_len || !s->ring_ts)
+                goto fail;
+            atomic_init(&s->ring_head, 0);
+            atomic_init(&s->ring_tail, 0);
+            atomic_init(&s->ring_waiting, 0);
+#ifdef SO_TIMESTAMP
+            tmp = 1;
+            if (setsockopt(udp_fd, SOL_SOCKET, SO_TIMESTAMP, &tmp, sizeof(tmp)) < 0)
+                log_net_error(h, AV_LOG_WARNING, "setsockopt(SO_TIMESTAMP)");
+#endif
+        } else
+#endif
         /* start the task going */
         s->fifo = av_fifo_alloc(s->circular_buffer_size);
         ret = pthread_mutex_init(&s->mutex, NULL);
@@ -974,6 +1256,11 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             av_log(h, AV_LOG_ERROR, "pthread_cond_init failed : %s\n", strerror(ret));
             goto cond_fail;
         }
+#if UDP_MMSG
+        if (s->ring)
+            ret = pthread_create(&s->circular_buffer_thread, NULL, circular_buffer_task_rx_mmsg, h);
+        else
+#endif
         ret = pthread_create(&s->circular_buffer_thread, NULL, is_output?circular_buffer_task_tx:circular_buffer_task_rx, h);
         if (ret != 0) {
             av_log(h, AV_LOG_ERROR, "pthread_create failed : %s\n", strerror(ret));
@@ -994,6 +1281,7 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     if (udp_fd >= 0)
         closesocket(udp_fd);
     av_fifo_freep(&s->fifo);
+    udp_free_buffers(s);
     for (i = 0; i < num_include_sources; i++)
         av_freep(&include_sources[i]);
     for (i = 0; i < num_exclude_sources; i++)
@@ -1011,6 +1299,53 @@ static int udplite_open(URLContext *h, const char *uri, int flags)
     return udp_open(h, uri, flags);
 }
 
+#if UDP_MMSG
+static int udp_read_ring(URLContext *h, uint8_t *buf, int size)
+{
+    UDPContext *s = h->priv_data;
+    unsigned tail = atomic_load_explicit(&s->ring_tail, memory_order_relaxed);
+    int nonblock = h->flags & AVIO_FLAG_NONBLOCK;
+
+    while (1) {
+        int ret = 0;
+
+        if (atomic_load(&s->ring_head) != tail) {
+            unsigned slot = tail % s->ring_slots;
+            int len = s->ring_len[slot];
+
+            if (len > size) {
+                av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+                len = size;
+            }
+            memcpy(buf, s->ring + (size_t)slot * s->ring_slot_size, len);
+            s->rx_timestamp = s->ring_ts[slot];
+            atomic_store_explicit(&s->ring_tail, tail + 1, memory_order_release);
+            return len;
+        }
+
+        pthread_mutex_lock(&s->mutex);
+        atomic_store(&s->ring_waiting, 1);
+        if (atomic_load(&s->ring_head) == tail) {
+            if (s->circular_buffer_error) {
+                ret = s->circular_buffer_error;
+            } else if (nonblock) {
+                ret = AVERROR(EAGAIN);
+            } else {
+                int64_t t = av_gettime() + 100000;
+                struct timespec tv = { .tv_sec  =  t / 1000000,
+                                       .tv_nsec = (t % 1000000) * 1000 };
+                pthread_cond_timedwait(&s->cond, &s->mutex, &tv);
+                nonblock = 1;
+            }
+        }
+        atomic_store(&s->ring_waiting, 0);
+        pthread_mutex_unlock(&s->mutex);
+        if (ret < 0)
+            return ret;
+    }
+}
+#endif
+
 static int udp_read(URLContext *h, uint8_t *buf, int size)
 {
     UDPContext *s = h->priv_data;
@@ -1018,6 +1353,11 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
 #if HAVE_PTHREAD_CANCEL
     int avail, nonblock = h->flags & AVIO_FLAG_NONBLOCK;
 
+#if UDP_MMSG
+    if (s->ring)
+        return udp_read_ring(h, buf, size);
+#endif
+
     if (s->fifo) {
         pthread_mutex_lock(&s->mutex);
         do {
@@ -1151,6 +1491,7 @@ static int udp_close(URLContext *h)
 #endif
     closesocket(s->udp_fd);
     av_fifo_freep(&s->fifo);
+    udp_free_buffers(s);
     return 0;
 }
 
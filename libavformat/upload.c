@@ -0,0 +1,527 @@
+/*
+ * Asynchronous upload of the output files of segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "avio_internal.h"
+#if CONFIG_HTTP_PROTOCOL
+#include "http.h"
+#endif
+#include "internal.h"
+#include "upload.h"
+#include "url.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+
+#define MAX_RETRY_DELAY 2000000
+
+typedef struct UploadEntry {
+    char *url;
+    AVDictionary *options;
+    uint8_t *data;
+    int size;
+    int flags;
+    int persistent;
+    int started;
+    struct UploadEntry *next;
+} UploadEntry;
+
+typedef struct UploadOutput {
+    AVIOContext *pb;
+    char *url;
+    AVDictionary *options;
+} UploadOutput;
+
+typedef struct UploadThread {
+    FFUploadQueue *q;
+    pthread_t thread;
+    /* persistent connection, reused by the next upload */
+    AVIOContext *pb;
+} UploadThread;
+
+struct FFUploadQueue {
+    AVFormatContext *s;
+    int max_queued;
+    int max_retries;
+
+    /* outputs opened by ff_upload_open(), only used by the muxer thread */
+    UploadOutput *outputs;
+    int nb_outputs;
+
+    /* queued and running uploads, in queue order */
+    UploadEntry *first;
+    int nb_entries;
+    int error;
+
+    UploadThread *threads;
+    int nb_threads;
+
+    int abort;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_worker;
+    pthread_cond_t cond_muxer;
+};
+
+static void cond_wait_for(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t delay)
+{
+    int64_t t = av_gettime() + delay;
+    struct timespec tv = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+    pthread_cond_timedwait(cond, mutex, &tv);
+}
+
+static void free_entry(UploadEntry **pe)
+{
+    UploadEntry *e = *pe;
+
+    if (!e)
+        return;
+    av_freep(&e->url);
+    av_dict_free(&e->options);
+    av_freep(&e->data);
+    av_freep(pe);
+}
+
+/* Called with the mutex locked. */
+static UploadEntry *next_entry(FFUploadQueue *q)
+{
+    UploadEntry *e;
+
+    if (q->abort)
+        return NULL;
+    for (e = q->first; e; e = e->next)
+        if (!e->started && (!(e->flags & FF_UPLOAD_ORDERED) || e == q->first))
+            return e;
+    return NULL;
+}
+
+/* Called with the mutex locked. */
+static void remove_entry(FFUploadQueue *q, UploadEntry *e)
+{
+    UploadEntry **pe = &q->first;
+
+    while (*pe != e)
+        pe = &(*pe)->next;
+    *pe = e->next;
+    q->nb_entries--;
+    free_entry(&e);
+}
+
+static int upload_once(UploadThread *t, UploadEntry *e)
+{
+    AVFormatContext *s = t->q->s;
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    int ret;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (e->persistent && t->pb) {
+        if (ff_http_do_new_request(ffio_geturlcontext(t->pb), e->url) >= 0)
+            pb = t->pb;
+        else
+            ff_format_io_close(s, &t->pb);
+        t->pb = NULL;
+    }
+#endif
+    if (!pb) {
+        if ((ret = av_dict_copy(&opts, e->options, 0)) < 0)
+            return ret;
+        ret = s->io_open(s, &pb, e->url, AVIO_FLAG_WRITE, &opts);
+        av_dict_free(&opts);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (e->size)
+        avio_write(pb, e->data, e->size);
+    avio_flush(pb);
+    ret = pb->error;
+    if (e->persistent && ret >= 0) {
+        ret = ffurl_shutdown(ffio_geturlcontext(pb), AVIO_FLAG_WRITE);
+        if (ret >= 0) {
+            t->pb = pb;
+            return 0;
+        }
+    }
+    ff_format_io_close(s, &pb);
+    return ret;
+}
+
+static int upload_entry(UploadThread *t, UploadEntry *e)
+{
+    FFUploadQueue *q = t->q;
+    int i, ret;
+
+    for (i = 0; ; i++) {
+        ret = upload_once(t, e);
+        if (ret >= 0 || i >= q->max_retries ||
+            ff_check_interrupt(&q->s->interrupt_callback))
+            break;
+        av_log(q->s, AV_LOG_WARNING, "Failed to upload '%s': %s, retrying\n",
+               e->url, av_err2str(ret));
+        av_usleep(FFMIN(100000LL << FFMIN(i, 10), MAX_RETRY_DELAY));
+    }
+    if (ret < 0)
+        av_log(q->s, AV_LOG_ERROR, "Failed to upload '%s': %s\n",
+               e->url, av_err2str(ret));
+    return ret;
+}
+
+static void *upload_thread(void *arg)
+{
+    UploadThread *t = arg;
+    FFUploadQueue *q = t->q;
+
+    pthread_mutex_lock(&q->mutex);
+    for (;;) {
+        UploadEntry *e = next_entry(q);
+        int ret;
+
+        if (!e) {
+            if (q->abort)
+                break;
+            pthread_cond_wait(&q->cond_worker, &q->mutex);
+            continue;
+        }
+
+        e->started = 1;
+        pthread_mutex_unlock(&q->mutex);
+        ret = upload_entry(t, e);
+        pthread_mutex_lock(&q->mutex);
+
+        if (ret < 0 && !q->error)
+            q->error = ret;
+        remove_entry(q, e);
+        /* an ordered upload may be startable now */
+        pthread_cond_broadcast(&q->cond_worker);
+        pthread_cond_signal(&q->cond_muxer);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    ff_format_io_close(q->s, &t->pb);
+    return NULL;
+}
+
+int ff_upload_queue_alloc(FFUploadQueue **pq, AVFormatContext *s, int nb_threads,
+                          int max_queued, int max_retries)
+{
+    FFUploadQueue *q;
+    int i, ret;
+
+    *pq = NULL;
+    if (nb_threads <= 0 || max_queued <= 0)
+        return AVERROR(EINVAL);
+    q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+    q->threads = av_mallocz_array(nb_threads, sizeof(*q->threads));
+    if (!q->threads) {
+        av_free(q);
+        return AVERROR(ENOMEM);
+    }
+    q->s           = s;
+    q->max_queued  = max_queued;
+    q->max_retries = max_retries;
+
+    if ((ret = pthread_mutex_init(&q->mutex, NULL))) {
+        ret = AVERROR(ret);
+        goto mutex_fail;
+    }
+    if ((ret = pthread_cond_init(&q->cond_worker, NULL))) {
+        ret = AVERROR(ret);
+        goto cond_worker_fail;
+    }
+    if ((ret = pthread_cond_init(&q->cond_muxer, NULL))) {
+        ret = AVERROR(ret);
+        goto cond_muxer_fail;
+    }
+    for (i = 0; i < nb_threads; i++) {
+        UploadThread *t = &q->threads[i];
+
+        t->q = q;
+        if ((ret = pthread_create(&t->thread, NULL, upload_thread, t))) {
+            av_log(s, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(AVERROR(ret)));
+            ret = AVERROR(ret);
+            break;
+        }
+        q->nb_threads++;
+    }
+    if (!q->nb_threads)
+        goto thread_fail;
+
+    *pq = q;
+    return 0;
+thread_fail:
+    pthread_cond_destroy(&q->cond_muxer);
+cond_muxer_fail:
+    pthread_cond_destroy(&q->cond_worker);
+cond_worker_fail:
+    pthread_mutex_destroy(&q->mutex);
+mutex_fail:
+    av_free(q->threads);
+    av_free(q);
+    return ret;
+}
+
+static void free_output(FFUploadQueue *q, int i)
+{
+    UploadOutput *out = &q->outputs[i];
+
+    av_freep(&out->url);
+    av_dict_free(&out->options);
+    q->outputs[i] = q->outputs[--q->nb_outputs];
+}
+
+void ff_upload_queue_free(FFUploadQueue **pq)
+{
+    FFUploadQueue *q = *pq;
+    int i;
+
+    if (!q)
+        return;
+
+    pthread_mutex_lock(&q->mutex);
+    q->abort = 1;
+    pthread_cond_broadcast(&q->cond_worker);
+    pthread_mutex_unlock(&q->mutex);
+    for (i = 0; i < q->nb_threads; i++)
+        pthread_join(q->threads[i].thread, NULL);
+
+    while (q->first) {
+        UploadEntry *e = q->first;
+        q->first = e->next;
+        free_entry(&e);
+    }
+    while (q->nb_outputs) {
+        ffio_free_dyn_buf(&q->outputs[0].pb);
+        free_output(q, 0);
+    }
+    av_freep(&q->outputs);
+    av_freep(&q->threads);
+    pthread_cond_destroy(&q->cond_muxer);
+    pthread_cond_destroy(&q->cond_worker);
+    pthread_mutex_destroy(&q->mutex);
+    av_freep(pq);
+}
+
+int ff_upload_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                   AVDictionary **options)
+{
+    UploadOutput *outputs, *out;
+    int ret;
+
+    outputs = av_realloc_array(q->outputs, q->nb_outputs + 1, sizeof(*q->outputs));
+    if (!outputs)
+        return AVERROR(ENOMEM);
+    q->outputs = outputs;
+    out = &q->outputs[q->nb_outputs];
+    memset(out, 0, sizeof(*out));
+    if (!(out->url = av_strdup(url)))
+        return AVERROR(ENOMEM);
+    if (options && (ret = av_dict_copy(&out->options, *options, 0)) < 0)
+        goto fail;
+    if ((ret = avio_open_dyn_buf(&out->pb)) < 0)
+        goto fail;
+
+    *pb = out->pb;
+    q->nb_outputs++;
+    return 0;
+fail:
+    av_freep(&out->url);
+    av_dict_free(&out->options);
+    return ret;
+}
+
+static int find_output(FFUploadQueue *q, AVIOContext *pb)
+{
+    int i;
+
+    for (i = 0; i < q->nb_outputs; i++)
+        if (q->outputs[i].pb == pb)
+            return i;
+    return -1;
+}
+
+static int queue_entry(FFUploadQueue *q, UploadEntry *e, int flags)
+{
+    UploadEntry **pe;
+    int ret = 0;
+
+    e->flags = flags;
+#if CONFIG_HTTP_PROTOCOL
+    if (ff_is_http_proto(e->url)) {
+        AVDictionaryEntry *mr     = av_dict_get(e->options, "multiple_requests", NULL, 0);
+        AVDictionaryEntry *method = av_dict_get(e->options, "method", NULL, 0);
+        e->persistent = mr && atoi(mr->value) &&
+                        !(method && !av_strcasecmp(method->value, "DELETE"));
+    }
+#endif
+
+    pthread_mutex_lock(&q->mutex);
+    while (q->nb_entries >= q->max_queued) {
+        if (ff_check_interrupt(&q->s->interrupt_callback)) {
+            pthread_mutex_unlock(&q->mutex);
+            free_entry(&e);
+            return AVERROR_EXIT;
+        }
+        cond_wait_for(&q->cond_muxer, &q->mutex, 100000);
+    }
+    for (pe = &q->first; *pe; pe = &(*pe)->next)
+        ;
+    *pe = e;
+    q->nb_entries++;
+    pthread_cond_signal(&q->cond_worker);
+
+    ret      = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->mutex);
+    return ret;
+}
+
+int ff_upload_close(FFUploadQueue *q, AVIOContext **pb, int flags)
+{
+    UploadOutput *out;
+    UploadEntry *e;
+    int i = find_output(q, *pb);
+
+    if (i < 0)
+        return AVERROR(EINVAL);
+    out = &q->outputs[i];
+
+    e = av_mallocz(sizeof(*e));
+    if (!e) {
+        ffio_free_dyn_buf(pb);
+        free_output(q, i);
+        return AVERROR(ENOMEM);
+    }
+    e->size = avio_close_dyn_buf(*pb, &e->data);
+    *pb = NULL;
+    e->url     = out->url;
+    e->options = out->options;
+    out->url     = NULL;
+    out->options = NULL;
+    free_output(q, i);
+    if (e->size < 0 || (e->size && !e->data)) {
+        free_entry(&e);
+        return AVERROR(ENOMEM);
+    }
+
+    return queue_entry(q, e, flags);
+}
+
+int ff_upload_owns(FFUploadQueue *q, AVIOContext *pb)
+{
+    return q && pb && find_output(q, pb) >= 0;
+}
+
+void ff_upload_discard(FFUploadQueue *q, AVIOContext **pb)
+{
+    int i;
+
+    if (!q || !*pb || (i = find_output(q, *pb)) < 0)
+        return;
+    ffio_free_dyn_buf(pb);
+    free_output(q, i);
+}
+
+int ff_upload_request(FFUploadQueue *q, const char *url, AVDictionary *options,
+                      int flags)
+{
+    UploadEntry *e = av_mallocz(sizeof(*e));
+    int ret;
+
+    if (!e)
+        return AVERROR(ENOMEM);
+    if (!(e->url = av_strdup(url)) ||
+        (ret = av_dict_copy(&e->options, options, 0)) < 0) {
+        free_entry(&e);
+        return AVERROR(ENOMEM);
+    }
+
+    return queue_entry(q, e, flags);
+}
+
+int ff_upload_queue_wait(FFUploadQueue *q)
+{
+    int ret;
+
+    pthread_mutex_lock(&q->mutex);
+    while (q->nb_entries) {
+        if (ff_check_interrupt(&q->s->interrupt_callback)) {
+            pthread_mutex_unlock(&q->mutex);
+            return AVERROR_EXIT;
+        }
+        cond_wait_for(&q->cond_muxer, &q->mutex, 100000);
+    }
+    ret      = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->mutex);
+    return ret;
+}
+
+#else
+
+int ff_upload_queue_alloc(FFUploadQueue **pq, AVFormatContext *s, int nb_threads,
+                          int max_queued, int max_retries)
+{
+    *pq = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void ff_upload_queue_free(FFUploadQueue **pq)
+{
+}
+
+int ff_upload_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                   AVDictionary **options)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_close(FFUploadQueue *q, AVIOContext **pb, int flags)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_owns(FFUploadQueue *q, AVIOContext *pb)
+{
+    return 0;
+}
+
+void ff_upload_discard(FFUploadQueue *q, AVIOContext **pb)
+{
+}
+
+int ff_upload_request(FFUploadQueue *q, const char *url, AVDictionary *options,
+                      int flags)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_queue_wait(FFUploadQueue *q)
+{
+    return AVERROR(ENOSYS);
+}
+
+#endif /* HAVE_PTHREADS */
@@ -0,0 +1,108 @@
+/*
+ * Asynchronous upload of the output files of segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_UPLOAD_H
+#define AVFORMAT_UPLOAD_H
+
+#include "avformat.h"
+
+/**
+ * An upload queue writes the output files of a muxer into memory and
+ * uploads them from worker threads, so that the muxer never waits for the
+ * network unless max_queued uploads are pending. Failed uploads are
+ * retried.
+ *
+ * The worker threads open and close the outputs with s->io_open() and
+ * s->io_close(), concurrently with each other and with the muxer, so these
+ * callbacks have to be thread-safe.
+ */
+typedef struct FFUploadQueue FFUploadQueue;
+
+/**
+ * Start the upload only once all the previously queued uploads completed,
+ * e.g. for a playlist referencing the segments queued before it.
+ */
+#define FF_UPLOAD_ORDERED 1
+
+/**
+ * Allocate an upload queue and start its worker threads.
+ *
+ * @param nb_threads  number of uploads run in parallel
+ * @param max_queued  maximum number of queued and running uploads
+ * @param max_retries number of times a failed upload is retried
+ * @return 0 on success, a negative AVERROR code on failure (notably
+ *         AVERROR(ENOSYS) in builds without threads)
+ */
+int ff_upload_queue_alloc(FFUploadQueue **pq, AVFormatContext *s, int nb_threads,
+                          int max_queued, int max_retries);
+
+/**
+ * Stop the worker threads once the running uploads completed and free the
+ * queue. The uploads not started yet are dropped, call
+ * ff_upload_queue_wait() first to complete them.
+ */
+void ff_upload_queue_free(FFUploadQueue **pq);
+
+/**
+ * Open an in-memory output for url, to be passed to ff_upload_close().
+ *
+ * @param options options used to open url with s->io_open(), copied
+ */
+int ff_upload_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                   AVDictionary **options);
+
+/**
+ * Queue the upload of the data written to an output opened with
+ * ff_upload_open() and free it, waiting if too many uploads are pending.
+ *
+ * @param flags a combination of FF_UPLOAD_* flags
+ * @return 0 on success, the error of an upload which failed since the
+ *         previous call, or AVERROR_EXIT if the interrupt callback fired
+ */
+int ff_upload_close(FFUploadQueue *q, AVIOContext **pb, int flags);
+
+/**
+ * @return 1 if pb was opened with ff_upload_open() and not closed yet,
+ *         0 otherwise
+ */
+int ff_upload_owns(FFUploadQueue *q, AVIOContext *pb);
+
+/**
+ * Free an output opened with ff_upload_open() without uploading it. Does
+ * nothing if *pb was not opened with ff_upload_open().
+ */
+void ff_upload_discard(FFUploadQueue *q, AVIOContext **pb);
+
+/**
+ * Queue a request without payload, e.g. an HTTP DELETE, which is sent by
+ * opening and closing url with the given options.
+ */
+int ff_upload_request(FFUploadQueue *q, const char *url, AVDictionary *options,
+                      int flags);
+
+/**
+ * Wait for all queued uploads to complete.
+ *
+ * @return 0 on success, the error of an upload which failed since the
+ *         previous call
+ */
+int ff_upload_queue_wait(FFUploadQueue *q);
+
+#endif /* AVFORMAT_UPLOAD_H */
@@ -590,6 +590,9 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
     }
 
+    if (s->flags & AVFMT_FLAG_ZEROCOPY && s->pb && ffio_enable_zerocopy(s->pb) < 0)
+        av_log(s, AV_LOG_VERBOSE, "Zero-copy reading is not supported by the I/O context\n");
+
     if (s->format_whitelist && av_match_list(s->iformat->name, s->format_whitelist, ',') <= 0) {
         av_log(s, AV_LOG_ERROR, "Format not on whitelist \'%s\'\n", s->format_whitelist);
         ret = AVERROR(EINVAL);
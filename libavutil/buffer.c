@@ -355,3 +355,14 @@ AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
 
     return ret;
 }
+
+void *av_buffer_pool_buffer_get_opaque(const AVBufferRef *ref)
+{
+    BufferPoolEntry *buf;
+
+    if (ref->buffer->free != pool_release_buffer)
+        return NULL;
+
+    buf = ref->buffer->opaque;
+    return buf->opaque;
+}
@@ -284,6 +284,19 @@ void av_buffer_pool_uninit(AVBufferPool **pool);
  */
 AVBufferRef *av_buffer_pool_get(AVBufferPool *pool);
 
+/**
+ * Query the original opaque parameter of a buffer allocated from a pool,
+ * i.e. the opaque the allocator passed to av_buffer_create() for it.
+ *
+ * This can be used by the owner of a pool with av_buffer_pool_init2() to
+ * recognize its own buffers by tagging them with a unique opaque.
+ *
+ * @param ref a buffer reference
+ * @return the opaque of the pooled buffer, NULL if ref does not come from
+ *         av_buffer_pool_get()
+ */
+void *av_buffer_pool_buffer_get_opaque(const AVBufferRef *ref);
+
 /**
  * @}
  */
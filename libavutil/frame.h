@@ -158,6 +158,13 @@ enum AVFrameSideDataType {
      */
     AV_FRAME_DATA_QP_TABLE_DATA,
 #endif
+
+    /**
+     * The scene change score of the frame, as computed by the select filter.
+     * The data is a double between 0 and 1, a higher value meaning that the
+     * frame is more likely to start a new scene.
+     */
+    AV_FRAME_DATA_SCENE_SCORE,
 };
 
 enum AVActiveFormatDescription {
@@ -163,3 +163,75 @@ cglobal pixelutils_sad_%1_16x16, 4,4,3, src1, stride1, src2, stride2
 
 SAD_XMM_16x16 a
 SAD_XMM_16x16 u
+
+;-------------------------------------------------------------------------------
+; int ff_pixelutils_sad_32x32_sse2(const uint8_t *src1, ptrdiff_t stride1,
+;                                  const uint8_t *src2, ptrdiff_t stride2);
+;-------------------------------------------------------------------------------
+INIT_XMM sse2
+cglobal pixelutils_sad_32x32, 4,5,5, src1, stride1, src2, stride2, h
+    pxor        m4, m4
+    mov         hd, 16
+.loop:
+    movu        m0, [src1q]
+    movu        m1, [src1q + 16]
+    movu        m2, [src2q]
+    movu        m3, [src2q + 16]
+    psadbw      m0, m2
+    psadbw      m1, m3
+    paddd       m4, m0
+    paddd       m4, m1
+    movu        m0, [src1q + stride1q]
+    movu        m1, [src1q + stride1q + 16]
+    movu        m2, [src2q + stride2q]
+    movu        m3, [src2q + stride2q + 16]
+    psadbw      m0, m2
+    psadbw      m1, m3
+    paddd       m4, m0
+    paddd       m4, m1
+    lea         src1q, [src1q + 2*stride1q]
+    lea         src2q, [src2q + 2*stride2q]
+    dec         hd
+    jnz .loop
+
+    movhlps     m0, m4
+    paddd       m4, m0
+    movd        eax, m4
+    RET
+
+%if HAVE_AVX2_EXTERNAL
+;-------------------------------------------------------------------------------
+; int ff_pixelutils_sad_32x32_avx2(const uint8_t *src1, ptrdiff_t stride1,
+;                                  const uint8_t *src2, ptrdiff_t stride2);
+;-------------------------------------------------------------------------------
+INIT_YMM avx2
+cglobal pixelutils_sad_32x32, 4,7,5, src1, stride1, src2, stride2, stride3_1, stride3_2, h
+    lea         stride3_1q, [stride1q * 3]
+    lea         stride3_2q, [stride2q * 3]
+    pxor        m0, m0
+    mov         hd, 8
+.loop:
+    movu        m1, [src1q]
+    movu        m2, [src1q + stride1q]
+    movu        m3, [src1q + 2*stride1q]
+    movu        m4, [src1q + stride3_1q]
+    psadbw      m1, [src2q]
+    psadbw      m2, [src2q + stride2q]
+    psadbw      m3, [src2q + 2*stride2q]
+    psadbw      m4, [src2q + stride3_2q]
+    paddd       m1, m2
+    paddd       m3, m4
+    paddd       m0, m1
+    paddd       m0, m3
+    lea         src1q, [src1q + 4*stride1q]
+    lea         src2q, [src2q + 4*stride2q]
+    dec         hd
+    jnz .loop
+
+    vextracti128 xm1, m0, 1
+    paddd       xm0, xm1
+    pshufd      xm1, xm0, q0002
+    paddd       xm0, xm1
+    movd        eax, xm0
+    RET
+%endif
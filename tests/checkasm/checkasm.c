@@ -150,6 +150,10 @@ static const struct {
     #endif
 #endif
 #if CONFIG_AVFILTER
+        { "drawutils", checkasm_check_drawutils },
+    #if CONFIG_BLACKDETECT_FILTER || CONFIG_BLACKFRAME_FILTER || CONFIG_CROPDETECT_FILTER
+        { "statsdsp", checkasm_check_statsdsp },
+    #endif
     #if CONFIG_BLEND_FILTER
         { "vf_blend", checkasm_check_blend },
     #endif
@@ -159,12 +163,30 @@ static const struct {
     #if CONFIG_HFLIP_FILTER
         { "vf_hflip", checkasm_check_vf_hflip },
     #endif
+    #if CONFIG_LUT_FILTER
+        { "vf_lut", checkasm_check_vf_lut },
+    #endif
     #if CONFIG_NLMEANS_FILTER
         { "vf_nlmeans", checkasm_check_nlmeans },
     #endif
+    #if CONFIG_NNEDI_FILTER
+        { "vf_nnedi", checkasm_check_vf_nnedi },
+    #endif
+    #if CONFIG_PALETTEUSE_FILTER
+        { "vf_paletteuse", checkasm_check_vf_paletteuse },
+    #endif
+    #if CONFIG_REMAP_FILTER
+        { "vf_remap", checkasm_check_vf_remap },
+    #endif
     #if CONFIG_THRESHOLD_FILTER
         { "vf_threshold", checkasm_check_vf_threshold },
     #endif
+    #if CONFIG_TONEMAP_FILTER
+        { "vf_tonemap", checkasm_check_vf_tonemap },
+    #endif
+    #if CONFIG_VMAFMOTION_FILTER
+        { "vf_vmafmotion", checkasm_check_vf_vmafmotion },
+    #endif
 #endif
 #if CONFIG_SWSCALE
     { "sw_rgb", checkasm_check_sw_rgb },
@@ -0,0 +1,77 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/drawutils.h"
+#include "libavutil/mem.h"
+
+#define WIDTH 259
+#define WIDTH_PADDED (WIDTH + 32)
+
+#define randomize_buffers(buf, size)     \
+    do {                                 \
+       int j;                            \
+       uint8_t *tmp_buf = (uint8_t *)buf;\
+       for (j = 0; j < size; j++)        \
+           tmp_buf[j] = rnd() & 0xFF;    \
+    } while (0)
+
+static void check_blend_row8(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, mask,    [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint8_t, dst_ref, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint8_t, dst_new, [WIDTH_PADDED]);
+    static const int widths[] = { 1, 3, 4, 8, 15, 16, 33, WIDTH };
+    FFDrawContext draw;
+    int i;
+
+    declare_func(void, uint8_t *dst, const uint8_t *mask,
+                 unsigned src, unsigned alpha, int w);
+
+    if (ff_draw_init(&draw, AV_PIX_FMT_YUV420P, 0) < 0) {
+        fail();
+        return;
+    }
+
+    if (check_func(draw.blend_row8, "blend_row8")) {
+        for (i = 0; i < FF_ARRAY_ELEMS(widths); i++) {
+            unsigned src   = rnd() & 0xFF;
+            /* cover the extremes of the alpha range as well */
+            unsigned alpha = i == 0 ? 0x10203 : i == 1 ? 0 : rnd() % 0x10204;
+
+            randomize_buffers(mask,    WIDTH_PADDED);
+            randomize_buffers(dst_ref, WIDTH_PADDED);
+            if (i == 2)
+                memset(mask, 0xFF, WIDTH_PADDED);
+            memcpy(dst_new, dst_ref, WIDTH_PADDED);
+
+            call_ref(dst_ref, mask, src, alpha, widths[i]);
+            call_new(dst_new, mask, src, alpha, widths[i]);
+            if (memcmp(dst_ref, dst_new, WIDTH_PADDED))
+                fail();
+        }
+        bench_new(dst_new, mask, rnd() & 0xFF, 0x10203, WIDTH);
+    }
+    report("blend_row8");
+}
+
+void checkasm_check_drawutils(void)
+{
+    check_blend_row8();
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/statsdsp.h"
+#include "libavutil/mem.h"
+
+#define WIDTH 256
+#define WIDTH_PADDED 256 + 32
+
+#define randomize_buffer(buf, size)         \
+    do {                                    \
+        int j;                              \
+        for (j = 0; j < size; j++)          \
+            buf[j] = rnd();                 \
+    } while (0)
+
+static void check_count_le(StatsDSPContext *dsp, const uint8_t *src)
+{
+    static const int thresholds[] = { 0, 32, 128, 255 };
+    int i, w;
+
+    if (check_func(dsp->count_le, "count_le")) {
+        declare_func(int, const uint8_t *src, int w, int threshold);
+
+        for (i = 0; i < FF_ARRAY_ELEMS(thresholds); i++) {
+            for (w = WIDTH - 33; w <= WIDTH; w += 11) {
+                if (call_ref(src, w, thresholds[i]) != call_new(src, w, thresholds[i]))
+                    fail();
+            }
+        }
+        bench_new(src, WIDTH, 32);
+    }
+}
+
+static void check_row_sum(StatsDSPContext *dsp, const uint8_t *src)
+{
+    int w;
+
+    if (check_func(dsp->row_sum, "row_sum")) {
+        declare_func(int, const uint8_t *src, int w);
+
+        for (w = WIDTH - 33; w <= WIDTH; w += 11) {
+            if (call_ref(src, w) != call_new(src, w))
+                fail();
+        }
+        bench_new(src, WIDTH);
+    }
+}
+
+static void check_col_sum(StatsDSPContext *dsp, const uint8_t *src)
+{
+    LOCAL_ALIGNED_32(uint32_t, sum_ref, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint32_t, sum_new, [WIDTH_PADDED]);
+    int w;
+
+    if (check_func(dsp->col_sum, "col_sum")) {
+        declare_func(void, uint32_t *sum, const uint8_t *src, int w);
+
+        for (w = WIDTH - 33; w <= WIDTH; w += 11) {
+            randomize_buffer(sum_ref, WIDTH_PADDED);
+            memcpy(sum_new, sum_ref, WIDTH_PADDED * sizeof(*sum_ref));
+            call_ref(sum_ref, src, w);
+            call_new(sum_new, src, w);
+            if (memcmp(sum_ref, sum_new, WIDTH_PADDED * sizeof(*sum_ref)))
+                fail();
+        }
+        bench_new(sum_new, src, WIDTH);
+    }
+}
+
+void checkasm_check_statsdsp(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, src, [WIDTH_PADDED]);
+    StatsDSPContext dsp;
+
+    randomize_buffer(src, WIDTH_PADDED);
+    ff_statsdsp_init(&dsp);
+
+    check_count_le(&dsp, src);
+    report("count_le");
+
+    check_row_sum(&dsp, src);
+    report("row_sum");
+
+    check_col_sum(&dsp, src);
+    report("col_sum");
+}
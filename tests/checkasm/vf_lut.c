@@ -0,0 +1,145 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/lutdsp.h"
+#include "libavutil/mem.h"
+
+#define WIDTH 256
+#define WIDTH_PADDED (256 + 32)
+#define GUARD 0xAA
+
+#define randomize_buffer(buf, size, mask)   \
+    do {                                    \
+        int j;                              \
+        for (j = 0; j < size; j++)          \
+            buf[j] = rnd() & (mask);        \
+    } while (0)
+
+static void check_lut_row(LutDSPContext *dsp, const uint16_t *lut)
+{
+    LOCAL_ALIGNED_32(uint8_t,  src8,     [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint8_t,  dst8_ref, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint8_t,  dst8_new, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, src16,     [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst16_ref, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst16_new, [WIDTH_PADDED]);
+    int w;
+
+    randomize_buffer(src8,  WIDTH_PADDED, 0xFF);
+    randomize_buffer(src16, WIDTH_PADDED, 0xFFFF);
+
+    if (check_func(dsp->lut_row8, "lut_row8")) {
+        declare_func(void, uint8_t *dst, const uint8_t *src,
+                     const uint16_t *lut, int w);
+
+        for (w = 1; w <= WIDTH; w = w < 16 ? w + 1 : w + 3) {
+            memset(dst8_ref, GUARD, WIDTH_PADDED * sizeof(*dst8_ref));
+            memset(dst8_new, GUARD, WIDTH_PADDED * sizeof(*dst8_new));
+            call_ref(dst8_ref, src8, lut, w);
+            call_new(dst8_new, src8, lut, w);
+            if (memcmp(dst8_ref, dst8_new, WIDTH_PADDED * sizeof(*dst8_ref)))
+                fail();
+        }
+        bench_new(dst8_new, src8, lut, WIDTH);
+    }
+
+    if (check_func(dsp->lut_row16, "lut_row16")) {
+        declare_func(void, uint16_t *dst, const uint16_t *src,
+                     const uint16_t *lut, int w);
+
+        for (w = 1; w <= WIDTH; w = w < 16 ? w + 1 : w + 3) {
+            memset(dst16_ref, GUARD, WIDTH_PADDED * sizeof(*dst16_ref));
+            memset(dst16_new, GUARD, WIDTH_PADDED * sizeof(*dst16_new));
+            call_ref(dst16_ref, src16, lut, w);
+            call_new(dst16_new, src16, lut, w);
+            if (memcmp(dst16_ref, dst16_new, WIDTH_PADDED * sizeof(*dst16_ref)))
+                fail();
+        }
+        bench_new(dst16_new, src16, lut, WIDTH);
+    }
+}
+
+static void check_lut2_row(LutDSPContext *dsp, const uint16_t *lut)
+{
+    LOCAL_ALIGNED_32(uint8_t,  srcx8,    [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint8_t,  srcy8,    [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint8_t,  dst8_ref, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint8_t,  dst8_new, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, srcx16,    [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, srcy16,    [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst16_ref, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst16_new, [WIDTH_PADDED]);
+    int w;
+
+    randomize_buffer(srcx8,  WIDTH_PADDED, 0xFF);
+    randomize_buffer(srcy8,  WIDTH_PADDED, 0xFF);
+    /* not masked to the depth, the functions have to mask the samples */
+    randomize_buffer(srcx16, WIDTH_PADDED, 0xFFFF);
+    randomize_buffer(srcy16, WIDTH_PADDED, 0xFFFF);
+
+    if (check_func(dsp->lut2_row8, "lut2_row8")) {
+        declare_func(void, uint8_t *dst, const uint8_t *srcx, const uint8_t *srcy,
+                     const uint16_t *lut, int depthx, int w);
+
+        for (w = 1; w <= WIDTH; w = w < 16 ? w + 1 : w + 3) {
+            memset(dst8_ref, GUARD, WIDTH_PADDED * sizeof(*dst8_ref));
+            memset(dst8_new, GUARD, WIDTH_PADDED * sizeof(*dst8_new));
+            call_ref(dst8_ref, srcx8, srcy8, lut, 8, w);
+            call_new(dst8_new, srcx8, srcy8, lut, 8, w);
+            if (memcmp(dst8_ref, dst8_new, WIDTH_PADDED * sizeof(*dst8_ref)))
+                fail();
+        }
+        bench_new(dst8_new, srcx8, srcy8, lut, 8, WIDTH);
+    }
+
+    if (check_func(dsp->lut2_row16, "lut2_row16")) {
+        declare_func(void, uint16_t *dst, const uint16_t *srcx, const uint16_t *srcy,
+                     const uint16_t *lut, int depthx, int w);
+
+        for (w = 1; w <= WIDTH; w = w < 16 ? w + 1 : w + 3) {
+            memset(dst16_ref, GUARD, WIDTH_PADDED * sizeof(*dst16_ref));
+            memset(dst16_new, GUARD, WIDTH_PADDED * sizeof(*dst16_new));
+            call_ref(dst16_ref, srcx16, srcy16, lut, 10, w);
+            call_new(dst16_new, srcx16, srcy16, lut, 10, w);
+            if (memcmp(dst16_ref, dst16_new, WIDTH_PADDED * sizeof(*dst16_ref)))
+                fail();
+        }
+        bench_new(dst16_new, srcx16, srcy16, lut, 10, WIDTH);
+    }
+}
+
+void checkasm_check_vf_lut(void)
+{
+    LutDSPContext dsp;
+    uint16_t *lut = av_malloc_array(1 << 20, sizeof(*lut));
+
+    if (!lut)
+        return;
+    randomize_buffer(lut, 1 << 20, 0xFFFF);
+    ff_lutdsp_init(&dsp);
+
+    check_lut_row(&dsp, lut);
+    report("lut_row");
+
+    check_lut2_row(&dsp, lut);
+    report("lut2_row");
+
+    av_free(lut);
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/vf_nnedi.h"
+#include "libavutil/mem.h"
+
+#define MAX_N   32
+#define MAX_LEN 288
+
+#define randomize_float(buf, size)                                  \
+    do {                                                            \
+        int j;                                                      \
+        for (j = 0; j < size; j++)                                  \
+            buf[j] = (float)rnd() / (float)UINT32_MAX * 2.0f - 1.0f; \
+    } while (0)
+
+#define randomize_int16(buf, size, range)                           \
+    do {                                                            \
+        int j;                                                      \
+        for (j = 0; j < size; j++)                                  \
+            buf[j] = (int)(rnd() % (2 * (range) + 1)) - (range);    \
+    } while (0)
+
+static const int lens[] = { 48, 64, 96, 192, 288 };
+
+static void check_dot_prods(NNEDIDSPContext *dsp)
+{
+    LOCAL_ALIGNED_32(float, data,     [MAX_LEN]);
+    LOCAL_ALIGNED_32(float, weights,  [MAX_N * MAX_LEN + MAX_N]);
+    LOCAL_ALIGNED_32(float, vals_ref, [MAX_N]);
+    LOCAL_ALIGNED_32(float, vals_new, [MAX_N]);
+    float scale = 0.5f + (float)rnd() / (float)UINT32_MAX;
+    int i, n;
+
+    randomize_float(data,    MAX_LEN);
+    randomize_float(weights, MAX_N * MAX_LEN + MAX_N);
+
+    if (check_func(dsp->dot_prods, "dot_prods")) {
+        declare_func(void, const float *data, const float *weights, float *vals,
+                     int n, int len, const float *scale);
+
+        for (n = 4; n <= MAX_N; n *= 2) {
+            for (i = 0; i < FF_ARRAY_ELEMS(lens); i++) {
+                call_ref(data, weights, vals_ref, n, lens[i], &scale);
+                call_new(data, weights, vals_new, n, lens[i], &scale);
+                if (!float_near_abs_eps_array(vals_ref, vals_new, 1e-3f, n))
+                    fail();
+            }
+        }
+        bench_new(data, weights, vals_new, MAX_N, MAX_LEN, &scale);
+    }
+}
+
+static void check_dot_prods_i16(NNEDIDSPContext *dsp)
+{
+    LOCAL_ALIGNED_32(int16_t, data,     [MAX_LEN]);
+    LOCAL_ALIGNED_32(int16_t, weights,  [MAX_N * MAX_LEN + MAX_N * 4]);
+    LOCAL_ALIGNED_32(float,   vals_ref, [MAX_N]);
+    LOCAL_ALIGNED_32(float,   vals_new, [MAX_N]);
+    float scale = 0.5f + (float)rnd() / (float)UINT32_MAX;
+    int i, n;
+
+    randomize_int16(data, MAX_LEN, 1024);
+
+    if (check_func(dsp->dot_prods_i16, "dot_prods_i16")) {
+        declare_func(void, const int16_t *data, const int16_t *weights, float *vals,
+                     int n, int len, const float *scale);
+
+        for (n = 4; n <= MAX_N; n *= 2) {
+            for (i = 0; i < FF_ARRAY_ELEMS(lens); i++) {
+                float *wf = (float *)&weights[n * lens[i]];
+
+                randomize_int16(weights, n * lens[i], 4096);
+                randomize_float(wf, n * 2);
+                call_ref(data, weights, vals_ref, n, lens[i], &scale);
+                call_new(data, weights, vals_new, n, lens[i], &scale);
+                if (!float_near_ulp_array(vals_ref, vals_new, 1, n))
+                    fail();
+            }
+        }
+        bench_new(data, weights, vals_new, MAX_N, MAX_LEN, &scale);
+    }
+}
+
+void checkasm_check_vf_nnedi(void)
+{
+    NNEDIDSPContext dsp;
+
+    ff_nnedi_init(&dsp);
+
+    check_dot_prods(&dsp);
+    report("dot_prods");
+
+    check_dot_prods_i16(&dsp);
+    report("dot_prods_i16");
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/paletteuse.h"
+#include "libavutil/mem.h"
+
+#define NB_ENTRIES 256
+
+static void check_nearest_row(PaletteUseDSPContext *dsp)
+{
+    LOCAL_ALIGNED_32(uint8_t, dst_ref, [256]);
+    LOCAL_ALIGNED_32(uint8_t, dst_new, [256]);
+    int base[NB_ENTRIES], comp[NB_ENTRIES], idx[NB_ENTRIES];
+    int i, n;
+
+    for (i = 0; i < NB_ENTRIES; i++) {
+        const int dr = (int)(rnd() & 0xff) - (int)(rnd() & 0xff);
+        const int dg = (int)(rnd() & 0xff) - (int)(rnd() & 0xff);
+
+        base[i] = dr * dr + dg * dg;
+        comp[i] = rnd() & 0xff;
+        idx[i]  = rnd() & 0xff;
+    }
+    /* equidistant entries must resolve to the first one */
+    base[3] = base[7];
+    comp[3] = comp[7];
+
+    if (check_func(dsp->nearest_row, "nearest_row")) {
+        declare_func(void, uint8_t *dst, const int *base, const int *comp,
+                     const int *idx, int nb_entries);
+
+        for (n = 1; n <= NB_ENTRIES; n = n * 2 + 1) {
+            memset(dst_ref, 0, 256);
+            memset(dst_new, 0, 256);
+            call_ref(dst_ref, base, comp, idx, n);
+            call_new(dst_new, base, comp, idx, n);
+            if (memcmp(dst_ref, dst_new, 256))
+                fail();
+        }
+        bench_new(dst_new, base, comp, idx, 16);
+    }
+}
+
+void checkasm_check_vf_paletteuse(void)
+{
+    PaletteUseDSPContext dsp;
+
+    ff_paletteuse_init(&dsp);
+
+    check_nearest_row(&dsp);
+    report("nearest_row");
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/remap.h"
+#include "libavutil/mem.h"
+
+#define WIDTH 256
+#define HEIGHT 16
+#define WIDTH_PADDED 256 + 32
+#define SRC_STRIDE (WIDTH * 4)
+
+#define randomize_buffer(buf, size)         \
+    do {                                    \
+        int j;                              \
+        for (j = 0; j < size; j++)          \
+            buf[j] = rnd();                 \
+    } while (0)
+
+static void check_remap_line(remap_line_fn func, const char *name, int bpp,
+                             const uint8_t *src)
+{
+    LOCAL_ALIGNED_32(uint8_t,  dst_ref, [WIDTH_PADDED * 4]);
+    LOCAL_ALIGNED_32(uint8_t,  dst_new, [WIDTH_PADDED * 4]);
+    LOCAL_ALIGNED_32(uint16_t, xmap,    [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, ymap,    [WIDTH_PADDED]);
+    /* the last source sample ends the buffer */
+    const int sw = SRC_STRIDE / bpp;
+    const int sh = HEIGHT;
+    int i, w;
+
+    /* mostly in range, with some coordinates past the source edges */
+    for (i = 0; i < WIDTH_PADDED; i++) {
+        xmap[i] = rnd() % (sw + 8);
+        ymap[i] = rnd() % (sh + 2);
+    }
+    xmap[0] = sw;
+    ymap[1] = sh;
+    xmap[2] = 0xFFFF;
+    for (i = 3; i < 6; i++) {
+        xmap[i] = sw + 2 - i;
+        ymap[i] = sh - 1;
+    }
+
+    if (check_func(func, "%s", name)) {
+        declare_func(void, uint8_t *dst, const uint8_t *src, ptrdiff_t slinesize,
+                     const uint16_t *xmap, const uint16_t *ymap,
+                     int w, int sw, int sh);
+
+        for (w = WIDTH - 3; w <= WIDTH; w++) {
+            memset(dst_ref, 0xAA, WIDTH_PADDED * 4);
+            memset(dst_new, 0xAA, WIDTH_PADDED * 4);
+            call_ref(dst_ref, src, SRC_STRIDE, xmap, ymap, w, sw, sh);
+            call_new(dst_new, src, SRC_STRIDE, xmap, ymap, w, sw, sh);
+            if (memcmp(dst_ref, dst_new, WIDTH_PADDED * 4))
+                fail();
+        }
+        bench_new(dst_new, src, SRC_STRIDE, xmap, ymap, WIDTH, sw, sh);
+    }
+}
+
+void checkasm_check_vf_remap(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, src, [SRC_STRIDE * HEIGHT]);
+    RemapDSPContext dsp;
+
+    randomize_buffer(src, SRC_STRIDE * HEIGHT);
+    ff_remap_init(&dsp);
+
+    check_remap_line(dsp.remap_line8, "remap_line8", 1, src);
+    report("remap_line8");
+
+    check_remap_line(dsp.remap_line16, "remap_line16", 2, src);
+    report("remap_line16");
+
+    check_remap_line(dsp.remap_line32, "remap_line32", 4, src);
+    report("remap_line32");
+}
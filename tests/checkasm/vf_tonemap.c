@@ -0,0 +1,107 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/tonemap.h"
+#include "libavutil/mem.h"
+
+#define WIDTH 256
+#define WIDTH_PADDED (256 + 32)
+#define PEAK 10.0f
+#define EPS 1e-5f
+
+#define randomize_buffer(buf, size, max)                   \
+    do {                                                   \
+        int j;                                             \
+        for (j = 0; j < size; j++)                         \
+            buf[j] = (rnd() & 0xFFFFFF) * (max) / 0xFFFFFF; \
+    } while (0)
+
+/* the gain of the reinhard curve, sampled as done by the filter */
+static void init_lut(float *lut, float *params)
+{
+    int i;
+
+    for (i = 0; i <= TONEMAP_LUT_SIZE; i++) {
+        float sig = FFMAX(PEAK * i * i / (TONEMAP_LUT_SIZE * TONEMAP_LUT_SIZE), 1e-6f);
+        lut[i] = 1.0f / (sig + 0.5f) * (PEAK + 0.5f) / PEAK;
+    }
+    lut[TONEMAP_LUT_SIZE + 1] = lut[TONEMAP_LUT_SIZE];
+
+    params[TONEMAP_PARAM_CR]        = 0.2627f;
+    params[TONEMAP_PARAM_CG]        = 0.6780f;
+    params[TONEMAP_PARAM_CB]        = 0.0593f;
+    params[TONEMAP_PARAM_DESAT]     = 2.0f;
+    params[TONEMAP_PARAM_LUT_SCALE] = TONEMAP_LUT_SIZE * TONEMAP_LUT_SIZE / PEAK;
+    params[TONEMAP_PARAM_PEAK]      = PEAK;
+}
+
+static void check_map_row(tonemap_row_fn func, const char *name,
+                          const float *lut, const float *params)
+{
+    LOCAL_ALIGNED_32(float, src, [3], [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(float, dst_ref, [3], [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(float, dst_new, [3], [WIDTH_PADDED]);
+    int w, i;
+
+    declare_func(void, float *dst_r, float *dst_g, float *dst_b,
+                 const float *src_r, const float *src_g, const float *src_b,
+                 const float *lut, const float *params, int width);
+
+    /* up to above the peak, which is clipped */
+    for (i = 0; i < 3; i++)
+        randomize_buffer(src[i], WIDTH_PADDED, PEAK * 1.2f);
+
+    if (check_func(func, "%s", name)) {
+        /* the vector widths are 4 and 8 */
+        for (w = 1; w <= WIDTH; w = w < 17 ? w + 1 : w + 13) {
+            memset(dst_ref, 0, sizeof(dst_ref[0]) * 3);
+            memset(dst_new, 0, sizeof(dst_new[0]) * 3);
+            call_ref(dst_ref[0], dst_ref[1], dst_ref[2],
+                     src[0], src[1], src[2], lut, params, w);
+            call_new(dst_new[0], dst_new[1], dst_new[2],
+                     src[0], src[1], src[2], lut, params, w);
+            for (i = 0; i < 3; i++)
+                if (!float_near_abs_eps_array(dst_ref[i], dst_new[i], EPS, WIDTH_PADDED))
+                    fail();
+        }
+        bench_new(dst_new[0], dst_new[1], dst_new[2],
+                  src[0], src[1], src[2], lut, params, WIDTH);
+    }
+}
+
+void checkasm_check_vf_tonemap(void)
+{
+    LOCAL_ALIGNED_16(float, params, [TONEMAP_PARAM_NB]);
+    float *lut = av_malloc_array(TONEMAP_LUT_SIZE + 2, sizeof(*lut));
+    TonemapDSPContext dsp;
+
+    if (!lut)
+        return;
+    init_lut(lut, params);
+    ff_tonemap_dsp_init(&dsp);
+
+    check_map_row(dsp.map_row, "map_row", lut, params);
+    report("map_row");
+
+    check_map_row(dsp.map_row_desat, "map_row_desat", lut, params);
+    report("map_row_desat");
+
+    av_free(lut);
+}
@@ -0,0 +1,140 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/vmaf_motion.h"
+#include "libavutil/mem.h"
+
+#define WIDTH 256
+#define HEIGHT 4
+#define WIDTH_PADDED (WIDTH + 2 * VMAFMOTION_TEMP_PAD)
+
+/* the taps of the vmaf motion blur in Q15 */
+static const uint16_t filter[5] = { 1785, 8002, 13193, 8002, 1785 };
+
+static void check_convolution_y(int bpp)
+{
+    LOCAL_ALIGNED_32(uint16_t, src, [5 * WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst_ref, [WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst_new, [WIDTH_PADDED]);
+    const uint8_t *rows[5];
+    VMAFMotionDSPContext dsp;
+    int i, w;
+
+    if (bpp == 8) {
+        uint8_t *src8 = (uint8_t *)src;
+        for (i = 0; i < 5 * WIDTH_PADDED * 2; i++)
+            src8[i] = rnd();
+    } else {
+        for (i = 0; i < 5 * WIDTH_PADDED; i++)
+            src[i] = rnd() & 0x3FF;
+    }
+    for (i = 0; i < 5; i++)
+        rows[i] = (const uint8_t *)(src + i * WIDTH_PADDED);
+
+    ff_vmafmotion_dsp_init(&dsp, bpp);
+
+    if (check_func(dsp.convolution_y, "convolution_y_%dbit", bpp)) {
+        declare_func(void, const uint16_t *filter, const uint8_t *const *src,
+                     uint16_t *dst, int w);
+
+        for (w = WIDTH - 17; w <= WIDTH; w += 17) {
+            memset(dst_ref, 0xAA, WIDTH_PADDED * sizeof(*dst_ref));
+            memset(dst_new, 0xAA, WIDTH_PADDED * sizeof(*dst_new));
+            call_ref(filter, rows, dst_ref, w);
+            call_new(filter, rows, dst_new, w);
+            if (memcmp(dst_ref, dst_new, WIDTH_PADDED * sizeof(*dst_ref)))
+                fail();
+        }
+        bench_new(filter, rows, dst_new, WIDTH);
+    }
+}
+
+static void check_convolution_x(void)
+{
+    LOCAL_ALIGNED_32(uint16_t, src, [HEIGHT * WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst_ref, [HEIGHT * WIDTH_PADDED]);
+    LOCAL_ALIGNED_32(uint16_t, dst_new, [HEIGHT * WIDTH_PADDED]);
+    const ptrdiff_t stride = WIDTH_PADDED * sizeof(*src);
+    VMAFMotionDSPContext dsp;
+    int i, y, w;
+
+    for (i = 0; i < HEIGHT * WIDTH_PADDED; i++)
+        src[i] = rnd() & 0x7FFF;
+
+    ff_vmafmotion_dsp_init(&dsp, 8);
+
+    if (check_func(dsp.convolution_x, "convolution_x")) {
+        declare_func(void, const uint16_t *filter, const uint16_t *src,
+                     uint16_t *dst, int w, int h, ptrdiff_t src_stride,
+                     ptrdiff_t dst_stride);
+
+        for (w = WIDTH - 17; w <= WIDTH; w += 17) {
+            call_ref(filter, src + VMAFMOTION_TEMP_PAD, dst_ref, w, HEIGHT, stride, stride);
+            call_new(filter, src + VMAFMOTION_TEMP_PAD, dst_new, w, HEIGHT, stride, stride);
+            for (y = 0; y < HEIGHT; y++) {
+                if (memcmp(dst_ref + y * WIDTH_PADDED, dst_new + y * WIDTH_PADDED,
+                           w * sizeof(*dst_ref)))
+                    fail();
+            }
+        }
+        bench_new(filter, src + VMAFMOTION_TEMP_PAD, dst_new, WIDTH, HEIGHT, stride, stride);
+    }
+}
+
+static void check_sad(void)
+{
+    LOCAL_ALIGNED_32(uint16_t, img1, [HEIGHT * WIDTH]);
+    LOCAL_ALIGNED_32(uint16_t, img2, [HEIGHT * WIDTH]);
+    const ptrdiff_t stride = WIDTH * sizeof(*img1);
+    VMAFMotionDSPContext dsp;
+    int i, w;
+
+    for (i = 0; i < HEIGHT * WIDTH; i++) {
+        img1[i] = rnd() & 0x7FFF;
+        img2[i] = rnd() & 0x7FFF;
+    }
+
+    ff_vmafmotion_dsp_init(&dsp, 8);
+
+    if (check_func(dsp.sad, "sad")) {
+        declare_func(uint64_t, const uint16_t *img1, const uint16_t *img2,
+                     int w, int h, ptrdiff_t img1_stride, ptrdiff_t img2_stride);
+
+        for (w = WIDTH - 17; w <= WIDTH; w += 17) {
+            if (call_ref(img1, img2, w, HEIGHT, stride, stride) !=
+                call_new(img1, img2, w, HEIGHT, stride, stride))
+                fail();
+        }
+        bench_new(img1, img2, WIDTH, HEIGHT, stride, stride);
+    }
+}
+
+void checkasm_check_vf_vmafmotion(void)
+{
+    check_convolution_y(8);
+    check_convolution_y(10);
+    report("convolution_y");
+
+    check_convolution_x();
+    report("convolution_x");
+
+    check_sad();
+    report("sad");
+}
@@ -3,6 +3,7 @@ FATE_CHECKASM = fate-checkasm-aacpsdsp                                  \
                 fate-checkasm-audiodsp                                  \
                 fate-checkasm-blockdsp                                  \
                 fate-checkasm-bswapdsp                                  \
+                fate-checkasm-drawutils                                 \
                 fate-checkasm-exrdsp                                    \
                 fate-checkasm-fixed_dsp                                 \
                 fate-checkasm-flacdsp                                   \
@@ -20,13 +21,20 @@ FATE_CHECKASM = fate-checkasm-aacpsdsp                                  \
                 fate-checkasm-llviddspenc                               \
                 fate-checkasm-pixblockdsp                               \
                 fate-checkasm-sbrdsp                                    \
+                fate-checkasm-statsdsp                                  \
                 fate-checkasm-synth_filter                              \
                 fate-checkasm-sw_rgb                                    \
                 fate-checkasm-v210enc                                   \
                 fate-checkasm-vf_blend                                  \
                 fate-checkasm-vf_colorspace                             \
                 fate-checkasm-vf_hflip                                  \
+                fate-checkasm-vf_lut                                    \
+                fate-checkasm-vf_nnedi                                  \
+                fate-checkasm-vf_paletteuse                             \
+                fate-checkasm-vf_remap                                  \
                 fate-checkasm-vf_threshold                              \
+                fate-checkasm-vf_tonemap                                \
+                fate-checkasm-vf_vmafmotion                             \
                 fate-checkasm-videodsp                                  \
                 fate-checkasm-vp8dsp                                    \
                 fate-checkasm-vp9dsp                                    \
@@ -22,4 +22,29 @@ fate-mpegts-probe-pmt-merge: CMD = run $(PROBE_CODEC_NAME_COMMAND) -merge_pmt_ve
 
 FATE_SAMPLES_FFPROBE += $(FATE_MPEGTS_PROBE-yes)
 
-fate-mpegts: $(FATE_MPEGTS_PROBE-yes)
+#
+# Test demuxing a two program TS on the program threads, the packets must
+# be the same as those demuxed by the reading thread
+#
+tests/data/mpegts-programs.ts: TAG = GEN
+tests/data/mpegts-programs.ts: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< \
+        -f lavfi -i "testsrc=s=160x120:r=25:d=2" -f lavfi -i "aevalsrc=sin(2*PI*440*t):d=2" \
+        -f lavfi -i "testsrc2=s=160x120:r=25:d=2" -f lavfi -i "aevalsrc=sin(2*PI*660*t):d=2" \
+        -map 0 -map 1 -map 2 -map 3 -flags +bitexact -fflags +bitexact -codec:v mpeg2video -codec:a mp2fixed \
+        -program st=0:st=1 -program st=2:st=3 -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_MPEGTS_PROGRAMS = fate-mpegts-programs fate-mpegts-program-threads
+$(FATE_MPEGTS_PROGRAMS): tests/data/mpegts-programs.ts
+fate-mpegts-programs: CMD = framecrc -i $(TARGET_PATH)/tests/data/mpegts-programs.ts -map 0 -c copy
+fate-mpegts-program-threads: CMD = framecrc -program_threads 1 -i $(TARGET_PATH)/tests/data/mpegts-programs.ts -map 0 -c copy
+fate-mpegts-program-threads: REF = $(SRC_PATH)/tests/ref/fate/mpegts-programs
+
+FATE_MPEGTS-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER TESTSRC2_FILTER AEVALSRC_FILTER \
+                           MPEG2VIDEO_ENCODER MP2FIXED_ENCODER MPEGTS_MUXER \
+                           MPEGTS_DEMUXER MPEGVIDEO_PARSER MPEGAUDIO_PARSER \
+                           FRAMECRC_MUXER) += $(FATE_MPEGTS_PROGRAMS)
+
+FATE_FFMPEG += $(FATE_MPEGTS-yes)
+
+fate-mpegts: $(FATE_MPEGTS_PROBE-yes) $(FATE_MPEGTS-yes)